@@ -0,0 +1,337 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/clut.h"
+#include "common/darktable.h"
+
+#include <math.h>
+
+// pixels handed to one thread at a time by the threaded lookups
+#define CLUT_BLOCKSIZE 1024
+
+// half float conversions after Fabian Giesen's public domain snippets, written without branches on the
+// decoding side so the node fetches still vectorize. infinities and NaN are never stored: the encoder clamps
+// to the largest half and flushes NaN to 0.
+typedef union clut_float_bits_t
+{
+  float f;
+  uint32_t u;
+} clut_float_bits_t;
+
+static inline float _half_to_float(const uint16_t h)
+{
+  clut_float_bits_t o;
+  o.u = (uint32_t)(h & 0x7fff) << 13;
+  o.f *= 0x1.0p+112f; // rebias the exponent, also takes care of denormals
+  o.u |= (uint32_t)(h & 0x8000) << 16;
+  return o.f;
+}
+
+static inline uint16_t _float_to_half(const float v)
+{
+  const clut_float_bits_t f16max = { .u = (127 + 16) << 23 };
+  const clut_float_bits_t denorm_magic = { .u = ((127 - 15) + (23 - 10) + 1) << 23 };
+  clut_float_bits_t f = { .f = v };
+  if(isnan(v)) return 0;
+
+  const uint32_t sign = f.u & 0x80000000u;
+  f.u ^= sign;
+
+  uint16_t o;
+  if(f.u >= f16max.u)
+    o = 0x7bff; // 65504
+  else if(f.u < (113u << 23))
+  {
+    // result is a denormal (or zero), let the fpu do the rounding
+    f.f += denorm_magic.f;
+    o = f.u - denorm_magic.u;
+  }
+  else
+  {
+    const uint32_t mant_odd = (f.u >> 13) & 1; // resulting mantissa is odd
+    f.u += ((uint32_t)(15 - 127) << 23) + 0xfff;
+    f.u += mant_odd;
+    o = f.u >> 13;
+  }
+  return o | (sign >> 16);
+}
+
+void dt_clut_float_to_half(const float *const in, uint16_t *const out, const size_t n)
+{
+  for(size_t k = 0; k < n; k++) out[k] = _float_to_half(in[k]);
+}
+
+void dt_clut_half_to_float(const uint16_t *const in, float *const out, const size_t n)
+{
+  for(size_t k = 0; k < n; k++) out[k] = _half_to_float(in[k]);
+}
+
+// exactly one of clut and clut_half is set. the callers pass constants, so this folds away.
+static inline float _node(const float *const clut, const uint16_t *const clut_half, const int i)
+{
+  return clut_half ? _half_to_float(clut_half[i]) : clut[i];
+}
+
+// cell of the pixel: offset of P000 and the deltas within the cell
+static inline int _cell(const float *const input, const int level, float rgbd[3])
+{
+  const float scale = (float)(level - 1);
+  const int stride[3] = { 3, 3 * level, 3 * level * level };
+  int base = 0;
+  for(int c = 0; c < 3; c++)
+  {
+    const float v = fminf(fmaxf(input[c], 0.0f), 1.0f) * scale;
+    const int i = MIN((int)v, level - 2);
+    rgbd[c] = v - i;
+    base += i * stride[c];
+  }
+  return base;
+}
+
+// from OpenColorIO
+// https://github.com/imageworks/OpenColorIO/blob/master/src/OpenColorIO/ops/Lut3D/Lut3DOp.cpp
+// written without branches: the cube is walked from P000 to P111 along the axes sorted by decreasing
+// distance, so the lookups of neighbouring pixels can be done side by side in vector registers.
+static inline void _tetrahedral_row(const float *const in, float *const out, const size_t npixels,
+                                    const float *const clut, const uint16_t *const clut_half, const int level)
+{
+  const int stride[3] = { 3, 3 * level, 3 * level * level };
+
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(size_t k = 0; k < npixels; k++)
+  {
+    const float *const input = in + 4 * k;
+    float *const output = out + 4 * k;
+
+    float rgbd[3];
+    const int base = _cell(input, level, rgbd);
+
+    // largest, middle and smallest delta and the axes they belong to
+    const int r_ge_g = rgbd[0] >= rgbd[1];
+    const int g_ge_b = rgbd[1] >= rgbd[2];
+    const int r_ge_b = rgbd[0] >= rgbd[2];
+
+    const int amax = r_ge_g ? (r_ge_b ? 0 : 2) : (g_ge_b ? 1 : 2);
+    const int amin = r_ge_g ? (g_ge_b ? 2 : 1) : (r_ge_b ? 2 : 0);
+    const int amid = 3 - amax - amin;
+
+    const float dmax = rgbd[amax];
+    const float dmid = rgbd[amid];
+    const float dmin = rgbd[amin];
+
+    const int i0 = base;
+    const int i1 = i0 + stride[amax];
+    const int i2 = i1 + stride[amid];
+    const int i3 = i2 + stride[amin];
+
+    const float w0 = 1.0f - dmax;
+    const float w1 = dmax - dmid;
+    const float w2 = dmid - dmin;
+    const float w3 = dmin;
+
+    const float alpha = input[3];
+    for(int c = 0; c < 3; c++)
+      output[c] = w0 * _node(clut, clut_half, i0 + c) + w1 * _node(clut, clut_half, i1 + c)
+                  + w2 * _node(clut, clut_half, i2 + c) + w3 * _node(clut, clut_half, i3 + c);
+    output[3] = alpha;
+  }
+}
+
+// From `HaldCLUT_correct.c' by Eskil Steenberg (http://www.quelsolaar.com) (BSD licensed)
+static inline void _trilinear_row(const float *const in, float *const out, const size_t npixels,
+                                  const float *const clut, const uint16_t *const clut_half, const int level)
+{
+  const int sg = 3 * level;
+  const int sb = 3 * level * level;
+
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(size_t k = 0; k < npixels; k++)
+  {
+    const float *const input = in + 4 * k;
+    float *const output = out + 4 * k;
+
+    float rgbd[3];
+    const int i000 = _cell(input, level, rgbd);
+    const int i010 = i000 + sg;
+    const int i001 = i000 + sb;
+    const int i011 = i000 + sg + sb;
+
+    const float alpha = input[3];
+    for(int c = 0; c < 3; c++)
+    {
+      // along red, then green, then blue
+      const float c00 = _node(clut, clut_half, i000 + c) * (1.0f - rgbd[0]) + _node(clut, clut_half, i000 + 3 + c) * rgbd[0];
+      const float c10 = _node(clut, clut_half, i010 + c) * (1.0f - rgbd[0]) + _node(clut, clut_half, i010 + 3 + c) * rgbd[0];
+      const float c01 = _node(clut, clut_half, i001 + c) * (1.0f - rgbd[0]) + _node(clut, clut_half, i001 + 3 + c) * rgbd[0];
+      const float c11 = _node(clut, clut_half, i011 + c) * (1.0f - rgbd[0]) + _node(clut, clut_half, i011 + 3 + c) * rgbd[0];
+      const float c0 = c00 * (1.0f - rgbd[1]) + c10 * rgbd[1];
+      const float c1 = c01 * (1.0f - rgbd[1]) + c11 * rgbd[1];
+      output[c] = c0 * (1.0f - rgbd[2]) + c1 * rgbd[2];
+    }
+    output[3] = alpha;
+  }
+}
+
+// from Study on the 3D Interpolation Models Used in Color Conversion
+// http://ijetch.org/papers/318-T860.pdf
+static inline void _pyramid_row(const float *const in, float *const out, const size_t npixels,
+                                const float *const clut, const uint16_t *const clut_half, const int level)
+{
+  const int sg = 3 * level;
+  const int sb = 3 * level * level;
+
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(size_t k = 0; k < npixels; k++)
+  {
+    const float *const input = in + 4 * k;
+    float *const output = out + 4 * k;
+
+    float rgbd[3];
+    const int i000 = _cell(input, level, rgbd);
+    const int i100 = i000 + 3;
+    const int i010 = i000 + sg;
+    const int i110 = i010 + 3;
+    const int i001 = i000 + sb;
+    const int i101 = i001 + 3;
+    const int i011 = i010 + sb;
+    const int i111 = i011 + 3;
+
+    const float dr = rgbd[0], dg = rgbd[1], db = rgbd[2];
+    const int pyramid_r = dg > dr && db > dr;
+    const int pyramid_g = !pyramid_r && dr > dg && db > dg;
+
+    const float alpha = input[3];
+    for(int c = 0; c < 3; c++)
+    {
+      const float c000 = _node(clut, clut_half, i000 + c);
+      const float c100 = _node(clut, clut_half, i100 + c);
+      const float c010 = _node(clut, clut_half, i010 + c);
+      const float c110 = _node(clut, clut_half, i110 + c);
+      const float c001 = _node(clut, clut_half, i001 + c);
+      const float c101 = _node(clut, clut_half, i101 + c);
+      const float c011 = _node(clut, clut_half, i011 + c);
+      const float c111 = _node(clut, clut_half, i111 + c);
+      if(pyramid_r)
+        output[c] = c000 + (c111 - c011) * dr + (c010 - c000) * dg + (c001 - c000) * db
+                    + (c011 - c001 - c010 + c000) * dg * db;
+      else if(pyramid_g)
+        output[c] = c000 + (c100 - c000) * dr + (c111 - c101) * dg + (c001 - c000) * db
+                    + (c101 - c001 - c100 + c000) * dr * db;
+      else
+        output[c] = c000 + (c100 - c000) * dr + (c010 - c000) * dg + (c111 - c110) * db
+                    + (c110 - c100 - c010 + c000) * dr * dg;
+    }
+    output[3] = alpha;
+  }
+}
+
+__DT_CLONE_TARGETS__
+void dt_clut_tetrahedral_row(const float *const in, float *const out, const size_t npixels,
+                             const float *const clut, const int level)
+{
+  _tetrahedral_row(in, out, npixels, clut, NULL, level);
+}
+
+__DT_CLONE_TARGETS__
+static void _tetrahedral_row_half(const float *const in, float *const out, const size_t npixels,
+                                  const uint16_t *const clut_half, const int level)
+{
+  _tetrahedral_row(in, out, npixels, NULL, clut_half, level);
+}
+
+__DT_CLONE_TARGETS__
+static void _trilinear_row_float(const float *const in, float *const out, const size_t npixels,
+                                 const float *const clut, const int level)
+{
+  _trilinear_row(in, out, npixels, clut, NULL, level);
+}
+
+__DT_CLONE_TARGETS__
+static void _trilinear_row_half(const float *const in, float *const out, const size_t npixels,
+                                const uint16_t *const clut_half, const int level)
+{
+  _trilinear_row(in, out, npixels, NULL, clut_half, level);
+}
+
+__DT_CLONE_TARGETS__
+static void _pyramid_row_float(const float *const in, float *const out, const size_t npixels,
+                               const float *const clut, const int level)
+{
+  _pyramid_row(in, out, npixels, clut, NULL, level);
+}
+
+__DT_CLONE_TARGETS__
+static void _pyramid_row_half(const float *const in, float *const out, const size_t npixels,
+                              const uint16_t *const clut_half, const int level)
+{
+  _pyramid_row(in, out, npixels, NULL, clut_half, level);
+}
+
+void dt_clut_tetrahedral(const float *const in, float *const out, const size_t npixels, const float *const clut,
+                         const int level)
+{
+  dt_clut_apply(in, out, npixels, clut, NULL, level, DT_CLUT_TETRAHEDRAL);
+}
+
+void dt_clut_apply(const float *const in, float *const out, const size_t npixels, const float *const clut,
+                   const uint16_t *const clut_half, const int level, const dt_clut_interpolation_t interpolation)
+{
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(clut, clut_half, in, interpolation, level, npixels, out) \
+  schedule(static)
+#endif
+  for(size_t k = 0; k < npixels; k += CLUT_BLOCKSIZE)
+  {
+    const float *const i = in + 4 * k;
+    float *const o = out + 4 * k;
+    const size_t n = MIN((size_t)CLUT_BLOCKSIZE, npixels - k);
+    switch(interpolation)
+    {
+      case DT_CLUT_TRILINEAR:
+        if(clut_half)
+          _trilinear_row_half(i, o, n, clut_half, level);
+        else
+          _trilinear_row_float(i, o, n, clut, level);
+        break;
+      case DT_CLUT_PYRAMID:
+        if(clut_half)
+          _pyramid_row_half(i, o, n, clut_half, level);
+        else
+          _pyramid_row_float(i, o, n, clut, level);
+        break;
+      case DT_CLUT_TETRAHEDRAL:
+      default:
+        if(clut_half)
+          _tetrahedral_row_half(i, o, n, clut_half, level);
+        else
+          dt_clut_tetrahedral_row(i, o, n, clut, level);
+        break;
+    }
+  }
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
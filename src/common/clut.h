@@ -0,0 +1,66 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * 3D color lookup tables.
+ *
+ * A clut of a given level holds level^3 rgb triplets, red running fastest:
+ * node (r, g, b) is at 3 * (r + g * level + b * level * level).
+ * Lookups expect 4 channel pixels with the first three in [0, 1], values
+ * outside are clamped. The fourth channel is copied.
+ *
+ * The nodes are either floats or, to keep big tables (65^3 is 3.3MB as
+ * floats) in cache, IEEE half floats. Exactly one of clut and clut_half
+ * is passed to the lookups, the other one is NULL.
+ */
+
+typedef enum dt_clut_interpolation_t
+{
+  DT_CLUT_TETRAHEDRAL = 0,
+  DT_CLUT_TRILINEAR = 1,
+  DT_CLUT_PYRAMID = 2,
+} dt_clut_interpolation_t;
+
+/** apply the clut with tetrahedral interpolation to one row (or any run) of pixels. not threaded, meant
+ * to be called from within the caller's parallel loops. in and out may be the same buffer. */
+void dt_clut_tetrahedral_row(const float *const in, float *const out, const size_t npixels,
+                             const float *const clut, const int level);
+
+/** same as above for a whole buffer, threaded */
+void dt_clut_tetrahedral(const float *const in, float *const out, const size_t npixels, const float *const clut,
+                         const int level);
+
+/** apply the float or half float clut to a whole buffer with the given interpolation, threaded. in and out
+ * may be the same buffer. */
+void dt_clut_apply(const float *const in, float *const out, const size_t npixels, const float *const clut,
+                   const uint16_t *const clut_half, const int level, const dt_clut_interpolation_t interpolation);
+
+/** convert n floats to half floats, rounding to nearest. values beyond the half range are clamped. */
+void dt_clut_float_to_half(const float *const in, uint16_t *const out, const size_t n);
+
+/** convert n half floats back to floats */
+void dt_clut_half_to_float(const uint16_t *const in, float *const out, const size_t n);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
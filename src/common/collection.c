@@ -1208,6 +1208,16 @@ gchar *dt_collection_get_makermodel(const char *exif_maker, const char *exif_mod
   return makermodel;
 }
 
+// substring search in a metadata field, through the full text search index when there is one
+static gchar *_add_metadata_query(gchar *query, const int key, const char *escaped_text)
+{
+  if(dt_database_has_fts(darktable.db))
+    return dt_util_dstrcat(query, "(id IN (SELECT rowid >> 8 FROM main.meta_data_fts WHERE key = %d AND value "
+                                  "LIKE '%%%s%%'))", key, escaped_text);
+  return dt_util_dstrcat(query, "(id IN (SELECT id FROM main.meta_data WHERE key = %d AND value "
+                                "LIKE '%%%s%%'))", key, escaped_text);
+}
+
 static gchar *get_query_string(const dt_collection_properties_t property, const gchar *text)
 {
   char *escaped_text = sqlite3_mprintf("%q", text);
@@ -1317,35 +1327,39 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
       query = dt_util_dstrcat(query, ")");
       break;
     case DT_COLLECTION_PROP_TAG: // tag
-      query = dt_util_dstrcat(query, "(id IN (SELECT imgid FROM main.tagged_images AS a JOIN "
-                                     "data.tags AS b ON a.tagid = b.id WHERE name LIKE '%s'))",
-                              escaped_text);
+      if(dt_database_has_fts(darktable.db))
+        query = dt_util_dstrcat(query, "(id IN (SELECT imgid FROM main.tagged_images WHERE tagid IN "
+                                       "(SELECT rowid FROM data.tags_fts WHERE name LIKE '%s')))",
+                                escaped_text);
+      else
+        query = dt_util_dstrcat(query, "(id IN (SELECT imgid FROM main.tagged_images WHERE tagid IN "
+                                       "(SELECT id FROM data.tags WHERE name LIKE '%s')))",
+                                escaped_text);
       break;
 
     // TODO: How to handle images without metadata? In the moment they are not shown.
     // TODO: Autogenerate this code?
     case DT_COLLECTION_PROP_TITLE: // title
-      query = dt_util_dstrcat(query, "(id IN (SELECT id FROM main.meta_data WHERE key = %d AND value "
-                                     "LIKE '%%%s%%'))", DT_METADATA_XMP_DC_TITLE, escaped_text);
+      query = _add_metadata_query(query, DT_METADATA_XMP_DC_TITLE, escaped_text);
       break;
     case DT_COLLECTION_PROP_DESCRIPTION: // description
-      query = dt_util_dstrcat(query, "(id IN (SELECT id FROM main.meta_data WHERE key = %d AND value "
-                                     "LIKE '%%%s%%'))", DT_METADATA_XMP_DC_DESCRIPTION, escaped_text);
+      query = _add_metadata_query(query, DT_METADATA_XMP_DC_DESCRIPTION, escaped_text);
       break;
     case DT_COLLECTION_PROP_CREATOR: // creator
-      query = dt_util_dstrcat(query, "(id IN (SELECT id FROM main.meta_data WHERE key = %d AND value "
-                                     "LIKE '%%%s%%'))", DT_METADATA_XMP_DC_CREATOR, escaped_text);
+      query = _add_metadata_query(query, DT_METADATA_XMP_DC_CREATOR, escaped_text);
       break;
     case DT_COLLECTION_PROP_PUBLISHER: // publisher
-      query = dt_util_dstrcat(query, "(id IN (SELECT id FROM main.meta_data WHERE key = %d AND value "
-                                     "LIKE '%%%s%%'))", DT_METADATA_XMP_DC_PUBLISHER, escaped_text);
+      query = _add_metadata_query(query, DT_METADATA_XMP_DC_PUBLISHER, escaped_text);
       break;
     case DT_COLLECTION_PROP_RIGHTS: // rights
-      query = dt_util_dstrcat(query, "(id IN (SELECT id FROM main.meta_data WHERE key = %d AND value "
-                                     "LIKE '%%%s%%'))", DT_METADATA_XMP_DC_RIGHTS, escaped_text);
+      query = _add_metadata_query(query, DT_METADATA_XMP_DC_RIGHTS, escaped_text);
       break;
     case DT_COLLECTION_PROP_LENS: // lens
-      query = dt_util_dstrcat(query, "(lens LIKE '%%%s%%')", escaped_text);
+      if(dt_database_has_fts(darktable.db))
+        query = dt_util_dstrcat(query, "(id IN (SELECT rowid FROM main.images_fts WHERE lens LIKE '%%%s%%'))",
+                                escaped_text);
+      else
+        query = dt_util_dstrcat(query, "(lens LIKE '%%%s%%')", escaped_text);
       break;
 
     case DT_COLLECTION_PROP_FOCAL_LENGTH: // focal length
@@ -1446,7 +1460,11 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
     break;
 
     case DT_COLLECTION_PROP_FILENAME: // filename
-      query = dt_util_dstrcat(query, "(filename LIKE '%%%s%%')", escaped_text);
+      if(dt_database_has_fts(darktable.db))
+        query = dt_util_dstrcat(query, "(id IN (SELECT rowid FROM main.images_fts WHERE filename LIKE '%%%s%%'))",
+                                escaped_text);
+      else
+        query = dt_util_dstrcat(query, "(filename LIKE '%%%s%%')", escaped_text);
       break;
 
     case DT_COLLECTION_PROP_DAY:
@@ -36,6 +36,8 @@
 #include "common/exif.h"
 #include "common/pwstorage/pwstorage.h"
 #include "common/selection.h"
+#include "common/startup.h"
+#include "common/trace.h"
 #include "common/system_signal_handling.h"
 #ifdef HAVE_GPHOTO2
 #include "common/camera_control.h"
@@ -48,6 +50,7 @@
 #include "common/image.h"
 #include "common/image_cache.h"
 #include "common/imageio_module.h"
+#include "common/interpolation.h"
 #include "common/iop_order.h"
 #include "common/l10n.h"
 #include "common/mipmap_cache.h"
@@ -120,7 +123,7 @@ static int usage(const char *argv0)
   printf("  --conf <key>=<value>\n");
   printf("  --configdir <user config directory>\n");
   printf("  -d {all,cache,camctl,camsupport,control,dev,fswatch,input,lighttable,\n");
-  printf("      lua, masks,memory,nan,opencl,perf,pwstorage,print,sql}\n");
+  printf("      lua, masks,memory,nan,opencl,perf,pwstorage,print,sql,startup,trace}\n");
   printf("  --datadir <data directory>\n");
 #ifdef HAVE_OPENCL
   printf("  --disable-opencl\n");
@@ -338,6 +341,7 @@ static void dt_codepaths_init()
 int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load_data, lua_State *L)
 {
   double start_wtime = dt_get_wtime();
+  dt_startup_begin("dt_init");
 
 #ifndef _WIN32
   if(getuid() == 0 || geteuid() == 0)
@@ -435,8 +439,10 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   dt_pthread_mutex_init(&(darktable.db_insert), NULL);
   dt_pthread_mutex_init(&(darktable.plugin_threadsafe), NULL);
   dt_pthread_mutex_init(&(darktable.capabilities_threadsafe), NULL);
+  dt_pthread_mutex_init(&(darktable.iop_global_threadsafe), NULL);
   dt_pthread_mutex_init(&(darktable.exiv2_threadsafe), NULL);
   dt_pthread_mutex_init(&(darktable.readFile_mutex), NULL);
+  dt_interpolation_init();
   darktable.control = (dt_control_t *)calloc(1, sizeof(dt_control_t));
 
   // database
@@ -633,6 +639,10 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
           darktable.unmuted |= DT_DEBUG_PRINT; // print errors are reported on console
         else if(!strcmp(argv[k + 1], "camsupport"))
           darktable.unmuted |= DT_DEBUG_CAMERA_SUPPORT; // camera support warnings are reported on console
+        else if(!strcmp(argv[k + 1], "startup"))
+          darktable.unmuted |= DT_DEBUG_STARTUP; // where the time of dt_init() goes
+        else if(!strcmp(argv[k + 1], "trace"))
+          darktable.unmuted |= DT_DEBUG_TRACE; // pixelpipe events dumped as chrome trace at exit
         else
           return usage(argv[0]);
         k++;
@@ -723,6 +733,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
     dt_print_mem_usage();
   }
 
+  dt_trace_init();
+
   if(init_gui)
   {
     // I doubt that connecting to dbus for darktable-cli makes sense
@@ -758,12 +770,14 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   snprintf(darktablerc, sizeof(darktablerc), "%s/darktablerc", datadir);
 
   // initialize the config backend. this needs to be done first...
+  dt_startup_begin("config");
   darktable.conf = (dt_conf_t *)calloc(1, sizeof(dt_conf_t));
   dt_conf_init(darktable.conf, darktablerc, config_override);
   g_slist_free_full(config_override, g_free);
 
   // set the interface language and prepare selection for prefs
   darktable.l10n = dt_l10n_init(init_gui);
+  dt_startup_end();
 
   // we need this REALLY early so that error messages can be shown, however after gtk_disable_setlocale
   if(init_gui)
@@ -774,7 +788,9 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
     // priority to the XWayland backend for Wayland users.
     gdk_set_allowed_backends("x11,*");
 #endif
+    dt_startup_begin("gtk");
     gtk_init(&argc, &argv);
+    dt_startup_end();
 
     // execute a performance check and configuration if needed
     int last_configure_version = dt_conf_get_int("performance_configuration_version_completed");
@@ -802,10 +818,14 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   dt_codepaths_init();
 
   // get the list of color profiles
+  dt_startup_begin("color profiles");
   darktable.color_profiles = dt_colorspaces_init();
+  dt_startup_end();
 
   // initialize the database
+  dt_startup_begin("database");
   darktable.db = dt_database_init(dbfilename_from_command, load_data, init_gui);
+  dt_startup_end();
   if(darktable.db == NULL)
   {
     printf("ERROR : cannot open database\n");
@@ -854,7 +874,9 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   GList *changed_xmp_files = NULL;
   if(init_gui && dt_conf_get_bool("run_crawler_on_start"))
   {
+    dt_startup_begin("xmp crawler");
     changed_xmp_files = dt_control_crawler_run();
+    dt_startup_end();
   }
 
   if(init_gui)
@@ -896,7 +918,9 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
   darktable.opencl = (dt_opencl_t *)calloc(1, sizeof(dt_opencl_t));
 #ifdef HAVE_OPENCL
+  dt_startup_begin("opencl");
   dt_opencl_init(darktable.opencl, exclude_opencl, print_statistics);
+  dt_startup_end();
 #endif
 
   darktable.points = (dt_points_t *)calloc(1, sizeof(dt_points_t));
@@ -906,11 +930,13 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
   // must come before mipmap_cache, because that one will need to access
   // image dimensions stored in here:
+  dt_startup_begin("caches");
   darktable.image_cache = (dt_image_cache_t *)calloc(1, sizeof(dt_image_cache_t));
   dt_image_cache_init(darktable.image_cache);
 
   darktable.mipmap_cache = (dt_mipmap_cache_t *)calloc(1, sizeof(dt_mipmap_cache_t));
   dt_mipmap_cache_init(darktable.mipmap_cache);
+  dt_startup_end();
 
   // The GUI must be initialized before the views, because the init()
   // functions of the views depend on darktable.control->accels_* to register
@@ -918,15 +944,19 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
   if(init_gui)
   {
+    dt_startup_begin("gui");
     darktable.gui = (dt_gui_gtk_t *)calloc(1, sizeof(dt_gui_gtk_t));
     if(dt_gui_gtk_init(darktable.gui)) return 1;
     dt_bauhaus_init();
+    dt_startup_end();
   }
   else
     darktable.gui = NULL;
 
+  dt_startup_begin("views");
   darktable.view_manager = (dt_view_manager_t *)calloc(1, sizeof(dt_view_manager_t));
   dt_view_manager_init(darktable.view_manager);
+  dt_startup_end();
 
   // check whether we were able to load darkroom view. if we failed, we'll crash everywhere later on.
   if(!darktable.develop) return 1;
@@ -935,11 +965,13 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   dt_imageio_init(darktable.imageio);
 
   // load iop order
+  dt_startup_begin("iop modules");
   darktable.iop_order_list = dt_ioppr_get_iop_order_list(NULL);
   // load iop order rules
   darktable.iop_order_rules = dt_ioppr_get_iop_order_rules();
   // load the darkroom mode plugins once:
   dt_iop_load_modules_so();
+  dt_startup_end();
   // check if all modules have a iop order assigned
   if(dt_ioppr_check_so_iop_order(darktable.iop, darktable.iop_order_list)) return 1;
 
@@ -948,16 +980,22 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 #ifdef HAVE_GPHOTO2
     // Initialize the camera control.
     // this is done late so that the gui can react to the signal sent but before switching to lighttable!
+    dt_startup_begin("camera control");
     darktable.camctl = dt_camctl_new();
+    dt_startup_end();
 #endif
 
+    dt_startup_begin("lib modules");
     darktable.lib = (dt_lib_t *)calloc(1, sizeof(dt_lib_t));
     dt_lib_init(darktable.lib);
+    dt_startup_end();
 
     dt_gui_gtk_load_config();
 
     // init the gui part of views
+    dt_startup_begin("views gui");
     dt_view_manager_gui_init(darktable.view_manager);
+    dt_startup_end();
     // Loading the keybindings
     char keyfile[PATH_MAX] = { 0 };
 
@@ -989,7 +1027,9 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
 /* init lua last, since it's user made stuff it must be in the real environment */
 #ifdef USE_LUA
+  dt_startup_begin("lua");
   dt_lua_init(darktable.lua_state.state, lua_command);
+  dt_startup_end();
 #endif
 
   if(init_gui)
@@ -1013,6 +1053,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
     }
     // we have to call dt_ctl_switch_mode_to() here already to not run into a lua deadlock.
     // having another call later is ok
+    dt_startup_begin("initial view");
     dt_ctl_switch_mode_to(mode);
 
 #ifndef MAC_INTEGRATION
@@ -1042,6 +1083,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
       dt_ctl_switch_mode_to("darkroom");
     }
 #endif
+    dt_startup_end();
   }
 
   // last but not least construct the popup that asks the user about images whose xmp files are newer than the
@@ -1052,6 +1094,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   }
 
   dt_print(DT_DEBUG_CONTROL, "[init] startup took %f seconds\n", dt_get_wtime() - start_wtime);
+  dt_startup_end();
+  dt_startup_report();
 
   return 0;
 }
@@ -1082,6 +1126,8 @@ void dt_cleanup()
 #endif
   dt_view_manager_cleanup(darktable.view_manager);
   free(darktable.view_manager);
+  // all pipes are gone by now
+  dt_trace_cleanup();
   if(init_gui)
   {
     dt_imageio_cleanup(darktable.imageio);
@@ -1130,9 +1176,12 @@ void dt_cleanup()
 
   dt_capabilities_cleanup();
 
+  dt_interpolation_cleanup();
+
   dt_pthread_mutex_destroy(&(darktable.db_insert));
   dt_pthread_mutex_destroy(&(darktable.plugin_threadsafe));
   dt_pthread_mutex_destroy(&(darktable.capabilities_threadsafe));
+  dt_pthread_mutex_destroy(&(darktable.iop_global_threadsafe));
   dt_pthread_mutex_destroy(&(darktable.exiv2_threadsafe));
   dt_pthread_mutex_destroy(&(darktable.readFile_mutex));
 
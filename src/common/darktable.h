@@ -218,6 +218,8 @@ typedef enum dt_debug_thread_t
   DT_DEBUG_INPUT = 1 << 14,
   DT_DEBUG_PRINT = 1 << 15,
   DT_DEBUG_CAMERA_SUPPORT = 1 << 16,
+  DT_DEBUG_STARTUP = 1 << 17,
+  DT_DEBUG_TRACE = 1 << 18,
 } dt_debug_thread_t;
 
 typedef struct dt_codepath_t
@@ -263,6 +265,7 @@ typedef struct darktable_t
   dt_pthread_mutex_t db_insert;
   dt_pthread_mutex_t plugin_threadsafe;
   dt_pthread_mutex_t capabilities_threadsafe;
+  dt_pthread_mutex_t iop_global_threadsafe;
   dt_pthread_mutex_t exiv2_threadsafe;
   dt_pthread_mutex_t readFile_mutex;
   char *progname;
@@ -22,6 +22,7 @@
 #include "common/debug.h"
 #include "common/file_location.h"
 #include "common/iop_order.h"
+#include "common/startup.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "gui/legacy_presets.h"
@@ -39,7 +40,7 @@
 
 // whenever _create_*_schema() gets changed you HAVE to bump this version and add an update path to
 // _upgrade_*_schema_step()!
-#define CURRENT_DATABASE_VERSION_LIBRARY 19
+#define CURRENT_DATABASE_VERSION_LIBRARY 20
 #define CURRENT_DATABASE_VERSION_DATA 3
 
 typedef struct dt_database_t
@@ -56,6 +57,9 @@ typedef struct dt_database_t
   sqlite3 *handle;
 
   gchar *error_message, *error_dbfilename;
+
+  /* the full text search index is usable */
+  gboolean fts;
 } dt_database_t;
 
 
@@ -1142,6 +1146,28 @@ static int _upgrade_library_schema_step(dt_database_t *db, int version)
     sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
     new_version = 19;
   }
+  else if(version == 19)
+  {
+    // composite and covering indexes matching the collection queries, see
+    // dt_collection_update() and the query plan test in src/tests/collection.c
+    sqlite3_exec(db->handle, "BEGIN TRANSACTION", NULL, NULL, NULL);
+    TRY_EXEC("DROP INDEX IF EXISTS main.images_film_id_index",
+             "[init] can't drop images film_id index from database\n");
+    TRY_EXEC("CREATE INDEX main.images_film_id_index ON images (film_id, filename, version)",
+             "[init] can't create images film_id index\n");
+    TRY_EXEC("CREATE INDEX main.images_datetime_taken_index ON images (film_id, datetime_taken)",
+             "[init] can't create images datetime_taken index\n");
+    TRY_EXEC("DROP INDEX IF EXISTS main.tagged_images_tagid_index",
+             "[init] can't drop tagged_images tagid index from database\n");
+    TRY_EXEC("CREATE INDEX main.tagged_images_tagid_index ON tagged_images (tagid, imgid)",
+             "[init] can't create tagged_images tagid index\n");
+    TRY_EXEC("CREATE INDEX main.color_labels_color_index ON color_labels (color, imgid)",
+             "[init] can't create color_labels color index\n");
+    TRY_EXEC("CREATE INDEX main.metadata_key_value_index ON meta_data (key, value, id)",
+             "[init] can't create meta_data key/value index\n");
+    sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
+    new_version = 20;
+  }
   else
     new_version = version; // should be the fallback so that calling code sees that we are in an infinite loop
 
@@ -1338,7 +1364,10 @@ static void _create_library_schema(dt_database_t *db)
       "max_version INTEGER, write_timestamp INTEGER, history_end INTEGER, position INTEGER, aspect_ratio REAL, iop_order_version INTEGER)",
       NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE INDEX main.images_group_id_index ON images (group_id)", NULL, NULL, NULL);
-  sqlite3_exec(db->handle, "CREATE INDEX main.images_film_id_index ON images (film_id)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.images_film_id_index ON images (film_id, filename, version)", NULL,
+               NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.images_datetime_taken_index ON images (film_id, datetime_taken)", NULL,
+               NULL, NULL);
   sqlite3_exec(db->handle, "CREATE INDEX main.images_filename_index ON images (filename)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE INDEX main.image_position_index ON images (position)", NULL, NULL, NULL);
 
@@ -1366,7 +1395,8 @@ static void _create_library_schema(dt_database_t *db)
   ////////////////////////////// tagged_images
   sqlite3_exec(db->handle, "CREATE TABLE main.tagged_images (imgid INTEGER, tagid INTEGER, "
                            "PRIMARY KEY (imgid, tagid))", NULL, NULL, NULL);
-  sqlite3_exec(db->handle, "CREATE INDEX main.tagged_images_tagid_index ON tagged_images (tagid)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.tagged_images_tagid_index ON tagged_images (tagid, imgid)", NULL, NULL,
+               NULL);
   ////////////////////////////// used_tags
   sqlite3_exec(db->handle, "CREATE TABLE main.used_tags (id INTEGER, name VARCHAR NOT NULL)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE UNIQUE INDEX main.used_tags_idx ON used_tags (id, name)", NULL, NULL, NULL);
@@ -1374,9 +1404,13 @@ static void _create_library_schema(dt_database_t *db)
   sqlite3_exec(db->handle, "CREATE TABLE main.color_labels (imgid INTEGER, color INTEGER)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE UNIQUE INDEX main.color_labels_idx ON color_labels (imgid, color)", NULL, NULL,
                NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.color_labels_color_index ON color_labels (color, imgid)", NULL, NULL,
+               NULL);
   ////////////////////////////// meta_data
   sqlite3_exec(db->handle, "CREATE TABLE main.meta_data (id INTEGER, key INTEGER, value VARCHAR)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE INDEX main.metadata_index ON meta_data (id, key)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.metadata_key_value_index ON meta_data (key, value, id)", NULL, NULL,
+               NULL);
 }
 
 /* create the current database schema and set the version in db_info accordingly */
@@ -1593,6 +1627,139 @@ static gboolean _synchronize_tags(dt_database_t *db)
   return TRUE;
 }
 
+/* full text search over the text columns the collect module filters with substrings. sqlite's trigram
+ * tokenizer lets the fts5 tables answer LIKE queries directly. the tables are kept in sync by triggers,
+ * which have to go whenever the sqlite in use can't handle them (no fts5 or older than 3.34), so that
+ * writing to the indexed tables keeps working. the index is rebuilt once it is usable again. */
+typedef struct dt_database_fts_t
+{
+  const char *schema;
+  const char *const *objects; // the tables and triggers that make the index, tables first
+  const char *const *create;  // statements creating and filling them
+} dt_database_fts_t;
+
+static const char *const _fts_library_objects[]
+    = { "images_fts", "meta_data_fts", "images_fts_insert", "images_fts_delete", "images_fts_update",
+        "meta_data_fts_insert", "meta_data_fts_delete", "meta_data_fts_update", NULL };
+
+// meta_data has no integer primary key, its index rows are keyed by (id << 8) | key instead
+static const char *const _fts_library_create[] = {
+  "CREATE VIRTUAL TABLE main.images_fts USING fts5 (filename, lens, content='images', content_rowid='id', "
+  "tokenize='trigram')",
+  "CREATE TRIGGER main.images_fts_insert AFTER INSERT ON images BEGIN "
+  "INSERT INTO images_fts (rowid, filename, lens) VALUES (new.id, new.filename, new.lens); END",
+  "CREATE TRIGGER main.images_fts_delete AFTER DELETE ON images BEGIN "
+  "INSERT INTO images_fts (images_fts, rowid, filename, lens) VALUES ('delete', old.id, old.filename, old.lens); "
+  "END",
+  "CREATE TRIGGER main.images_fts_update AFTER UPDATE OF filename, lens ON images BEGIN "
+  "INSERT INTO images_fts (images_fts, rowid, filename, lens) VALUES ('delete', old.id, old.filename, old.lens); "
+  "INSERT INTO images_fts (rowid, filename, lens) VALUES (new.id, new.filename, new.lens); END",
+  "INSERT INTO main.images_fts (images_fts) VALUES ('rebuild')",
+  "CREATE VIRTUAL TABLE main.meta_data_fts USING fts5 (key UNINDEXED, value, tokenize='trigram')",
+  "CREATE TRIGGER main.meta_data_fts_insert AFTER INSERT ON meta_data BEGIN "
+  "DELETE FROM meta_data_fts WHERE rowid = (new.id << 8) | new.key; "
+  "INSERT INTO meta_data_fts (rowid, key, value) VALUES ((new.id << 8) | new.key, new.key, new.value); END",
+  "CREATE TRIGGER main.meta_data_fts_delete AFTER DELETE ON meta_data BEGIN "
+  "DELETE FROM meta_data_fts WHERE rowid = (old.id << 8) | old.key; END",
+  "CREATE TRIGGER main.meta_data_fts_update AFTER UPDATE ON meta_data BEGIN "
+  "DELETE FROM meta_data_fts WHERE rowid = (old.id << 8) | old.key; "
+  "DELETE FROM meta_data_fts WHERE rowid = (new.id << 8) | new.key; "
+  "INSERT INTO meta_data_fts (rowid, key, value) VALUES ((new.id << 8) | new.key, new.key, new.value); END",
+  "INSERT INTO main.meta_data_fts (rowid, key, value) "
+  "SELECT (id << 8) | key, key, value FROM main.meta_data GROUP BY id, key",
+  NULL
+};
+
+static const char *const _fts_data_objects[]
+    = { "tags_fts", "tags_fts_insert", "tags_fts_delete", "tags_fts_update", NULL };
+
+static const char *const _fts_data_create[] = {
+  "CREATE VIRTUAL TABLE data.tags_fts USING fts5 (name, content='tags', content_rowid='id', tokenize='trigram')",
+  "CREATE TRIGGER data.tags_fts_insert AFTER INSERT ON tags BEGIN "
+  "INSERT INTO tags_fts (rowid, name) VALUES (new.id, new.name); END",
+  "CREATE TRIGGER data.tags_fts_delete AFTER DELETE ON tags BEGIN "
+  "INSERT INTO tags_fts (tags_fts, rowid, name) VALUES ('delete', old.id, old.name); END",
+  "CREATE TRIGGER data.tags_fts_update AFTER UPDATE OF name ON tags BEGIN "
+  "INSERT INTO tags_fts (tags_fts, rowid, name) VALUES ('delete', old.id, old.name); "
+  "INSERT INTO tags_fts (rowid, name) VALUES (new.id, new.name); END",
+  "INSERT INTO data.tags_fts (tags_fts) VALUES ('rebuild')",
+  NULL
+};
+
+static const dt_database_fts_t _fts_indexes[] = { { "main", _fts_library_objects, _fts_library_create },
+                                                  { "data", _fts_data_objects, _fts_data_create } };
+
+// drop the triggers (and, if supported, the tables) of an index
+static void _drop_fts_index(dt_database_t *db, const dt_database_fts_t *fts, const gboolean supported)
+{
+  for(const char *const *o = fts->objects; *o; o++)
+  {
+    const gboolean table = g_str_has_suffix(*o, "_fts");
+    if(table && !supported) continue;
+    gchar *query = g_strdup_printf("DROP %s IF EXISTS %s.%s", table ? "TABLE" : "TRIGGER", fts->schema, *o);
+    sqlite3_exec(db->handle, query, NULL, NULL, NULL);
+    g_free(query);
+  }
+}
+
+static gboolean _create_fts_index(dt_database_t *db)
+{
+  // does this sqlite have fts5 with the trigram tokenizer?
+  const gboolean supported
+      = sqlite3_exec(db->handle, "CREATE VIRTUAL TABLE temp.fts_probe USING fts5 (x, tokenize='trigram')", NULL,
+                     NULL, NULL)
+        == SQLITE_OK;
+  if(supported) sqlite3_exec(db->handle, "DROP TABLE temp.fts_probe", NULL, NULL, NULL);
+
+  for(int k = 0; k < (int)(sizeof(_fts_indexes) / sizeof(_fts_indexes[0])); k++)
+  {
+    const dt_database_fts_t *fts = _fts_indexes + k;
+
+    if(!supported)
+    {
+      _drop_fts_index(db, fts, FALSE);
+      continue;
+    }
+
+    // the index is in sync if all its parts exist, the triggers might be gone since a run without fts5
+    int expected = 0;
+    gchar *names = NULL;
+    for(const char *const *o = fts->objects; *o; o++, expected++)
+      names = dt_util_dstrcat(names, "%s'%s'", names ? ", " : "", *o);
+    gchar *query = g_strdup_printf("SELECT COUNT(*) FROM %s.sqlite_master WHERE name IN (%s)", fts->schema, names);
+    g_free(names);
+
+    sqlite3_stmt *stmt;
+    int found = 0;
+    sqlite3_prepare_v2(db->handle, query, -1, &stmt, NULL);
+    if(sqlite3_step(stmt) == SQLITE_ROW) found = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    g_free(query);
+    if(found == expected) continue;
+
+    const double start = dt_get_wtime();
+    sqlite3_exec(db->handle, "BEGIN TRANSACTION", NULL, NULL, NULL);
+    _drop_fts_index(db, fts, TRUE);
+    for(const char *const *c = fts->create; *c; c++)
+    {
+      if(sqlite3_exec(db->handle, *c, NULL, NULL, NULL) != SQLITE_OK)
+      {
+        fprintf(stderr, "[init] can't create the full text search index: %s\n[init]   %s\n",
+                sqlite3_errmsg(db->handle), *c);
+        sqlite3_exec(db->handle, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+        // don't leave triggers behind that would fail on every write
+        _drop_fts_index(db, fts, TRUE);
+        return FALSE;
+      }
+    }
+    sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
+    dt_print(DT_DEBUG_SQL, "[init] built the full text search index of `%s' in %.3f secs\n", fts->schema,
+             dt_get_wtime() - start);
+  }
+
+  return supported;
+}
+
 #undef TRY_EXEC
 #undef TRY_STEP
 #undef TRY_PREPARE
@@ -1929,7 +2096,10 @@ start:
         ask_for_upgrade(dbfilename_data, has_gui);
 
         // older: upgrade
-        if(!_upgrade_data_schema(db, db_version))
+        dt_startup_begin("data.db upgrade");
+        const gboolean upgraded = _upgrade_data_schema(db, db_version);
+        dt_startup_end();
+        if(!upgraded)
         {
           // we couldn't upgrade the db for some reason. bail out.
           fprintf(stderr, "[init] database `%s' couldn't be upgraded from version %d to %d. aborting\n",
@@ -2007,7 +2177,10 @@ start:
       ask_for_upgrade(dbfilename_library, has_gui);
 
       // older: upgrade
-      if(!_upgrade_library_schema(db, db_version))
+      dt_startup_begin("library.db upgrade");
+      const gboolean upgraded = _upgrade_library_schema(db, db_version);
+      dt_startup_end();
+      if(!upgraded)
       {
         // we couldn't upgrade the db for some reason. bail out.
         fprintf(stderr, "[init] database `%s' couldn't be upgraded from version %d to %d. aborting\n", dbname,
@@ -2128,6 +2301,9 @@ start:
     goto error;
   }
 
+  // substring searches in the collect module use this when available
+  db->fts = _create_fts_index(db);
+
 error:
   g_free(dbname);
 
@@ -2164,6 +2340,11 @@ const gchar *dt_database_get_path(const struct dt_database_t *db)
   return db->dbfilename_library;
 }
 
+gboolean dt_database_has_fts(const struct dt_database_t *db)
+{
+  return db->fts;
+}
+
 static void _database_migrate_to_xdg_structure()
 {
   gchar dbfilename[PATH_MAX] = { 0 };
@@ -30,6 +30,8 @@ void dt_database_destroy(const struct dt_database_t *);
 struct sqlite3 *dt_database_get(const struct dt_database_t *);
 /** Returns database path */
 const gchar *dt_database_get_path(const struct dt_database_t *db);
+/** test if the full text search index over file names, lenses, tags and metadata can be used */
+gboolean dt_database_has_fts(const struct dt_database_t *db);
 /** test if database was already locked by another instance */
 gboolean dt_database_get_lock_acquired(const struct dt_database_t *db);
 /** show an error popup. this has to be postponed until after we tried using dbus to reach another instance */
@@ -19,9 +19,6 @@
 #include "control/control.h"
 #include "develop/imageop.h"
 #include "heal.h"
-#if defined(__SSE__)
-#include <xmmintrin.h>
-#endif
 
 /* Based on the original source code of GIMP's Healing Tool, by Jean-Yves Couleaud
  *
@@ -44,6 +41,11 @@
  * dealing here with RGB integer components, more is overkill.
  *
  * Jean-Yves Couleaud cjyves@free.fr
+ *
+ * darktable: the Gauss-Seidel iterations needed thousands of sweeps on large
+ * areas, they are now the smoother of a multigrid V-cycle. The coarser levels
+ * halve the resolution down to 8x8 cells, a coarse cell is solved for if all
+ * of its 4 fine cells are. A handful of cycles reach the convergence criteria.
  */
 
 
@@ -77,187 +79,259 @@ static void dt_heal_add(const float *const first_buffer, const float *const seco
   for(int i = 0; i < i_size; i++) result_buffer[i] = first_buffer[i] + second_buffer[i];
 }
 
-#if defined(__SSE__)
-static float dt_heal_laplace_iteration_sse(float *pixels, const float *const Adiag, const int *const Aidx,
-                                           const float w, const int nmask_from, const int nmask_to)
+// one level of the multigrid hierarchy. level 0 is the image itself, where the pixels outside the mask hold the
+// Dirichlet conditions. coarser levels solve for the correction of the finer one, which is 0 outside the mask.
+typedef struct dt_heal_level_t
+{
+  int width, height;
+  uint8_t *mask;    // != 0 for the cells to solve for
+  float *pixels;    // solution on level 0, correction on the coarser levels, ch floats per cell
+  float *rhs;       // right hand side, NULL (all 0) on level 0
+  float *residual;
+} dt_heal_level_t;
+
+// red/black Gauss-Seidel sweeps of (n * x - sum of the n neighbors on the canvas) = rhs
+__DT_CLONE_TARGETS__
+static void dt_heal_level_smooth(const dt_heal_level_t *const l, const int ch, const int sweeps)
 {
-  float err = 0.f;
+  const int width = l->width;
+  const int height = l->height;
+  const int ch1 = (ch == 4) ? ch - 1 : ch;
+  const uint8_t *const mask = l->mask;
+  const float *const rhs = l->rhs;
+  float *const pixels = l->pixels;
 
+  for(int s = 0; s < sweeps; s++)
+    for(int parity = 0; parity < 2; parity++)
+    {
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(Adiag, Aidx, w, nmask_from, nmask_to) \
-  shared(pixels) \
+  dt_omp_firstprivate(ch, ch1, height, mask, parity, pixels, rhs, width) \
+  schedule(static)
+#endif
+      for(int i = 0; i < height; i++)
+      {
+        for(int j = (i & 1) ^ parity; j < width; j += 2)
+        {
+          const size_t idx = (size_t)i * width + j;
+          if(!mask[idx]) continue;
+
+          /* Omit Dirichlet conditions for any neighbors off the
+           * edge of the canvas.
+           */
+          const int n = (i > 0) + (j > 0) + (i < height - 1) + (j < width - 1);
+          if(n == 0) continue;
+          const float inv_n = 1.0f / n;
+
+          float *const p = pixels + idx * ch;
+          for(int k = 0; k < ch1; k++)
+          {
+            float sum = rhs ? rhs[idx * ch + k] : 0.0f;
+            if(i > 0) sum += p[k - (size_t)width * ch];
+            if(i < height - 1) sum += p[k + (size_t)width * ch];
+            if(j > 0) sum += p[k - ch];
+            if(j < width - 1) sum += p[k + ch];
+            p[k] = sum * inv_n;
+          }
+        }
+      }
+    }
+}
+
+// store the residual of the masked cells and return its sum of squares
+__DT_CLONE_TARGETS__
+static float dt_heal_level_residual(const dt_heal_level_t *const l, const int ch)
+{
+  const int width = l->width;
+  const int height = l->height;
+  const int ch1 = (ch == 4) ? ch - 1 : ch;
+  const uint8_t *const mask = l->mask;
+  const float *const rhs = l->rhs;
+  const float *const pixels = l->pixels;
+  float *const residual = l->residual;
+  float err = 0.0f;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(ch, ch1, height, mask, pixels, residual, rhs, width) \
   schedule(static) \
   reduction(+ : err)
 #endif
-  for(int i = nmask_from; i < nmask_to; i++)
+  for(int i = 0; i < height; i++)
   {
-    int ii = i * 5;
-    int j0 = Aidx[ii + 0];
-    int j1 = Aidx[ii + 1];
-    int j2 = Aidx[ii + 2];
-    int j3 = Aidx[ii + 3];
-    int j4 = Aidx[ii + 4];
-
-    __m128 valb_a = _mm_set1_ps(Adiag[i]);
-    __m128 valb_w = { w, w, w, w };
-
-    __m128 valb_j0 = _mm_load_ps(pixels + j0); // center
-    __m128 valb_j1 = _mm_load_ps(pixels + j1); // E
-    __m128 valb_j2 = _mm_load_ps(pixels + j2); // S
-    __m128 valb_j3 = _mm_load_ps(pixels + j3); // W
-    __m128 valb_j4 = _mm_load_ps(pixels + j4); // N
-
-    /*  float diff = w * (a * pixels[j0 + k] -
-                            (pixels[j1 + k] +
-                             pixels[j2 + k] +
-                             pixels[j3 + k] +
-                             pixels[j4 + k]));*/
-    __m128 valb_diff
-        = _mm_mul_ps(valb_w, _mm_sub_ps(_mm_mul_ps(valb_a, valb_j0),
-                                        _mm_add_ps(valb_j1, _mm_add_ps(valb_j2, _mm_add_ps(valb_j3, valb_j4)))));
-
-    /*  pixels[j0 + k] -= diff;*/
-    _mm_store_ps(pixels + j0, _mm_sub_ps(valb_j0, valb_diff));
-    /*  err += diff * diff;*/
-    union {
-      __m128 v;
-      float f[4];
-    } valb_err;
-    valb_err.v = _mm_mul_ps(valb_diff, valb_diff);
-    err += valb_err.f[0] + valb_err.f[1] + valb_err.f[2];
+    for(int j = 0; j < width; j++)
+    {
+      const size_t idx = (size_t)i * width + j;
+      float *const r = residual + idx * ch;
+      if(!mask[idx])
+      {
+        for(int k = 0; k < ch1; k++) r[k] = 0.0f;
+        continue;
+      }
+
+      const int n = (i > 0) + (j > 0) + (i < height - 1) + (j < width - 1);
+      const float *const p = pixels + idx * ch;
+      for(int k = 0; k < ch1; k++)
+      {
+        float sum = rhs ? rhs[idx * ch + k] : 0.0f;
+        if(i > 0) sum += p[k - (size_t)width * ch];
+        if(i < height - 1) sum += p[k + (size_t)width * ch];
+        if(j > 0) sum += p[k - ch];
+        if(j < width - 1) sum += p[k + ch];
+        r[k] = sum - n * p[k];
+        err += r[k] * r[k];
+      }
+    }
   }
 
   return err;
 }
-#endif
 
-// Perform one iteration of Gauss-Seidel, and return the sum squared residual.
-static float dt_heal_laplace_iteration(float *pixels, const float *const Adiag, const int *const Aidx,
-                                       const float w, const int nmask_from, const int nmask_to, const int ch,
-                                       const int use_sse)
+// sum the residual of each 2x2 block into the right hand side of the coarser level (the operator is not
+// scaled with the grid spacing, so the sum is 4 times the average) and start from a zero correction.
+// a coarse cell is only solved for if all its fine cells are: growing the domain instead would let thin
+// Dirichlet borders vanish and leave the coarse problem (near) singular.
+static void dt_heal_level_restrict(const dt_heal_level_t *const fine, const dt_heal_level_t *const coarse,
+                                   const int ch)
 {
-#if defined(__SSE__)
-  if(ch == 4 && use_sse) return dt_heal_laplace_iteration_sse(pixels, Adiag, Aidx, w, nmask_from, nmask_to);
+  const int ch1 = (ch == 4) ? ch - 1 : ch;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(ch, ch1, coarse, fine) \
+  schedule(static)
 #endif
+  for(int i = 0; i < coarse->height; i++)
+  {
+    for(int j = 0; j < coarse->width; j++)
+    {
+      const size_t idx = (size_t)i * coarse->width + j;
+      float *const f = coarse->rhs + idx * ch;
+      int m = 0, children = 0;
+      for(int k = 0; k < ch; k++) f[k] = 0.0f;
+      for(int ii = 2 * i; ii < MIN(2 * i + 2, fine->height); ii++)
+        for(int jj = 2 * j; jj < MIN(2 * j + 2, fine->width); jj++)
+        {
+          const size_t fidx = (size_t)ii * fine->width + jj;
+          m += fine->mask[fidx] != 0;
+          children++;
+          for(int k = 0; k < ch1; k++) f[k] += fine->residual[fidx * ch + k];
+        }
+      coarse->mask[idx] = m == children;
+      for(int k = 0; k < ch; k++) coarse->pixels[idx * ch + k] = 0.0f;
+    }
+  }
+}
 
-  float err = 0.f;
+// add the bilinearly interpolated correction of the coarser level to the masked cells
+static void dt_heal_level_prolong(const dt_heal_level_t *const coarse, const dt_heal_level_t *const fine,
+                                  const int ch)
+{
   const int ch1 = (ch == 4) ? ch - 1 : ch;
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(Adiag, Aidx, w, nmask_from, nmask_to, ch1) \
-  shared(pixels) \
-  schedule(static) \
-  reduction(+ : err)
+  dt_omp_firstprivate(ch, ch1, coarse, fine) \
+  schedule(static)
 #endif
-  for(int i = nmask_from; i < nmask_to; i++)
+  for(int i = 0; i < fine->height; i++)
   {
-    const int j0 = Aidx[i * 5 + 0];
-    const int j1 = Aidx[i * 5 + 1];
-    const int j2 = Aidx[i * 5 + 2];
-    const int j3 = Aidx[i * 5 + 3];
-    const int j4 = Aidx[i * 5 + 4];
-    const float a = Adiag[i];
-
-    for(int k = 0; k < ch1; k++)
+    const int ci = i / 2;
+    // the coarse row on the same side as this fine row, clamped to the canvas
+    const int ci2 = MIN(MAX((i & 1) ? ci + 1 : ci - 1, 0), coarse->height - 1);
+    for(int j = 0; j < fine->width; j++)
     {
-      const float diff
-          = w * (a * pixels[j0 + k] - (pixels[j1 + k] + pixels[j2 + k] + pixels[j3 + k] + pixels[j4 + k]));
-
-      pixels[j0 + k] -= diff;
-      err += diff * diff;
+      const size_t idx = (size_t)i * fine->width + j;
+      if(!fine->mask[idx]) continue;
+
+      const int cj = j / 2;
+      const int cj2 = MIN(MAX((j & 1) ? cj + 1 : cj - 1, 0), coarse->width - 1);
+      const float *const c00 = coarse->pixels + ((size_t)ci * coarse->width + cj) * ch;
+      const float *const c01 = coarse->pixels + ((size_t)ci * coarse->width + cj2) * ch;
+      const float *const c10 = coarse->pixels + ((size_t)ci2 * coarse->width + cj) * ch;
+      const float *const c11 = coarse->pixels + ((size_t)ci2 * coarse->width + cj2) * ch;
+      float *const p = fine->pixels + idx * ch;
+      for(int k = 0; k < ch1; k++)
+        p[k] += (9.0f * c00[k] + 3.0f * (c01[k] + c10[k]) + c11[k]) * (1.0f / 16.0f);
     }
   }
+}
+
+// one V-cycle starting at level l
+static void dt_heal_vcycle(const dt_heal_level_t *const levels, const int l, const int nlevels, const int ch)
+{
+  if(l == nlevels - 1)
+  {
+    // the coarsest level has at most 8x8 cells, just iterate it to convergence
+    dt_heal_level_smooth(levels + l, ch, 64);
+    return;
+  }
 
-  return err;
+  dt_heal_level_smooth(levels + l, ch, 2);
+  dt_heal_level_residual(levels + l, ch);
+  dt_heal_level_restrict(levels + l, levels + l + 1, ch);
+  dt_heal_vcycle(levels, l + 1, nlevels, ch);
+  dt_heal_level_prolong(levels + l + 1, levels + l, ch);
+  dt_heal_level_smooth(levels + l, ch, 2);
 }
 
 // Solve the laplace equation for pixels and store the result in-place.
 static void dt_heal_laplace_loop(float *pixels, const int width, const int height, const int ch,
-                                 const float *const mask, const int use_sse)
+                                 const float *const mask)
 {
+#define HEAL_MAX_LEVELS 16
+  dt_heal_level_t levels[HEAL_MAX_LEVELS] = { { 0 } };
+  int nlevels = 0;
   int nmask = 0;
-  int nmask2 = 0;
 
-  float *Adiag = dt_alloc_align(64, sizeof(float) * width * height);
-  int *Aidx = dt_alloc_align(64, sizeof(int) * 5 * width * height);
-
-  if((Adiag == NULL) || (Aidx == NULL))
+  // build the hierarchy down to 8x8 cells
+  for(int w = width, h = height; nlevels < HEAL_MAX_LEVELS; w = (w + 1) / 2, h = (h + 1) / 2)
   {
-    fprintf(stderr, "dt_heal_laplace_loop: error allocating memory for healing\n");
-    goto cleanup;
-  }
-
-  /* All off-diagonal elements of A are either -1 or 0. We could store it as a
-   * general-purpose sparse matrix, but that adds some unnecessary overhead to
-   * the inner loop. Instead, assume exactly 4 off-diagonal elements in each
-   * row, all of which have value -1. Any row that in fact wants less than 4
-   * coefs can put them in a dummy column to be multiplied by an empty pixel.
-   */
-  const int zero = ch * width * height;
-  memset(pixels + zero, 0, ch * sizeof(float));
-
-  /* Construct the system of equations.
-   * Arrange Aidx in checkerboard order, so that a single linear pass over that
-   * array results updating all of the red cells and then all of the black cells.
-   */
-  for(int parity = 0; parity < 2; parity++)
-  {
-    if(parity == 1) nmask2 = nmask;
-
-    for(int i = 0; i < height; i++)
+    dt_heal_level_t *l = levels + nlevels++;
+    l->width = w;
+    l->height = h;
+    l->mask = dt_alloc_align(64, sizeof(uint8_t) * w * h);
+    l->pixels = nlevels == 1 ? pixels : dt_alloc_align(64, sizeof(float) * ch * w * h);
+    l->rhs = nlevels == 1 ? NULL : dt_alloc_align(64, sizeof(float) * ch * w * h);
+    l->residual = dt_alloc_align(64, sizeof(float) * ch * w * h);
+    if(!l->mask || !l->pixels || !l->residual || (nlevels > 1 && !l->rhs))
     {
-      for(int j = (i & 1) ^ parity; j < width; j += 2)
-      {
-        if(mask[j + i * width])
-        {
-#define A_NEIGHBOR(o, di, dj)                                                                                     \
-  if((dj < 0 && j == 0) || (dj > 0 && j == width - 1) || (di < 0 && i == 0) || (di > 0 && i == height - 1))       \
-    Aidx[o + nmask * 5] = zero;                                                                                   \
-  else                                                                                                            \
-    Aidx[o + nmask * 5] = ((i + di) * width + (j + dj)) * ch;
-
-          /* Omit Dirichlet conditions for any neighbors off the
-           * edge of the canvas.
-           */
-          Adiag[nmask] = 4 - (i == 0) - (j == 0) - (i == height - 1) - (j == width - 1);
-          A_NEIGHBOR(0, 0, 0);
-          A_NEIGHBOR(1, 0, 1);
-          A_NEIGHBOR(2, 1, 0);
-          A_NEIGHBOR(3, 0, -1);
-          A_NEIGHBOR(4, -1, 0);
-          nmask++;
-        }
-      }
+      fprintf(stderr, "dt_heal_laplace_loop: error allocating memory for healing\n");
+      goto cleanup;
     }
+    if(w <= 8 && h <= 8) break;
   }
 
-#undef A_NEIGHBOR
+  for(size_t k = 0; k < (size_t)width * height; k++)
+  {
+    levels[0].mask[k] = mask[k] != 0.0f;
+    nmask += levels[0].mask[k];
+  }
+  if(nmask == 0) goto cleanup;
 
-  /* Empirically optimal over-relaxation factor. (Benchmarked on
-   * round brushes, at least. I don't know whether aspect ratio
-   * affects it.)
+  /* We are dealing here with RGB components that end up as integers, stop
+   * when the average residual is way below what could be seen.
    */
-  float w = ((2.0f - 1.0f / (0.1575f * sqrtf(nmask) + 0.8f)) * .25f);
-
-  const int max_iter = 1000;
-  const float epsilon = (0.1 / 255);
-  const float err_exit = epsilon * epsilon * w * w;
+  const int ch1 = (ch == 4) ? ch - 1 : ch;
+  const float epsilon = (0.1 / 255) * 0.001;
+  const float err_exit = epsilon * epsilon * nmask * ch1;
+  const int max_cycles = 30;
 
-  /* Gauss-Seidel with successive over-relaxation */
-  for(int iter = 0; iter < max_iter; iter++)
+  for(int cycle = 0; cycle < max_cycles; cycle++)
   {
-    // process red/black cells separate
-    float err = dt_heal_laplace_iteration(pixels, Adiag, Aidx, w, 0, nmask2, ch, use_sse);
-    err += dt_heal_laplace_iteration(pixels, Adiag, Aidx, w, nmask2, nmask, ch, use_sse);
-
-    if(err < err_exit) break;
+    dt_heal_vcycle(levels, 0, nlevels, ch);
+    if(dt_heal_level_residual(levels, ch) < err_exit) break;
   }
 
 cleanup:
-  if(Adiag) dt_free_align(Adiag);
-  if(Aidx) dt_free_align(Aidx);
+  for(int k = 0; k < nlevels; k++)
+  {
+    if(levels[k].mask) dt_free_align(levels[k].mask);
+    if(k > 0 && levels[k].pixels) dt_free_align(levels[k].pixels);
+    if(levels[k].rhs) dt_free_align(levels[k].rhs);
+    if(levels[k].residual) dt_free_align(levels[k].residual);
+  }
+#undef HEAL_MAX_LEVELS
 }
 
 
@@ -269,7 +343,7 @@ cleanup:
 void dt_heal(const float *const src_buffer, float *dest_buffer, const float *const mask_buffer, const int width,
              const int height, const int ch, const int use_sse)
 {
-  float *diff_buffer = dt_alloc_align(64, width * (height + 1) * ch * sizeof(float));
+  float *diff_buffer = dt_alloc_align(64, (size_t)width * height * ch * sizeof(float));
 
   if(diff_buffer == NULL)
   {
@@ -280,7 +354,7 @@ void dt_heal(const float *const src_buffer, float *dest_buffer, const float *con
   /* subtract pattern from image and store the result in diff */
   dt_heal_sub(dest_buffer, src_buffer, diff_buffer, width, height, ch);
 
-  dt_heal_laplace_loop(diff_buffer, width, height, ch, mask_buffer, use_sse);
+  dt_heal_laplace_loop(diff_buffer, width, height, ch, mask_buffer);
 
   /* add solution to original image and store in dest */
   dt_heal_add(diff_buffer, src_buffer, dest_buffer, width, height, ch);
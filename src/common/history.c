@@ -527,15 +527,36 @@ int dt_history_merge_module_into_history(dt_develop_t *dev_dest, dt_develop_t *d
   return module_added;
 }
 
-static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_imgid, GList *ops)
+// state shared by all the destination images of a paste: the source history
+// is decoded once and the destination module stack is recycled
+typedef struct dt_history_paste_t
 {
-  GList *modules_used = NULL;
+  int32_t imgid;
+  GList *ops;
+  gboolean loaded;
+  dt_develop_t dev_src;
+  dt_develop_t dev_dest;
+  GList *dest_base;
+  // source history_end and iop_order_version for the overwrite path, -1 if not yet read
+  int history_end;
+  int iop_order_version;
+} dt_history_paste_t;
+
+static void _history_paste_init(dt_history_paste_t *paste, int32_t imgid, GList *ops)
+{
+  memset(paste, 0, sizeof(dt_history_paste_t));
+  paste->imgid = imgid;
+  paste->ops = ops;
+  paste->history_end = -1;
+  paste->iop_order_version = -1;
+}
 
-  dt_develop_t _dev_src = { 0 };
-  dt_develop_t _dev_dest = { 0 };
+static void _history_paste_load(dt_history_paste_t *paste)
+{
+  if(paste->loaded) return;
 
-  dt_develop_t *dev_src = &_dev_src;
-  dt_develop_t *dev_dest = &_dev_dest;
+  dt_develop_t *dev_src = &paste->dev_src;
+  dt_develop_t *dev_dest = &paste->dev_dest;
 
   // we will do the copy/paste on memory so we can deal with masks
   dt_dev_init(dev_src, FALSE);
@@ -543,17 +564,48 @@ static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_im
 
   dev_src->iop = dt_iop_load_modules_ext(dev_src, TRUE);
   dev_dest->iop = dt_iop_load_modules_ext(dev_dest, TRUE);
+  paste->dest_base = g_list_copy(dev_dest->iop);
+
+  dt_dev_read_history_ext(dev_src, paste->imgid, TRUE);
+
+  dt_ioppr_check_iop_order(dev_src, paste->imgid, "_history_copy_and_paste_on_image_merge ");
+
+  dt_dev_pop_history_items_ext(dev_src, dev_src->history_end);
+
+  dt_ioppr_check_iop_order(dev_src, paste->imgid, "_history_copy_and_paste_on_image_merge 1");
+
+  paste->loaded = TRUE;
+}
+
+static void _history_paste_cleanup(dt_history_paste_t *paste)
+{
+  if(!paste->loaded) return;
+
+  g_list_free(paste->dest_base);
+  dt_dev_cleanup(&paste->dev_src);
+  dt_dev_cleanup(&paste->dev_dest);
+  paste->loaded = FALSE;
+}
+
+static int _history_copy_and_paste_on_image_merge(dt_history_paste_t *paste, int32_t dest_imgid)
+{
+  GList *modules_used = NULL;
+  GList *ops = paste->ops;
+  const int32_t imgid = paste->imgid;
+
+  _history_paste_load(paste);
+
+  dt_develop_t *dev_src = &paste->dev_src;
+  dt_develop_t *dev_dest = &paste->dev_dest;
+
+  dt_dev_reset_history_ext(dev_dest, paste->dest_base);
 
-  dt_dev_read_history_ext(dev_src, imgid, TRUE);
   dt_dev_read_history_ext(dev_dest, dest_imgid, TRUE);
 
-  dt_ioppr_check_iop_order(dev_src, imgid, "_history_copy_and_paste_on_image_merge ");
   dt_ioppr_check_iop_order(dev_dest, imgid, "_history_copy_and_paste_on_image_merge ");
 
-  dt_dev_pop_history_items_ext(dev_src, dev_src->history_end);
   dt_dev_pop_history_items_ext(dev_dest, dev_dest->history_end);
 
-  dt_ioppr_check_iop_order(dev_src, imgid, "_history_copy_and_paste_on_image_merge 1");
   dt_ioppr_check_iop_order(dev_dest, imgid, "_history_copy_and_paste_on_image_merge 1");
 
   // the user have selected some history entries
@@ -601,17 +653,15 @@ static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_im
   // write history and forms to db
   dt_dev_write_history_ext(dev_dest, dest_imgid);
 
-  dt_dev_cleanup(dev_src);
-  dt_dev_cleanup(dev_dest);
-
   g_list_free(modules_used);
 
   return 0;
 }
 
-static int _history_copy_and_paste_on_image_overwrite(int32_t imgid, int32_t dest_imgid, GList *ops)
+static int _history_copy_and_paste_on_image_overwrite(dt_history_paste_t *paste, int32_t dest_imgid)
 {
   int ret_val = 0;
+  const int32_t imgid = paste->imgid;
   sqlite3_stmt *stmt;
 
   // replace history stack
@@ -637,7 +687,7 @@ static int _history_copy_and_paste_on_image_overwrite(int32_t imgid, int32_t des
   sqlite3_finalize(stmt);
 
   // the user wants an exact duplicate of the history, so just copy the db
-  if(!ops)
+  if(!paste->ops)
   {
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                                 "INSERT INTO main.history "
@@ -663,63 +713,55 @@ static int _history_copy_and_paste_on_image_overwrite(int32_t imgid, int32_t des
     sqlite3_step(stmt);
     sqlite3_finalize(stmt);
 
-    int history_end = 0;
-    int iop_order_version = 0;
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "SELECT history_end, iop_order_version FROM main.images WHERE id = ?1",
-                                -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-    if(sqlite3_step(stmt) == SQLITE_ROW)
+    if(paste->history_end == -1)
     {
-      if(sqlite3_column_type(stmt, 0) != SQLITE_NULL)
-        history_end = sqlite3_column_int(stmt, 0);
-      if(sqlite3_column_type(stmt, 1) != SQLITE_NULL)
-        iop_order_version = sqlite3_column_int(stmt, 1);
+      paste->history_end = 0;
+      paste->iop_order_version = 0;
+      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                  "SELECT history_end, iop_order_version FROM main.images WHERE id = ?1",
+                                  -1, &stmt, NULL);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+      if(sqlite3_step(stmt) == SQLITE_ROW)
+      {
+        if(sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+          paste->history_end = sqlite3_column_int(stmt, 0);
+        if(sqlite3_column_type(stmt, 1) != SQLITE_NULL)
+          paste->iop_order_version = sqlite3_column_int(stmt, 1);
+      }
+      sqlite3_finalize(stmt);
     }
-    sqlite3_finalize(stmt);
 
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                                 "UPDATE main.images SET history_end = ?2, iop_order_version = ?3 "
                                 " WHERE id = ?1",
                                 -1, &stmt, NULL);
     DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, dest_imgid);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, history_end);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, iop_order_version);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, paste->history_end);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, paste->iop_order_version);
     sqlite3_step(stmt);
     sqlite3_finalize(stmt);
   }
   else
   {
     // since the history and masks where deleted we can do a merge
-    ret_val = _history_copy_and_paste_on_image_merge(imgid, dest_imgid, ops);
+    ret_val = _history_copy_and_paste_on_image_merge(paste, dest_imgid);
   }
 
   return ret_val;
 }
 
-int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboolean merge, GList *ops)
+// pastes onto one destination, the thumbnail is left for the caller to invalidate
+static int _history_copy_and_paste_on_image_ext(dt_history_paste_t *paste, int32_t dest_imgid, gboolean merge)
 {
-  if(imgid == dest_imgid) return 1;
-
-  if(imgid == -1)
-  {
-    dt_control_log(_("you need to copy history from an image before you paste it onto another"));
-    return 1;
-  }
-
-  // be sure the current history is written before pasting some other history data
-  const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
-  if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
-
   dt_undo_lt_history_t *hist = dt_history_snapshot_item_init();
   hist->imgid = dest_imgid;
   dt_history_snapshot_undo_create(hist->imgid, &hist->before, &hist->before_history_end);
 
   int ret_val = 0;
   if(merge)
-    ret_val = _history_copy_and_paste_on_image_merge(imgid, dest_imgid, ops);
+    ret_val = _history_copy_and_paste_on_image_merge(paste, dest_imgid);
   else
-    ret_val = _history_copy_and_paste_on_image_overwrite(imgid, dest_imgid, ops);
+    ret_val = _history_copy_and_paste_on_image_overwrite(paste, dest_imgid);
 
   dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
   dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
@@ -742,9 +784,6 @@ int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboole
   /* update xmp file */
   dt_image_synch_xmp(dest_imgid);
 
-  dt_mipmap_cache_remove(darktable.mipmap_cache, dest_imgid);
-  dt_image_reset_final_size(imgid);
-
   /* update the aspect ratio. recompute only if really needed for performance reasons */
   if(darktable.collection->params.sort == DT_COLLECTION_SORT_ASPECT_RATIO)
     dt_image_set_aspect_ratio(dest_imgid);
@@ -754,6 +793,91 @@ int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboole
   return ret_val;
 }
 
+static gboolean _history_copy_and_paste_check(int32_t imgid)
+{
+  if(imgid == -1)
+  {
+    dt_control_log(_("you need to copy history from an image before you paste it onto another"));
+    return FALSE;
+  }
+
+  // be sure the current history is written before pasting some other history data
+  const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
+  if(cv && cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
+
+  return TRUE;
+}
+
+int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboolean merge, GList *ops)
+{
+  if(imgid == dest_imgid) return 1;
+
+  if(!_history_copy_and_paste_check(imgid)) return 1;
+
+  dt_history_paste_t paste;
+  _history_paste_init(&paste, imgid, ops);
+
+  const int ret_val = _history_copy_and_paste_on_image_ext(&paste, dest_imgid, merge);
+
+  _history_paste_cleanup(&paste);
+
+  dt_mipmap_cache_remove(darktable.mipmap_cache, dest_imgid);
+  dt_image_reset_final_size(dest_imgid);
+
+  return ret_val;
+}
+
+int dt_history_copy_and_paste_on_list(int32_t imgid, GList *list, gboolean merge, GList *ops)
+{
+  if(!list) return 1;
+
+  if(!_history_copy_and_paste_check(imgid)) return 1;
+
+  const double start = dt_get_wtime();
+  int count = 0;
+  int ret_val = 0;
+
+  dt_history_paste_t paste;
+  _history_paste_init(&paste, imgid, ops);
+
+  // the rows are committed in batches, this keeps the journal small while
+  // avoiding one sync per image. everything called from here has to nest,
+  // i.e. use savepoints instead of BEGIN/COMMIT (see history_snapshot.c).
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "BEGIN", NULL, NULL, NULL);
+  for(GList *l = list; l; l = g_list_next(l))
+  {
+    const int32_t dest_imgid = GPOINTER_TO_INT(l->data);
+    if(dest_imgid == imgid) continue;
+
+    ret_val |= _history_copy_and_paste_on_image_ext(&paste, dest_imgid, merge);
+
+    if(++count % DT_HISTORY_PASTE_BATCH == 0)
+    {
+      DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+      DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "BEGIN", NULL, NULL, NULL);
+    }
+  }
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+
+  _history_paste_cleanup(&paste);
+
+  // invalidate all the thumbnails in one go once the new histories are visible
+  for(GList *l = list; l; l = g_list_next(l))
+  {
+    const int32_t dest_imgid = GPOINTER_TO_INT(l->data);
+    if(dest_imgid == imgid) continue;
+
+    dt_mipmap_cache_remove(darktable.mipmap_cache, dest_imgid);
+    dt_image_reset_final_size(dest_imgid);
+  }
+
+  const double elapsed = dt_get_wtime() - start;
+  dt_print(DT_DEBUG_PERF, "[history] pasted history of image %d onto %d images in %.3f secs (%.1f images/s)\n",
+           imgid, count, elapsed, elapsed > 0.0 ? count / elapsed : 0.0);
+
+  return ret_val;
+}
+
 GList *dt_history_get_items(int32_t imgid, gboolean enabled)
 {
   GList *result = NULL;
@@ -844,28 +968,31 @@ int dt_history_copy_and_paste_on_selection(int32_t imgid, gboolean merge, GList
   if(imgid < 0) return 1;
 
   int res = 0;
+  GList *list = NULL;
   sqlite3_stmt *stmt;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                               "SELECT imgid FROM main.selected_images WHERE imgid != ?1", -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
+  while(sqlite3_step(stmt) == SQLITE_ROW)
   {
-    dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
-    do
-    {
-      /* get imgid of selected image */
-      int32_t dest_imgid = sqlite3_column_int(stmt, 0);
+    /* get imgid of selected image */
+    list = g_list_prepend(list, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
+  }
+  sqlite3_finalize(stmt);
 
-      /* paste history stack onto image id */
-      dt_history_copy_and_paste_on_image(imgid, dest_imgid, merge, ops);
+  if(list)
+  {
+    list = g_list_reverse(list);
 
-    } while(sqlite3_step(stmt) == SQLITE_ROW);
+    /* paste history stack onto all the images */
+    dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
+    dt_history_copy_and_paste_on_list(imgid, list, merge, ops);
     dt_undo_end_group(darktable.undo);
+    g_list_free(list);
   }
   else
     res = 1;
 
-  sqlite3_finalize(stmt);
   return res;
 }
 
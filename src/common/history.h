@@ -22,6 +22,9 @@
 #include <inttypes.h>
 #include <sqlite3.h>
 
+// number of images pasted per transaction by dt_history_copy_and_paste_on_list()
+#define DT_HISTORY_PASTE_BATCH 100
+
 struct dt_develop_t;
 struct dt_iop_module_t;
 
@@ -40,6 +43,10 @@ void dt_history_delete_on_image(int32_t imgid);
 /** as above but control whether to record undo/redo */
 void dt_history_delete_on_image_ext(int32_t imgid, gboolean undo);
 
+/** copy history from imgid and pasts on a list of imgids, merge or overwrite. the source history is read
+    once and the rows are committed in batches of DT_HISTORY_PASTE_BATCH images */
+int dt_history_copy_and_paste_on_list(int32_t imgid, GList *list, gboolean merge, GList *ops);
+
 /** copy history from imgid and pasts on selected images, merge or overwrite... */
 int dt_history_copy_and_paste_on_selection(int32_t imgid, gboolean merge, GList *ops);
 
@@ -53,7 +53,8 @@ void dt_history_snapshot_undo_create(int32_t imgid, int *snap_id, int *history_e
     *snap_id = sqlite3_column_int(stmt, 0) + 1;
   sqlite3_finalize(stmt);
 
-  sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+  // a savepoint, as we may be called from within the transaction of a batch paste or style apply
+  sqlite3_exec(dt_database_get(darktable.db), "SAVEPOINT history_snapshot", NULL, NULL, NULL);
 
   // copy current state into undo_history
 
@@ -76,10 +77,9 @@ void dt_history_snapshot_undo_create(int32_t imgid, int *snap_id, int *history_e
   all_ok = all_ok && (sqlite3_step(stmt) == SQLITE_DONE);
   sqlite3_finalize(stmt);
 
-  if(all_ok)
-    sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
-  else
-    sqlite3_exec(dt_database_get(darktable.db), "ROLLBACK_TRANSACTION", NULL, NULL, NULL);
+  if(!all_ok)
+    sqlite3_exec(dt_database_get(darktable.db), "ROLLBACK TO SAVEPOINT history_snapshot", NULL, NULL, NULL);
+  sqlite3_exec(dt_database_get(darktable.db), "RELEASE SAVEPOINT history_snapshot", NULL, NULL, NULL);
 }
 
 static void _history_snapshot_undo_restore(int32_t imgid, int snap_id, int history_end)
@@ -88,7 +88,8 @@ static void _history_snapshot_undo_restore(int32_t imgid, int snap_id, int histo
   sqlite3_stmt *stmt;
   gboolean all_ok = TRUE;
 
-  sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+  // a savepoint, as we may be called from within the transaction of a batch paste or style apply
+  sqlite3_exec(dt_database_get(darktable.db), "SAVEPOINT history_snapshot", NULL, NULL, NULL);
 
   dt_history_delete_on_image_ext(imgid, FALSE);
 
@@ -100,7 +101,7 @@ static void _history_snapshot_undo_restore(int32_t imgid, int snap_id, int histo
                               " FROM memory.undo_history WHERE imgid=?2 AND id=?1", -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, snap_id);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, imgid);
-  all_ok &= (sqlite3_step(stmt) != SQLITE_DONE);
+  all_ok &= (sqlite3_step(stmt) == SQLITE_DONE);
   sqlite3_finalize(stmt);
 
   // copy undo_masks_history snapshot back as current masks_history state
@@ -111,7 +112,7 @@ static void _history_snapshot_undo_restore(int32_t imgid, int snap_id, int histo
                               -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, snap_id);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, imgid);
-  all_ok &= (sqlite3_step(stmt) != SQLITE_DONE);
+  all_ok &= (sqlite3_step(stmt) == SQLITE_DONE);
   sqlite3_finalize(stmt);
 
   // set history end
@@ -120,13 +121,12 @@ static void _history_snapshot_undo_restore(int32_t imgid, int snap_id, int histo
                               "UPDATE main.images SET history_end=?2 WHERE id=?1", -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, history_end);
-  all_ok &= (sqlite3_step(stmt) != SQLITE_DONE);
+  all_ok &= (sqlite3_step(stmt) == SQLITE_DONE);
   sqlite3_finalize(stmt);
 
-  if(all_ok)
-    sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
-  else
-    sqlite3_exec(dt_database_get(darktable.db), "ROLLBACK_TRANSACTION", NULL, NULL, NULL);
+  if(!all_ok)
+    sqlite3_exec(dt_database_get(darktable.db), "ROLLBACK TO SAVEPOINT history_snapshot", NULL, NULL, NULL);
+  sqlite3_exec(dt_database_get(darktable.db), "RELEASE SAVEPOINT history_snapshot", NULL, NULL, NULL);
 }
 
 static void _clear_undo_snapshot(int32_t imgid, int snap_id)
@@ -1268,7 +1268,7 @@ const struct dt_interpolation *dt_interpolation_new(enum dt_interpolation_type t
  * out position meta[3*out]
  * @return 0 for success, !0 for failure
  */
-static int prepare_resampling_plan(const struct dt_interpolation *itor, int in, const int in_x0, int out,
+static int compute_resampling_plan(const struct dt_interpolation *itor, int in, const int in_x0, int out,
                                    const int out_x0, float scale, int **plength, float **pkernel,
                                    int **pindex, int **pmeta)
 {
@@ -1449,167 +1449,207 @@ static int prepare_resampling_plan(const struct dt_interpolation *itor, int in,
   return 0;
 }
 
-static void dt_interpolation_resample_plain(const struct dt_interpolation *itor, float *out,
-                                            const dt_iop_roi_t *const roi_out, const int32_t out_stride,
-                                            const float *const in, const dt_iop_roi_t *const roi_in,
-                                            const int32_t in_stride)
+/* --------------------------------------------------------------------------
+ * Resampling plan cache
+ * ------------------------------------------------------------------------*/
+
+/* mipmap generation, finalscale and every darkroom redraw keep asking for the
+ * very same plans, so keep the most recently used ones around. Plans are
+ * read only once computed, a reference count protects them from eviction
+ * while in use. */
+
+#define RESAMPLING_PLAN_CACHE_SIZE 16
+
+typedef struct dt_resampling_plan_t
 {
-  int *hindex = NULL;
-  int *hlength = NULL;
-  float *hkernel = NULL;
-  int *vindex = NULL;
-  int *vlength = NULL;
-  float *vkernel = NULL;
-  int *vmeta = NULL;
+  // key
+  enum dt_interpolation_type itor;
+  int in;
+  int out;
+  int out_x0;
+  float scale;
+
+  // plan, lengths is the start of the allocated blob
+  int *lengths;
+  float *kernel;
+  int *index;
+  int *meta;
+
+  int users;
+  uint64_t stamp;
+} dt_resampling_plan_t;
+
+static struct
+{
+  gboolean initialized;
+  dt_pthread_mutex_t lock;
+  dt_resampling_plan_t plan[RESAMPLING_PLAN_CACHE_SIZE];
+  uint64_t stamp;
+  uint64_t hits;
+  uint64_t misses;
+} resampling_plans = { 0 };
+
+void dt_interpolation_init()
+{
+  memset(&resampling_plans, 0, sizeof(resampling_plans));
+  dt_pthread_mutex_init(&resampling_plans.lock, NULL);
+  resampling_plans.initialized = TRUE;
+}
 
-  int r;
+void dt_interpolation_cleanup()
+{
+  if(!resampling_plans.initialized) return;
+  dt_print(DT_DEBUG_PERF, "[resampling] plan cache: %" PRIu64 " hits, %" PRIu64 " misses\n",
+           resampling_plans.hits, resampling_plans.misses);
+  resampling_plans.initialized = FALSE;
+  for(int k = 0; k < RESAMPLING_PLAN_CACHE_SIZE; k++) dt_free_align(resampling_plans.plan[k].lengths);
+  dt_pthread_mutex_destroy(&resampling_plans.lock);
+}
 
-  debug_info("resampling %p (%dx%d@%dx%d scale %f) -> %p (%dx%d@%dx%d scale %f)\n", in, roi_in->width,
-             roi_in->height, roi_in->x, roi_in->y, roi_in->scale, out, roi_out->width, roi_out->height,
-             roi_out->x, roi_out->y, roi_out->scale);
+/** Same contract as compute_resampling_plan(), but the plan is taken from the
+ * cache when possible. Release it with release_resampling_plan(*plength)
+ * instead of freeing it. */
+static int prepare_resampling_plan(const struct dt_interpolation *itor, int in, const int in_x0, int out,
+                                   const int out_x0, float scale, int **plength, float **pkernel,
+                                   int **pindex, int **pmeta)
+{
+  if(!resampling_plans.initialized || scale == 1.f)
+    return compute_resampling_plan(itor, in, in_x0, out, out_x0, scale, plength, pkernel, pindex, pmeta);
 
-  // Fast code path for 1:1 copy, only cropping area can change
-  if(roi_out->scale == 1.f)
+  dt_pthread_mutex_lock(&resampling_plans.lock);
+
+  dt_resampling_plan_t *plan = NULL;
+  for(int k = 0; k < RESAMPLING_PLAN_CACHE_SIZE; k++)
   {
-    const int x0 = roi_out->x * 4 * sizeof(float);
-#if DEBUG_RESAMPLING_TIMING
-    int64_t ts_resampling = getts();
-#endif
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-    dt_omp_firstprivate(in, in_stride, out_stride, roi_out, x0) \
-    shared(out)
-#endif
-    for(int y = 0; y < roi_out->height; y++)
+    dt_resampling_plan_t *p = resampling_plans.plan + k;
+    if(p->lengths && p->itor == itor->id && p->in == in && p->out == out && p->out_x0 == out_x0
+       && p->scale == scale)
     {
-      memcpy((char *)out + (size_t)out_stride * y,
-             (char *)in + (size_t)in_stride * (y + roi_out->y) + x0,
-             out_stride);
+      plan = p;
+      break;
     }
-#if DEBUG_RESAMPLING_TIMING
-    ts_resampling = getts() - ts_resampling;
-    fprintf(stderr, "resampling %p plan:0us resampling:%" PRId64 "us\n", in, ts_resampling);
-#endif
-    // All done, so easy case
-    return;
-  }
-
-// Generic non 1:1 case... much more complicated :D
-#if DEBUG_RESAMPLING_TIMING
-  int64_t ts_plan = getts();
-#endif
-
-  // Prepare resampling plans once and for all
-  r = prepare_resampling_plan(itor, roi_in->width, roi_in->x, roi_out->width, roi_out->x, roi_out->scale,
-                              &hlength, &hkernel, &hindex, NULL);
-  if(r)
-  {
-    goto exit;
   }
 
-  r = prepare_resampling_plan(itor, roi_in->height, roi_in->y, roi_out->height, roi_out->y, roi_out->scale,
-                              &vlength, &vkernel, &vindex, &vmeta);
-  if(r)
+  if(plan)
   {
-    goto exit;
+    resampling_plans.hits++;
   }
-
-#if DEBUG_RESAMPLING_TIMING
-  ts_plan = getts() - ts_plan;
-#endif
-
-#if DEBUG_RESAMPLING_TIMING
-  int64_t ts_resampling = getts();
-#endif
-
-// Process each output line
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, in_stride, out_stride, roi_out) \
-  shared(out, hindex, hlength, hkernel, vindex, vlength, vkernel, vmeta)
-#endif
-  for(int oy = 0; oy < roi_out->height; oy++)
+  else
   {
-    // Initialize column resampling indexes
-    int vlidx = vmeta[3 * oy + 0]; // V(ertical) L(ength) I(n)d(e)x
-    int vkidx = vmeta[3 * oy + 1]; // V(ertical) K(ernel) I(n)d(e)x
-    int viidx = vmeta[3 * oy + 2]; // V(ertical) I(ndex) I(n)d(e)x
+    resampling_plans.misses++;
 
-    // Initialize row resampling indexes
-    int hlidx = 0; // H(orizontal) L(ength) I(n)d(e)x
-    int hkidx = 0; // H(orizontal) K(ernel) I(n)d(e)x
-    int hiidx = 0; // H(orizontal) I(ndex) I(n)d(e)x
+    // least recently used slot not in use
+    for(int k = 0; k < RESAMPLING_PLAN_CACHE_SIZE; k++)
+    {
+      dt_resampling_plan_t *p = resampling_plans.plan + k;
+      if(p->users == 0 && (!plan || p->stamp < plan->stamp)) plan = p;
+    }
 
-    // Number of lines contributing to the output line
-    int vl = vlength[vlidx++]; // V(ertical) L(ength)
+    if(!plan)
+    {
+      // everything is busy, hand out a private plan
+      dt_pthread_mutex_unlock(&resampling_plans.lock);
+      return compute_resampling_plan(itor, in, in_x0, out, out_x0, scale, plength, pkernel, pindex, pmeta);
+    }
 
-    // Process each output column
-    for(int ox = 0; ox < roi_out->width; ox++)
+    dt_free_align(plan->lengths);
+    memset(plan, 0, sizeof(dt_resampling_plan_t));
+    if(compute_resampling_plan(itor, in, in_x0, out, out_x0, scale, &plan->lengths, &plan->kernel,
+                               &plan->index, &plan->meta))
     {
-      debug_extra("output %p [% 4d % 4d]\n", out, ox, oy);
+      dt_pthread_mutex_unlock(&resampling_plans.lock);
+      *plength = NULL;
+      *pkernel = NULL;
+      *pindex = NULL;
+      if(pmeta) *pmeta = NULL;
+      return 1;
+    }
+    plan->itor = itor->id;
+    plan->in = in;
+    plan->out = out;
+    plan->out_x0 = out_x0;
+    plan->scale = scale;
+  }
 
-      // This will hold the resulting pixel
-      float vs[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  plan->users++;
+  plan->stamp = ++resampling_plans.stamp;
 
-      // Number of horizontal samples contributing to the output
-      int hl = hlength[hlidx++]; // H(orizontal) L(ength)
+  *plength = plan->lengths;
+  *pkernel = plan->kernel;
+  *pindex = plan->index;
+  if(pmeta) *pmeta = plan->meta;
 
-      for(int iy = 0; iy < vl; iy++)
-      {
-        // This is our input line
-        const float *i = (float *)((char *)in + (size_t)in_stride * vindex[viidx++]);
-
-        float vhs[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-
-        for(int ix = 0; ix < hl; ix++)
-        {
-          // Apply the precomputed filter kernel
-          size_t baseidx = (size_t)hindex[hiidx++] * 4;
-          const float htap = hkernel[hkidx++];
-          for(int c = 0; c < 3; c++) vhs[c] += i[baseidx + c] * htap;
-        }
+  dt_pthread_mutex_unlock(&resampling_plans.lock);
+  return 0;
+}
 
-        // Accumulate contribution from this line
-        const float vtap = vkernel[vkidx++];
-        for(int c = 0; c < 3; c++) vs[c] += vhs[c] * vtap;
+static void release_resampling_plan(int *lengths)
+{
+  if(!lengths) return;
 
-        // Reset horizontal resampling context
-        hkidx -= hl;
-        hiidx -= hl;
+  if(resampling_plans.initialized)
+  {
+    dt_pthread_mutex_lock(&resampling_plans.lock);
+    for(int k = 0; k < RESAMPLING_PLAN_CACHE_SIZE; k++)
+    {
+      dt_resampling_plan_t *p = resampling_plans.plan + k;
+      if(p->lengths == lengths)
+      {
+        p->users--;
+        dt_pthread_mutex_unlock(&resampling_plans.lock);
+        return;
       }
+    }
+    dt_pthread_mutex_unlock(&resampling_plans.lock);
+  }
 
-      // Output pixel is ready
-      float *o = (float *)((char *)out + (size_t)oy * out_stride + (size_t)ox * 4 * sizeof(float));
-      for(int c = 0; c < 3; c++) o[c] = vs[c];
+  // not a cached plan
+  dt_free_align(lengths);
+}
 
-      // Reset vertical resampling context
-      viidx -= vl;
-      vkidx -= vl;
+/* Separable resampling: every input line is filtered horizontally once into
+ * a ring of out->width wide lines, output lines are then a weighted sum of
+ * vmaxtaps of those. Each thread works on a contiguous block of output lines
+ * so that the ring is reused while it is cache resident. Both passes are
+ * plain loops over 4 channel pixels, the clones take care of AVX2 & co. */
 
-      // Progress in horizontal context
-      hiidx += hl;
-      hkidx += hl;
+__DT_CLONE_TARGETS__
+static void resample_line_horizontal(float *const restrict out, const float *const restrict in, const int width,
+                                     const int *const restrict hlength, const float *const restrict hkernel,
+                                     const int *const restrict hindex)
+{
+  int hkidx = 0;
+  for(int ox = 0; ox < width; ox++)
+  {
+    const int hl = hlength[ox];
+    float vs[4] DT_ALIGNED_PIXEL = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for(int ix = 0; ix < hl; ix++, hkidx++)
+    {
+      const float *const i = in + (size_t)hindex[hkidx] * 4;
+      const float htap = hkernel[hkidx];
+      for(int c = 0; c < 4; c++) vs[c] += i[c] * htap;
     }
+    for(int c = 0; c < 4; c++) out[4 * ox + c] = vs[c];
   }
+}
 
-#if DEBUG_RESAMPLING_TIMING
-  ts_resampling = getts() - ts_resampling;
-  fprintf(stderr, "resampling %p plan:%" PRId64 "us resampling:%" PRId64 "us\n", in, ts_plan, ts_resampling);
-#endif
-
-exit:
-  /* Free the resampling plans. It's nasty to optimize allocs like that, but
-   * it simplifies the code :-D. The length array is in fact the only memory
-   * allocated. */
-  dt_free_align(hlength);
-  dt_free_align(vlength);
+__DT_CLONE_TARGETS__
+static void resample_line_vertical(float *const restrict out, const float *const *const restrict lines,
+                                   const float *const restrict vkernel, const int vl, const size_t n)
+{
+  for(size_t k = 0; k < n; k++) out[k] = 0.0f;
+  for(int iy = 0; iy < vl; iy++)
+  {
+    const float *const restrict l = lines[iy];
+    const float vtap = vkernel[iy];
+    for(size_t k = 0; k < n; k++) out[k] += l[k] * vtap;
+  }
 }
 
-#if defined(__SSE2__)
-static void dt_interpolation_resample_sse(const struct dt_interpolation *itor, float *out,
-                                          const dt_iop_roi_t *const roi_out, const int32_t out_stride,
-                                          const float *const in, const dt_iop_roi_t *const roi_in,
-                                          const int32_t in_stride)
+static void dt_interpolation_resample_blocked(const struct dt_interpolation *itor, float *out,
+                                              const dt_iop_roi_t *const roi_out, const int32_t out_stride,
+                                              const float *const in, const dt_iop_roi_t *const roi_in,
+                                              const int32_t in_stride)
 {
   int *hindex = NULL;
   int *hlength = NULL;
@@ -1639,9 +1679,9 @@ static void dt_interpolation_resample_sse(const struct dt_interpolation *itor, f
 #endif
     for(int y = 0; y < roi_out->height; y++)
     {
-      float *i = (float *)((char *)in + (size_t)in_stride * (y + roi_out->y) + x0);
-      float *o = (float *)((char *)out + (size_t)out_stride * y);
-      memcpy(o, i, out_stride);
+      memcpy((char *)out + (size_t)out_stride * y,
+             (char *)in + (size_t)in_stride * (y + roi_out->y) + x0,
+             out_stride);
     }
 #if DEBUG_RESAMPLING_TIMING
     ts_resampling = getts() - ts_resampling;
@@ -1671,6 +1711,13 @@ static void dt_interpolation_resample_sse(const struct dt_interpolation *itor, f
     goto exit;
   }
 
+  // vertical taps of one output line are consecutive input lines (replicated at the borders), a ring
+  // one line larger than the longest filter never overwrites a line still needed
+  int vmaxtaps = 0;
+  for(int k = 0; k < roi_out->height; k++) vmaxtaps = MAX(vmaxtaps, vlength[k]);
+  const int ringsize = vmaxtaps + 1;
+  const size_t linesize = dt_round_size_sse((size_t)4 * roi_out->width);
+
 #if DEBUG_RESAMPLING_TIMING
   ts_plan = getts() - ts_plan;
 #endif
@@ -1679,79 +1726,49 @@ static void dt_interpolation_resample_sse(const struct dt_interpolation *itor, f
   int64_t ts_resampling = getts();
 #endif
 
-// Process each output line
 #ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, in_stride, out_stride, roi_out) \
+#pragma omp parallel default(none) \
+  dt_omp_firstprivate(in, in_stride, out_stride, roi_out, ringsize, linesize) \
   shared(out, hindex, hlength, hkernel, vindex, vlength, vkernel, vmeta)
 #endif
-  for(int oy = 0; oy < roi_out->height; oy++)
   {
-    // Initialize column resampling indexes
-    int vlidx = vmeta[3 * oy + 0]; // V(ertical) L(ength) I(n)d(e)x
-    int vkidx = vmeta[3 * oy + 1]; // V(ertical) K(ernel) I(n)d(e)x
-    int viidx = vmeta[3 * oy + 2]; // V(ertical) I(ndex) I(n)d(e)x
-
-    // Initialize row resampling indexes
-    int hlidx = 0; // H(orizontal) L(ength) I(n)d(e)x
-    int hkidx = 0; // H(orizontal) K(ernel) I(n)d(e)x
-    int hiidx = 0; // H(orizontal) I(ndex) I(n)d(e)x
+    float *const ring = dt_alloc_align(SSE_ALIGNMENT, sizeof(float) * linesize * ringsize);
+    int *const ringline = malloc(sizeof(int) * ringsize);
+    const float **lines = malloc(sizeof(float *) * ringsize);
+    for(int k = 0; k < ringsize; k++) ringline[k] = -1;
 
-    // Number of lines contributing to the output line
-    int vl = vlength[vlidx++]; // V(ertical) L(ength)
-
-    // Process each output column
-    for(int ox = 0; ox < roi_out->width; ox++)
+    // static schedule: contiguous blocks of output lines per thread
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for(int oy = 0; oy < roi_out->height; oy++)
     {
-      debug_extra("output %p [% 4d % 4d]\n", out, ox, oy);
-
-      // This will hold the resulting pixel
-      __m128 vs = _mm_setzero_ps();
-
-      // Number of horizontal samples contributing to the output
-      int hl = hlength[hlidx++]; // H(orizontal) L(ength)
+      const int vl = vlength[vmeta[3 * oy + 0]];
+      const float *const vk = vkernel + vmeta[3 * oy + 1];
+      const int *const vi = vindex + vmeta[3 * oy + 2];
 
       for(int iy = 0; iy < vl; iy++)
       {
-        // This is our input line
-        const float *i = (float *)((char *)in + (size_t)in_stride * vindex[viidx++]);
-
-        __m128 vhs = _mm_setzero_ps();
-
-        for(int ix = 0; ix < hl; ix++)
+        const int line = vi[iy];
+        const int slot = line % ringsize;
+        float *const l = ring + linesize * slot;
+        if(ringline[slot] != line)
         {
-          // Apply the precomputed filter kernel
-          size_t baseidx = (size_t)hindex[hiidx++] * 4;
-          float htap = hkernel[hkidx++];
-          __m128 vhtap = _mm_set_ps1(htap);
-          vhs = _mm_add_ps(vhs, _mm_mul_ps(*(__m128 *)&i[baseidx], vhtap));
+          const float *const i = (const float *)((const char *)in + (size_t)in_stride * line);
+          resample_line_horizontal(l, i, roi_out->width, hlength, hkernel, hindex);
+          ringline[slot] = line;
         }
-
-        // Accumulate contribution from this line
-        float vtap = vkernel[vkidx++];
-        __m128 vvtap = _mm_set_ps1(vtap);
-        vs = _mm_add_ps(vs, _mm_mul_ps(vhs, vvtap));
-
-        // Reset horizontal resampling context
-        hkidx -= hl;
-        hiidx -= hl;
+        lines[iy] = l;
       }
 
-      // Output pixel is ready
-      float *o = (float *)((char *)out + (size_t)oy * out_stride + (size_t)ox * 4 * sizeof(float));
-      _mm_stream_ps(o, vs);
-
-      // Reset vertical resampling context
-      viidx -= vl;
-      vkidx -= vl;
-
-      // Progress in horizontal context
-      hiidx += hl;
-      hkidx += hl;
+      float *const o = (float *)((char *)out + (size_t)oy * out_stride);
+      resample_line_vertical(o, lines, vk, vl, (size_t)4 * roi_out->width);
     }
-  }
 
-  _mm_sfence();
+    free(lines);
+    free(ringline);
+    dt_free_align(ring);
+  }
 
 #if DEBUG_RESAMPLING_TIMING
   ts_resampling = getts() - ts_resampling;
@@ -1759,13 +1776,12 @@ static void dt_interpolation_resample_sse(const struct dt_interpolation *itor, f
 #endif
 
 exit:
-  /* Free the resampling plans. It's nasty to optimize allocs like that, but
+  /* Release the resampling plans. It's nasty to optimize allocs like that, but
    * it simplifies the code :-D. The length array is in fact the only memory
    * allocated. */
-  dt_free_align(hlength);
-  dt_free_align(vlength);
+  release_resampling_plan(hlength);
+  release_resampling_plan(vlength);
 }
-#endif
 
 /** Applies resampling (re-scaling) on *full* input and output buffers.
  *  roi_in and roi_out define the part of the buffers that is affected.
@@ -1775,14 +1791,7 @@ void dt_interpolation_resample(const struct dt_interpolation *itor, float *out,
                                const float *const in, const dt_iop_roi_t *const roi_in,
                                const int32_t in_stride)
 {
-  if(darktable.codepath.OPENMP_SIMD)
-    return dt_interpolation_resample_plain(itor, out, roi_out, out_stride, in, roi_in, in_stride);
-#if defined(__SSE2__)
-  else if(darktable.codepath.SSE2)
-    return dt_interpolation_resample_sse(itor, out, roi_out, out_stride, in, roi_in, in_stride);
-#endif
-  else
-    dt_unreachable_codepath();
+  dt_interpolation_resample_blocked(itor, out, roi_out, out_stride, in, roi_in, in_stride);
 }
 
 /** Applies resampling (re-scaling) on a specific region-of-interest of an image. The input
@@ -2019,8 +2028,8 @@ int dt_interpolation_resample_cl(const struct dt_interpolation *itor, int devid,
   dt_opencl_release_mem_object(dev_vlength);
   dt_opencl_release_mem_object(dev_vkernel);
   dt_opencl_release_mem_object(dev_vmeta);
-  dt_free_align(hlength);
-  dt_free_align(vlength);
+  release_resampling_plan(hlength);
+  release_resampling_plan(vlength);
   return CL_SUCCESS;
 
 error:
@@ -2032,8 +2041,8 @@ error:
   dt_opencl_release_mem_object(dev_vlength);
   dt_opencl_release_mem_object(dev_vkernel);
   dt_opencl_release_mem_object(dev_vmeta);
-  dt_free_align(hlength);
-  dt_free_align(vlength);
+  release_resampling_plan(hlength);
+  release_resampling_plan(vlength);
   dt_print(DT_DEBUG_OPENCL, "[opencl_resampling] couldn't enqueue kernel! %d\n", err);
   return err;
 }
@@ -2205,11 +2214,11 @@ static void dt_interpolation_resample_1c_plain(const struct dt_interpolation *it
 #endif
 
   exit:
-  /* Free the resampling plans. It's nasty to optimize allocs like that, but
+  /* Release the resampling plans. It's nasty to optimize allocs like that, but
    * it simplifies the code :-D. The length array is in fact the only memory
    * allocated. */
-  dt_free_align(hlength);
-  dt_free_align(vlength);
+  release_resampling_plan(hlength);
+  release_resampling_plan(vlength);
 }
 
 /** Applies resampling (re-scaling) on *full* input and output buffers.
@@ -116,6 +116,10 @@ void dt_interpolation_compute_pixel1c(const struct dt_interpolation *itor, const
  */
 const struct dt_interpolation *dt_interpolation_new(enum dt_interpolation_type type);
 
+/** Set up and tear down the cache of resampling plans shared by all resampling calls */
+void dt_interpolation_init(void);
+void dt_interpolation_cleanup(void);
+
 /** Image resampler.
  *
  * Resamples the image "in" to "out" according to roi values. Here is the
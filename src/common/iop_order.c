@@ -1528,9 +1528,9 @@ int dt_ioppr_convert_onthefly(const int imgid)
             this->num, this->operation, this->multi_priority, this->old_iop_order, this->new_iop_order);
   }
 
-  // Now write history
+  // Now write history. a savepoint, this may run within the transaction of a history paste or style apply
 
-  sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+  sqlite3_exec(dt_database_get(darktable.db), "SAVEPOINT iop_order_convert", NULL, NULL, NULL);
   for (int i=0; i<history_size; i++)
   {
     struct dt_onthefly_history_t *this = &myhistory[i];
@@ -1553,7 +1553,7 @@ int dt_ioppr_convert_onthefly(const int imgid)
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
 
-  sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+  sqlite3_exec(dt_database_get(darktable.db), "RELEASE SAVEPOINT iop_order_convert", NULL, NULL, NULL);
 
   free(myhistory);
 
@@ -18,6 +18,7 @@
 
 #include "common/darktable.h"
 #include "common/locallaplacian.h"
+#include "develop/pixelpipe_hb.h"
 
 #include <string.h>
 #include <stdint.h>
@@ -575,6 +576,12 @@ void apply_curve(
   for(int j=h-padding;j<h;j++) memcpy(out + w*j, out+w*(h-padding-1), sizeof(float)*w);
 }
 
+// true if the pipe we are rendering for doesn't need the result any more
+static inline int ll_cancelled(local_laplacian_boundary_t *b)
+{
+  return b && b->piece && dt_dev_pixelpipe_piece_cancelled(b->piece);
+}
+
 void local_laplacian_internal(
     const float *const input,   // input buffer in some Labx or yuvx format
     float *const out,           // output buffer with colour
@@ -640,8 +647,10 @@ void local_laplacian_internal(
   // the paper says remapping only level 3 not 0 does the trick, too
   // (but i really like the additional octave of sharpness we get,
   // willing to pay the cost).
+  int cancelled = 0;
   for(int k=0;k<num_gamma;k++)
   { // process images
+    if((cancelled = ll_cancelled(b))) goto cleanup;
 #if defined(__SSE2__)
     if(use_sse2)
       apply_curve_sse2(buf[k][0], padded[0], w, h, max_supp, gamma[k], sigma, shadows, highlights, clarity);
@@ -751,6 +760,7 @@ void local_laplacian_internal(
   for(int l=last_level-1;l >= 0; l--)
   {
     const int pw = dl(w,l), ph = dl(h,l);
+    if((cancelled = ll_cancelled(b))) goto cleanup;
 
     gauss_expand(output[l+1], output[l], pw, ph);
     // go through all coefficients in the upsampled gauss buffer:
@@ -791,7 +801,8 @@ void local_laplacian_internal(
     out[4*(j*wd+i)+1] = input[4*(j*wd+i)+1]; // copy original colour channels
     out[4*(j*wd+i)+2] = input[4*(j*wd+i)+2];
   }
-  if(b && b->mode == 1)
+cleanup:
+  if(b && b->mode == 1 && !cancelled)
   { // output the buffers for later re-use
     b->pad0 = padded[0];
     b->wd = wd;
@@ -802,10 +813,11 @@ void local_laplacian_internal(
     for(int l=0;l<num_levels;l++) b->output[l] = output[l];
   }
   // free all buffers except the ones passed out for preview rendering
+  const int keep = b && b->mode == 1 && !cancelled;
   for(int l=0;l<max_levels;l++)
   {
-    if(!b || b->mode != 1 || l)   dt_free_align(padded[l]);
-    if(!b || b->mode != 1)        dt_free_align(output[l]);
+    if(!keep || l)                dt_free_align(padded[l]);
+    if(!keep)                     dt_free_align(output[l]);
     for(int k=0; k<num_gamma;k++) dt_free_align(buf[k][l]);
   }
 #undef num_levels
@@ -34,6 +34,7 @@ typedef struct local_laplacian_boundary_t
   const dt_iop_roi_t *buf; // dimensions of full buffer
   float *output[30];       // output pyramid of preview pass (allocated via dt_alloc_align)
   int num_levels;          // number of levels in preview output pyramid
+  struct dt_dev_pixelpipe_iop_t *piece; // polled for cancellation between pyramid levels (can be 0)
 }
 local_laplacian_boundary_t;
 
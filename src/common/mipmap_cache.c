@@ -26,6 +26,7 @@
 #include "common/imageio.h"
 #include "common/imageio_jpeg.h"
 #include "common/imageio_module.h"
+#include "common/mipmap_pack.h"
 #include "control/conf.h"
 #include "control/jobs.h"
 #include "develop/imageop_math.h"
@@ -242,6 +243,41 @@ exit:
   return r;
 }
 
+// the pack file of this level, if they are used and it could be opened. also returns packs left
+// over from when they were switched on, so thumbnails removed meanwhile don't come back later.
+static dt_mipmap_pack_t *_get_pack(dt_mipmap_cache_t *cache, const dt_mipmap_size_t mip, const gboolean existing)
+{
+  if(!cache->cachedir[0] || mip >= DT_MIPMAP_F || (!cache->use_pack && !existing)) return NULL;
+
+  dt_pthread_mutex_lock(&cache->pack_mutex);
+  if(!cache->pack[mip] && !cache->pack_failed[mip])
+  {
+    char filename[PATH_MAX] = { 0 };
+    snprintf(filename, sizeof(filename), "%s.d/%d.pack", cache->cachedir, mip);
+    if(cache->use_pack || g_file_test(filename, G_FILE_TEST_EXISTS))
+    {
+      char dirname[PATH_MAX] = { 0 };
+      snprintf(dirname, sizeof(dirname), "%s.d", cache->cachedir);
+      if(!g_mkdir_with_parents(dirname, 0750)) cache->pack[mip] = dt_mipmap_pack_open(filename);
+      // don't try again with every thumbnail, the files are used instead
+      cache->pack_failed[mip] = !cache->pack[mip];
+    }
+  }
+  dt_mipmap_pack_t *pack = cache->pack[mip];
+  dt_pthread_mutex_unlock(&cache->pack_mutex);
+  return pack;
+}
+
+static gboolean _ondisk_exists(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip)
+{
+  dt_mipmap_pack_t *pack = _get_pack(cache, mip, FALSE);
+  if(pack) return dt_mipmap_pack_contains(pack, imgid, NULL);
+
+  char filename[PATH_MAX] = { 0 };
+  snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", cache->cachedir, mip, imgid);
+  return g_file_test(filename, G_FILE_TEST_EXISTS);
+}
+
 static void _init_f(dt_mipmap_buffer_t *mipmap_buf, float *buf, uint32_t *width, uint32_t *height, float *iscale,
                     const uint32_t imgid);
 static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *iscale,
@@ -374,8 +410,37 @@ void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
   int loaded_from_disk = 0;
   if(mip < DT_MIPMAP_F)
   {
+    dt_mipmap_pack_t *pack = NULL;
     if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
-                              || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8)))
+                              || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8))
+       && (pack = _get_pack(cache, mip, FALSE)))
+    {
+      // straight from the mapped pack file
+      const uint32_t imgid = get_imgid(entry->key);
+      dt_mipmap_pack_blob_t blob;
+      if(dt_mipmap_pack_read(pack, imgid, &blob))
+      {
+        dt_imageio_jpeg_t jpg;
+        if(dt_imageio_jpeg_decompress_header(blob.data, blob.size, &jpg)
+           || (jpg.width > cache->max_width[mip] || jpg.height > cache->max_height[mip])
+           || dt_imageio_jpeg_decompress(&jpg, entry->data + sizeof(*dsc)))
+        {
+          fprintf(stderr, "[mipmap_cache] failed to decompress thumbnail for image %d from pack %d!\n", imgid, mip);
+          dt_mipmap_pack_remove(pack, imgid);
+        }
+        else
+        {
+          dsc->width = jpg.width;
+          dsc->height = jpg.height;
+          dsc->iscale = 1.0f;
+          dsc->color_space = blob.color_space;
+          loaded_from_disk = 1;
+        }
+        dt_mipmap_pack_blob_release(&blob);
+      }
+    }
+    else if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
+                                   || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8)))
     {
       // try and load from disk, if successful set flag
       char filename[PATH_MAX] = {0};
@@ -444,7 +509,36 @@ static void dt_mipmap_cache_unlink_ondisk_thumbnail(void *data, uint32_t imgid,
     char filename[PATH_MAX] = { 0 };
     snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", cache->cachedir, mip, imgid);
     g_unlink(filename);
+
+    dt_mipmap_pack_t *pack = _get_pack(cache, mip, TRUE);
+    if(pack) dt_mipmap_pack_remove(pack, imgid);
+  }
+}
+
+static void _write_pack(dt_mipmap_cache_t *cache, dt_mipmap_pack_t *pack, const uint32_t imgid,
+                        const struct dt_mipmap_buffer_dsc *dsc, const uint8_t *pixels)
+{
+  // same as for the files, recompressing would only lose quality
+  if(dt_mipmap_pack_contains(pack, imgid, NULL)) return;
+
+  char dirname[PATH_MAX] = { 0 };
+  snprintf(dirname, sizeof(dirname), "%s.d", cache->cachedir);
+  struct statvfs vfsbuf;
+  if(statvfs(dirname, &vfsbuf) || ((vfsbuf.f_frsize * vfsbuf.f_bavail) >> 20) < 100)
+  {
+    fprintf(stderr, "Aborting thumbnail write as there's less than 100 MB free in %s\n", dirname);
+    return;
   }
+
+  // the colorspace goes to the pack record, no need for exif
+  const int cache_quality = dt_conf_get_int("database_cache_quality");
+  const size_t length = (size_t)4 * dsc->width * dsc->height;
+  uint8_t *blob = dt_alloc_align(64, length);
+  if(!blob) return;
+  const int size = dt_imageio_jpeg_compress(pixels, blob, dsc->width, dsc->height,
+                                            MIN(100, MAX(10, cache_quality)));
+  if(size > 1) dt_mipmap_pack_write(pack, imgid, blob, size, dsc->color_space);
+  dt_free_align(blob);
 }
 
 void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
@@ -461,6 +555,12 @@ void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
       {
         dt_mipmap_cache_unlink_ondisk_thumbnail(data, get_imgid(entry->key), mip);
       }
+      else if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
+                                     || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8))
+              && _get_pack(cache, mip, FALSE))
+      {
+        _write_pack(cache, _get_pack(cache, mip, FALSE), get_imgid(entry->key), dsc, entry->data + sizeof(*dsc));
+      }
       else if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
                                      || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8)))
       {
@@ -529,6 +629,10 @@ static uint32_t nearest_power_of_two(const uint32_t value)
 void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
 {
   dt_mipmap_cache_get_filename(cache->cachedir, sizeof(cache->cachedir));
+  cache->use_pack = dt_conf_get_bool("cache_disk_backend_pack");
+  memset(cache->pack, 0, sizeof(cache->pack));
+  memset(cache->pack_failed, 0, sizeof(cache->pack_failed));
+  dt_pthread_mutex_init(&cache->pack_mutex, NULL);
   // make sure static memory is initialized
   struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)dt_mipmap_cache_static_dead_image;
   dead_image_f((dt_mipmap_buffer_t *)(dsc + 1));
@@ -611,6 +715,14 @@ void dt_mipmap_cache_cleanup(dt_mipmap_cache_t *cache)
   dt_cache_cleanup(&cache->mip_thumbs.cache);
   dt_cache_cleanup(&cache->mip_full.cache);
   dt_cache_cleanup(&cache->mip_f.cache);
+
+  // after the caches, they write their thumbnails to the packs
+  for(int k = 0; k < DT_MIPMAP_F; k++)
+  {
+    dt_mipmap_pack_close(cache->pack[k]);
+    cache->pack[k] = NULL;
+  }
+  dt_pthread_mutex_destroy(&cache->pack_mutex);
 }
 
 void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
@@ -660,12 +772,22 @@ void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
   printf("\n\n");
 }
 
+static gint _signal_mipmap_updated_pending = 0;
+
 static gboolean _raise_signal_mipmap_updated(gpointer user_data)
 {
+  g_atomic_int_set(&_signal_mipmap_updated_pending, 0);
   dt_control_signal_raise(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED);
   return FALSE; // only call once
 }
 
+void dt_mipmap_cache_signal_updated()
+{
+  // a burst of thumbnails finishing together only needs one redraw
+  if(g_atomic_int_compare_and_exchange(&_signal_mipmap_updated_pending, 0, 1))
+    g_idle_add(_raise_signal_mipmap_updated, 0);
+}
+
 static dt_mipmap_cache_one_t *_get_cache(dt_mipmap_cache_t *cache, const dt_mipmap_size_t mip)
 {
   switch(mip)
@@ -727,7 +849,13 @@ void dt_mipmap_cache_get_with_caller(
     // and opposite: prefetch without locking
     if(mip > DT_MIPMAP_FULL || (int)mip < DT_MIPMAP_0)
       return; // remove the (int) once we no longer have to support gcc < 4.8 :/
-    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, dt_image_load_job_create(imgid, mip));
+    dt_thumbnail_jobs_request(imgid, mip, DT_THUMBNAIL_PRIORITY_PREFETCH, FALSE);
+  }
+  else if(flags == DT_MIPMAP_PREFETCH_WINDOW)
+  {
+    if(mip > DT_MIPMAP_FULL || (int)mip < DT_MIPMAP_0)
+      return; // remove the (int) once we no longer have to support gcc < 4.8 :/
+    dt_thumbnail_jobs_request(imgid, mip, DT_THUMBNAIL_PRIORITY_PREFETCH, TRUE);
   }
   else if(flags == DT_MIPMAP_PREFETCH_DISK)
   {
@@ -735,13 +863,11 @@ void dt_mipmap_cache_get_with_caller(
     if(!cache->cachedir[0]) return;
     if(mip > DT_MIPMAP_FULL || (int)mip < DT_MIPMAP_0)
       return; // remove the (int) once we no longer have to support gcc < 4.8 :/
-    char filename[PATH_MAX] = {0};
-    snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", cache->cachedir, mip, key);
     // don't attempt to load if disk cache doesn't exist
-    if(!g_file_test(filename, G_FILE_TEST_EXISTS)) return;
-    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, dt_image_load_job_create(imgid, mip));
+    if(!_ondisk_exists(cache, imgid, mip)) return;
+    dt_thumbnail_jobs_request(imgid, mip, DT_THUMBNAIL_PRIORITY_PREFETCH, FALSE);
   }
-  else if(flags == DT_MIPMAP_BLOCKING)
+  else if(flags == DT_MIPMAP_BLOCKING || flags == DT_MIPMAP_BLOCKING_QUIET)
   {
     // simple case: blocking get
     dt_cache_entry_t *entry =  dt_cache_get_with_caller(&_get_cache(cache, mip)->cache, key, mode, file, line);
@@ -854,10 +980,10 @@ void dt_mipmap_cache_get_with_caller(
     }
 #endif
 
-    if(mipmap_generated)
+    if(mipmap_generated && flags != DT_MIPMAP_BLOCKING_QUIET)
     {
       /* raise signal that mipmaps has been flushed to cache */
-      g_idle_add(_raise_signal_mipmap_updated, 0);
+      dt_mipmap_cache_signal_updated();
     }
 
     buf->width = dsc->width;
@@ -885,46 +1011,52 @@ void dt_mipmap_cache_get_with_caller(
   {
     __sync_fetch_and_add(&(_get_cache(cache, mip)->stats_requests), 1);
     // best-effort, might also return NULL.
-    // never decrease mip level for float buffer or full image:
-    dt_mipmap_size_t min_mip = (mip >= DT_MIPMAP_F) ? mip : DT_MIPMAP_0;
-    for(int k = mip; k >= min_mip && k >= 0; k--)
+    // progressive: whatever level is closest to the requested one serves as a stand-in right away, the
+    // caller scales it. the requested size is queued and DT_SIGNAL_DEVELOP_MIPMAP_UPDATED tells once it's in.
+    dt_mipmap_cache_get(cache, buf, imgid, mip, DT_MIPMAP_TESTLOCK, 'r');
+    if(buf->buf && buf->width > 0 && buf->height > 0) return;
+
+    __sync_fetch_and_add(&(_get_cache(cache, mip)->stats_near_match), 1);
+    dt_thumbnail_jobs_request(imgid, mip, DT_THUMBNAIL_PRIORITY_VISIBLE, FALSE);
+
+    // never decrease mip level for float buffer or full image, larger ones only up to the thumbnails
+    // (these will be slightly slower due to cairo rescaling, so smaller ones win a tie):
+    const dt_mipmap_size_t min_mip = (mip >= DT_MIPMAP_F) ? mip : DT_MIPMAP_0;
+    const dt_mipmap_size_t max_mip = (mip >= DT_MIPMAP_F) ? mip : DT_MIPMAP_F - 1;
+    for(int d = 1; (int)mip - d >= (int)min_mip || (int)mip + d <= (int)max_mip; d++)
     {
-      // already loaded?
-      dt_mipmap_cache_get(cache, buf, imgid, k, DT_MIPMAP_TESTLOCK, 'r');
-      if(buf->buf && buf->width > 0 && buf->height > 0)
-      {
-        if(mip != k) __sync_fetch_and_add(&(_get_cache(cache, mip)->stats_standin), 1);
-        return;
-      }
-      // didn't succeed the first time? prefetch for later!
-      if(mip == k)
+      const int nearest[2] = { (int)mip - d, (int)mip + d };
+      for(int n = 0; n < 2; n++)
       {
-        __sync_fetch_and_add(&(_get_cache(cache, mip)->stats_near_match), 1);
-        dt_mipmap_cache_get(cache, buf, imgid, mip, DT_MIPMAP_PREFETCH, 'r');
+        const int k = nearest[n];
+        if(k < (int)min_mip || k > (int)max_mip) continue;
+        // already loaded?
+        dt_mipmap_cache_get(cache, buf, imgid, k, DT_MIPMAP_TESTLOCK, 'r');
+        if(buf->buf && buf->width > 0 && buf->height > 0)
+        {
+          __sync_fetch_and_add(&(_get_cache(cache, mip)->stats_standin), 1);
+          return;
+        }
       }
     }
-    // couldn't find a smaller thumb, try larger ones only now (these will be slightly slower due to cairo rescaling):
-    dt_mipmap_size_t max_mip = (mip >= DT_MIPMAP_F) ? mip : DT_MIPMAP_F-1;
-    for(int k = mip+1; k <= max_mip; k++)
+    __sync_fetch_and_add(&(_get_cache(cache, mip)->stats_misses), 1);
+    // nothing in memory. unless the requested size is in the disk cache anyway, have the nearest
+    // thumbnail from there stand in, it's quick to load. requested last it's served first.
+    if(cache->cachedir[0] && mip < DT_MIPMAP_F && !_ondisk_exists(cache, imgid, mip))
     {
-      // already loaded?
-      dt_mipmap_cache_get(cache, buf, imgid, k, DT_MIPMAP_TESTLOCK, 'r');
-      if(buf->buf && buf->width > 0 && buf->height > 0)
+      gboolean found = FALSE;
+      for(int d = 1; !found && d < DT_MIPMAP_F; d++)
       {
-        __sync_fetch_and_add(&(_get_cache(cache, mip)->stats_standin), 1);
-        return;
+        const int nearest[2] = { (int)mip - d, (int)mip + d };
+        for(int n = 0; n < 2 && !found; n++)
+        {
+          const int k = nearest[n];
+          if(k < DT_MIPMAP_0 || k >= DT_MIPMAP_F) continue;
+          if((found = _ondisk_exists(cache, imgid, k)))
+            dt_thumbnail_jobs_request(imgid, k, DT_THUMBNAIL_PRIORITY_VISIBLE, FALSE);
+        }
       }
     }
-    __sync_fetch_and_add(&(_get_cache(cache, mip)->stats_misses), 1);
-    // in case we don't even have a disk cache for our requested thumbnail,
-    // prefetch at least mip0, in case we have that in the disk caches:
-    if(cache->cachedir[0])
-    {
-      char filename[PATH_MAX] = {0};
-      snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", cache->cachedir, mip, key);
-      if(g_file_test(filename, G_FILE_TEST_EXISTS))
-        dt_mipmap_cache_get(cache, 0, imgid, DT_MIPMAP_0, DT_MIPMAP_PREFETCH_DISK, 0);
-    }
     // nothing found :(
     buf->buf = NULL;
     buf->imgid = 0;
@@ -1296,12 +1428,24 @@ dt_colorspaces_color_profile_type_t dt_mipmap_cache_get_colorspace()
   return DT_COLORSPACE_DISPLAY;
 }
 
-void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid)
+void dt_mipmap_cache_copy_thumbnails(dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid)
 {
   if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend"))
   {
     for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
     {
+      dt_mipmap_pack_t *pack = cache->use_pack ? _get_pack(cache, mip, FALSE) : NULL;
+      dt_mipmap_pack_blob_t blob;
+      if(pack)
+      {
+        if(dt_mipmap_pack_read(pack, src_imgid, &blob))
+        {
+          dt_mipmap_pack_write(pack, dst_imgid, blob.data, blob.size, blob.color_space);
+          dt_mipmap_pack_blob_release(&blob);
+        }
+        continue;
+      }
+
       // try and load from disk, if successful set flag
       char srcpath[PATH_MAX] = {0};
       char dstpath[PATH_MAX] = {0};
@@ -1319,6 +1463,38 @@ void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint3
   }
 }
 
+int64_t dt_mipmap_cache_get_ondisk_timestamp(dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                             const dt_mipmap_size_t mip)
+{
+  if(!cache->cachedir[0] || mip >= DT_MIPMAP_F) return -1;
+
+  int64_t timestamp = -1;
+  dt_mipmap_pack_t *pack = _get_pack(cache, mip, FALSE);
+  if(pack)
+  {
+    if(!dt_mipmap_pack_contains(pack, imgid, &timestamp)) timestamp = -1;
+    return timestamp;
+  }
+
+  char filename[PATH_MAX] = { 0 };
+  snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", cache->cachedir, mip, imgid);
+  GStatBuf st;
+  if(!g_stat(filename, &st)) timestamp = st.st_mtime;
+  return timestamp;
+}
+
+gboolean dt_mipmap_cache_contains(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip)
+{
+  if(mip > DT_MIPMAP_FULL || (int)mip < DT_MIPMAP_0) return FALSE;
+  return dt_cache_contains(&_get_cache(cache, mip)->cache, get_key(imgid, mip)) ? TRUE : FALSE;
+}
+
+size_t dt_mipmap_cache_get_quota(dt_mipmap_cache_t *cache, const dt_mipmap_size_t mip)
+{
+  if(mip > DT_MIPMAP_FULL || (int)mip < DT_MIPMAP_0) return 0;
+  return _get_cache(cache, mip)->cache.cost_quota;
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -56,7 +56,15 @@ typedef enum dt_mipmap_get_flags_t
   DT_MIPMAP_BLOCKING = 3,
   // don't actually acquire the lock if it is not
   // in cache (i.e. would have to be loaded first)
-  DT_MIPMAP_TESTLOCK = 4
+  DT_MIPMAP_TESTLOCK = 4,
+  // like prefetching, but the request is dropped if the image
+  // left the prefetch window before it got its turn.
+  // see dt_thumbnail_jobs_set_window().
+  DT_MIPMAP_PREFETCH_WINDOW = 5,
+  // blocking, but don't raise DT_SIGNAL_DEVELOP_MIPMAP_UPDATED
+  // when the buffer had to be generated. for the thumbnail queue
+  // which knows better when anybody is waiting for it.
+  DT_MIPMAP_BLOCKING_QUIET = 6
 } dt_mipmap_get_flags_t;
 
 // struct to be alloc'ed by the client, filled by dt_mipmap_cache_get()
@@ -99,6 +107,13 @@ typedef struct dt_mipmap_cache_t
   dt_mipmap_cache_one_t mip_f;
   dt_mipmap_cache_one_t mip_full;
   char cachedir[PATH_MAX]; // cached sha1sum filename for faster access
+
+  // thumbnails on disk go to one pack file per level instead of one jpeg each,
+  // see common/mipmap_pack.h. opened on first use.
+  gboolean use_pack;
+  struct dt_mipmap_pack_t *pack[DT_MIPMAP_F];
+  gboolean pack_failed[DT_MIPMAP_F];
+  dt_pthread_mutex_t pack_mutex;
 } dt_mipmap_cache_t;
 
 // dynamic memory allocation interface for imageio backend: a write locked
@@ -134,6 +149,9 @@ void dt_mipmap_cache_write_get_with_caller(
     const char *file,
     int line);
 
+// have DT_SIGNAL_DEVELOP_MIPMAP_UPDATED raised from the gui thread, once for a burst of calls
+void dt_mipmap_cache_signal_updated();
+
 // drop a lock
 #define dt_mipmap_cache_release(A, B) dt_mipmap_cache_release_with_caller(A, B, __FILE__, __LINE__)
 void dt_mipmap_cache_release_with_caller(dt_mipmap_cache_t *cache, dt_mipmap_buffer_t *buf, const char *file,
@@ -162,7 +180,17 @@ dt_colorspaces_color_profile_type_t dt_mipmap_cache_get_colorspace();
 
 // copy over thumbnails. used by file operation that copies raw files, to speed up thumbnail generation.
 // only copies over the jpg backend on disk, doesn't directly affect the in-memory cache.
-void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid);
+void dt_mipmap_cache_copy_thumbnails(dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid);
+
+// when the thumbnail of this size was written to the disk cache, seconds since epoch. -1 if it isn't there.
+int64_t dt_mipmap_cache_get_ondisk_timestamp(dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                             const dt_mipmap_size_t mip);
+
+// whether mip of imgid is held (or being filled) in the memory cache right now
+gboolean dt_mipmap_cache_contains(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip);
+
+// the memory cache quota for mip. for DT_MIPMAP_F and DT_MIPMAP_FULL this is a number of buffers, bytes otherwise.
+size_t dt_mipmap_cache_get_quota(dt_mipmap_cache_t *cache, const dt_mipmap_size_t mip);
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -0,0 +1,517 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/mipmap_pack.h"
+#include "common/darktable.h"
+#include "common/dtpthread.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define DT_MIPMAP_PACK_VERSION 1
+#define DT_MIPMAP_PACK_RECORD_MAGIC 0x6b63706du // "mpck"
+// packs with less garbage than this are not worth rewriting
+#define DT_MIPMAP_PACK_MIN_COMPACT (8 << 20)
+
+static const char _pack_magic[8] = "dtmpack";
+static const char _index_magic[8] = "dtmpidx";
+
+typedef struct dt_mipmap_pack_header_t
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t unused;
+  uint64_t generation; // new with every rewrite of the pack, ties the index to it
+} dt_mipmap_pack_header_t;
+
+typedef struct dt_mipmap_pack_record_t
+{
+  uint32_t magic;
+  uint32_t imgid;
+  uint32_t size; // of the payload following the record, 0 removes the image
+  uint32_t color_space;
+  int64_t timestamp;
+  uint32_t checksum; // over the fields above and the payload
+  uint32_t unused;
+} dt_mipmap_pack_record_t;
+
+// where to find the current thumbnail of an image. written as is to the index file.
+typedef struct dt_mipmap_pack_entry_t
+{
+  uint32_t imgid;
+  uint32_t size;
+  uint32_t color_space;
+  uint32_t unused;
+  uint64_t offset; // of the payload
+  int64_t timestamp;
+} dt_mipmap_pack_entry_t;
+
+typedef struct dt_mipmap_pack_index_header_t
+{
+  char magic[8];
+  uint64_t generation;
+  uint64_t end; // length of the pack when the index was written
+  uint64_t count;
+} dt_mipmap_pack_index_header_t;
+
+struct dt_mipmap_pack_t
+{
+  dt_pthread_mutex_t lock;
+  char *filename;
+  FILE *f; // opened for appending
+  uint64_t generation;
+  uint64_t end;  // length of the pack
+  uint64_t live; // bytes of it still in use
+  GHashTable *entries; // imgid -> dt_mipmap_pack_entry_t
+  GMappedFile *map;
+  gboolean dirty;  // index on disk is behind
+  gboolean failed; // a write went wrong, don't try again
+};
+
+static inline uint64_t _record_size(const uint32_t size)
+{
+  // keep records 8 byte aligned
+  return sizeof(dt_mipmap_pack_record_t) + (((uint64_t)size + 7) & ~(uint64_t)7);
+}
+
+// fnv-1a, only needs to tell torn writes apart
+static uint32_t _checksum(const dt_mipmap_pack_record_t *record, const uint8_t *data)
+{
+  dt_mipmap_pack_record_t r = *record;
+  r.checksum = 0;
+  uint32_t hash = 2166136261u;
+  const uint8_t *p = (const uint8_t *)&r;
+  for(size_t k = 0; k < sizeof(r); k++) hash = (hash ^ p[k]) * 16777619u;
+  for(size_t k = 0; k < record->size; k++) hash = (hash ^ data[k]) * 16777619u;
+  return hash;
+}
+
+static uint64_t _new_generation()
+{
+  return ((uint64_t)g_random_int() << 32) | g_random_int();
+}
+
+static int _sync(FILE *f)
+{
+  if(fflush(f)) return 1;
+#ifdef _WIN32
+  return _commit(_fileno(f));
+#else
+  return fsync(fileno(f));
+#endif
+}
+
+static int _truncate(FILE *f, const uint64_t size)
+{
+#ifdef _WIN32
+  return _chsize_s(_fileno(f), size);
+#else
+  return ftruncate(fileno(f), size);
+#endif
+}
+
+// makes the record the current state of its image
+static void _apply(dt_mipmap_pack_t *pack, const dt_mipmap_pack_record_t *record, const uint64_t offset)
+{
+  const dt_mipmap_pack_entry_t *old = g_hash_table_lookup(pack->entries, GUINT_TO_POINTER(record->imgid));
+  if(old) pack->live -= _record_size(old->size);
+
+  if(!record->size)
+  {
+    g_hash_table_remove(pack->entries, GUINT_TO_POINTER(record->imgid));
+    return;
+  }
+
+  dt_mipmap_pack_entry_t *entry = g_malloc0(sizeof(dt_mipmap_pack_entry_t));
+  entry->imgid = record->imgid;
+  entry->size = record->size;
+  entry->color_space = record->color_space;
+  entry->offset = offset;
+  entry->timestamp = record->timestamp;
+  g_hash_table_insert(pack->entries, GUINT_TO_POINTER(record->imgid), entry);
+  pack->live += _record_size(record->size);
+}
+
+// loads what the index knows, returns where the records it hasn't seen start
+static uint64_t _read_index(dt_mipmap_pack_t *pack, const uint64_t length)
+{
+  gchar *filename = g_strdup_printf("%s.idx", pack->filename);
+  gchar *contents = NULL;
+  gsize size = 0;
+  uint64_t start = sizeof(dt_mipmap_pack_header_t);
+
+  if(g_file_get_contents(filename, &contents, &size, NULL) && size >= sizeof(dt_mipmap_pack_index_header_t))
+  {
+    const dt_mipmap_pack_index_header_t *header = (dt_mipmap_pack_index_header_t *)contents;
+    const dt_mipmap_pack_entry_t *entries = (dt_mipmap_pack_entry_t *)(header + 1);
+    if(!memcmp(header->magic, _index_magic, sizeof(_index_magic)) && header->generation == pack->generation
+       && header->end <= length && header->end >= start
+       && size == sizeof(*header) + header->count * sizeof(dt_mipmap_pack_entry_t))
+    {
+      for(uint64_t k = 0; k < header->count; k++)
+      {
+        if(entries[k].offset < start + sizeof(dt_mipmap_pack_record_t)
+           || entries[k].offset + entries[k].size > header->end)
+          continue;
+        dt_mipmap_pack_entry_t *entry = g_memdup(entries + k, sizeof(dt_mipmap_pack_entry_t));
+        g_hash_table_insert(pack->entries, GUINT_TO_POINTER(entry->imgid), entry);
+        pack->live += _record_size(entry->size);
+      }
+      start = header->end;
+    }
+  }
+
+  g_free(contents);
+  g_free(filename);
+  return start;
+}
+
+static int _write_index(dt_mipmap_pack_t *pack)
+{
+  gchar *filename = g_strdup_printf("%s.idx", pack->filename);
+  gchar *tmp = g_strdup_printf("%s.idx.tmp", pack->filename);
+  int error = 1;
+
+  // the index may only point at data that made it to the disk
+  FILE *f = NULL;
+  if(!_sync(pack->f) && (f = g_fopen(tmp, "wb")))
+  {
+    dt_mipmap_pack_index_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, _index_magic, sizeof(_index_magic));
+    header.generation = pack->generation;
+    header.end = pack->end;
+    header.count = g_hash_table_size(pack->entries);
+    error = fwrite(&header, sizeof(header), 1, f) != 1;
+
+    GHashTableIter it;
+    gpointer value;
+    g_hash_table_iter_init(&it, pack->entries);
+    while(!error && g_hash_table_iter_next(&it, NULL, &value))
+      error = fwrite(value, sizeof(dt_mipmap_pack_entry_t), 1, f) != 1;
+
+    error |= _sync(f);
+    fclose(f);
+    if(!error) error = g_rename(tmp, filename) != 0;
+    if(error) g_unlink(tmp);
+  }
+  if(!error) pack->dirty = FALSE;
+
+  g_free(tmp);
+  g_free(filename);
+  return error;
+}
+
+static int _write_header(FILE *f, const uint64_t generation)
+{
+  dt_mipmap_pack_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, _pack_magic, sizeof(_pack_magic));
+  header.version = DT_MIPMAP_PACK_VERSION;
+  header.generation = generation;
+  return fwrite(&header, sizeof(header), 1, f) != 1;
+}
+
+dt_mipmap_pack_t *dt_mipmap_pack_open(const char *filename)
+{
+  dt_mipmap_pack_t *pack = g_malloc0(sizeof(dt_mipmap_pack_t));
+  dt_pthread_mutex_init(&pack->lock, NULL);
+  pack->filename = g_strdup(filename);
+  pack->entries = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+
+  // left over by a compaction that didn't finish
+  gchar *tmp = g_strdup_printf("%s.tmp", filename);
+  g_unlink(tmp);
+  g_free(tmp);
+
+  const double start = dt_get_wtime();
+  uint64_t length = 0;
+  if(g_file_test(filename, G_FILE_TEST_EXISTS))
+  {
+    pack->map = g_mapped_file_new(filename, FALSE, NULL);
+    if(!pack->map)
+    {
+      fprintf(stderr, "[mipmap_pack] can't map `%s'\n", filename);
+      dt_mipmap_pack_close(pack);
+      return NULL;
+    }
+    length = g_mapped_file_get_length(pack->map);
+  }
+
+  const uint8_t *contents = pack->map ? (const uint8_t *)g_mapped_file_get_contents(pack->map) : NULL;
+  const dt_mipmap_pack_header_t *header = (const dt_mipmap_pack_header_t *)contents;
+  if(length >= sizeof(dt_mipmap_pack_header_t) && !memcmp(header->magic, _pack_magic, sizeof(_pack_magic))
+     && header->version == DT_MIPMAP_PACK_VERSION)
+  {
+    pack->generation = header->generation;
+    uint64_t offset = _read_index(pack, length);
+    const uint64_t indexed = offset;
+
+    // replay whatever was appended after the index was written
+    while(offset + sizeof(dt_mipmap_pack_record_t) <= length)
+    {
+      dt_mipmap_pack_record_t record;
+      memcpy(&record, contents + offset, sizeof(record));
+      if(record.magic != DT_MIPMAP_PACK_RECORD_MAGIC || offset + _record_size(record.size) > length
+         || _checksum(&record, contents + offset + sizeof(record)) != record.checksum)
+        break;
+      _apply(pack, &record, offset + sizeof(record));
+      offset += _record_size(record.size);
+    }
+    pack->end = offset;
+    pack->dirty = offset != indexed;
+
+    if((pack->f = g_fopen(filename, "ab")) && pack->end < length)
+    {
+      // a torn record at the end, don't leave it in the way of the next one
+      dt_print(DT_DEBUG_CACHE, "[mipmap_pack] dropping %" PRIu64 " bytes of incomplete records from `%s'\n",
+               length - pack->end, filename);
+      g_mapped_file_unref(pack->map);
+      pack->map = NULL;
+      if(_truncate(pack->f, pack->end)) pack->failed = TRUE;
+    }
+  }
+  else
+  {
+    // no pack yet, or one we don't understand
+    if(pack->map) g_mapped_file_unref(pack->map);
+    pack->map = NULL;
+    pack->generation = _new_generation();
+    pack->end = sizeof(dt_mipmap_pack_header_t);
+    pack->dirty = TRUE;
+    FILE *f = g_fopen(filename, "wb");
+    if(f)
+    {
+      const int error = _write_header(f, pack->generation);
+      fclose(f);
+      if(!error) pack->f = g_fopen(filename, "ab");
+    }
+  }
+
+  if(!pack->f)
+  {
+    fprintf(stderr, "[mipmap_pack] can't open `%s' for writing\n", filename);
+    dt_mipmap_pack_close(pack);
+    return NULL;
+  }
+
+  dt_print(DT_DEBUG_CACHE | DT_DEBUG_PERF, "[mipmap_pack] opened `%s', %u thumbnails in %.3f s\n", filename,
+           g_hash_table_size(pack->entries), dt_get_wtime() - start);
+  return pack;
+}
+
+static gint _sort_by_imgid(gconstpointer a, gconstpointer b)
+{
+  const uint32_t ia = ((const dt_mipmap_pack_entry_t *)a)->imgid;
+  const uint32_t ib = ((const dt_mipmap_pack_entry_t *)b)->imgid;
+  return (ia > ib) - (ia < ib);
+}
+
+static int _compact(dt_mipmap_pack_t *pack)
+{
+  if(pack->failed) return 1;
+  if(fflush(pack->f)) return 1;
+
+  // the old records are read from a mapping of the full pack
+  if(pack->map && g_mapped_file_get_length(pack->map) < pack->end)
+  {
+    g_mapped_file_unref(pack->map);
+    pack->map = NULL;
+  }
+  if(!pack->map) pack->map = g_mapped_file_new(pack->filename, FALSE, NULL);
+  if(!pack->map) return 1;
+  const uint8_t *contents = (const uint8_t *)g_mapped_file_get_contents(pack->map);
+
+  const double start = dt_get_wtime();
+  const uint64_t old_end = pack->end;
+  gchar *tmp = g_strdup_printf("%s.tmp", pack->filename);
+  FILE *f = g_fopen(tmp, "wb");
+  if(!f)
+  {
+    g_free(tmp);
+    return 1;
+  }
+
+  // in image id order, thumbnails of a film roll end up close to each other
+  GList *entries = g_list_sort(g_hash_table_get_values(pack->entries), _sort_by_imgid);
+  const uint64_t generation = _new_generation();
+  int error = _write_header(f, generation);
+  uint64_t offset = sizeof(dt_mipmap_pack_header_t);
+  for(const GList *l = entries; l && !error; l = g_list_next(l))
+  {
+    const dt_mipmap_pack_entry_t *entry = (dt_mipmap_pack_entry_t *)l->data;
+    const uint64_t size = _record_size(entry->size);
+    error = fwrite(contents + entry->offset - sizeof(dt_mipmap_pack_record_t), size, 1, f) != 1;
+    offset += size;
+  }
+  error |= _sync(f);
+  fclose(f);
+
+  g_mapped_file_unref(pack->map);
+  pack->map = NULL;
+  fclose(pack->f);
+  if(!error) error = g_rename(tmp, pack->filename) != 0;
+  if(error) g_unlink(tmp);
+  g_free(tmp);
+
+  pack->f = g_fopen(pack->filename, "ab");
+  if(!pack->f) pack->failed = TRUE;
+
+  if(!error)
+  {
+    // same order as above
+    uint64_t position = sizeof(dt_mipmap_pack_header_t);
+    for(GList *l = entries; l; l = g_list_next(l))
+    {
+      dt_mipmap_pack_entry_t *entry = (dt_mipmap_pack_entry_t *)l->data;
+      entry->offset = position + sizeof(dt_mipmap_pack_record_t);
+      position += _record_size(entry->size);
+    }
+    pack->generation = generation;
+    pack->end = offset;
+    pack->dirty = TRUE;
+    dt_print(DT_DEBUG_CACHE | DT_DEBUG_PERF,
+             "[mipmap_pack] compacted `%s' from %" PRIu64 " to %" PRIu64 " bytes in %.3f s\n", pack->filename,
+             old_end, offset, dt_get_wtime() - start);
+  }
+  g_list_free(entries);
+  return error;
+}
+
+int dt_mipmap_pack_compact(dt_mipmap_pack_t *pack)
+{
+  dt_pthread_mutex_lock(&pack->lock);
+  const int error = _compact(pack);
+  dt_pthread_mutex_unlock(&pack->lock);
+  return error;
+}
+
+void dt_mipmap_pack_close(dt_mipmap_pack_t *pack)
+{
+  if(!pack) return;
+
+  if(pack->f && !pack->failed)
+  {
+    const uint64_t garbage = pack->end - sizeof(dt_mipmap_pack_header_t) - pack->live;
+    if(garbage > pack->live && garbage >= DT_MIPMAP_PACK_MIN_COMPACT) _compact(pack);
+    if(pack->dirty && !pack->failed) _write_index(pack);
+  }
+
+  if(pack->f) fclose(pack->f);
+  if(pack->map) g_mapped_file_unref(pack->map);
+  g_hash_table_destroy(pack->entries);
+  dt_pthread_mutex_destroy(&pack->lock);
+  g_free(pack->filename);
+  g_free(pack);
+}
+
+gboolean dt_mipmap_pack_contains(dt_mipmap_pack_t *pack, const uint32_t imgid, int64_t *timestamp)
+{
+  dt_pthread_mutex_lock(&pack->lock);
+  const dt_mipmap_pack_entry_t *entry = g_hash_table_lookup(pack->entries, GUINT_TO_POINTER(imgid));
+  if(entry && timestamp) *timestamp = entry->timestamp;
+  dt_pthread_mutex_unlock(&pack->lock);
+  return entry != NULL;
+}
+
+gboolean dt_mipmap_pack_read(dt_mipmap_pack_t *pack, const uint32_t imgid, dt_mipmap_pack_blob_t *blob)
+{
+  memset(blob, 0, sizeof(dt_mipmap_pack_blob_t));
+
+  dt_pthread_mutex_lock(&pack->lock);
+  const dt_mipmap_pack_entry_t *entry = g_hash_table_lookup(pack->entries, GUINT_TO_POINTER(imgid));
+  if(entry && (!pack->map || g_mapped_file_get_length(pack->map) < entry->offset + entry->size))
+  {
+    // the pack grew since it was mapped. readers still holding the old mapping keep it alive.
+    if(pack->map) g_mapped_file_unref(pack->map);
+    pack->map = g_mapped_file_new(pack->filename, FALSE, NULL);
+  }
+  if(entry && pack->map && g_mapped_file_get_length(pack->map) >= entry->offset + entry->size)
+  {
+    blob->map = g_mapped_file_ref(pack->map);
+    blob->data = (const uint8_t *)g_mapped_file_get_contents(pack->map) + entry->offset;
+    blob->size = entry->size;
+    blob->color_space = entry->color_space;
+    blob->timestamp = entry->timestamp;
+  }
+  dt_pthread_mutex_unlock(&pack->lock);
+  return blob->map != NULL;
+}
+
+void dt_mipmap_pack_blob_release(dt_mipmap_pack_blob_t *blob)
+{
+  if(blob->map) g_mapped_file_unref(blob->map);
+  memset(blob, 0, sizeof(dt_mipmap_pack_blob_t));
+}
+
+static int _append(dt_mipmap_pack_t *pack, const uint32_t imgid, const uint8_t *data, const size_t size,
+                   const uint32_t color_space)
+{
+  dt_mipmap_pack_record_t record = { 0 };
+  record.magic = DT_MIPMAP_PACK_RECORD_MAGIC;
+  record.imgid = imgid;
+  record.size = size;
+  record.color_space = color_space;
+  record.timestamp = time(NULL);
+  record.checksum = _checksum(&record, data);
+
+  static const uint8_t zeros[8] = { 0 };
+  const size_t padding = _record_size(size) - sizeof(record) - size;
+  if(pack->failed || fwrite(&record, sizeof(record), 1, pack->f) != 1
+     || (size && fwrite(data, size, 1, pack->f) != 1) || (padding && fwrite(zeros, padding, 1, pack->f) != 1)
+     || fflush(pack->f))
+  {
+    // whatever made it to the file is cut off when the pack is opened next time
+    if(!pack->failed) fprintf(stderr, "[mipmap_pack] failed to write to `%s'\n", pack->filename);
+    pack->failed = TRUE;
+    return 1;
+  }
+
+  _apply(pack, &record, pack->end + sizeof(record));
+  pack->end += _record_size(size);
+  pack->dirty = TRUE;
+  return 0;
+}
+
+int dt_mipmap_pack_write(dt_mipmap_pack_t *pack, const uint32_t imgid, const uint8_t *data, const size_t size,
+                         const uint32_t color_space)
+{
+  if(!size || size > UINT32_MAX) return 1;
+  dt_pthread_mutex_lock(&pack->lock);
+  const int error = _append(pack, imgid, data, size, color_space);
+  dt_pthread_mutex_unlock(&pack->lock);
+  return error;
+}
+
+void dt_mipmap_pack_remove(dt_mipmap_pack_t *pack, const uint32_t imgid)
+{
+  dt_pthread_mutex_lock(&pack->lock);
+  if(g_hash_table_contains(pack->entries, GUINT_TO_POINTER(imgid))) _append(pack, imgid, NULL, 0, 0);
+  dt_pthread_mutex_unlock(&pack->lock);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
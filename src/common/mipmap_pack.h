@@ -0,0 +1,76 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+// packed on-disk store for one mip level of the thumbnail cache. instead of one
+// jpeg file per image all thumbnails of a level are appended to a single file:
+//
+//   header | record | record | ...
+//
+// every record carries the image id, the payload size and a checksum, a record with
+// an empty payload removes the image. the newest record of an image wins. the file
+// is only ever appended to, so a crash can only leave a torn record at the end, which
+// is cut off the next time the pack is opened.
+//
+// the location of every image is kept in memory. on close it is also written next to
+// the pack (<pack>.idx), so opening only has to look at records appended since then.
+// reads point straight into a memory mapping of the pack.
+//
+// once more than half of the file is superseded records, closing the pack rewrites it
+// with only the live ones (compaction).
+
+typedef struct dt_mipmap_pack_t dt_mipmap_pack_t;
+
+// a thumbnail as stored in the pack. data stays valid until dt_mipmap_pack_blob_release().
+typedef struct dt_mipmap_pack_blob_t
+{
+  const uint8_t *data;
+  size_t size;
+  uint32_t color_space; // dt_colorspaces_color_profile_type_t
+  int64_t timestamp;    // seconds since epoch the record was written
+
+  GMappedFile *map;
+} dt_mipmap_pack_blob_t;
+
+// opens (and creates) the pack file. returns NULL if it can't be written.
+dt_mipmap_pack_t *dt_mipmap_pack_open(const char *filename);
+// writes the index and compacts the pack if it's worth it.
+void dt_mipmap_pack_close(dt_mipmap_pack_t *pack);
+
+// TRUE if the pack has a thumbnail for this image. timestamp can be NULL.
+gboolean dt_mipmap_pack_contains(dt_mipmap_pack_t *pack, const uint32_t imgid, int64_t *timestamp);
+// zero copy read of the thumbnail, returns FALSE if there is none.
+gboolean dt_mipmap_pack_read(dt_mipmap_pack_t *pack, const uint32_t imgid, dt_mipmap_pack_blob_t *blob);
+void dt_mipmap_pack_blob_release(dt_mipmap_pack_blob_t *blob);
+// stores the thumbnail, replacing any older one. returns 0 on success.
+int dt_mipmap_pack_write(dt_mipmap_pack_t *pack, const uint32_t imgid, const uint8_t *data, const size_t size,
+                         const uint32_t color_space);
+// forgets the thumbnail of this image.
+void dt_mipmap_pack_remove(dt_mipmap_pack_t *pack, const uint32_t imgid);
+
+// rewrites the pack with the live records only. returns 0 on success.
+int dt_mipmap_pack_compact(dt_mipmap_pack_t *pack);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
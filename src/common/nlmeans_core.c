@@ -0,0 +1,251 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/nlmeans_core.h"
+#include "common/darktable.h"
+#include "develop/pixelpipe_hb.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// tile size: input and output rows of a tile plus the patch margins stay in the L2 cache while all offsets
+// are processed
+#define NLMEANS_TILE_WIDTH 128
+#define NLMEANS_TILE_HEIGHT 64
+
+typedef union floatint_t
+{
+  float f;
+  uint32_t i;
+} floatint_t;
+
+// very fast approximation for 2^-x (returns 0 for x > 126)
+static inline float fast_mexp2f(const float x)
+{
+  const float i1 = (float)0x3f800000u; // 2^0
+  const float i2 = (float)0x3f000000u; // 2^-1
+  const float k0 = i1 + x * (i2 - i1);
+  floatint_t k;
+  k.i = k0 >= (float)0x800000u ? k0 : 0;
+  return k.f;
+}
+
+static int sign(int a)
+{
+  return (a > 0) - (a < 0);
+}
+
+// the offsets to compare patches with. scattering is made for:
+// - ensuring that kj = kj_index and ki = ki_index when scattering is 0
+// - ensuring that no patch can appear twice (provided that scattering is in 0,1 range)
+// - avoiding grid artifacts by trying to take patches on various lines and columns
+static int _offsets(const dt_nlmeans_param_t *const params, int *const offsets)
+{
+  const int K = params->search_radius;
+  const float scale = params->scale;
+  const float scattering = params->scattering;
+  int n = 0;
+  for(int kj_index = -K; kj_index <= K; kj_index++)
+    for(int ki_index = -K; ki_index <= K; ki_index++)
+    {
+      const int abs_kj = abs(kj_index);
+      const int abs_ki = abs(ki_index);
+      offsets[2 * n + 0]
+          = scale * ((abs_ki * abs_ki * abs_ki + 7.0 * abs_ki * sqrt(abs_kj)) * sign(ki_index) * scattering / 6.0
+                     + ki_index);
+      offsets[2 * n + 1]
+          = scale * ((abs_kj * abs_kj * abs_kj + 7.0 * abs_kj * sqrt(abs_ki)) * sign(kj_index) * scattering / 6.0
+                     + kj_index);
+      n++;
+    }
+  return n;
+}
+
+// S[x] += factor * weighted squared difference between a and b, for n pixels
+__DT_CLONE_TARGETS__
+static void _add_distance(float *const restrict S, const float *const restrict a, const float *const restrict b,
+                          const int n, const float norm[3], const float factor)
+{
+#ifdef _OPENMP
+#pragma omp simd aligned(a, b : 16)
+#endif
+  for(int x = 0; x < n; x++)
+  {
+    const float d0 = a[4 * x + 0] - b[4 * x + 0];
+    const float d1 = a[4 * x + 1] - b[4 * x + 1];
+    const float d2 = a[4 * x + 2] - b[4 * x + 2];
+    S[x] += factor * (norm[0] * d0 * d0 + norm[1] * d1 * d1 + norm[2] * d2 * d2);
+  }
+}
+
+// out += weight * in_shifted for n pixels, weights from the patch dissimilarities D
+__DT_CLONE_TARGETS__
+static void _accumulate(float *const restrict out, const float *const restrict in,
+                        const float *const restrict in_shifted, const float *const restrict D, const int n,
+                        const dt_nlmeans_param_t *const params, const float center_scale)
+{
+  const float sharpness = params->sharpness;
+  const float bias = params->bias;
+  const float cw = params->center_weight;
+  const float n0 = params->norm[0], n1 = params->norm[1], n2 = params->norm[2];
+
+#ifdef _OPENMP
+#pragma omp simd aligned(out, in, in_shifted : 16)
+#endif
+  for(int x = 0; x < n; x++)
+  {
+    float dissimilarity = D[x];
+    if(cw != 0.0f)
+    {
+      // multiply the center contribution to be able to have a general setting that does not depend on
+      // patch size
+      const float d0 = in[4 * x + 0] - in_shifted[4 * x + 0];
+      const float d1 = in[4 * x + 1] - in_shifted[4 * x + 1];
+      const float d2 = in[4 * x + 2] - in_shifted[4 * x + 2];
+      const float center = (n0 * d0 * d0 + n1 * d1 * d1 + n2 * d2 * d2) * center_scale;
+      dissimilarity = (dissimilarity + center * cw) / (1.0f + cw);
+    }
+    const float w = fast_mexp2f(fmaxf(0.0f, dissimilarity * sharpness - bias));
+    out[4 * x + 0] += w * in_shifted[4 * x + 0];
+    out[4 * x + 1] += w * in_shifted[4 * x + 1];
+    out[4 * x + 2] += w * in_shifted[4 * x + 2];
+    out[4 * x + 3] += w;
+  }
+}
+
+static void _denoise_tile(const float *const in, float *const out, const int width, const int height,
+                          const int x0, const int y0, const int x1, const int y1, const int *const offsets,
+                          const int num_offsets, const dt_nlmeans_param_t *const params, float *const S,
+                          float *const D)
+{
+  const int P = params->patch_radius;
+  const float center_scale = (2 * P + 1) * (2 * P + 1);
+
+  for(int y = y0; y < y1; y++) memset(out + 4 * ((size_t)width * y + x0), 0, sizeof(float) * 4 * (x1 - x0));
+
+  for(int o = 0; o < num_offsets; o++)
+  {
+    const int ki = offsets[2 * o + 0];
+    const int kj = offsets[2 * o + 1];
+
+    // pixels of the tile whose shifted center is inside the image
+    const int xa = MAX(x0, -ki), xb = MIN(x1, width - ki);
+    const int ya = MAX(y0, -kj), yb = MIN(y1, height - kj);
+    if(xa >= xb || ya >= yb) continue;
+
+    // S holds the column sums of the distances over the patch rows, for columns xa - P .. xb + P.
+    // pixels outside the image (or shifted outside) don't contribute.
+    const int sx0 = xa - P;
+    const int dx0 = MAX(sx0, MAX(0, -ki));
+    const int dx1 = MIN(xb + P, MIN(width, width - ki));
+    const int n = dx1 - dx0;
+    memset(S, 0, sizeof(float) * (xb - xa + 2 * P + 2));
+
+#define ROW_VALID(r) ((r) >= 0 && (r) < height && (r) + kj >= 0 && (r) + kj < height)
+#define ROW(r) (in + 4 * ((size_t)width * (r) + dx0))
+#define ROW_SHIFTED(r) (in + 4 * ((size_t)width * ((r) + kj) + dx0 + ki))
+
+    for(int r = ya - P; r <= ya + P; r++)
+      if(ROW_VALID(r) && n > 0) _add_distance(S + dx0 - sx0, ROW(r), ROW_SHIFTED(r), n, params->norm, 1.0f);
+
+    for(int y = ya; y < yb; y++)
+    {
+      // patch sums by sliding along the row
+      float slide = 0.0f;
+      for(int i = 0; i < 2 * P + 1; i++) slide += S[i];
+      for(int i = 0; i < xb - xa; i++)
+      {
+        D[i] = slide;
+        slide += S[i + 2 * P + 1] - S[i];
+      }
+
+      _accumulate(out + 4 * ((size_t)width * y + xa), in + 4 * ((size_t)width * y + xa),
+                  in + 4 * ((size_t)width * (y + kj) + xa + ki), D, xb - xa, params, center_scale);
+
+      // move the patch rows down by one
+      if(y + 1 < yb && n > 0)
+      {
+        if(ROW_VALID(y + P + 1))
+          _add_distance(S + dx0 - sx0, ROW(y + P + 1), ROW_SHIFTED(y + P + 1), n, params->norm, 1.0f);
+        if(ROW_VALID(y - P))
+          _add_distance(S + dx0 - sx0, ROW(y - P), ROW_SHIFTED(y - P), n, params->norm, -1.0f);
+      }
+    }
+
+#undef ROW_VALID
+#undef ROW
+#undef ROW_SHIFTED
+  }
+
+  // normalize
+  for(int y = y0; y < y1; y++)
+  {
+    float *const o = out + 4 * ((size_t)width * y + x0);
+    for(int x = 0; x < x1 - x0; x++)
+    {
+      const float w = o[4 * x + 3];
+      if(w > 0.0f)
+        for(int c = 0; c < 3; c++) o[4 * x + c] /= w;
+      o[4 * x + 3] = 1.0f;
+    }
+  }
+}
+
+void dt_nlmeans_denoise(const float *const in, float *const out, const int width, const int height,
+                        const dt_nlmeans_param_t *const params)
+{
+  const int K = params->search_radius;
+  const int P = params->patch_radius;
+  int *const offsets = malloc(sizeof(int) * 2 * (2 * K + 1) * (2 * K + 1));
+  const int num_offsets = _offsets(params, offsets);
+
+  // per thread scratch: column sums (one past the last patch for the sliding sum) and patch sums of a tile row
+  const size_t scratch_size = dt_round_size_sse((size_t)2 * (NLMEANS_TILE_WIDTH + 2 * P + 2));
+  float *const scratch = dt_alloc_align(64, sizeof(float) * scratch_size * dt_get_num_threads());
+
+  const int tiles_x = (width + NLMEANS_TILE_WIDTH - 1) / NLMEANS_TILE_WIDTH;
+  const int tiles_y = (height + NLMEANS_TILE_HEIGHT - 1) / NLMEANS_TILE_HEIGHT;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(height, in, num_offsets, offsets, out, params, scratch, scratch_size, tiles_x, tiles_y, \
+                      width) \
+  schedule(dynamic)
+#endif
+  for(int t = 0; t < tiles_x * tiles_y; t++)
+  {
+    // a tile takes a few milliseconds, skip the remaining ones once nobody waits for the result
+    if(params->piece && dt_dev_pixelpipe_piece_cancelled(params->piece)) continue;
+
+    const int x0 = (t % tiles_x) * NLMEANS_TILE_WIDTH;
+    const int y0 = (t / tiles_x) * NLMEANS_TILE_HEIGHT;
+    const int x1 = MIN(x0 + NLMEANS_TILE_WIDTH, width);
+    const int y1 = MIN(y0 + NLMEANS_TILE_HEIGHT, height);
+    float *const S = scratch + scratch_size * dt_get_thread_num();
+    float *const D = S + scratch_size / 2;
+    _denoise_tile(in, out, width, height, x0, y0, x1, y1, offsets, num_offsets, params, S, D);
+  }
+
+  dt_free_align(scratch);
+  free(offsets);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
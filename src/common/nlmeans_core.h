@@ -0,0 +1,52 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+struct dt_dev_pixelpipe_iop_t;
+
+/*
+ * Non-local means on 4 channel float buffers, shared by the nlmeans and denoiseprofile modules.
+ *
+ * Every pixel becomes the weighted mean of the pixels at a set of offsets around it, weighted by the
+ * similarity of the patches around both. The image is processed in small tiles: for a tile all offsets
+ * are done while its rows are still in the cpu cache, instead of streaming the whole image once per
+ * offset.
+ */
+
+typedef struct dt_nlmeans_param_t
+{
+  int patch_radius;    // patches are (2 * patch_radius + 1)^2 pixels
+  int search_radius;   // offsets range over [-search_radius, search_radius]^2 before scattering
+  float scattering;    // spreads the outer offsets further away, 0 for a plain grid
+  float scale;         // zoom factor applied to the offsets, 1 for a plain grid
+  float sharpness;     // weight = 2^-max(0, sharpness * dissimilarity - bias)
+  float bias;
+  float center_weight; // extra weight of the center pixel in the dissimilarity, 0 for none
+  float norm[3];       // per channel weights of the squared differences
+  struct dt_dev_pixelpipe_iop_t *piece; // polled for cancellation between tiles, may be NULL
+} dt_nlmeans_param_t;
+
+/** denoise width x height pixels of in into out, which must not overlap. out gets the normalized weighted
+ * means in the color channels and 1 in the fourth one. */
+void dt_nlmeans_denoise(const float *const in, float *const out, const int width, const int height,
+                        const dt_nlmeans_param_t *const params);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -32,6 +32,7 @@
 #include "common/locallaplaciancl.h"
 #include "common/nvidia_gpus.h"
 #include "common/opencl_drivers_blacklist.h"
+#include "common/startup.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "develop/blend.h"
@@ -594,6 +595,7 @@ void dt_opencl_init(dt_opencl_t *cl, const gboolean exclude_opencl, const gboole
   dt_print(DT_DEBUG_OPENCL, "[opencl_init] opencl_micro_nap: %d\n", dt_conf_get_int("opencl_micro_nap"));
   dt_print(DT_DEBUG_OPENCL, "[opencl_init] opencl_use_pinned_memory: %d\n",
            dt_conf_get_bool("opencl_use_pinned_memory"));
+  dt_print(DT_DEBUG_OPENCL, "[opencl_init] opencl_async_tiling: %d\n", dt_conf_get_bool("opencl_async_tiling"));
   dt_print(DT_DEBUG_OPENCL, "[opencl_init] opencl_use_cpu_devices: %d\n",
            dt_conf_get_bool("opencl_use_cpu_devices"));
 
@@ -763,6 +765,7 @@ finally:
       // store new checksum value in config
       dt_conf_set_string("opencl_checksum", checksum);
       // do CPU bencharking
+      dt_startup_begin("opencl benchmark");
       float tcpu = dt_opencl_benchmark_cpu(1024, 1024, 5, 100.0f);
       // get best benchmarking value of all detected OpenCL devices
       float tgpumin = INFINITY;
@@ -771,6 +774,7 @@ finally:
         float tgpu = cl->dev[n].benchmark = dt_opencl_benchmark_gpu(n, 1024, 1024, 5, 100.0f);
         tgpumin = fmin(tgpu, tgpumin);
       }
+      dt_startup_end();
       dt_print(DT_DEBUG_OPENCL, "[opencl_init] benchmarking results: %f seconds for fastest GPU versus %f seconds for CPU.\n",
            tgpumin, tcpu);
 
@@ -1127,6 +1131,38 @@ int dt_opencl_enqueue_barrier(const int devid)
   return (cl->dlocl->symbols->dt_clEnqueueBarrier)(cl->dev[devid].cmd_queue);
 }
 
+cl_event dt_opencl_enqueue_marker(const int devid)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || devid < 0) return NULL;
+  cl_event event = NULL;
+  const cl_int err = (cl->dlocl->symbols->dt_clEnqueueMarker)(cl->dev[devid].cmd_queue, &event);
+  if(err != CL_SUCCESS)
+  {
+    dt_print(DT_DEBUG_OPENCL, "[opencl_enqueue_marker] could not enqueue marker: %d\n", err);
+    return NULL;
+  }
+  return event;
+}
+
+int dt_opencl_flush(const int devid)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || devid < 0) return -1;
+  return (cl->dlocl->symbols->dt_clFlush)(cl->dev[devid].cmd_queue);
+}
+
+int dt_opencl_wait_and_release_event(const int devid, cl_event event)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || devid < 0 || event == NULL) return FALSE;
+  const cl_int err = (cl->dlocl->symbols->dt_clWaitForEvents)(1, &event);
+  (cl->dlocl->symbols->dt_clReleaseEvent)(event);
+  if(err != CL_SUCCESS)
+    dt_print(DT_DEBUG_OPENCL, "[opencl_wait_and_release_event] waiting for event failed: %d\n", err);
+  return err == CL_SUCCESS;
+}
+
 static int _take_from_list(int *list, int value)
 {
   int result = -1;
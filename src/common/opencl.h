@@ -217,6 +217,16 @@ int dt_opencl_finish(const int devid);
 /** enqueues a synchronization point. */
 int dt_opencl_enqueue_barrier(const int devid);
 
+/** enqueues a marker. the returned event completes once everything enqueued before it has finished,
+ * NULL on failure. */
+cl_event dt_opencl_enqueue_marker(const int devid);
+
+/** submits everything enqueued so far to the device without waiting for it. */
+int dt_opencl_flush(const int devid);
+
+/** waits for an event from dt_opencl_enqueue_marker() and releases it. TRUE if all went fine. */
+int dt_opencl_wait_and_release_event(const int devid, cl_event event);
+
 /** locks a device for your thread's exclusive use */
 int dt_opencl_lock_device(const int pipetype);
 
@@ -0,0 +1,189 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/startup.h"
+#include "common/darktable.h"
+#include "common/file_location.h"
+
+#define DT_STARTUP_MAX_PHASES 64
+#define DT_STARTUP_MAX_DEPTH 8
+
+typedef struct dt_startup_phase_t
+{
+  const char *name;
+  int parent; // index of the enclosing phase, -1 for top level ones
+  double wall[2], cpu[2];
+  int64_t rss[2]; // in kB
+} dt_startup_phase_t;
+
+static struct
+{
+  dt_startup_phase_t phase[DT_STARTUP_MAX_PHASES];
+  int num_phases;
+  int open[DT_STARTUP_MAX_DEPTH];
+  int depth;
+  gboolean reported;
+} _startup = { .num_phases = 0, .depth = 0, .reported = FALSE };
+
+static double _startup_cpu_time()
+{
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * (1.0 / 1000000.0) + ru.ru_stime.tv_sec
+         + ru.ru_stime.tv_usec * (1.0 / 1000000.0);
+}
+
+static int64_t _startup_rss()
+{
+#if defined(__linux__)
+  long pages = 0, resident = 0;
+  FILE *f = g_fopen("/proc/self/statm", "r");
+  if(!f) return 0;
+  if(fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+  fclose(f);
+  return (int64_t)resident * sysconf(_SC_PAGESIZE) / 1024;
+#elif defined(__APPLE__)
+  struct task_basic_info t_info;
+  mach_msg_type_number_t t_info_count = TASK_BASIC_INFO_COUNT;
+  if(KERN_SUCCESS != task_info(mach_task_self(), TASK_BASIC_INFO, (task_info_t)&t_info, &t_info_count))
+    return 0;
+  return (int64_t)t_info.resident_size / 1024;
+#elif defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS_EX pmc;
+  GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS *)&pmc, sizeof(pmc));
+  return (int64_t)pmc.WorkingSetSize / 1024;
+#else
+  return 0;
+#endif
+}
+
+void dt_startup_begin(const char *name)
+{
+  if(_startup.reported) return;
+  if(_startup.num_phases >= DT_STARTUP_MAX_PHASES || _startup.depth >= DT_STARTUP_MAX_DEPTH)
+  {
+    // keep begin/end balanced, the phase just doesn't show up
+    _startup.depth++;
+    return;
+  }
+
+  dt_startup_phase_t *p = _startup.phase + _startup.num_phases;
+  p->name = name;
+  p->parent = _startup.depth ? _startup.open[_startup.depth - 1] : -1;
+  p->wall[0] = dt_get_wtime();
+  p->cpu[0] = _startup_cpu_time();
+  p->rss[0] = _startup_rss();
+  _startup.open[_startup.depth++] = _startup.num_phases++;
+}
+
+void dt_startup_end()
+{
+  if(_startup.reported || _startup.depth == 0) return;
+  _startup.depth--;
+  if(_startup.depth >= DT_STARTUP_MAX_DEPTH) return;
+
+  dt_startup_phase_t *p = _startup.phase + _startup.open[_startup.depth];
+  p->wall[1] = dt_get_wtime();
+  p->cpu[1] = _startup_cpu_time();
+  p->rss[1] = _startup_rss();
+}
+
+static void _startup_print(const int parent, const int depth)
+{
+  for(int k = 0; k < _startup.num_phases; k++)
+  {
+    const dt_startup_phase_t *p = _startup.phase + k;
+    if(p->parent != parent) continue;
+    dt_print(DT_DEBUG_STARTUP, "[startup] %*s%-*s %8.3f s wall %8.3f s cpu %+9" PRId64 " kB rss\n", 2 * depth, "",
+             32 - 2 * depth, p->name, p->wall[1] - p->wall[0], p->cpu[1] - p->cpu[0], p->rss[1] - p->rss[0]);
+    _startup_print(k, depth + 1);
+  }
+}
+
+static void _startup_json(JsonBuilder *builder, const int parent)
+{
+  json_builder_begin_array(builder);
+  for(int k = 0; k < _startup.num_phases; k++)
+  {
+    const dt_startup_phase_t *p = _startup.phase + k;
+    if(p->parent != parent) continue;
+    json_builder_begin_object(builder);
+    json_builder_set_member_name(builder, "name");
+    json_builder_add_string_value(builder, p->name);
+    json_builder_set_member_name(builder, "start");
+    json_builder_add_double_value(builder, p->wall[0] - _startup.phase[0].wall[0]);
+    json_builder_set_member_name(builder, "wall");
+    json_builder_add_double_value(builder, p->wall[1] - p->wall[0]);
+    json_builder_set_member_name(builder, "cpu");
+    json_builder_add_double_value(builder, p->cpu[1] - p->cpu[0]);
+    json_builder_set_member_name(builder, "rss_kb");
+    json_builder_add_int_value(builder, p->rss[1]);
+    json_builder_set_member_name(builder, "rss_delta_kb");
+    json_builder_add_int_value(builder, p->rss[1] - p->rss[0]);
+    json_builder_set_member_name(builder, "phases");
+    _startup_json(builder, k);
+    json_builder_end_object(builder);
+  }
+  json_builder_end_array(builder);
+}
+
+void dt_startup_report()
+{
+  if(_startup.reported) return;
+  while(_startup.depth) dt_startup_end();
+  _startup.reported = TRUE;
+
+  if(!(darktable.unmuted & DT_DEBUG_STARTUP) || _startup.num_phases == 0) return;
+
+  _startup_print(-1, 0);
+
+  JsonBuilder *builder = json_builder_new();
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "version");
+  json_builder_add_string_value(builder, darktable_package_version);
+  json_builder_set_member_name(builder, "threads");
+  json_builder_add_int_value(builder, dt_get_num_threads());
+  json_builder_set_member_name(builder, "phases");
+  _startup_json(builder, -1);
+  json_builder_end_object(builder);
+
+  char filename[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(filename, sizeof(filename));
+  g_strlcat(filename, "/startup.json", sizeof(filename));
+
+  JsonGenerator *generator = json_generator_new();
+  json_generator_set_pretty(generator, TRUE);
+  JsonNode *root = json_builder_get_root(builder);
+  json_generator_set_root(generator, root);
+  GError *error = NULL;
+  if(json_generator_to_file(generator, filename, &error))
+    dt_print(DT_DEBUG_STARTUP, "[startup] report written to `%s'\n", filename);
+  else
+  {
+    fprintf(stderr, "[startup] can't write `%s': %s\n", filename, error->message);
+    g_error_free(error);
+  }
+
+  json_node_free(root);
+  g_object_unref(generator);
+  g_object_unref(builder);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,44 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+/*
+ * Startup profiling.
+ *
+ * dt_init() is split into named phases which may nest. Each phase records
+ * wall clock time, cpu time (user + system) and the change of the resident
+ * set size. The bookkeeping is cheap and always on, only the report at the
+ * end of dt_init() depends on -d startup: it prints the phase tree and writes
+ * it as json to startup.json in the cache directory, for scripts tracking
+ * startup regressions.
+ *
+ * Only to be called from the thread running dt_init(), everything after the
+ * report is ignored.
+ */
+
+/** opens a phase nested into the currently open one. name has to be a string literal. */
+void dt_startup_begin(const char *name);
+/** closes the innermost open phase. */
+void dt_startup_end();
+/** closes what is still open and reports, with -d startup. */
+void dt_startup_report();
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -486,17 +486,22 @@ void dt_styles_apply_to_selection(const char *name, gboolean duplicate)
 
   /* for each selected image apply style */
   sqlite3_stmt *stmt;
-  dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
+  GList *imgs = NULL;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT imgid FROM main.selected_images",
                               -1, &stmt, NULL);
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
     const int imgid = sqlite3_column_int(stmt, 0);
-    dt_styles_apply_to_image(name, duplicate, imgid);
+    imgs = g_list_prepend(imgs, GINT_TO_POINTER(imgid));
     selected = TRUE;
   }
   sqlite3_finalize(stmt);
+  imgs = g_list_reverse(imgs);
+
+  dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
+  dt_styles_apply_to_list(name, duplicate, imgs);
   dt_undo_end_group(darktable.undo);
+  g_list_free(imgs);
 
   if(!selected) dt_control_log(_("no image selected!"));
 }
@@ -652,125 +657,180 @@ void dt_styles_apply_style_item(dt_develop_t *dev, dt_style_item_t *style_item,
   }
 }
 
-void dt_styles_apply_to_image(const char *name, gboolean duplicate, int32_t imgid)
+// reads all items of style id once, the blobs are owned by the returned items
+static GList *_styles_get_apply_items(const int id)
 {
-  int id = 0;
+  GList *items = NULL;
   sqlite3_stmt *stmt;
-  int32_t newimgid;
-
-  if((id = dt_styles_get_id_by_name(name)) != 0)
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT num, module, operation, op_params, enabled, "
+                              "blendop_params, blendop_version, multi_priority, multi_name, iop_order "
+                              "FROM data.style_items WHERE styleid=?1 "
+                              "ORDER BY num",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
   {
-    /* check if we should make a duplicate before applying style */
-    if(duplicate)
+    dt_style_item_t *item = (dt_style_item_t *)calloc(1, sizeof(dt_style_item_t));
+
+    item->num = sqlite3_column_int(stmt, 0);
+    item->selimg_num = 0;
+    item->enabled = sqlite3_column_int(stmt, 4);
+    item->multi_priority = sqlite3_column_int(stmt, 7);
+    item->name = NULL;
+    item->operation = g_strdup((char *)sqlite3_column_text(stmt, 2));
+    item->multi_name = g_strdup((char *)sqlite3_column_text(stmt, 8));
+    item->module_version = sqlite3_column_int(stmt, 1);
+    item->blendop_version = sqlite3_column_int(stmt, 6);
+    item->params_size = sqlite3_column_bytes(stmt, 3);
+    item->blendop_params_size = sqlite3_column_bytes(stmt, 5);
+    item->iop_order = sqlite3_column_double(stmt, 9);
+
+    // keep NULL blobs NULL, dt_styles_apply_style_item() relies on it
+    if(sqlite3_column_blob(stmt, 3))
     {
-      newimgid = dt_image_duplicate(imgid);
-      if(newimgid != -1) dt_history_copy_and_paste_on_image(imgid, newimgid, FALSE, NULL);
+      item->params = malloc(item->params_size);
+      memcpy(item->params, sqlite3_column_blob(stmt, 3), item->params_size);
+    }
+    if(sqlite3_column_blob(stmt, 5))
+    {
+      item->blendop_params = malloc(item->blendop_params_size);
+      memcpy(item->blendop_params, sqlite3_column_blob(stmt, 5), item->blendop_params_size);
     }
-    else
-      newimgid = imgid;
 
-    // now deal with the history
-    GList *modules_used = NULL;
+    items = g_list_append(items, item);
+  }
+  sqlite3_finalize(stmt);
+  return items;
+}
 
-    dt_develop_t _dev_dest = { 0 };
+// applies the style items to one image using an already loaded module stack
+static void _styles_apply_to_image_ext(dt_develop_t *dev, GList *base, const char *name, GList *items,
+                                       gboolean duplicate, int32_t imgid)
+{
+  int32_t newimgid;
 
-    dt_develop_t *dev_dest = &_dev_dest;
+  /* check if we should make a duplicate before applying style */
+  if(duplicate)
+  {
+    newimgid = dt_image_duplicate(imgid);
+    if(newimgid != -1) dt_history_copy_and_paste_on_image(imgid, newimgid, FALSE, NULL);
+  }
+  else
+    newimgid = imgid;
 
-    dt_dev_init(dev_dest, FALSE);
+  // now deal with the history
+  GList *modules_used = NULL;
 
-    dev_dest->iop = dt_iop_load_modules_ext(dev_dest, TRUE);
+  dt_dev_reset_history_ext(dev, base);
 
-    dt_dev_read_history_ext(dev_dest, newimgid, TRUE);
+  dt_dev_read_history_ext(dev, newimgid, TRUE);
 
-    dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image ");
+  dt_ioppr_check_iop_order(dev, newimgid, "dt_styles_apply_to_image ");
 
-    dt_dev_pop_history_items_ext(dev_dest, dev_dest->history_end);
+  dt_dev_pop_history_items_ext(dev, dev->history_end);
 
-    dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image 1");
+  dt_ioppr_check_iop_order(dev, newimgid, "dt_styles_apply_to_image 1");
 
-    // go through all entries in style
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "SELECT num, module, operation, op_params, enabled, "
-                                "blendop_params, blendop_version, multi_priority, multi_name, iop_order "
-                                "FROM data.style_items WHERE styleid=?1 "
-                                "ORDER BY num",
-                                -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
-    while(sqlite3_step(stmt) == SQLITE_ROW)
-    {
-      dt_style_item_t style_item = { 0 };
-
-      style_item.num = sqlite3_column_int(stmt, 0);
-      style_item.selimg_num = 0;
-      style_item.enabled = sqlite3_column_int(stmt, 4);
-      style_item.multi_priority = sqlite3_column_int(stmt, 7);
-      style_item.name = NULL;
-      style_item.operation = (char *)sqlite3_column_text(stmt, 2);
-      style_item.multi_name = (char *)sqlite3_column_text(stmt, 8);
-      style_item.module_version = sqlite3_column_int(stmt, 1);
-      style_item.blendop_version = sqlite3_column_int(stmt, 6);
-      style_item.params = (void *)sqlite3_column_blob(stmt, 3);
-      style_item.blendop_params = (void *)sqlite3_column_blob(stmt, 5);
-      style_item.params_size = sqlite3_column_bytes(stmt, 3);
-      style_item.blendop_params_size = sqlite3_column_bytes(stmt, 5);
-      style_item.iop_order = sqlite3_column_double(stmt, 9);
-
-      dt_styles_apply_style_item(dev_dest, &style_item, &modules_used, FALSE);
-    }
-    sqlite3_finalize(stmt);
+  // go through all entries in style
+  for(GList *l = items; l; l = g_list_next(l))
+    dt_styles_apply_style_item(dev, (dt_style_item_t *)l->data, &modules_used, FALSE);
 
-    dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image 2");
+  dt_ioppr_check_iop_order(dev, newimgid, "dt_styles_apply_to_image 2");
 
-    dt_undo_lt_history_t *hist = dt_history_snapshot_item_init();
-    hist->imgid = newimgid;
-    dt_history_snapshot_undo_create(hist->imgid, &hist->before, &hist->before_history_end);
+  dt_undo_lt_history_t *hist = dt_history_snapshot_item_init();
+  hist->imgid = newimgid;
+  dt_history_snapshot_undo_create(hist->imgid, &hist->before, &hist->before_history_end);
 
-    // write history and forms to db
-    dt_dev_write_history_ext(dev_dest, newimgid);
+  // write history and forms to db
+  dt_dev_write_history_ext(dev, newimgid);
 
-    dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
-    dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
-    dt_undo_record(darktable.undo, NULL, DT_UNDO_LT_HISTORY, (dt_undo_data_t)hist,
-                   dt_history_snapshot_undo_pop, dt_history_snapshot_undo_lt_history_data_free);
-    dt_undo_end_group(darktable.undo);
+  dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
+  dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
+  dt_undo_record(darktable.undo, NULL, DT_UNDO_LT_HISTORY, (dt_undo_data_t)hist,
+                 dt_history_snapshot_undo_pop, dt_history_snapshot_undo_lt_history_data_free);
+  dt_undo_end_group(darktable.undo);
 
-    dt_dev_cleanup(dev_dest);
+  g_list_free(modules_used);
 
-    g_list_free(modules_used);
+  /* add tag */
+  guint tagid = 0;
+  gchar ntag[512] = { 0 };
+  g_snprintf(ntag, sizeof(ntag), "darktable|style|%s", name);
+  if(dt_tag_new(ntag, &tagid)) dt_tag_attach_from_gui(tagid, newimgid);
+  if(dt_tag_new("darktable|changed", &tagid)) dt_tag_attach_from_gui(tagid, newimgid);
 
-    /* add tag */
-    guint tagid = 0;
-    gchar ntag[512] = { 0 };
-    g_snprintf(ntag, sizeof(ntag), "darktable|style|%s", name);
-    if(dt_tag_new(ntag, &tagid)) dt_tag_attach_from_gui(tagid, newimgid);
-    if(dt_tag_new("darktable|changed", &tagid)) dt_tag_attach_from_gui(tagid, newimgid);
+  /* if current image in develop reload history */
+  if(dt_dev_is_current_image(darktable.develop, newimgid))
+  {
+    dt_dev_reload_history_items(darktable.develop);
+    dt_dev_modulegroups_set(darktable.develop, dt_dev_modulegroups_get(darktable.develop));
+  }
 
-    /* if current image in develop reload history */
-    if(dt_dev_is_current_image(darktable.develop, newimgid))
-    {
-      dt_dev_reload_history_items(darktable.develop);
-      dt_dev_modulegroups_set(darktable.develop, dt_dev_modulegroups_get(darktable.develop));
-    }
+  /* update xmp file */
+  dt_image_synch_xmp(newimgid);
 
-    /* update xmp file */
-    dt_image_synch_xmp(newimgid);
+  /* remove old obsolete thumbnails */
+  dt_mipmap_cache_remove(darktable.mipmap_cache, newimgid);
+  dt_image_reset_final_size(newimgid);
 
-    /* remove old obsolete thumbnails */
-    dt_mipmap_cache_remove(darktable.mipmap_cache, newimgid);
-    dt_image_reset_final_size(newimgid);
+  /* update the aspect ratio. recompute only if really needed for performance reasons */
+  if(darktable.collection->params.sort == DT_COLLECTION_SORT_ASPECT_RATIO)
+    dt_image_set_aspect_ratio(newimgid);
+  else
+    dt_image_reset_aspect_ratio(newimgid);
+}
 
-    /* update the aspect ratio. recompute only if really needed for performance reasons */
-    if(darktable.collection->params.sort == DT_COLLECTION_SORT_ASPECT_RATIO)
-      dt_image_set_aspect_ratio(newimgid);
-    else
-      dt_image_reset_aspect_ratio(newimgid);
+void dt_styles_apply_to_list(const char *name, gboolean duplicate, GList *imgs)
+{
+  const int id = dt_styles_get_id_by_name(name);
+  if(id == 0 || !imgs) return;
+
+  const double start = dt_get_wtime();
+  int count = 0;
+
+  // the style is read once and the module stack is loaded once, it is then
+  // recycled for each image in the list
+  GList *items = _styles_get_apply_items(id);
+
+  dt_develop_t _dev_dest = { 0 };
+  dt_develop_t *dev_dest = &_dev_dest;
+  dt_dev_init(dev_dest, FALSE);
+  dev_dest->iop = dt_iop_load_modules_ext(dev_dest, TRUE);
+  GList *base = g_list_copy(dev_dest->iop);
+
+  // one transaction for the whole list. everything called from here, the undo
+  // snapshots, history reading and iop order conversion, has to nest, i.e. use
+  // savepoints instead of BEGIN/COMMIT. an inner COMMIT would end the batch.
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "BEGIN", NULL, NULL, NULL);
+  for(GList *l = imgs; l; l = g_list_next(l))
+  {
+    _styles_apply_to_image_ext(dev_dest, base, name, items, duplicate, GPOINTER_TO_INT(l->data));
+    count++;
+  }
+  assert(!sqlite3_get_autocommit(dt_database_get(darktable.db)));
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
 
-    /* if we have created a duplicate, reset collected images */
-    if(duplicate) dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED);
+  g_list_free(base);
+  dt_dev_cleanup(dev_dest);
+  g_list_free_full(items, dt_style_item_free);
 
-    /* redraw center view to update visible mipmaps */
-    dt_control_queue_redraw_center();
-  }
+  /* if we have created a duplicate, reset collected images */
+  if(duplicate) dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED);
+
+  /* redraw center view to update visible mipmaps */
+  dt_control_queue_redraw_center();
+
+  const double elapsed = dt_get_wtime() - start;
+  dt_print(DT_DEBUG_PERF, "[styles] applied style `%s' to %d images in %.3f secs (%.1f images/s)\n", name,
+           count, elapsed, elapsed > 0.0 ? count / elapsed : 0.0);
+}
+
+void dt_styles_apply_to_image(const char *name, gboolean duplicate, int32_t imgid)
+{
+  GList *imgs = g_list_append(NULL, GINT_TO_POINTER(imgid));
+  dt_styles_apply_to_list(name, duplicate, imgs);
+  g_list_free(imgs);
 }
 
 void dt_styles_delete_by_name(const char *name)
@@ -76,6 +76,9 @@ void dt_styles_apply_style_item(dt_develop_t *dev, dt_style_item_t *style_item,
 /** applies the style to image by imgid*/
 void dt_styles_apply_to_image(const char *name, gboolean dulpicate, int32_t imgid);
 
+/** applies the style to a list of imgids, the module stack is loaded once and reused for all images */
+void dt_styles_apply_to_list(const char *name, gboolean duplicate, GList *imgs);
+
 /** delete a style by name */
 void dt_styles_delete_by_name(const char *name);
 
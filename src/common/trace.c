@@ -0,0 +1,215 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/trace.h"
+#include "common/file_location.h"
+
+// has to be a power of two
+#define DT_TRACE_EVENTS (1 << 16)
+
+typedef struct dt_trace_slot_t
+{
+  const char *cat, *pipe;
+  char name[32];
+  double start, end;
+  int tid, device, width, height;
+  size_t bytes;
+} dt_trace_slot_t;
+
+static struct
+{
+  dt_trace_slot_t *ring;
+  gint next;   // total number of events recorded so far, wraps around
+  gint tids;   // last handed out thread id
+  double t0;
+} _trace = { NULL, 0, 0, 0.0 };
+
+static __thread int _trace_tid = 0;
+
+void dt_trace_init()
+{
+  if(!dt_trace_enabled() || _trace.ring) return;
+  _trace.ring = calloc(DT_TRACE_EVENTS, sizeof(dt_trace_slot_t));
+  _trace.next = 0;
+  _trace.t0 = dt_get_wtime();
+}
+
+void dt_trace_add(const dt_trace_event_t *event)
+{
+  if(!_trace.ring) return;
+  if(!_trace_tid) _trace_tid = g_atomic_int_add(&_trace.tids, 1) + 1;
+
+  const guint k = (guint)g_atomic_int_add(&_trace.next, 1) & (DT_TRACE_EVENTS - 1);
+  dt_trace_slot_t *slot = _trace.ring + k;
+  slot->cat = event->cat;
+  slot->pipe = event->pipe;
+  g_strlcpy(slot->name, event->name ? event->name : "", sizeof(slot->name));
+  slot->start = event->start;
+  slot->end = event->end;
+  slot->tid = _trace_tid;
+  slot->device = event->device;
+  slot->width = event->width;
+  slot->height = event->height;
+  slot->bytes = event->bytes;
+}
+
+// oldest first. a wrapped ring starts at the slot written next.
+static guint _trace_range(guint *recorded, guint *first)
+{
+  *recorded = (guint)g_atomic_int_get(&_trace.next);
+  *first = *recorded > DT_TRACE_EVENTS ? *recorded & (DT_TRACE_EVENTS - 1) : 0;
+  return MIN(*recorded, DT_TRACE_EVENTS);
+}
+
+gboolean dt_trace_write(const char *filename)
+{
+  if(!_trace.ring) return FALSE;
+
+  guint recorded, first;
+  const guint count = _trace_range(&recorded, &first);
+  const gint64 pid = getpid();
+
+  JsonBuilder *builder = json_builder_new();
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "displayTimeUnit");
+  json_builder_add_string_value(builder, "ms");
+  json_builder_set_member_name(builder, "traceEvents");
+  json_builder_begin_array(builder);
+  for(guint i = 0; i < count; i++)
+  {
+    const dt_trace_slot_t *slot = _trace.ring + ((first + i) & (DT_TRACE_EVENTS - 1));
+    if(!slot->cat) continue;
+    const gboolean instant = slot->end <= slot->start;
+
+    json_builder_begin_object(builder);
+    json_builder_set_member_name(builder, "name");
+    json_builder_add_string_value(builder, slot->name);
+    json_builder_set_member_name(builder, "cat");
+    json_builder_add_string_value(builder, slot->cat);
+    json_builder_set_member_name(builder, "ph");
+    json_builder_add_string_value(builder, instant ? "i" : "X");
+    if(instant)
+    {
+      json_builder_set_member_name(builder, "s");
+      json_builder_add_string_value(builder, "t");
+    }
+    json_builder_set_member_name(builder, "ts");
+    json_builder_add_double_value(builder, (slot->start - _trace.t0) * 1e6);
+    if(!instant)
+    {
+      json_builder_set_member_name(builder, "dur");
+      json_builder_add_double_value(builder, (slot->end - slot->start) * 1e6);
+    }
+    json_builder_set_member_name(builder, "pid");
+    json_builder_add_int_value(builder, pid);
+    json_builder_set_member_name(builder, "tid");
+    json_builder_add_int_value(builder, slot->tid);
+
+    json_builder_set_member_name(builder, "args");
+    json_builder_begin_object(builder);
+    if(slot->pipe)
+    {
+      json_builder_set_member_name(builder, "pipe");
+      json_builder_add_string_value(builder, slot->pipe);
+    }
+    json_builder_set_member_name(builder, "device");
+    json_builder_add_string_value(builder, slot->device < 0 ? "CPU" : "GPU");
+    if(slot->device >= 0)
+    {
+      json_builder_set_member_name(builder, "devid");
+      json_builder_add_int_value(builder, slot->device);
+    }
+    json_builder_set_member_name(builder, "width");
+    json_builder_add_int_value(builder, slot->width);
+    json_builder_set_member_name(builder, "height");
+    json_builder_add_int_value(builder, slot->height);
+    json_builder_set_member_name(builder, "bytes");
+    json_builder_add_int_value(builder, slot->bytes);
+    json_builder_end_object(builder);
+
+    json_builder_end_object(builder);
+  }
+  json_builder_end_array(builder);
+  json_builder_end_object(builder);
+
+  JsonGenerator *generator = json_generator_new();
+  JsonNode *root = json_builder_get_root(builder);
+  json_generator_set_root(generator, root);
+  GError *error = NULL;
+  const gboolean res = json_generator_to_file(generator, filename, &error);
+  if(res)
+    fprintf(stderr, "[trace] %u of %u events written to `%s'\n", count, recorded, filename);
+  else
+  {
+    fprintf(stderr, "[trace] can't write `%s': %s\n", filename, error->message);
+    g_error_free(error);
+  }
+
+  json_node_free(root);
+  g_object_unref(generator);
+  g_object_unref(builder);
+  return res;
+}
+
+void dt_trace_foreach(dt_trace_func_t func, void *user_data)
+{
+  if(!_trace.ring) return;
+
+  guint recorded, first;
+  const guint count = _trace_range(&recorded, &first);
+  for(guint i = 0; i < count; i++)
+  {
+    const dt_trace_slot_t *slot = _trace.ring + ((first + i) & (DT_TRACE_EVENTS - 1));
+    if(!slot->cat) continue;
+    const dt_trace_event_t event = { .cat = slot->cat,
+                                     .name = slot->name,
+                                     .pipe = slot->pipe,
+                                     .start = slot->start,
+                                     .end = slot->end,
+                                     .device = slot->device,
+                                     .width = slot->width,
+                                     .height = slot->height,
+                                     .bytes = slot->bytes };
+    func(&event, user_data);
+  }
+}
+
+void dt_trace_reset()
+{
+  if(!_trace.ring) return;
+  memset(_trace.ring, 0, sizeof(dt_trace_slot_t) * DT_TRACE_EVENTS);
+  g_atomic_int_set(&_trace.next, 0);
+}
+
+void dt_trace_cleanup()
+{
+  if(!_trace.ring) return;
+
+  char filename[PATH_MAX] = { 0 };
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  snprintf(filename, sizeof(filename), "%s/trace-%d.json", cachedir, (int)getpid());
+  dt_trace_write(filename);
+
+  free(_trace.ring);
+  _trace.ring = NULL;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
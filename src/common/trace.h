@@ -0,0 +1,68 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/darktable.h"
+
+/*
+ * Pixelpipe tracing.
+ *
+ * With -d trace the pixelpipe records one event per pipe run, processed
+ * module, cache hit and tile into a fixed size ring buffer. Recording takes
+ * no lock, the oldest events get overwritten once the ring is full. At
+ * shutdown the ring is written as chrome trace event json to
+ * trace-<pid>.json in the cache directory, to be loaded into
+ * chrome://tracing or https://ui.perfetto.dev.
+ */
+
+typedef struct dt_trace_event_t
+{
+  const char *cat;    // "pipe", "module", "cache" or "tile", has to be a string literal
+  const char *name;   // module op or similar, gets copied (and truncated)
+  const char *pipe;   // pipe type as string literal, can be NULL
+  double start, end;  // dt_get_wtime(), start == end gives an instant event
+  int device;         // opencl device, -1 for the cpu
+  int width, height;  // roi of the output
+  size_t bytes;       // buffer memory needed for the event
+} dt_trace_event_t;
+
+/** only collect what goes into an event if this is true. */
+static inline gboolean dt_trace_enabled()
+{
+  return (darktable.unmuted & DT_DEBUG_TRACE) != 0;
+}
+
+/** allocates the ring buffer if tracing has been requested. */
+void dt_trace_init();
+/** writes the trace file and frees the ring buffer. */
+void dt_trace_cleanup();
+/** records an event, cheap and thread safe. */
+void dt_trace_add(const dt_trace_event_t *event);
+/** writes all recorded events as chrome trace event json, returns TRUE on success. */
+gboolean dt_trace_write(const char *filename);
+
+typedef void (*dt_trace_func_t)(const dt_trace_event_t *event, void *user_data);
+/** calls func for all recorded events, oldest first. not to be used while a pipe is running. */
+void dt_trace_foreach(dt_trace_func_t func, void *user_data);
+/** drops all recorded events. not to be used while a pipe is running. */
+void dt_trace_reset();
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -608,6 +608,8 @@ double dt_control_job_get_progress(dt_job_t *job)
 // moved out of control.c to be able to make some helper functions static
 void dt_control_jobs_init(dt_control_t *control)
 {
+  dt_thumbnail_jobs_init();
+
   // start threads
   control->num_threads = CLAMP(dt_conf_get_int("worker_threads"), 1, 8);
   control->thread = (pthread_t *)calloc(control->num_threads, sizeof(pthread_t));
@@ -641,6 +643,7 @@ void dt_control_jobs_init(dt_control_t *control)
 
 void dt_control_jobs_cleanup(dt_control_t *control)
 {
+  dt_thumbnail_jobs_cleanup();
   free(control->job);
   free(control->thread);
 }
@@ -99,6 +99,7 @@ int32_t dt_control_get_threadid();
 #include "control/jobs/develop_jobs.h"
 #include "control/jobs/film_jobs.h"
 #include "control/jobs/image_jobs.h"
+#include "control/jobs/thumbnail_jobs.h"
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
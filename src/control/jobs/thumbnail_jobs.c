@@ -0,0 +1,301 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "control/jobs/thumbnail_jobs.h"
+#include "common/darktable.h"
+#include "common/image_cache.h"
+#include "control/control.h"
+#include "control/jobs.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// visible requests nobody asked for again within this many seconds are served like prefetches:
+// the view moved on and doesn't show them any more.
+#define DT_THUMBNAIL_VISIBLE_TIMEOUT 1.0
+// beyond this the least important queued requests are dropped
+#define DT_THUMBNAIL_MAX_REQUESTS 256
+
+typedef struct dt_thumbnail_request_t
+{
+  uint64_t key; // imgid << 8 | mip
+  uint32_t imgid;
+  dt_mipmap_size_t mip;
+  dt_thumbnail_priority_t priority;
+  gboolean windowed;
+  gboolean running;
+  double queued;    // first asked for
+  double requested; // last asked for
+} dt_thumbnail_request_t;
+
+typedef struct dt_thumbnail_stats_t
+{
+  int requests, merged, boosted, cancelled, dropped, loaded;
+  int max_depth;
+  double wait; // summed up time the loaded requests spent in the queue
+} dt_thumbnail_stats_t;
+
+typedef struct dt_thumbnail_queue_t
+{
+  dt_pthread_mutex_t lock;
+  GHashTable *requests; // key -> dt_thumbnail_request_t, queued and running ones
+  GHashTable *window;   // imgids windowed requests are still wanted for
+  int queued;           // requests waiting for a pump
+  int pumps;            // our jobs in the control queue
+  uint32_t serial;      // unique pump names, so the control queue doesn't merge them
+  dt_thumbnail_stats_t stats;
+} dt_thumbnail_queue_t;
+
+static dt_thumbnail_queue_t _queue = { 0 };
+
+static inline dt_thumbnail_priority_t _priority(const dt_thumbnail_request_t *r, const double now)
+{
+  if(r->priority == DT_THUMBNAIL_PRIORITY_VISIBLE && now - r->requested > DT_THUMBNAIL_VISIBLE_TIMEOUT)
+    return DT_THUMBNAIL_PRIORITY_PREFETCH;
+  return r->priority;
+}
+
+// should a be served before b? the most recent request first within a priority, like the
+// DT_JOB_QUEUE_SYSTEM_FG stack used to do.
+static inline gboolean _before(const dt_thumbnail_request_t *a, const dt_thumbnail_request_t *b, const double now)
+{
+  const dt_thumbnail_priority_t pa = _priority(a, now), pb = _priority(b, now);
+  if(pa != pb) return pa > pb;
+  return a->requested > b->requested;
+}
+
+// the next (best == TRUE) or least important (best == FALSE) queued request. needs the lock.
+static dt_thumbnail_request_t *_find(const gboolean best, const double now)
+{
+  dt_thumbnail_request_t *found = NULL;
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init(&iter, _queue.requests);
+  while(g_hash_table_iter_next(&iter, NULL, &value))
+  {
+    dt_thumbnail_request_t *r = (dt_thumbnail_request_t *)value;
+    if(r->running) continue;
+    if(!found || (best ? _before(r, found, now) : _before(found, r, now))) found = r;
+  }
+  return found;
+}
+
+// needs the lock
+static void _report_if_drained()
+{
+  if(g_hash_table_size(_queue.requests) > 0) return;
+  const dt_thumbnail_stats_t *s = &_queue.stats;
+  if(s->requests)
+    dt_print(DT_DEBUG_PERF,
+             "[thumbnail queue] drained: %d requests, %d loaded, %d merged, %d boosted, %d cancelled, "
+             "%d dropped, max depth %d, mean wait %.3f secs\n",
+             s->requests, s->loaded, s->merged, s->boosted, s->cancelled, s->dropped, s->max_depth,
+             s->loaded ? s->wait / s->loaded : 0.0);
+  memset(&_queue.stats, 0, sizeof(_queue.stats));
+}
+
+static void _load(const uint32_t imgid, const dt_mipmap_size_t mip, const dt_mipmap_get_flags_t flags)
+{
+  // hook back into mipmap_cache:
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, mip, flags, 'r');
+
+  // drop read lock, as this is only speculative async loading.
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+
+  if(buf.buf && buf.height && buf.width)
+  {
+    const double aspect_ratio = (double)buf.width / (double)buf.height;
+    dt_image_set_aspect_ratio_to(imgid, aspect_ratio);
+  }
+}
+
+static void _spawn_pumps(const int finishing);
+
+static int32_t _pump_run(dt_job_t *job)
+{
+  const double now = dt_get_wtime();
+
+  dt_pthread_mutex_lock(&_queue.lock);
+  dt_thumbnail_request_t *r = _find(TRUE, now);
+  if(!r)
+  {
+    dt_pthread_mutex_unlock(&_queue.lock);
+    return 0;
+  }
+  r->running = TRUE;
+  _queue.queued--;
+  _queue.stats.wait += now - r->queued;
+  const uint64_t key = r->key;
+  const uint32_t imgid = r->imgid;
+  const dt_mipmap_size_t mip = r->mip;
+  dt_pthread_mutex_unlock(&_queue.lock);
+
+  // only tell the views if they are waiting for this one, prefetches are picked up when they get there
+  _load(imgid, mip, DT_MIPMAP_BLOCKING_QUIET);
+
+  dt_pthread_mutex_lock(&_queue.lock);
+  r = (dt_thumbnail_request_t *)g_hash_table_lookup(_queue.requests, &key);
+  const gboolean visible = r && r->priority == DT_THUMBNAIL_PRIORITY_VISIBLE;
+  g_hash_table_remove(_queue.requests, &key);
+  _queue.stats.loaded++;
+  _report_if_drained();
+  dt_pthread_mutex_unlock(&_queue.lock);
+
+  if(visible) dt_mipmap_cache_signal_updated();
+
+  // one request per job, so the thumbnails don't hog a worker other queues are waiting for
+  _spawn_pumps(1);
+  return 0;
+}
+
+static void _pump_destroy(void *data)
+{
+  dt_pthread_mutex_lock(&_queue.lock);
+  _queue.pumps--;
+  dt_pthread_mutex_unlock(&_queue.lock);
+}
+
+// keep up to one pump per worker thread in the control queue while there are requests waiting.
+// finishing counts the calling pump out, it is about to be disposed.
+static void _spawn_pumps(const int finishing)
+{
+  dt_pthread_mutex_lock(&_queue.lock);
+  const int n = MIN(_queue.queued, darktable.control->num_threads) - (_queue.pumps - finishing);
+  const uint32_t serial = _queue.serial;
+  if(n > 0)
+  {
+    _queue.pumps += n;
+    _queue.serial += n;
+  }
+  dt_pthread_mutex_unlock(&_queue.lock);
+
+  // not under our lock: the control queue calls _pump_destroy() with its own lock held
+  for(int k = 0; k < n; k++)
+  {
+    dt_job_t *job = dt_control_job_create(&_pump_run, "thumbnail queue %u", serial + k);
+    if(!job)
+    {
+      _pump_destroy(NULL);
+      continue;
+    }
+    dt_control_job_set_params(job, NULL, _pump_destroy);
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, job);
+  }
+}
+
+void dt_thumbnail_jobs_request(const uint32_t imgid, const dt_mipmap_size_t mip,
+                               const dt_thumbnail_priority_t priority, const gboolean windowed)
+{
+  if(!_queue.requests || !dt_control_running())
+  {
+    // nobody to hand the work to
+    _load(imgid, mip, DT_MIPMAP_BLOCKING);
+    return;
+  }
+
+  const double now = dt_get_wtime();
+  const uint64_t key = ((uint64_t)imgid << 8) | mip;
+
+  dt_pthread_mutex_lock(&_queue.lock);
+  _queue.stats.requests++;
+  dt_thumbnail_request_t *r = (dt_thumbnail_request_t *)g_hash_table_lookup(_queue.requests, &key);
+  if(r)
+  {
+    _queue.stats.merged++;
+    // a running request still needs to know whether somebody waits for it
+    if(priority > r->priority)
+    {
+      r->priority = priority;
+      _queue.stats.boosted++;
+    }
+    r->windowed = r->windowed && windowed;
+    r->requested = now;
+    dt_pthread_mutex_unlock(&_queue.lock);
+    return;
+  }
+
+  r = (dt_thumbnail_request_t *)calloc(1, sizeof(dt_thumbnail_request_t));
+  r->key = key;
+  r->imgid = imgid;
+  r->mip = mip;
+  r->priority = priority;
+  r->windowed = windowed;
+  r->queued = r->requested = now;
+  g_hash_table_insert(_queue.requests, &r->key, r);
+  _queue.queued++;
+  _queue.stats.max_depth = MAX(_queue.stats.max_depth, _queue.queued);
+
+  if(_queue.queued > DT_THUMBNAIL_MAX_REQUESTS)
+  {
+    dt_thumbnail_request_t *worst = _find(FALSE, now);
+    g_hash_table_remove(_queue.requests, &worst->key);
+    _queue.queued--;
+    _queue.stats.dropped++;
+  }
+  dt_pthread_mutex_unlock(&_queue.lock);
+
+  _spawn_pumps(0);
+}
+
+void dt_thumbnail_jobs_set_window(const uint32_t *imgids, const int count)
+{
+  if(!_queue.requests) return;
+
+  dt_pthread_mutex_lock(&_queue.lock);
+  g_hash_table_remove_all(_queue.window);
+  for(int k = 0; k < count; k++) g_hash_table_add(_queue.window, GUINT_TO_POINTER(imgids[k]));
+
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init(&iter, _queue.requests);
+  while(g_hash_table_iter_next(&iter, NULL, &value))
+  {
+    const dt_thumbnail_request_t *r = (dt_thumbnail_request_t *)value;
+    if(r->windowed && !r->running && !g_hash_table_contains(_queue.window, GUINT_TO_POINTER(r->imgid)))
+    {
+      g_hash_table_iter_remove(&iter);
+      _queue.queued--;
+      _queue.stats.cancelled++;
+    }
+  }
+  _report_if_drained();
+  dt_pthread_mutex_unlock(&_queue.lock);
+}
+
+void dt_thumbnail_jobs_init()
+{
+  dt_pthread_mutex_init(&_queue.lock, NULL);
+  _queue.requests = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, free);
+  _queue.window = g_hash_table_new(NULL, NULL);
+  _queue.queued = _queue.pumps = 0;
+  memset(&_queue.stats, 0, sizeof(_queue.stats));
+}
+
+void dt_thumbnail_jobs_cleanup()
+{
+  if(!_queue.requests) return;
+  g_hash_table_destroy(_queue.requests);
+  g_hash_table_destroy(_queue.window);
+  _queue.requests = _queue.window = NULL;
+  dt_pthread_mutex_destroy(&_queue.lock);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,48 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/mipmap_cache.h"
+#include <glib.h>
+#include <inttypes.h>
+
+/* the thumbnail queue: loads into the mipmap cache requested through DT_MIPMAP_PREFETCH and friends.
+ * requests are keyed by (imgid, mip), so asking for a queued thumbnail again doesn't add work, it only
+ * refreshes the request and possibly raises its priority. */
+
+typedef enum dt_thumbnail_priority_t
+{
+  DT_THUMBNAIL_PRIORITY_PREFETCH = 0, // speculative, the user might never get to see it
+  DT_THUMBNAIL_PRIORITY_VISIBLE = 1   // on screen right now, a stand-in or nothing is shown in its place
+} dt_thumbnail_priority_t;
+
+void dt_thumbnail_jobs_init();
+void dt_thumbnail_jobs_cleanup();
+
+/** queue loading mip of imgid. windowed requests are cancelled by dt_thumbnail_jobs_set_window() once
+ *  imgid isn't part of the window any more. without a running control the load happens right away. */
+void dt_thumbnail_jobs_request(const uint32_t imgid, const dt_mipmap_size_t mip,
+                               const dt_thumbnail_priority_t priority, const gboolean windowed);
+
+/** set the images windowed requests are still wanted for and drop the queued ones for all others */
+void dt_thumbnail_jobs_set_window(const uint32_t *imgids, const int count);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -47,6 +47,10 @@
 #define DT_DEV_AVERAGE_DELAY_START 250
 #define DT_DEV_PREVIEW_AVERAGE_DELAY_START 50
 #define DT_DEV_AVERAGE_DELAY_COUNT 5
+// progressive rendering of the full pipe: coarse pass at 1/DT_DEV_PROGRESSIVE_DOWNSCALE of the final
+// scale, done only if the full pipe took longer than DT_DEV_PROGRESSIVE_DELAY ms on average
+#define DT_DEV_PROGRESSIVE_DOWNSCALE 4
+#define DT_DEV_PROGRESSIVE_DELAY 300
 
 const gchar *dt_dev_histogram_type_names[DT_DEV_HISTOGRAM_N] = { "logarithmic", "linear", "waveform" };
 
@@ -575,6 +579,42 @@ restart:
   x = MAX(0, scale * dev->pipe->processed_width  * (.5 + zoom_x) - wd / 2);
   y = MAX(0, scale * dev->pipe->processed_height * (.5 + zoom_y) - ht / 2);
 
+  // progressive rendering: a new image or a new roi can't use anything from the pixelpipe cache, so if that
+  // is going to be slow show a coarse rendering of the roi first. the full scale pass below is then cancelled
+  // by dev->pipe->changed as usual if the user zooms, pans or edits in the meantime.
+  const int ds = DT_DEV_PROGRESSIVE_DOWNSCALE;
+  if(dev->gui_attached && dev->average_delay > DT_DEV_PROGRESSIVE_DELAY
+     && (dev->image_loading || (pipe_changed & DT_DEV_PIPE_ZOOMED)) && wd >= 4 * ds && ht >= 4 * ds
+     && dt_conf_get_bool("plugins/darkroom/progressive"))
+  {
+    dt_get_times(&start);
+    dev->pipe->downscale = ds;
+    const int err = dt_dev_pixelpipe_process(dev->pipe, dev, x / ds, y / ds, wd / ds, ht / ds, scale / ds);
+    dev->pipe->downscale = 1;
+    if(err)
+    {
+      if(dev->image_force_reload)
+      {
+        dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+        dt_control_log_busy_leave();
+        dev->image_status = DT_DEV_PIXELPIPE_INVALID;
+        dt_pthread_mutex_unlock(&dev->pipe_mutex);
+        return;
+      }
+      else
+        goto restart;
+    }
+    dt_show_times(&start, "[dev_process_image] pixel pipeline coarse pass");
+
+    if(dev->pipe->changed != DT_DEV_PIPE_UNCHANGED) goto restart;
+
+    // the coarse rendering is drawn scaled up to where the final one will be
+    dev->pipe->backbuf_scale = scale;
+    dev->pipe->backbuf_zoom_x = zoom_x;
+    dev->pipe->backbuf_zoom_y = zoom_y;
+    dt_control_queue_redraw_center();
+  }
+
   dt_get_times(&start);
   if(dt_dev_pixelpipe_process(dev->pipe, dev, x, y, wd, ht, scale))
   {
@@ -1373,7 +1413,8 @@ static void _dev_merge_history(dt_develop_t *dev, const int imgid)
                                   "UPDATE memory.history SET num=?1 WHERE rowid=?2", -1, &stmt, NULL);
 
       // let's wrap this into a transaction, it might make it a little faster.
-      sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+      // a savepoint, as history paste and style apply call us within their own.
+      sqlite3_exec(dt_database_get(darktable.db), "SAVEPOINT history_renumber", NULL, NULL, NULL);
       for(GList *r = rowids; r; r = g_list_next(r))
       {
         DT_DEBUG_SQLITE3_CLEAR_BINDINGS(stmt);
@@ -1386,7 +1427,7 @@ static void _dev_merge_history(dt_develop_t *dev, const int imgid)
         v++;
       }
 
-      sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+      sqlite3_exec(dt_database_get(darktable.db), "RELEASE SAVEPOINT history_renumber", NULL, NULL, NULL);
 
       g_list_free(rowids);
       sqlite3_finalize(stmt);
@@ -1727,6 +1768,37 @@ void dt_dev_read_history_ext(dt_develop_t *dev, const int imgid, gboolean no_ima
   dt_dev_masks_list_change(dev);
 }
 
+void dt_dev_reset_history_ext(dt_develop_t *dev, GList *base)
+{
+  while(dev->history)
+  {
+    dt_dev_free_history_item(((dt_dev_history_item_t *)dev->history->data));
+    dev->history = g_list_delete_link(dev->history, dev->history);
+  }
+  dev->history_end = 0;
+
+  g_list_free_full(dev->forms, (void (*)(void *))dt_masks_free_form);
+  dev->forms = NULL;
+  g_list_free_full(dev->allforms, (void (*)(void *))dt_masks_free_form);
+  dev->allforms = NULL;
+
+  // module params are reset to their defaults by dt_dev_pop_history_items_ext(),
+  // only the instances created for the previous image have to go
+  GList *modules = dev->iop;
+  while(modules)
+  {
+    GList *next = g_list_next(modules);
+    dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+    if(!g_list_find(base, module))
+    {
+      dt_iop_cleanup_module(module);
+      free(module);
+      dev->iop = g_list_delete_link(dev->iop, modules);
+    }
+    modules = next;
+  }
+}
+
 void dt_dev_read_history(dt_develop_t *dev)
 {
   dt_dev_read_history_ext(dev, dev->image_storage.id, FALSE);
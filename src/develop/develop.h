@@ -326,6 +326,9 @@ void dt_dev_write_history_ext(dt_develop_t *dev, const int imgid);
 void dt_dev_write_history(dt_develop_t *dev);
 void dt_dev_read_history_ext(dt_develop_t *dev, const int imgid, gboolean no_image);
 void dt_dev_read_history(dt_develop_t *dev);
+/** brings a headless stack back to its state right after dt_iop_load_modules_ext(), dropping history, masks
+    and all instances not in base, so it can be recycled for another image with dt_dev_read_history_ext() */
+void dt_dev_reset_history_ext(dt_develop_t *dev, GList *base);
 void dt_dev_free_history_item(gpointer data);
 void dt_dev_invalidate_history_module(GList *list, struct dt_iop_module_t *module);
 
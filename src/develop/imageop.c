@@ -28,6 +28,7 @@
 #include "common/iop_group.h"
 #include "common/module.h"
 #include "common/opencl.h"
+#include "common/startup.h"
 #include "common/usermanual_url.h"
 #include "control/control.h"
 #include "develop/blend.h"
@@ -49,6 +50,7 @@
 #endif
 
 #include <assert.h>
+#include <glib/gstdio.h>
 #include <gmodule.h>
 #include <math.h>
 #include <stdlib.h>
@@ -359,7 +361,8 @@ int dt_iop_load_module_so(void *m, const char *libname, const char *op)
       goto error;
   }
 
-  if(module->init_global) module->init_global(module);
+  // init_global() is run lazily by dt_iop_init_global_data()
+  module->global_inited = FALSE;
   return 0;
 error:
   fprintf(stderr, "[iop_load_module] failed to open operation `%s': %s\n", op, g_module_error());
@@ -367,6 +370,25 @@ error:
   return 1;
 }
 
+static void _iop_init_global_data(dt_iop_module_t *module, dt_iop_module_so_t *so)
+{
+  dt_pthread_mutex_lock(&darktable.iop_global_threadsafe);
+  if(!so->global_inited)
+  {
+    const double start = dt_get_wtime();
+    if(so->init_global) so->init_global(so);
+    so->global_inited = TRUE;
+    dt_print(DT_DEBUG_PERF, "[iop_init_global] %s set up in %.3f secs\n", so->op, dt_get_wtime() - start);
+  }
+  module->global_data = so->data;
+  dt_pthread_mutex_unlock(&darktable.iop_global_threadsafe);
+}
+
+void dt_iop_init_global_data(dt_iop_module_t *module)
+{
+  _iop_init_global_data(module, module->so);
+}
+
 int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, dt_develop_t *dev)
 {
   module->dt = &darktable;
@@ -493,7 +515,12 @@ int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, dt
     dt_iop_gui_set_state(module, state);
   }
 
-  module->global_data = so->data;
+  // the global data (opencl kernels, lookup tables, ...) is set up once a piece of the module is
+  // enabled in a pipe, see dt_iop_init_global_data(). the darkroom gui needs it right away.
+  if(module->dev && module->dev->gui_attached)
+    _iop_init_global_data(module, so);
+  else
+    module->global_data = so->data;
 
   // now init the instance:
   module->init(module);
@@ -532,6 +559,7 @@ int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, dt
 void dt_iop_init_pipe(struct dt_iop_module_t *module, struct dt_dev_pixelpipe_t *pipe,
                       struct dt_dev_pixelpipe_iop_t *piece)
 {
+  if(piece->enabled) dt_iop_init_global_data(module);
   module->init_pipe(module, pipe, piece);
   piece->blendop_data = calloc(1, sizeof(dt_develop_blend_params_t));
   /// FIXME: Commit params is already done in module
@@ -1405,11 +1433,106 @@ static void init_key_accels(dt_iop_module_so_t *module)
   sqlite3_finalize(stmt);
 }
 
-static void dt_iop_init_module_so(void *m)
+// data.db remembers for which build of each module the built-in presets have been written,
+// so that a start doesn't need to regenerate and upgrade the presets of all modules.
+#define DT_IOP_MANIFEST "iop_manifest"
+
+static gchar *_iop_manifest_header()
 {
-  dt_iop_module_so_t *module = (dt_iop_module_so_t *)m;
+  // a new darktable, blend version or language rewrites all presets
+  return g_strdup_printf("%s %d %s", darktable_package_version, dt_develop_blend_version(),
+                         g_get_language_names()[0]);
+}
+
+static gchar *_iop_manifest_entry(dt_iop_module_so_t *module)
+{
+  // a rebuilt plugin, a new module version or a tampered data.db invalidate the entry of a module
+  GStatBuf statbuf = { 0 };
+  g_stat(g_module_name(module->module), &statbuf);
+
+  int presets = 0;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT COUNT(*) FROM data.presets WHERE operation = ?1 AND writeprotect = 1",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, module->op, -1, SQLITE_TRANSIENT);
+  if(sqlite3_step(stmt) == SQLITE_ROW) presets = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+
+  return g_strdup_printf("%d %d %" G_GINT64_FORMAT " %d", module->version(), module->flags(),
+                         (gint64)statbuf.st_mtime, presets);
+}
+
+static void _iop_manifest_store(const char *key, const char *value)
+{
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT OR REPLACE INTO data.db_info (key, value) VALUES (?1, ?2)", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, key, -1, SQLITE_TRANSIENT);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, value, -1, SQLITE_TRANSIENT);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+}
+
+gboolean dt_iop_presets_manifest_current()
+{
+  gchar *header = _iop_manifest_header();
+  gboolean current = FALSE;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT value FROM data.db_info WHERE key = ?1", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, DT_IOP_MANIFEST, -1, SQLITE_STATIC);
+  if(sqlite3_step(stmt) == SQLITE_ROW) current = !g_strcmp0(header, (const char *)sqlite3_column_text(stmt, 0));
+  sqlite3_finalize(stmt);
+  g_free(header);
+  return current;
+}
+
+static GHashTable *_iop_manifest_load()
+{
+  GHashTable *manifest = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  if(!dt_iop_presets_manifest_current()) return manifest;
+
+  const size_t prefix = strlen(DT_IOP_MANIFEST "/");
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT key, value FROM data.db_info WHERE key LIKE '" DT_IOP_MANIFEST "/%'", -1,
+                              &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const char *key = (const char *)sqlite3_column_text(stmt, 0);
+    const char *value = (const char *)sqlite3_column_text(stmt, 1);
+    g_hash_table_insert(manifest, g_strdup(key + prefix), g_strdup(value));
+  }
+  sqlite3_finalize(stmt);
+  return manifest;
+}
+
+static gboolean dt_iop_init_module_so(dt_iop_module_so_t *module, GHashTable *manifest)
+{
+  gchar *entry = _iop_manifest_entry(module);
+  const gboolean refresh = g_strcmp0(entry, g_hash_table_lookup(manifest, module->op));
+  g_free(entry);
 
-  init_presets(module);
+  if(refresh)
+  {
+    // drop what an older build left behind, then write and upgrade the presets
+    sqlite3_stmt *stmt;
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "DELETE FROM data.presets WHERE operation = ?1 AND writeprotect = 1", -1, &stmt,
+                                NULL);
+    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, module->op, -1, SQLITE_TRANSIENT);
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+
+    init_presets(module);
+
+    gchar *key = g_strdup_printf(DT_IOP_MANIFEST "/%s", module->op);
+    entry = _iop_manifest_entry(module);
+    _iop_manifest_store(key, entry);
+    g_free(entry);
+    g_free(key);
+  }
 
   // do not init accelerators if there is no gui
   if(darktable.gui)
@@ -1431,12 +1554,32 @@ static void dt_iop_init_module_so(void *m)
       dt_accel_register_iop(module, FALSE, NC_("accel", "show preset menu"), 0, 0);
     }
   }
+
+  return refresh;
 }
 
 void dt_iop_load_modules_so()
 {
+  const double start = dt_get_wtime();
+  dt_startup_begin("dlopen");
   darktable.iop = dt_module_load_modules("/plugins", sizeof(dt_iop_module_so_t), dt_iop_load_module_so,
-                                         dt_iop_init_module_so, NULL);
+                                         NULL, NULL);
+  dt_startup_end();
+
+  dt_startup_begin("presets and shortcuts");
+  GHashTable *manifest = _iop_manifest_load();
+  int refreshed = 0;
+  for(GList *iop = darktable.iop; iop; iop = g_list_next(iop))
+    if(dt_iop_init_module_so((dt_iop_module_so_t *)iop->data, manifest)) refreshed++;
+  g_hash_table_destroy(manifest);
+  dt_startup_end();
+
+  gchar *header = _iop_manifest_header();
+  _iop_manifest_store(DT_IOP_MANIFEST, header);
+  g_free(header);
+
+  dt_print(DT_DEBUG_PERF, "[iop_load_modules_so] %d modules loaded in %.3f secs, presets of %d rewritten\n",
+           g_list_length(darktable.iop), dt_get_wtime() - start, refreshed);
 }
 
 int dt_iop_load_module(dt_iop_module_t *module, dt_iop_module_so_t *module_so, dt_develop_t *dev)
@@ -1514,14 +1657,18 @@ void dt_iop_cleanup_module(dt_iop_module_t *module)
 
 void dt_iop_unload_modules_so()
 {
+  int inited = 0;
+  const int total = g_list_length(darktable.iop);
   while(darktable.iop)
   {
     dt_iop_module_so_t *module = (dt_iop_module_so_t *)darktable.iop->data;
-    if(module->cleanup_global) module->cleanup_global(module);
+    if(module->global_inited) inited++;
+    if(module->global_inited && module->cleanup_global) module->cleanup_global(module);
     if(module->module) g_module_close(module->module);
     free(darktable.iop->data);
     darktable.iop = g_list_delete_link(darktable.iop, darktable.iop);
   }
+  dt_print(DT_DEBUG_PERF, "[iop_unload_modules_so] global data of %d of %d modules was set up\n", inited, total);
 }
 
 void dt_iop_set_mask_mode(dt_iop_module_t *module, int mask_mode)
@@ -1579,6 +1726,8 @@ void dt_iop_commit_params(dt_iop_module_t *module, dt_iop_params_t *params,
 
   if(piece->enabled)
   {
+    dt_iop_init_global_data(module);
+
     /* construct module params data for hash calc */
     int length = module->params_size;
     if(module->flags() & IOP_FLAGS_SUPPORTS_BLENDING) length += sizeof(dt_develop_blend_params_t);
@@ -281,6 +281,8 @@ typedef struct dt_iop_module_so_t
   void *(*get_p)(const void *param, const char *name);
   dt_introspection_field_t *(*get_f)(const char *name);
 
+  /** init_global() is deferred until a piece is enabled in a pipe, see dt_iop_init_global_data(). */
+  gboolean global_inited;
 } dt_iop_module_so_t;
 
 typedef struct dt_iop_module_t
@@ -548,6 +550,11 @@ typedef struct dt_iop_module_t
 void dt_iop_load_modules_so();
 /** cleans up the dlopen refs. */
 void dt_iop_unload_modules_so();
+/** TRUE if the built-in presets in data.db were written by this very darktable and language. */
+gboolean dt_iop_presets_manifest_current();
+/** run init_global() of the module's class if that didn't happen yet, and point the instance to the data.
+ * needed before anything touches module->global_data outside of an enabled pipe piece or the gui. */
+void dt_iop_init_global_data(dt_iop_module_t *module);
 /** load a module for a given .so */
 int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, struct dt_develop_t *dev);
 /** returns a list of instances referencing stuff loaded in load_modules_so. */
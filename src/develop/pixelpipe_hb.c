@@ -23,6 +23,7 @@
 #include "common/imageio.h"
 #include "common/opencl.h"
 #include "common/iop_order.h"
+#include "common/trace.h"
 #include "control/control.h"
 #include "control/signal.h"
 #include "develop/blend.h"
@@ -95,6 +96,26 @@ static char *_pipe_type_to_str(int pipe_type)
   return r;
 }
 
+const char *dt_dev_pixelpipe_type_to_str(const int pipe_type)
+{
+  return _pipe_type_to_str(pipe_type);
+}
+
+static void _trace_event(const char *cat, const char *name, const dt_dev_pixelpipe_t *pipe, const double start,
+                         const double end, const int device, const dt_iop_roi_t *roi, const size_t bytes)
+{
+  if(!dt_trace_enabled()) return;
+  dt_trace_add(&(dt_trace_event_t){ .cat = cat,
+                                    .name = name,
+                                    .pipe = _pipe_type_to_str(pipe->type),
+                                    .start = start,
+                                    .end = end,
+                                    .device = device,
+                                    .width = roi->width,
+                                    .height = roi->height,
+                                    .bytes = bytes });
+}
+
 int dt_dev_pixelpipe_init_export(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height, int levels,
                                  gboolean store_masks)
 {
@@ -164,6 +185,8 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->output_backbuf_width = 0;
   pipe->output_backbuf_height = 0;
   pipe->output_imgid = 0;
+  pipe->downscale = 1;
+  pipe->output_downscale = 1;
 
   pipe->processing = 0;
   pipe->shutdown = 0;
@@ -1140,6 +1163,8 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format);
 
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    const double now = dt_get_wtime();
+    _trace_event("cache", module ? module->op : "input", pipe, now, now, -1, roi_out, 0);
     if(!modules) return 0;
     // go to post-collect directly:
     goto post_process_collect_info;
@@ -1158,6 +1183,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
 
 
   // 3) input -> output
+  if(piece) piece->cancelled = 0;
   if(!modules)
   {
     // 3a) import input array with given scale and roi
@@ -1215,6 +1241,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     }
 
     dt_show_times_f(&start, "[dev_pixelpipe]", "initing base buffer [%s]", _pipe_type_to_str(pipe->type));
+    _trace_event("module", "input", pipe, start.clock, dt_get_wtime(), -1, roi_out, bufsize);
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
   }
   else
@@ -1924,8 +1951,10 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           // and save the output colorspace
           pipe->dsc.cst = module->output_colorspace(module, pipe, piece);
 
-          if(pipe->shutdown)
+          if(pipe->shutdown || piece->cancelled)
           {
+            // the module gave up half way, its output must not be picked up from the cache
+            if(piece->cancelled) dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
             dt_pthread_mutex_unlock(&pipe->busy_mutex);
             return 1;
           }
@@ -2079,8 +2108,10 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
         // and save the output colorspace
         pipe->dsc.cst = module->output_colorspace(module, pipe, piece);
 
-        if(pipe->shutdown)
+        if(pipe->shutdown || piece->cancelled)
         {
+          // the module gave up half way, its output must not be picked up from the cache
+          if(piece->cancelled) dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
           dt_pthread_mutex_unlock(&pipe->busy_mutex);
           return 1;
         }
@@ -2198,8 +2229,10 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       //(*out_format)->cst = module->output_colorspace(module, pipe, piece);
       pipe->dsc.cst = module->output_colorspace(module, pipe, piece);
 
-      if(pipe->shutdown)
+      if(pipe->shutdown || piece->cancelled)
       {
+        // the module gave up half way, its output must not be picked up from the cache
+        if(piece->cancelled) dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
         dt_pthread_mutex_unlock(&pipe->busy_mutex);
         return 1;
       }
@@ -2303,8 +2336,10 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     // and save the output colorspace
     pipe->dsc.cst = module->output_colorspace(module, pipe, piece);
 
-    if(pipe->shutdown)
+    if(pipe->shutdown || piece->cancelled)
     {
+      // the module gave up half way, its output must not be picked up from the cache
+      if(piece->cancelled) dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
       dt_pthread_mutex_unlock(&pipe->busy_mutex);
       return 1;
     }
@@ -2377,6 +2412,9 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     g_free(module_label);
     module_label = NULL;
 
+    _trace_event("module", module->op, pipe, start.clock, dt_get_wtime(),
+                 pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_ON_GPU ? pipe->devid : -1, roi_out, bufsize);
+
     // in case we get this buffer from the cache in the future, cache some stuff:
     **out_format = piece->dsc_out = pipe->dsc;
 
@@ -2704,8 +2742,10 @@ restart:
   dt_iop_buffer_dsc_t *out_format = &_out_format;
 
   // run pixelpipe recursively and get error status
+  const double trace_start = dt_get_wtime();
   int err = dt_dev_pixelpipe_process_rec_and_backcopy(pipe, dev, &buf, &cl_mem_out, &out_format, &roi, modules,
                                                       pieces, pos);
+  _trace_event("pipe", err ? "pipe (aborted)" : "pipe", pipe, trace_start, dt_get_wtime(), pipe->devid, &roi, 0);
 
   // get status summary of opencl queue by checking the eventlist
   int oclerr = (pipe->devid >= 0) ? (dt_opencl_events_flush(pipe->devid, 1) != 0) : 0;
@@ -2785,6 +2825,7 @@ restart:
     if(pipe->output_backbuf)
       memcpy(pipe->output_backbuf, pipe->backbuf, (size_t)pipe->output_backbuf_width * pipe->output_backbuf_height * 4 * sizeof(uint8_t));
     pipe->output_imgid = pipe->image.id;
+    pipe->output_downscale = MAX(1, pipe->downscale);
   }
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
 
@@ -2793,6 +2834,27 @@ restart:
   return 0;
 }
 
+int dt_dev_pixelpipe_piece_cancelled(dt_dev_pixelpipe_iop_t *piece)
+{
+  const dt_dev_pixelpipe_t *pipe = piece->pipe;
+  const dt_develop_t *dev = piece->module->dev;
+
+  // only the interactive pipes get interrupted, export and thumbnail pipes always run to the end
+  if(!dev || !dev->gui_attached) return 0;
+  if(pipe != dev->pipe && pipe != dev->preview_pipe && pipe != dev->preview2_pipe) return 0;
+
+  // same rules as dt_iop_breakpoint(), the preview pipes don't care about zooming
+  int cancelled = dev->gui_leaving;
+  if(pipe == dev->pipe)
+    cancelled |= pipe->changed != DT_DEV_PIPE_UNCHANGED || dev->image_force_reload;
+  else
+    cancelled |= (pipe->changed != DT_DEV_PIPE_UNCHANGED && pipe->changed != DT_DEV_PIPE_ZOOMED)
+                 || (pipe == dev->preview_pipe ? dev->preview_loading : dev->preview2_loading);
+
+  if(cancelled) piece->cancelled = 1;
+  return cancelled;
+}
+
 void dt_dev_pixelpipe_flush_caches(dt_dev_pixelpipe_t *pipe)
 {
   dt_dev_pixelpipe_cache_flush(&pipe->cache);
@@ -70,6 +70,8 @@ typedef struct dt_dev_pixelpipe_iop_t
   dt_iop_buffer_dsc_t dsc_in, dsc_out;
 
   GHashTable *raster_masks; // GList* of dt_dev_pixelpipe_raster_mask_t
+
+  int cancelled; // set once dt_dev_pixelpipe_piece_cancelled() told process() to give up
 } dt_dev_pixelpipe_iop_t;
 
 typedef enum dt_dev_pixelpipe_change_t
@@ -123,6 +125,9 @@ typedef struct dt_dev_pixelpipe_t
   uint8_t *output_backbuf;
   int output_backbuf_width, output_backbuf_height;
   int output_imgid;
+  // the roi is processed at 1/downscale of the final scale (coarse pass of progressive rendering),
+  // output_downscale is the value for what's in output_backbuf right now.
+  int downscale, output_downscale;
   // working?
   int processing;
   // shutting down?
@@ -214,6 +219,14 @@ int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev,
 int dt_dev_pixelpipe_process_no_gamma(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y,
                                       int width, int height, float scale);
 
+// cooperative cancellation for long running process() calls, cheap enough to be polled once per row or tile.
+// returns 1 once the output of piece isn't wanted any more (history, zoom or image changed, darkroom left),
+// process() may then return right away with garbage in its output, the pipe drops it.
+int dt_dev_pixelpipe_piece_cancelled(dt_dev_pixelpipe_iop_t *piece);
+
+// "full", "preview", "export", ... for log output
+const char *dt_dev_pixelpipe_type_to_str(const int pipe_type);
+
 // disable given op and all that comes after it in the pipe:
 void dt_dev_pixelpipe_disable_after(dt_dev_pixelpipe_t *pipe, const char *op);
 // disable given op and all that comes before it in the pipe:
@@ -19,6 +19,7 @@
 
 #include "develop/tiling.h"
 #include "common/opencl.h"
+#include "common/trace.h"
 #include "control/control.h"
 #include "develop/blend.h"
 #include "develop/pixelpipe.h"
@@ -579,6 +580,23 @@ static int _fit_output_to_input_roi(struct dt_iop_module_t *self, struct dt_dev_
 }
 
 
+static void _trace_tile(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                        const dt_iop_roi_t *const iroi, const dt_iop_roi_t *const oroi, const int in_bpp,
+                        const int out_bpp, const double start, const int devid)
+{
+  if(!dt_trace_enabled()) return;
+  dt_trace_add(&(dt_trace_event_t){ .cat = "tile",
+                                    .name = self->op,
+                                    .pipe = dt_dev_pixelpipe_type_to_str(piece->pipe->type),
+                                    .start = start,
+                                    .end = dt_get_wtime(),
+                                    .device = devid,
+                                    .width = oroi->width,
+                                    .height = oroi->height,
+                                    .bytes = (size_t)iroi->width * iroi->height * in_bpp
+                                             + (size_t)oroi->width * oroi->height * out_bpp });
+}
+
 /* simple tiling algorithm for roi_in == roi_out, i.e. for pixel to pixel modules/operations */
 static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                                         const void *const ivoid, void *const ovoid,
@@ -765,7 +783,9 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
       for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
 
       /* call process() of module */
+      const double tile_start = dt_get_wtime();
       self->process(self, piece, input, output, &iroi, &oroi);
+      _trace_tile(self, piece, &iroi, &oroi, in_bpp, out_bpp, tile_start, -1);
 
       /* aggregate resulting processed_maximum */
       /* TODO: check if there really can be differences between tiles and take
@@ -1115,7 +1135,9 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
       for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
 
       /* call process() of module */
+      const double tile_start = dt_get_wtime();
       self->process(self, piece, input, output, &iroi_full, &oroi_full);
+      _trace_tile(self, piece, &iroi_full, &oroi_full, in_bpp, out_bpp, tile_start, -1);
 
       /* aggregate resulting processed_maximum */
       /* TODO: check if there really can be differences between tiles and take
@@ -1193,6 +1215,56 @@ void default_process_tiling(struct dt_iop_module_t *self, struct dt_dev_pixelpip
 
 #ifdef HAVE_OPENCL
 /* simple tiling algorithm for roi_in == roi_out, i.e. for pixel to pixel modules/operations */
+/* a tile whose download has been queued but not waited for yet */
+typedef struct _cl_pending_tile_t
+{
+  cl_event done;     // marker behind the download, NULL if there is nothing in flight
+  char *host;        // good part of the tile in the pinned output buffer, NULL for direct transfers
+  size_t host_pitch; // row pitch in the pinned output buffer
+  size_t ooffs;      // offset of the good part in the output image
+  size_t rows;
+  size_t rowbytes;
+} _cl_pending_tile_t;
+
+/* copy the good part of a tile downloaded into a pinned buffer to the output image */
+static void _cl_tile_copy_out(const _cl_pending_tile_t *const tile, void *const ovoid, const int opitch)
+{
+  if(tile->host == NULL) return;
+
+  const char *const host = tile->host;
+  const size_t host_pitch = tile->host_pitch;
+  const size_t ooffs = tile->ooffs;
+  const size_t rows = tile->rows;
+  const size_t rowbytes = tile->rowbytes;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(host, host_pitch, ooffs, opitch, ovoid, rowbytes, rows) \
+  schedule(static)
+#endif
+  for(size_t j = 0; j < rows; j++)
+    memcpy((char *)ovoid + ooffs + j * opitch, host + j * host_pitch, rowbytes);
+}
+
+/* wait for the download of a pending tile and copy it out */
+static int _cl_pending_tile_finish(const int devid, _cl_pending_tile_t *tile, void *const ovoid,
+                                   const int opitch)
+{
+  if(tile->done == NULL) return TRUE;
+  const int success = dt_opencl_wait_and_release_event(devid, tile->done);
+  tile->done = NULL;
+  if(!success) return FALSE;
+  _cl_tile_copy_out(tile, ovoid, opitch);
+  return TRUE;
+}
+
+/* forget a pending tile without copying it out. waits for its marker, which is immediate after dt_opencl_finish() */
+static void _cl_pending_tile_drop(const int devid, _cl_pending_tile_t *tile)
+{
+  if(tile->done == NULL) return;
+  dt_opencl_wait_and_release_event(devid, tile->done);
+  tile->done = NULL;
+}
+
 static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                                           const void *const ivoid, void *const ovoid,
                                           const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
@@ -1201,10 +1273,11 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
   cl_int err = -999;
   cl_mem input = NULL;
   cl_mem output = NULL;
-  cl_mem pinned_input = NULL;
-  cl_mem pinned_output = NULL;
-  void *input_buffer = NULL;
-  void *output_buffer = NULL;
+  cl_mem pinned_input[2] = { NULL, NULL };
+  cl_mem pinned_output[2] = { NULL, NULL };
+  void *input_buffer[2] = { NULL, NULL };
+  void *output_buffer[2] = { NULL, NULL };
+  _cl_pending_tile_t pending = { 0 };
 
   dt_iop_buffer_dsc_t dsc;
   self->output_format(self, piece->pipe, piece, &dsc);
@@ -1221,9 +1294,15 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
 
   /* shall we use pinned memory transfers? */
   int use_pinned_memory = dt_conf_get_bool("opencl_use_pinned_memory");
-  const int pinned_buffer_overhead = use_pinned_memory ? 2 : 0; // add two additional pinned memory buffers
-                                                                // which seemingly get allocated not only on
-                                                                // host but also on device (why???)
+
+  /* shall we overlap host and device work? transfers of a tile then get queued without waiting, the host copies
+     the next tile in and the previous one out while the device computes. that takes a second set of buffers. */
+  const int async = dt_conf_get_bool("opencl_async_tiling");
+  const int slots = async ? 2 : 1;
+  const int async_buffer_overhead = async ? 2 : 0; // input and output of the previous tile may still be in use
+  const int pinned_buffer_overhead = use_pinned_memory ? 2 * slots : 0; // add additional pinned memory buffers
+                                                                        // which seemingly get allocated not only
+                                                                        // on host but also on device (why???)
   const float pinned_buffer_slack
       = use_pinned_memory
             ? 0.85f
@@ -1233,7 +1312,7 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
   float headroom = dt_conf_get_float("opencl_memory_headroom") * 1024.0f * 1024.0f;
   headroom = fmin(fmax(headroom, 0.0f), (float)darktable.opencl->dev[devid].max_global_mem);
   const float available = darktable.opencl->dev[devid].max_global_mem - headroom;
-  float factor = fmax(tiling.factor + pinned_buffer_overhead, 1.0f);
+  float factor = fmax(tiling.factor + pinned_buffer_overhead + async_buffer_overhead, 1.0f);
   const float singlebuffer = fmin(fmax((available - tiling.overhead) / factor, 0.0f),
                                   pinned_buffer_slack * darktable.opencl->dev[devid].max_mem_alloc);
   float maxbuf = fmax(tiling.maxbuf, 1.0f);
@@ -1324,62 +1403,57 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
   float processed_maximum_new[4] = { 1.0f };
   for(int k = 0; k < 4; k++) processed_maximum_saved[k] = piece->pipe->dsc.processed_maximum[k];
 
-  /* reserve pinned input and output memory for host<->device data transfer */
-  if(use_pinned_memory)
+  /* reserve pinned input and output memory for host<->device data transfer, one set per tile in flight */
+  for(int slot = 0; slot < slots && use_pinned_memory; slot++)
   {
-    pinned_input = dt_opencl_alloc_device_buffer_with_flags(devid, (size_t)width * height * in_bpp,
-                                                            CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR);
-    if(pinned_input == NULL)
+    pinned_input[slot] = dt_opencl_alloc_device_buffer_with_flags(devid, (size_t)width * height * in_bpp,
+                                                                  CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR);
+    if(pinned_input[slot] == NULL)
     {
       dt_print(DT_DEBUG_OPENCL,
                "[default_process_tiling_cl_ptp] could not alloc pinned input buffer for module '%s'\n",
                self->op);
       use_pinned_memory = 0;
+      break;
     }
-  }
 
-  if(use_pinned_memory)
-  {
-
-    input_buffer = dt_opencl_map_buffer(devid, pinned_input, CL_TRUE, CL_MAP_WRITE, 0,
-                                        (size_t)width * height * in_bpp);
-    if(input_buffer == NULL)
+    input_buffer[slot] = dt_opencl_map_buffer(devid, pinned_input[slot], CL_TRUE, CL_MAP_WRITE, 0,
+                                              (size_t)width * height * in_bpp);
+    if(input_buffer[slot] == NULL)
     {
       dt_print(DT_DEBUG_OPENCL, "[default_process_tiling_cl_ptp] could not map pinned input buffer to host "
                                 "memory for module '%s'\n",
                self->op);
       use_pinned_memory = 0;
+      break;
     }
-  }
 
-  if(use_pinned_memory)
-  {
-
-    pinned_output = dt_opencl_alloc_device_buffer_with_flags(devid, (size_t)width * height * out_bpp,
-                                                             CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR);
-    if(pinned_output == NULL)
+    pinned_output[slot] = dt_opencl_alloc_device_buffer_with_flags(devid, (size_t)width * height * out_bpp,
+                                                                   CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR);
+    if(pinned_output[slot] == NULL)
     {
       dt_print(DT_DEBUG_OPENCL,
                "[default_process_tiling_cl_ptp] could not alloc pinned output buffer for module '%s'\n",
                self->op);
       use_pinned_memory = 0;
+      break;
     }
-  }
 
-  if(use_pinned_memory)
-  {
-
-    output_buffer = dt_opencl_map_buffer(devid, pinned_output, CL_TRUE, CL_MAP_READ, 0,
-                                         (size_t)width * height * out_bpp);
-    if(output_buffer == NULL)
+    output_buffer[slot] = dt_opencl_map_buffer(devid, pinned_output[slot], CL_TRUE, CL_MAP_READ, 0,
+                                               (size_t)width * height * out_bpp);
+    if(output_buffer[slot] == NULL)
     {
       dt_print(DT_DEBUG_OPENCL, "[default_process_tiling_cl_ptp] could not map pinned output buffer to host "
                                 "memory for module '%s'\n",
                self->op);
       use_pinned_memory = 0;
+      break;
     }
   }
 
+  /* count tiles for the pinned buffer slots */
+  size_t tile_count = 0;
+
   /* iterate over tiles */
   for(size_t tx = 0; tx < tiles_x; tx++)
     for(size_t ty = 0; ty < tiles_y; ty++)
@@ -1410,6 +1484,12 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
                "[default_process_tiling_cl_ptp] tile (%zu, %zu) with %zu x %zu at origin [%zu, %zu]\n", tx, ty, wd,
                ht, tx * tile_wd, ty * tile_ht);
 
+      /* pinned buffers of this tile. in async mode the other slot may still be in use by the previous tile. */
+      const int slot = tile_count++ % slots;
+      char *const pinned_in = (char *)input_buffer[slot];
+      char *const pinned_out = (char *)output_buffer[slot];
+      _cl_pending_tile_t this_tile = { 0 };
+
       /* get input and output buffers */
       input = dt_opencl_alloc_device(devid, wd, ht, in_bpp);
       if(input == NULL) goto error;
@@ -1421,24 +1501,23 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
 /* prepare pinned input tile buffer: copy part of input image */
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-        dt_omp_firstprivate(in_bpp, ipitch, ivoid) \
-        shared(input_buffer, width, ioffs, wd, ht) \
+        dt_omp_firstprivate(in_bpp, ipitch, ivoid, pinned_in) \
+        shared(width, ioffs, wd, ht) \
         schedule(static)
 #endif
         for(size_t j = 0; j < ht; j++)
-          memcpy((char *)input_buffer + j * wd * in_bpp, (char *)ivoid + ioffs + j * ipitch,
-                 (size_t)wd * in_bpp);
+          memcpy(pinned_in + j * wd * in_bpp, (char *)ivoid + ioffs + j * ipitch, (size_t)wd * in_bpp);
 
-        /* blocking memory transfer: pinned host input buffer -> opencl/device tile */
-        err = dt_opencl_write_host_to_device_raw(devid, (char *)input_buffer, input, origin, region,
-                                                 wd * in_bpp, CL_TRUE);
+        /* memory transfer, blocking unless async: pinned host input buffer -> opencl/device tile */
+        err = dt_opencl_write_host_to_device_raw(devid, pinned_in, input, origin, region, wd * in_bpp,
+                                                 async ? CL_FALSE : CL_TRUE);
         if(err != CL_SUCCESS) goto error;
       }
       else
       {
-        /* blocking direct memory transfer: host input image -> opencl/device tile */
+        /* direct memory transfer, blocking unless async: host input image -> opencl/device tile */
         err = dt_opencl_write_host_to_device_raw(devid, (char *)ivoid + ioffs, input, origin, region, ipitch,
-                                                 CL_TRUE);
+                                                 async ? CL_FALSE : CL_TRUE);
         if(err != CL_SUCCESS) goto error;
       }
 
@@ -1446,7 +1525,9 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
       for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
 
       /* call process_cl of module */
+      const double tile_start = dt_get_wtime();
       if(!self->process_cl(self, piece, input, output, &iroi, &oroi)) goto error;
+      _trace_tile(self, piece, &iroi, &oroi, in_bpp, out_bpp, tile_start, devid);
 
       /* aggregate resulting processed_maximum */
       /* TODO: check if there really can be differences between tiles and take
@@ -1463,9 +1544,9 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
 
       if(use_pinned_memory)
       {
-        /* blocking memory transfer: complete opencl/device tile -> pinned host output buffer */
-        err = dt_opencl_read_host_from_device_raw(devid, (char *)output_buffer, output, origin, region,
-                                                  wd * out_bpp, CL_TRUE);
+        /* memory transfer, blocking unless async: complete opencl/device tile -> pinned host output buffer */
+        err = dt_opencl_read_host_from_device_raw(devid, pinned_out, output, origin, region, wd * out_bpp,
+                                                  async ? CL_FALSE : CL_TRUE);
         if(err != CL_SUCCESS) goto error;
       }
 
@@ -1486,54 +1567,88 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
 
       if(use_pinned_memory)
       {
-/* copy "good" part of tile from pinned output buffer to output image */
-#if 0 // def _OPENMP
-#pragma omp parallel for default(none) shared(ovoid, ooffs, output_buffer, width, origin, region,            \
-                                              wd) schedule(static)
-#endif
-        for(size_t j = 0; j < region[1]; j++)
-          memcpy((char *)ovoid + ooffs + j * opitch,
-                 (char *)output_buffer + ((j + origin[1]) * wd + origin[0]) * out_bpp,
-                 (size_t)region[0] * out_bpp);
+        /* "good" part of tile in the pinned output buffer, copied to the output image once the download
+           completed */
+        this_tile.host = pinned_out + (origin[1] * wd + origin[0]) * out_bpp;
+        this_tile.host_pitch = wd * out_bpp;
+        this_tile.ooffs = ooffs;
+        this_tile.rows = region[1];
+        this_tile.rowbytes = region[0] * out_bpp;
+        if(!async) _cl_tile_copy_out(&this_tile, ovoid, opitch);
       }
       else
       {
-        /* blocking direct memory transfer: good part of opencl/device tile -> host output image */
+        /* direct memory transfer, blocking unless async: good part of opencl/device tile -> host output image */
         err = dt_opencl_read_host_from_device_raw(devid, (char *)ovoid + ooffs, output, origin, region,
-                                                  opitch, CL_TRUE);
+                                                  opitch, async ? CL_FALSE : CL_TRUE);
         if(err != CL_SUCCESS) goto error;
       }
 
-      /* release input and output buffers */
+      /* release input and output buffers. the device keeps them alive until the queued work is done. */
       dt_opencl_release_mem_object(input);
       input = NULL;
       dt_opencl_release_mem_object(output);
       output = NULL;
 
+      if(async)
+      {
+        /* queue a marker behind this tile and get the device going, then finish the previous tile
+           while this one computes */
+        this_tile.done = dt_opencl_enqueue_marker(devid);
+        if(this_tile.done == NULL) goto error;
+        err = dt_opencl_flush(devid);
+        if(err != CL_SUCCESS)
+        {
+          _cl_pending_tile_drop(devid, &pending);
+          pending = this_tile;
+          goto error;
+        }
+        if(!_cl_pending_tile_finish(devid, &pending, ovoid, opitch))
+        {
+          pending = this_tile;
+          goto error;
+        }
+        pending = this_tile;
+      }
       /* block until opencl queue has finished to free all used event handlers */
-      if(!darktable.opencl->async_pixelpipe || piece->pipe->type == DT_DEV_PIXELPIPE_EXPORT)
+      else if(!darktable.opencl->async_pixelpipe || piece->pipe->type == DT_DEV_PIXELPIPE_EXPORT)
         dt_opencl_finish(devid);
     }
 
+  /* the last tile */
+  if(!_cl_pending_tile_finish(devid, &pending, ovoid, opitch)) goto error;
+  if(async && (!darktable.opencl->async_pixelpipe || piece->pipe->type == DT_DEV_PIXELPIPE_EXPORT))
+    dt_opencl_finish(devid);
+
   /* copy back final processed_maximum */
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
 
-  if(input_buffer != NULL) dt_opencl_unmap_mem_object(devid, pinned_input, input_buffer);
-  dt_opencl_release_mem_object(pinned_input);
-  if(output_buffer != NULL) dt_opencl_unmap_mem_object(devid, pinned_output, output_buffer);
-  dt_opencl_release_mem_object(pinned_output);
+  for(int slot = 0; slot < 2; slot++)
+  {
+    if(input_buffer[slot] != NULL) dt_opencl_unmap_mem_object(devid, pinned_input[slot], input_buffer[slot]);
+    dt_opencl_release_mem_object(pinned_input[slot]);
+    if(output_buffer[slot] != NULL) dt_opencl_unmap_mem_object(devid, pinned_output[slot], output_buffer[slot]);
+    dt_opencl_release_mem_object(pinned_output[slot]);
+  }
   dt_opencl_release_mem_object(input);
   dt_opencl_release_mem_object(output);
   piece->pipe->tiling = 0;
   return TRUE;
 
 error:
+  /* whatever is still queued, including a non-blocking download straight into ovoid, has to be done before
+     buffers go away and the cpu fallback writes ovoid */
+  dt_opencl_finish(devid);
+  _cl_pending_tile_drop(devid, &pending);
   /* copy back stored processed_maximum */
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
-  if(input_buffer != NULL) dt_opencl_unmap_mem_object(devid, pinned_input, input_buffer);
-  dt_opencl_release_mem_object(pinned_input);
-  if(output_buffer != NULL) dt_opencl_unmap_mem_object(devid, pinned_output, output_buffer);
-  dt_opencl_release_mem_object(pinned_output);
+  for(int slot = 0; slot < 2; slot++)
+  {
+    if(input_buffer[slot] != NULL) dt_opencl_unmap_mem_object(devid, pinned_input[slot], input_buffer[slot]);
+    dt_opencl_release_mem_object(pinned_input[slot]);
+    if(output_buffer[slot] != NULL) dt_opencl_unmap_mem_object(devid, pinned_output[slot], output_buffer[slot]);
+    dt_opencl_release_mem_object(pinned_output[slot]);
+  }
   dt_opencl_release_mem_object(input);
   dt_opencl_release_mem_object(output);
   piece->pipe->tiling = 0;
@@ -1555,10 +1670,11 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
   cl_int err = -999;
   cl_mem input = NULL;
   cl_mem output = NULL;
-  cl_mem pinned_input = NULL;
-  cl_mem pinned_output = NULL;
-  void *input_buffer = NULL;
-  void *output_buffer = NULL;
+  cl_mem pinned_input[2] = { NULL, NULL };
+  cl_mem pinned_output[2] = { NULL, NULL };
+  void *input_buffer[2] = { NULL, NULL };
+  void *output_buffer[2] = { NULL, NULL };
+  _cl_pending_tile_t pending = { 0 };
 
 
   //_print_roi(roi_in, "module roi_in");
@@ -1588,9 +1704,15 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
 
   /* shall we use pinned memory transfers? */
   int use_pinned_memory = dt_conf_get_bool("opencl_use_pinned_memory");
-  const int pinned_buffer_overhead = use_pinned_memory ? 2 : 0; // add two additional pinned memory buffers
-                                                                // which seemingly get allocated not only on
-                                                                // host but also on device (why???)
+
+  /* shall we overlap host and device work? transfers of a tile then get queued without waiting, the host copies
+     the next tile in and the previous one out while the device computes. that takes a second set of buffers. */
+  const int async = dt_conf_get_bool("opencl_async_tiling");
+  const int slots = async ? 2 : 1;
+  const int async_buffer_overhead = async ? 2 : 0; // input and output of the previous tile may still be in use
+  const int pinned_buffer_overhead = use_pinned_memory ? 2 * slots : 0; // add additional pinned memory buffers
+                                                                        // which seemingly get allocated not only
+                                                                        // on host but also on device (why???)
   const float pinned_buffer_slack
       = use_pinned_memory
             ? 0.85f
@@ -1600,7 +1722,7 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
   float headroom = dt_conf_get_float("opencl_memory_headroom") * 1024.0f * 1024.0f;
   headroom = fmin(fmax(headroom, 0.0f), (float)darktable.opencl->dev[devid].max_global_mem);
   const float available = darktable.opencl->dev[devid].max_global_mem - headroom;
-  float factor = fmax(tiling.factor + pinned_buffer_overhead, 1.0f);
+  float factor = fmax(tiling.factor + pinned_buffer_overhead + async_buffer_overhead, 1.0f);
   const float singlebuffer = fmin(fmax((available - tiling.overhead) / factor, 0.0f),
                                   pinned_buffer_slack * darktable.opencl->dev[devid].max_mem_alloc);
   float maxbuf = fmax(tiling.maxbuf, 1.0f);
@@ -1703,62 +1825,57 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
   float processed_maximum_new[4] = { 1.0f };
   for(int k = 0; k < 4; k++) processed_maximum_saved[k] = piece->pipe->dsc.processed_maximum[k];
 
-  /* reserve pinned input and output memory for host<->device data transfer */
-  if(use_pinned_memory)
+  /* reserve pinned input and output memory for host<->device data transfer, one set per tile in flight */
+  for(int slot = 0; slot < slots && use_pinned_memory; slot++)
   {
-    pinned_input = dt_opencl_alloc_device_buffer_with_flags(devid, (size_t)width * height * in_bpp,
-                                                            CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR);
-    if(pinned_input == NULL)
+    pinned_input[slot] = dt_opencl_alloc_device_buffer_with_flags(devid, (size_t)width * height * in_bpp,
+                                                                  CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR);
+    if(pinned_input[slot] == NULL)
     {
       dt_print(DT_DEBUG_OPENCL,
                "[default_process_tiling_cl_roi] could not alloc pinned input buffer for module '%s'\n",
                self->op);
       use_pinned_memory = 0;
+      break;
     }
-  }
 
-  if(use_pinned_memory)
-  {
-
-    input_buffer = dt_opencl_map_buffer(devid, pinned_input, CL_TRUE, CL_MAP_WRITE, 0,
-                                        (size_t)width * height * in_bpp);
-    if(input_buffer == NULL)
+    input_buffer[slot] = dt_opencl_map_buffer(devid, pinned_input[slot], CL_TRUE, CL_MAP_WRITE, 0,
+                                              (size_t)width * height * in_bpp);
+    if(input_buffer[slot] == NULL)
     {
       dt_print(DT_DEBUG_OPENCL, "[default_process_tiling_cl_roi] could not map pinned input buffer to host "
                                 "memory for module '%s'\n",
                self->op);
       use_pinned_memory = 0;
+      break;
     }
-  }
-
-  if(use_pinned_memory)
-  {
 
-    pinned_output = dt_opencl_alloc_device_buffer_with_flags(devid, (size_t)width * height * out_bpp,
-                                                             CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR);
-    if(pinned_output == NULL)
+    pinned_output[slot] = dt_opencl_alloc_device_buffer_with_flags(devid, (size_t)width * height * out_bpp,
+                                                                   CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR);
+    if(pinned_output[slot] == NULL)
     {
       dt_print(DT_DEBUG_OPENCL,
                "[default_process_tiling_cl_roi] could not alloc pinned output buffer for module '%s'\n",
                self->op);
       use_pinned_memory = 0;
+      break;
     }
-  }
-
-  if(use_pinned_memory)
-  {
 
-    output_buffer = dt_opencl_map_buffer(devid, pinned_output, CL_TRUE, CL_MAP_READ, 0,
-                                         (size_t)width * height * out_bpp);
-    if(output_buffer == NULL)
+    output_buffer[slot] = dt_opencl_map_buffer(devid, pinned_output[slot], CL_TRUE, CL_MAP_READ, 0,
+                                               (size_t)width * height * out_bpp);
+    if(output_buffer[slot] == NULL)
     {
       dt_print(DT_DEBUG_OPENCL, "[default_process_tiling_cl_roi] could not map pinned output buffer to host "
                                 "memory for module '%s'\n",
                self->op);
       use_pinned_memory = 0;
+      break;
     }
   }
 
+  /* count tiles for the pinned buffer slots */
+  size_t tile_count = 0;
+
 
   /* iterate over tiles */
   for(size_t tx = 0; tx < tiles_x; tx++)
@@ -1867,6 +1984,12 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
       size_t oorigin[] = { oroi_good.x - oroi_full.x, oroi_good.y - oroi_full.y, 0 };
       size_t oregion[] = { oroi_good.width, oroi_good.height, 1 };
 
+      /* pinned buffers of this tile. in async mode the other slot may still be in use by the previous tile. */
+      const int slot = tile_count++ % slots;
+      char *const pinned_in = (char *)input_buffer[slot];
+      char *const pinned_out = (char *)output_buffer[slot];
+      _cl_pending_tile_t this_tile = { 0 };
+
       /* get opencl input and output buffers */
       input = dt_opencl_alloc_device(devid, iroi_full.width, iroi_full.height, in_bpp);
       if(input == NULL) goto error;
@@ -1879,23 +2002,23 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
 /* prepare pinned input tile buffer: copy part of input image */
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-        dt_omp_firstprivate(in_bpp, ipitch, ivoid) \
-        shared(input_buffer, width, ioffs, iroi_full) schedule(static)
+        dt_omp_firstprivate(in_bpp, ipitch, ivoid, pinned_in) \
+        shared(width, ioffs, iroi_full) schedule(static)
 #endif
         for(size_t j = 0; j < iroi_full.height; j++)
-          memcpy((char *)input_buffer + j * iroi_full.width * in_bpp, (char *)ivoid + ioffs + j * ipitch,
+          memcpy(pinned_in + j * iroi_full.width * in_bpp, (char *)ivoid + ioffs + j * ipitch,
                  (size_t)iroi_full.width * in_bpp);
 
-        /* blocking memory transfer: pinned host input buffer -> opencl/device tile */
-        err = dt_opencl_write_host_to_device_raw(devid, (char *)input_buffer, input, iorigin, iregion,
-                                                 (size_t)iroi_full.width * in_bpp, CL_TRUE);
+        /* memory transfer, blocking unless async: pinned host input buffer -> opencl/device tile */
+        err = dt_opencl_write_host_to_device_raw(devid, pinned_in, input, iorigin, iregion,
+                                                 (size_t)iroi_full.width * in_bpp, async ? CL_FALSE : CL_TRUE);
         if(err != CL_SUCCESS) goto error;
       }
       else
       {
-        /* blocking direct memory transfer: host input image -> opencl/device tile */
+        /* direct memory transfer, blocking unless async: host input image -> opencl/device tile */
         err = dt_opencl_write_host_to_device_raw(devid, (char *)ivoid + ioffs, input, iorigin, iregion,
-                                                 ipitch, CL_TRUE);
+                                                 ipitch, async ? CL_FALSE : CL_TRUE);
         if(err != CL_SUCCESS) goto error;
       }
 
@@ -1903,7 +2026,9 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
       for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
 
       /* call process_cl of module */
+      const double tile_start = dt_get_wtime();
       if(!self->process_cl(self, piece, input, output, &iroi_full, &oroi_full)) goto error;
+      _trace_tile(self, piece, &iroi_full, &oroi_full, in_bpp, out_bpp, tile_start, devid);
 
       /* aggregate resulting processed_maximum */
       /* TODO: check if there really can be differences between tiles and take
@@ -1920,60 +2045,92 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
 
       if(use_pinned_memory)
       {
-        /* blocking memory transfer: complete opencl/device tile -> pinned host output buffer */
-        err = dt_opencl_read_host_from_device_raw(devid, (char *)output_buffer, output, oforigin, ofregion,
-                                                  (size_t)oroi_full.width * out_bpp, CL_TRUE);
+        /* memory transfer, blocking unless async: complete opencl/device tile -> pinned host output buffer */
+        err = dt_opencl_read_host_from_device_raw(devid, pinned_out, output, oforigin, ofregion,
+                                                  (size_t)oroi_full.width * out_bpp, async ? CL_FALSE : CL_TRUE);
         if(err != CL_SUCCESS) goto error;
 
-/* copy "good" part of tile from pinned output buffer to output image */
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-        dt_omp_firstprivate(ipitch, opitch, ovoid, out_bpp) \
-        shared(ooffs, output_buffer, oroi_full, oorigin, oregion) \
-        schedule(static)
-#endif
-        for(size_t j = 0; j < oregion[1]; j++)
-          memcpy((char *)ovoid + ooffs + j * opitch,
-                 (char *)output_buffer + ((j + oorigin[1]) * oroi_full.width + oorigin[0]) * out_bpp,
-                 (size_t)oregion[0] * out_bpp);
+        /* "good" part of tile in the pinned output buffer, copied to the output image once the download
+           completed */
+        this_tile.host = pinned_out + (oorigin[1] * oroi_full.width + oorigin[0]) * out_bpp;
+        this_tile.host_pitch = (size_t)oroi_full.width * out_bpp;
+        this_tile.ooffs = ooffs;
+        this_tile.rows = oregion[1];
+        this_tile.rowbytes = oregion[0] * out_bpp;
+        if(!async) _cl_tile_copy_out(&this_tile, ovoid, opitch);
       }
       else
       {
-        /* blocking direct memory transfer: good part of opencl/device tile -> host output image */
+        /* direct memory transfer, blocking unless async: good part of opencl/device tile -> host output image */
         err = dt_opencl_read_host_from_device_raw(devid, (char *)ovoid + ooffs, output, oorigin, oregion,
-                                                  opitch, CL_TRUE);
+                                                  opitch, async ? CL_FALSE : CL_TRUE);
         if(err != CL_SUCCESS) goto error;
       }
 
-      /* release input and output buffers */
+      /* release input and output buffers. the device keeps them alive until the queued work is done. */
       dt_opencl_release_mem_object(input);
       input = NULL;
       dt_opencl_release_mem_object(output);
       output = NULL;
 
+      if(async)
+      {
+        /* queue a marker behind this tile and get the device going, then finish the previous tile
+           while this one computes */
+        this_tile.done = dt_opencl_enqueue_marker(devid);
+        if(this_tile.done == NULL) goto error;
+        err = dt_opencl_flush(devid);
+        if(err != CL_SUCCESS)
+        {
+          _cl_pending_tile_drop(devid, &pending);
+          pending = this_tile;
+          goto error;
+        }
+        if(!_cl_pending_tile_finish(devid, &pending, ovoid, opitch))
+        {
+          pending = this_tile;
+          goto error;
+        }
+        pending = this_tile;
+      }
       /* block until opencl queue has finished to free all used event handlers */
-      if(!darktable.opencl->async_pixelpipe || piece->pipe->type == DT_DEV_PIXELPIPE_EXPORT)
+      else if(!darktable.opencl->async_pixelpipe || piece->pipe->type == DT_DEV_PIXELPIPE_EXPORT)
         dt_opencl_finish(devid);
     }
 
+  /* the last tile */
+  if(!_cl_pending_tile_finish(devid, &pending, ovoid, opitch)) goto error;
+  if(async && (!darktable.opencl->async_pixelpipe || piece->pipe->type == DT_DEV_PIXELPIPE_EXPORT))
+    dt_opencl_finish(devid);
+
   /* copy back final processed_maximum */
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
-  if(input_buffer != NULL) dt_opencl_unmap_mem_object(devid, pinned_input, input_buffer);
-  dt_opencl_release_mem_object(pinned_input);
-  if(output_buffer != NULL) dt_opencl_unmap_mem_object(devid, pinned_output, output_buffer);
-  dt_opencl_release_mem_object(pinned_output);
+  for(int slot = 0; slot < 2; slot++)
+  {
+    if(input_buffer[slot] != NULL) dt_opencl_unmap_mem_object(devid, pinned_input[slot], input_buffer[slot]);
+    dt_opencl_release_mem_object(pinned_input[slot]);
+    if(output_buffer[slot] != NULL) dt_opencl_unmap_mem_object(devid, pinned_output[slot], output_buffer[slot]);
+    dt_opencl_release_mem_object(pinned_output[slot]);
+  }
   dt_opencl_release_mem_object(input);
   dt_opencl_release_mem_object(output);
   piece->pipe->tiling = 0;
   return TRUE;
 
 error:
+  /* whatever is still queued, including a non-blocking download straight into ovoid, has to be done before
+     buffers go away and the cpu fallback writes ovoid */
+  dt_opencl_finish(devid);
+  _cl_pending_tile_drop(devid, &pending);
   /* copy back stored processed_maximum */
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
-  if(input_buffer != NULL) dt_opencl_unmap_mem_object(devid, pinned_input, input_buffer);
-  dt_opencl_release_mem_object(pinned_input);
-  if(output_buffer != NULL) dt_opencl_unmap_mem_object(devid, pinned_output, output_buffer);
-  dt_opencl_release_mem_object(pinned_output);
+  for(int slot = 0; slot < 2; slot++)
+  {
+    if(input_buffer[slot] != NULL) dt_opencl_unmap_mem_object(devid, pinned_input[slot], input_buffer[slot]);
+    dt_opencl_release_mem_object(pinned_input[slot]);
+    if(output_buffer[slot] != NULL) dt_opencl_unmap_mem_object(devid, pinned_output[slot], output_buffer[slot]);
+    dt_opencl_release_mem_object(pinned_output[slot]);
+  }
   dt_opencl_release_mem_object(input);
   dt_opencl_release_mem_object(output);
   piece->pipe->tiling = 0;
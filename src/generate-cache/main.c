@@ -18,6 +18,7 @@
 */
 
 #include <glib.h>    // for g_mkdir_with_parents, _
+#include <glib/gstdio.h> // for g_stat, g_fopen, g_unlink
 #include <gtk/gtk.h> // for gtk_init_check
 #include <libintl.h> // for bind_textdomain_codeset, etc
 #include <limits.h>  // for PATH_MAX
@@ -27,11 +28,12 @@
 #include <stdio.h>   // for fprintf, stderr, snprintf, NULL, etc
 #include <stdlib.h>  // for exit, EXIT_FAILURE
 #include <string.h>  // for strcmp
-#include <unistd.h>  // for access, R_OK
+#include <pthread.h> // for pthread_join
 
 #include "common/darktable.h"    // for darktable, darktable_t, dt_cleanup, etc
 #include "common/database.h"     // for dt_database_get
 #include "common/debug.h"        // for DT_DEBUG_SQLITE3_PREPARE_V2
+#include "common/image.h"        // for dt_image_full_path
 #include "common/mipmap_cache.h" // for dt_mipmap_size_t, etc
 #include "config.h"              // for GETTEXT_PACKAGE, etc
 #include "control/conf.h"        // for dt_conf_get_bool
@@ -40,7 +42,148 @@
 #include "win/main_wrapper.h"
 #endif
 
-static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip, const int32_t min_imgid, const int32_t max_imgid)
+// one entry of the work list
+typedef struct dt_gen_cache_image_t
+{
+  int32_t imgid;
+  int64_t write_timestamp;
+} dt_gen_cache_image_t;
+
+// state shared between the workers, everything below the mutex is protected by it
+typedef struct dt_gen_cache_t
+{
+  dt_mipmap_size_t min_mip, max_mip;
+  int jobs;
+  dt_gen_cache_image_t *images;
+  size_t image_count;
+
+  dt_pthread_mutex_t mutex;
+  size_t next, counter, generated, skipped;
+  double bytes_read;
+  double start;
+  FILE *checkpoint;
+  GHashTable *done; // image ids finished in an interrupted earlier run
+} dt_gen_cache_t;
+
+static int64_t _mtime(const char *filename, double *size)
+{
+  GStatBuf st;
+  if(g_stat(filename, &st)) return -1;
+  if(size) *size = st.st_size;
+  return st.st_mtime;
+}
+
+// TRUE if some mip level in the requested range is missing from the disk cache. stale ones, older than the
+// image or its last edit, are removed so they get generated again.
+static gboolean _needs_thumbnails(const dt_gen_cache_t *gc, const dt_gen_cache_image_t *image, double *bytes)
+{
+  char filename[PATH_MAX] = { 0 };
+  gboolean from_cache = TRUE;
+  dt_image_full_path(image->imgid, filename, sizeof(filename), &from_cache);
+  const int64_t source_mtime = _mtime(filename, bytes);
+  const int64_t changed = MAX(source_mtime, image->write_timestamp);
+
+  gboolean missing = FALSE;
+  for(int k = gc->max_mip; k >= gc->min_mip && k >= 0; k--)
+  {
+    const int64_t mtime = dt_mipmap_cache_get_ondisk_timestamp(darktable.mipmap_cache, image->imgid, k);
+    if(mtime < 0)
+      missing = TRUE;
+    else if(mtime < changed)
+    {
+      // the disk cache would hand out the old thumbnails again
+      dt_mipmap_cache_remove(darktable.mipmap_cache, image->imgid);
+      return TRUE;
+    }
+  }
+  return missing;
+}
+
+static void *_worker(void *data)
+{
+  dt_gen_cache_t *gc = (dt_gen_cache_t *)data;
+#ifdef _OPENMP // need to do this in every thread
+  omp_set_num_threads(MAX(1, darktable.num_openmp_threads / gc->jobs));
+#endif
+
+  while(TRUE)
+  {
+    dt_pthread_mutex_lock(&gc->mutex);
+    const dt_gen_cache_image_t *image = gc->next < gc->image_count ? gc->images + gc->next++ : NULL;
+    dt_pthread_mutex_unlock(&gc->mutex);
+    if(!image) break;
+
+    double bytes = 0.0;
+    const gboolean resumed = gc->done && g_hash_table_contains(gc->done, GINT_TO_POINTER(image->imgid));
+    const gboolean generate = !resumed && _needs_thumbnails(gc, image, &bytes);
+    if(generate)
+    {
+      for(int k = gc->max_mip; k >= gc->min_mip && k >= 0; k--)
+      {
+        // generate thumbnail and store in mipmap cache. the ones already on disc are just read back.
+        dt_mipmap_buffer_t buf;
+        dt_mipmap_cache_get(darktable.mipmap_cache, &buf, image->imgid, k, DT_MIPMAP_BLOCKING, 'r');
+        dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+      }
+
+      // and immediately write thumbs to disc and remove from mipmap cache.
+      dt_mimap_cache_evict(darktable.mipmap_cache, image->imgid);
+    }
+
+    dt_pthread_mutex_lock(&gc->mutex);
+    gc->counter++;
+    if(generate)
+    {
+      gc->generated++;
+      gc->bytes_read += bytes;
+    }
+    else
+      gc->skipped++;
+    if(gc->checkpoint && !resumed)
+    {
+      fprintf(gc->checkpoint, "%d\n", image->imgid);
+      fflush(gc->checkpoint);
+    }
+    const double elapsed = MAX(dt_get_wtime() - gc->start, 1e-3);
+    fprintf(stderr, "image %zu/%zu (%.02f%%) (id:%d%s) %.2f images/s, %.2f MB/s\n", gc->counter, gc->image_count,
+            100.0 * gc->counter / (float)gc->image_count, image->imgid, generate ? "" : ", skipped",
+            gc->generated / elapsed, gc->bytes_read / (1024.0 * 1024.0) / elapsed);
+    dt_pthread_mutex_unlock(&gc->mutex);
+  }
+  return NULL;
+}
+
+// the checkpoint lists the images done so far for this range of mip levels, one id per line
+static void _open_checkpoint(dt_gen_cache_t *gc, const char *filename, const gboolean restart)
+{
+  char header[64];
+  snprintf(header, sizeof(header), "darktable-generate-cache mips %d-%d\n", gc->min_mip, gc->max_mip);
+
+  FILE *f = restart ? NULL : g_fopen(filename, "r");
+  if(f)
+  {
+    char line[64];
+    if(fgets(line, sizeof(line), f) && !strcmp(line, header))
+    {
+      gc->done = g_hash_table_new(NULL, NULL);
+      while(fgets(line, sizeof(line), f)) g_hash_table_add(gc->done, GINT_TO_POINTER(atoi(line)));
+      fprintf(stderr, _("resuming from checkpoint '%s', %u images done\n"), filename,
+              g_hash_table_size(gc->done));
+    }
+    fclose(f);
+  }
+
+  gc->checkpoint = g_fopen(filename, gc->done ? "a" : "w");
+  if(!gc->checkpoint)
+    fprintf(stderr, _("warning: could not write checkpoint '%s', an interrupted run will start over\n"),
+            filename);
+  else if(!gc->done)
+    fputs(header, gc->checkpoint);
+}
+
+static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip,
+                                    const int32_t min_imgid, const int32_t max_imgid, const int jobs,
+                                    const gboolean restart)
 {
   fprintf(stderr, _("creating cache directories\n"));
   for(dt_mipmap_size_t k = min_mip; k <= max_mip; k++)
@@ -56,64 +199,71 @@ static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mip
     }
   }
 
-  // some progress counter
+  dt_gen_cache_t gc = { 0 };
+  gc.min_mip = min_mip;
+  gc.max_mip = max_mip;
+  gc.jobs = jobs;
+
+  // the work list, by film roll, so the raws of one folder are read one after the other
   sqlite3_stmt *stmt;
-  size_t image_count = 0, counter = 0;
+  size_t allocated = 1024;
+  gc.images = malloc(allocated * sizeof(dt_gen_cache_image_t));
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT COUNT(*) FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
+                              "SELECT id, IFNULL(write_timestamp, 0) FROM main.images"
+                              " WHERE id >= ?1 AND id <= ?2 ORDER BY film_id, filename, version",
+                              -1, &stmt, 0);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    image_count = sqlite3_column_int(stmt, 0);
-    sqlite3_finalize(stmt);
-  }
-  else
+  while(sqlite3_step(stmt) == SQLITE_ROW)
   {
-    return 1;
+    if(gc.image_count == allocated)
+    {
+      allocated *= 2;
+      gc.images = realloc(gc.images, allocated * sizeof(dt_gen_cache_image_t));
+    }
+    gc.images[gc.image_count].imgid = sqlite3_column_int(stmt, 0);
+    gc.images[gc.image_count].write_timestamp = sqlite3_column_int64(stmt, 1);
+    gc.image_count++;
   }
+  sqlite3_finalize(stmt);
 
-  if(!image_count)
+  if(!gc.image_count)
   {
     fprintf(stderr, _("warning: no images are matching the requested image id range\n"));
     if(min_imgid > max_imgid)
     {
       fprintf(stderr, _("warning: did you want to swap these boundaries?\n"));
     }
+    free(gc.images);
+    return 0;
   }
 
-  // go through all images:
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT id FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
-  while(sqlite3_step(stmt) == SQLITE_ROW)
+  char checkpoint[PATH_MAX] = { 0 };
+  snprintf(checkpoint, sizeof(checkpoint), "%s.d/generate-cache.checkpoint", darktable.mipmap_cache->cachedir);
+  _open_checkpoint(&gc, checkpoint, restart);
+
+  // go through all images, each worker runs its own pixelpipes
+  dt_pthread_mutex_init(&gc.mutex, NULL);
+  gc.start = dt_get_wtime();
+  pthread_t *workers = calloc(jobs, sizeof(pthread_t));
+  for(int k = 0; k < jobs; k++) dt_pthread_create(&workers[k], _worker, &gc);
+  for(int k = 0; k < jobs; k++) pthread_join(workers[k], NULL);
+  free(workers);
+  dt_pthread_mutex_destroy(&gc.mutex);
+
+  const double elapsed = MAX(dt_get_wtime() - gc.start, 1e-3);
+  fprintf(stderr, _("done: %zu images, %zu generated, %zu skipped in %.1f s (%.2f images/s, %.2f MB/s)\n"),
+          gc.counter, gc.generated, gc.skipped, elapsed, gc.generated / elapsed,
+          gc.bytes_read / (1024.0 * 1024.0) / elapsed);
+
+  // finished, nothing to resume
+  if(gc.checkpoint)
   {
-    const int32_t imgid = sqlite3_column_int(stmt, 0);
-
-    counter++;
-    fprintf(stderr, "image %zu/%zu (%.02f%%) (id:%d)\n", counter, image_count, 100.0 * counter / (float)image_count, imgid);
-
-    for(int k = max_mip; k >= min_mip && k >= 0; k--)
-    {
-      char filename[PATH_MAX] = { 0 };
-      snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", darktable.mipmap_cache->cachedir, k, imgid);
-
-      // if the thumbnail is already on disc - do nothing
-      if(!access(filename, R_OK)) continue;
-
-      // else, generate thumbnail and store in mipmap cache.
-      dt_mipmap_buffer_t buf;
-      dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
-      dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
-    }
-
-    // and immediately write thumbs to disc and remove from mipmap cache.
-    dt_mimap_cache_evict(darktable.mipmap_cache, imgid);
+    fclose(gc.checkpoint);
+    g_unlink(checkpoint);
   }
-
-  sqlite3_finalize(stmt);
-  fprintf(stderr, "done\n");
+  if(gc.done) g_hash_table_destroy(gc.done);
+  free(gc.images);
 
   return 0;
 }
@@ -125,13 +275,18 @@ static void usage(const char *progname)
       "usage: %s [-h, --help; --version]\n"
       "  [--min-mip <0-7> (default = 0)] [-m, --max-mip <0-7> (default = 2)]\n"
       "  [--min-imgid <N>] [--max-imgid <N>]\n"
+      "  [-j, --jobs <N> (default = 1)] [--restart]\n"
       "  [--core <darktable options>]\n"
       "\n"
       "When multiple mipmap sizes are requested, the biggest one is computed\n"
       "while the rest are quickly downsampled.\n"
       "\n"
       "The --min-imgid and --max-imgid specify the range of internal image ID\n"
-      "numbers to work on.\n",
+      "numbers to work on.\n"
+      "\n"
+      "--jobs sets the number of images worked on in parallel. Thumbnails older\n"
+      "than their image or its last edit are generated again. An interrupted\n"
+      "run picks up where it stopped, unless --restart is given.\n",
       progname);
 }
 
@@ -148,6 +303,8 @@ int main(int argc, char *arg[])
   dt_mipmap_size_t max_mip = DT_MIPMAP_2;
   int32_t min_imgid = 0;
   int32_t max_imgid = INT32_MAX;
+  int jobs = 1;
+  gboolean restart = FALSE;
 
   int k;
   for(k = 1; k < argc; k++)
@@ -182,6 +339,15 @@ int main(int argc, char *arg[])
       k++;
       max_imgid = (int32_t)MIN(MAX(atoi(arg[k]), 0), INT32_MAX);
     }
+    else if((!strcmp(arg[k], "-j") || !strcmp(arg[k], "--jobs")) && argc > k + 1)
+    {
+      k++;
+      jobs = MIN(MAX(atoi(arg[k]), 1), 256);
+    }
+    else if(!strcmp(arg[k], "--restart"))
+    {
+      restart = TRUE;
+    }
     else if(!strcmp(arg[k], "--core"))
     {
       // everything from here on should be passed to the core
@@ -225,7 +391,7 @@ int main(int argc, char *arg[])
 
   fprintf(stderr, _("creating complete lighttable thumbnail cache\n"));
 
-  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid))
+  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid, jobs, restart))
   {
     free(m_arg);
     exit(EXIT_FAILURE);
@@ -78,6 +78,10 @@ typedef struct dt_gui_presets_edit_dialog_t
 // so beware, don't use any darktable.gui stuff here .. (or change this behaviour in darktable.c)
 void dt_gui_presets_init()
 {
+  // the auto generated presets of this very darktable are still there, the iop manifest
+  // takes care of the modules which changed since.
+  if(dt_iop_presets_manifest_current()) return;
+
   // remove auto generated presets from plugins, not the user included ones.
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM data.presets WHERE writeprotect = 1", NULL,
                         NULL, NULL);
@@ -30,6 +30,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <tiffio.h>
+#include <zlib.h>
 
 DT_MODULE(3)
 
@@ -49,6 +50,91 @@ typedef struct dt_imageio_tiff_gui_t
   GtkWidget *compresslevel;
 } dt_imageio_tiff_gui_t;
 
+// strips are encoded in parallel and handed to libtiff as raw data. this size keeps
+// all threads busy and still compresses about as well as whole rows.
+#define DT_TIFF_STRIP_SIZE (256 * 1024)
+
+// what libtiff's predictors do to a row of 3 channel pixels before deflating it.
+// the floating point one stores the bytes of the row msb first, one byte plane
+// after the other, then both take differences to the previous pixel.
+static void _predict_row(uint8_t *row, uint8_t *tmp, const size_t width, const int bpp, const uint16_t predictor)
+{
+  const size_t samples = 3 * width;
+  if(predictor == PREDICTOR_FLOATINGPOINT)
+  {
+    const size_t bytes = 4 * samples;
+    memcpy(tmp, row, bytes);
+    for(size_t k = 0; k < samples; k++)
+      for(int b = 0; b < 4; b++)
+#if G_BYTE_ORDER == G_BIG_ENDIAN
+        row[b * samples + k] = tmp[4 * k + b];
+#else
+        row[(3 - b) * samples + k] = tmp[4 * k + b];
+#endif
+    for(size_t k = bytes; k-- > 3;) row[k] -= row[k - 3];
+  }
+  else if(predictor == PREDICTOR_HORIZONTAL)
+  {
+    if(bpp == 32)
+    {
+      uint32_t *r = (uint32_t *)row;
+      for(size_t k = samples; k-- > 3;) r[k] -= r[k - 3];
+    }
+    else if(bpp == 16)
+    {
+      uint16_t *r = (uint16_t *)row;
+      for(size_t k = samples; k-- > 3;) r[k] -= r[k - 3];
+    }
+    else
+      for(size_t k = samples; k-- > 3;) row[k] -= row[k - 3];
+  }
+
+#if G_BYTE_ORDER == G_BIG_ENDIAN
+  // the file is little endian, libtiff doesn't swap raw strips for us
+  if(predictor != PREDICTOR_FLOATINGPOINT && bpp > 8)
+  {
+    const int bytes = bpp / 8;
+    for(size_t k = 0; k < samples; k++)
+      for(int b = 0; b < bytes / 2; b++)
+      {
+        const uint8_t t = row[bytes * k + b];
+        row[bytes * k + b] = row[bytes * k + bytes - 1 - b];
+        row[bytes * k + bytes - 1 - b] = t;
+      }
+  }
+#endif
+}
+
+// converts the rows of one strip to 3 channels, applies the predictor and deflates them.
+// returns the size of the data to write, which is in raw or packed. -1 on error.
+static long _encode_strip(const dt_imageio_tiff_t *d, const uint16_t predictor, const void *in_void,
+                          const uint32_t strip, const uint32_t rowsperstrip, uint8_t *raw, uint8_t *packed,
+                          const size_t packed_size, uint8_t *tmp, const uint8_t **out)
+{
+  const size_t width = d->global.width;
+  const size_t bytes = d->bpp / 8;
+  const size_t rowsize = 3 * width * bytes;
+  const uint32_t first = strip * rowsperstrip;
+  const uint32_t rows = MIN(rowsperstrip, d->global.height - first);
+
+  for(uint32_t y = 0; y < rows; y++)
+  {
+    const uint8_t *in = (const uint8_t *)in_void + 4 * bytes * width * (first + y);
+    uint8_t *row = raw + rowsize * y;
+    for(size_t x = 0; x < width; x++) memcpy(row + 3 * bytes * x, in + 4 * bytes * x, 3 * bytes);
+    _predict_row(row, tmp, width, d->bpp, predictor);
+  }
+
+  *out = raw;
+  if(d->compress == 0) return rows * rowsize;
+
+  // a complete zlib stream per strip, just like libtiff's deflate codec writes it
+  uLongf size = packed_size;
+  if(compress2(packed, &size, raw, rows * rowsize, d->compresslevel) != Z_OK) return -1;
+  *out = packed;
+  return size;
+}
+
 
 int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void,
                 dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
@@ -140,7 +226,9 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32_t)d->global.height);
   TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, (uint16_t)PHOTOMETRIC_RGB);
   TIFFSetField(tif, TIFFTAG_PLANARCONFIG, (uint16_t)PLANARCONFIG_CONTIG);
-  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, (uint32_t)1);
+  const size_t rowsize = (size_t)3 * d->global.width * d->bpp / 8;
+  const uint32_t rowsperstrip = CLAMP(DT_TIFF_STRIP_SIZE / rowsize, 1, d->global.height);
+  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, rowsperstrip);
   TIFFSetField(tif, TIFFTAG_ORIENTATION, (uint16_t)ORIENTATION_TOPLEFT);
 
   int resolution = dt_conf_get_int("metadata/resolution");
@@ -151,71 +239,63 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
     TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, (uint16_t)RESUNIT_INCH);
   }
 
-  const size_t rowsize = (d->global.width * 3) * d->bpp / 8;
-  if((rowdata = malloc(rowsize)) == NULL)
+  const uint16_t predictor = d->compress == 3 && d->bpp == 32 ? PREDICTOR_FLOATINGPOINT
+                             : d->compress >= 2                ? PREDICTOR_HORIZONTAL
+                                                               : PREDICTOR_NONE;
+
+  // strips are encoded a batch at a time, and written in order
+  const double start = dt_get_wtime();
+  const uint32_t strips = (d->global.height + rowsperstrip - 1) / rowsperstrip;
+  const int batch = MIN(4 * dt_get_num_threads(), strips);
+  const size_t raw_size = rowsize * rowsperstrip;
+  const size_t packed_size = compressBound(raw_size);
+  // every sub-buffer starts 64 byte aligned, the predictors access them as 16 and 32 bit words and floats
+  const size_t raw_stride = dt_round_size_sse(raw_size);
+  const size_t packed_stride = dt_round_size_sse(packed_size);
+  const size_t stride = raw_stride + packed_stride + dt_round_size_sse(rowsize);
+  long *sizes = malloc(sizeof(long) * batch);
+  const uint8_t **outs = malloc(sizeof(uint8_t *) * batch);
+  if((rowdata = dt_alloc_align(64, stride * batch)) == NULL || !sizes || !outs)
   {
+    free(sizes);
+    free(outs);
     rc = 1;
     goto exit;
   }
 
-  if(d->bpp == 32)
+  int error = 0;
+  for(uint32_t first = 0; first < strips; first += batch)
   {
-    for(int y = 0; y < d->global.height; y++)
+    const int count = MIN(batch, strips - first);
+    uint8_t *const buf = (uint8_t *)rowdata;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(d, predictor, in_void, first, rowsperstrip, raw_stride, packed_size, packed_stride, \
+                        stride, count, buf, sizes, outs) \
+    schedule(dynamic)
+#endif
+    for(int s = 0; s < count; s++)
     {
-      float *in = (float *)in_void + (size_t)4 * y * d->global.width;
-      float *out = (float *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += 3)
-      {
-        memcpy(out, in, 3 * sizeof(float));
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
+      uint8_t *raw = buf + stride * s;
+      sizes[s] = _encode_strip(d, predictor, in_void, first + s, rowsperstrip, raw, raw + raw_stride, packed_size,
+                               raw + raw_stride + packed_stride, outs + s);
     }
-  }
-  else if(d->bpp == 16)
-  {
-    for(int y = 0; y < d->global.height; y++)
-    {
-      uint16_t *in = (uint16_t *)in_void + (size_t)4 * y * d->global.width;
-      uint16_t *out = (uint16_t *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += 3)
-      {
-        memcpy(out, in, 3 * sizeof(uint16_t));
-      }
 
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
-    }
+    for(int s = 0; s < count && !error; s++)
+      error = sizes[s] < 0 || TIFFWriteRawStrip(tif, first + s, (void *)outs[s], sizes[s]) == -1;
+    if(error) break;
   }
-  else
+  free(sizes);
+  free(outs);
+  if(error)
   {
-    for(int y = 0; y < d->global.height; y++)
-    {
-      uint8_t *in = (uint8_t *)in_void + (size_t)4 * y * d->global.width;
-      uint8_t *out = (uint8_t *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += 3)
-      {
-        memcpy(out, in, 3 * sizeof(uint8_t));
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
-    }
+    rc = 1;
+    goto exit;
   }
 
+  dt_print(DT_DEBUG_PERF, "[tiff] encoded %dx%d at %d bit in %u strips in %.3f s\n", d->global.width,
+           d->global.height, d->bpp, strips, dt_get_wtime() - start);
+
   // success
   rc = 0;
 
@@ -234,7 +314,7 @@ exit:
   }
   free(profile);
   profile = NULL;
-  free(rowdata);
+  dt_free_align(rowdata);
   rowdata = NULL;
 
   return rc;
@@ -20,6 +20,7 @@
 #include "config.h"
 #endif
 #include "bauhaus/bauhaus.h"
+#include "common/clut.h"
 #include "common/colormatrices.c"
 #include "common/colorspaces.h"
 #include "common/colorspaces_inline_conversions.h"
@@ -56,6 +57,9 @@
 
 #define LUT_SAMPLES 0x10000
 
+// size of the 3D lut lcms2 transforms are baked into
+#define CLUT_LEVEL 33
+
 DT_MODULE_INTROSPECTION(6, dt_iop_colorin_params_t)
 
 static void update_profile_list(dt_iop_module_t *self);
@@ -107,6 +111,7 @@ typedef struct dt_iop_colorin_data_t
   float nmatrix[9];
   float lmatrix[9];
   float unbounded_coeffs[3][3]; // approximation for extrapolation of shaper curves
+  float *clut;                  // lcms2 transforms baked into a 3D lut, indexed by sqrt of the input
   int blue_mapping;
   int nonlinearlut;
   dt_colorspaces_color_profile_type_t type;
@@ -910,6 +915,135 @@ static void process_cmatrix(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t
   }
 }
 
+// the general lcms2 fallback, in and out may be the same buffer
+static void transform_lcms2(const dt_iop_colorin_data_t *const d, const float *const in, float *const out,
+                            const int width)
+{
+  // convert to (L,a/L,b/L) to be able to change L without changing saturation.
+  if(!d->nrgb)
+  {
+    cmsDoTransform(d->xform_cam_Lab, in, out, width);
+  }
+  else
+  {
+    cmsDoTransform(d->xform_cam_nrgb, in, out, width);
+
+    float *rgbptr = (float *)out;
+    for(int j = 0; j < width; j++, rgbptr += 4)
+    {
+      for(int c = 0; c < 3; c++)
+      {
+        rgbptr[c] = CLAMP(rgbptr[c], 0.0f, 1.0f);
+      }
+    }
+
+    cmsDoTransform(d->xform_nrgb_Lab, out, out, width);
+  }
+}
+
+static inline int clut_out_of_domain(const float *const in)
+{
+  return !(in[0] >= 0.0f && in[0] <= 1.0f && in[1] >= 0.0f && in[1] <= 1.0f && in[2] >= 0.0f && in[2] <= 1.0f);
+}
+
+// run the lcms2 transforms on the lut nodes. the nodes are spaced evenly in sqrt(input) to spend more of
+// them on the shadows.
+static float *bake_clut(const dt_iop_colorin_data_t *const d)
+{
+  const int level = CLUT_LEVEL;
+  float *const clut = dt_alloc_align(64, sizeof(float) * 3 * level * level * level);
+  if(!clut) return NULL;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(clut, d, level) \
+  schedule(static)
+#endif
+  for(int gb = 0; gb < level * level; gb++)
+  {
+    float row[4 * CLUT_LEVEL] DT_ALIGNED_ARRAY;
+    const float g = (float)(gb % level) / (level - 1);
+    const float b = (float)(gb / level) / (level - 1);
+    for(int r = 0; r < level; r++)
+    {
+      const float rr = (float)r / (level - 1);
+      row[4 * r + 0] = rr * rr;
+      row[4 * r + 1] = g * g;
+      row[4 * r + 2] = b * b;
+      row[4 * r + 3] = 0.0f;
+    }
+
+    transform_lcms2(d, row, row, level);
+
+    float *const node = clut + (size_t)3 * level * gb;
+    for(int r = 0; r < level; r++)
+      for(int c = 0; c < 3; c++) node[3 * r + c] = row[4 * r + c];
+  }
+
+  return clut;
+}
+
+// lcms2 transforms baked into the 3D lut, pixels outside of its domain still go through lcms2
+static void process_clut(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+                         void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)piece->data;
+  const int ch = piece->colors;
+  const int blue_mapping = d->blue_mapping && piece->pipe->image.flags & DT_IMAGE_RAW;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(blue_mapping, ch, d, ivoid, ovoid, roi_out) \
+  schedule(static)
+#endif
+  for(int k = 0; k < roi_out->height; k++)
+  {
+    const float *in = (const float *)ivoid + (size_t)ch * k * roi_out->width;
+    float *out = (float *)ovoid + (size_t)ch * k * roi_out->width;
+    const int width = roi_out->width;
+
+    if(blue_mapping)
+    {
+      for(int j = 0; j < width; j++) apply_blue_mapping(in + 4 * j, out + 4 * j);
+      in = out;
+    }
+
+    // collect pixels the lut can't handle before out gets overwritten
+    int outside = 0;
+    for(int j = 0; j < width; j++) outside += clut_out_of_domain(in + 4 * j);
+
+    float *fallback = NULL;
+    int *fallback_index = NULL;
+    if(outside)
+    {
+      fallback = dt_alloc_align(64, sizeof(float) * 4 * outside);
+      fallback_index = malloc(sizeof(int) * outside);
+      for(int j = 0, n = 0; j < width; j++)
+      {
+        if(!clut_out_of_domain(in + 4 * j)) continue;
+        for(int c = 0; c < 4; c++) fallback[4 * n + c] = in[4 * j + c];
+        fallback_index[n++] = j;
+      }
+    }
+
+    for(int j = 0; j < width; j++)
+    {
+      for(int c = 0; c < 3; c++) out[4 * j + c] = sqrtf(fmaxf(in[4 * j + c], 0.0f));
+      out[4 * j + 3] = in[4 * j + 3];
+    }
+    dt_clut_tetrahedral_row(out, out, width, d->clut, CLUT_LEVEL);
+
+    if(outside)
+    {
+      transform_lcms2(d, fallback, fallback, outside);
+      for(int n = 0; n < outside; n++)
+        for(int c = 0; c < 3; c++) out[4 * fallback_index[n] + c] = fallback[4 * n + c];
+      free(fallback_index);
+      dt_free_align(fallback);
+    }
+  }
+}
+
 static void process_lcms2_bm(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
                              void *const ovoid, const dt_iop_roi_t *const roi_in,
                              const dt_iop_roi_t *const roi_out)
@@ -1004,8 +1138,12 @@ static void process_lcms2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *
   const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)piece->data;
   const int blue_mapping = d->blue_mapping && piece->pipe->image.flags & DT_IMAGE_RAW;
 
+  if(d->clut)
+  {
+    process_clut(self, piece, ivoid, ovoid, roi_in, roi_out);
+  }
   // use general lcms2 fallback
-  if(blue_mapping)
+  else if(blue_mapping)
   {
     process_lcms2_bm(self, piece, ivoid, ovoid, roi_in, roi_out);
   }
@@ -1402,8 +1540,12 @@ static void process_sse2_lcms2(struct dt_iop_module_t *self, dt_dev_pixelpipe_io
   const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)piece->data;
   const int blue_mapping = d->blue_mapping && piece->pipe->image.flags & DT_IMAGE_RAW;
 
+  if(d->clut)
+  {
+    process_clut(self, piece, ivoid, ovoid, roi_in, roi_out);
+  }
   // use general lcms2 fallback
-  if(blue_mapping)
+  else if(blue_mapping)
   {
     process_sse2_lcms2_bm(self, piece, ivoid, ovoid, roi_in, roi_out);
   }
@@ -1503,6 +1645,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     cmsDeleteTransform(d->xform_nrgb_Lab);
     d->xform_nrgb_Lab = NULL;
   }
+  dt_free_align(d->clut);
+  d->clut = NULL;
 
   d->cmatrix[0] = d->nmatrix[0] = d->lmatrix[0] = NAN;
   d->lut[0][0] = -1.0f;
@@ -1711,6 +1855,10 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     }
   }
 
+  // no matrix: bake the lcms2 transforms into a 3D lut instead of running them on every pixel.
+  // the lut covers [0,1] rgb, other input spaces stay on lcms2.
+  if(isnan(d->cmatrix[0]) && d->xform_cam_Lab && input_color_space == cmsSigRgbData) d->clut = bake_clut(d);
+
   d->nonlinearlut = 0;
 
   // now try to initialize unbounded mode:
@@ -1743,6 +1891,7 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
   d->xform_cam_Lab = NULL;
   d->xform_cam_nrgb = NULL;
   d->xform_nrgb_Lab = NULL;
+  d->clut = NULL;
   self->commit_params(self, self->default_params, pipe, piece);
 }
 
@@ -1765,6 +1914,8 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
     cmsDeleteTransform(d->xform_nrgb_Lab);
     d->xform_nrgb_Lab = NULL;
   }
+  dt_free_align(d->clut);
+  d->clut = NULL;
 
   free(piece->data);
   piece->data = NULL;
@@ -20,6 +20,7 @@
 #include "config.h"
 #endif
 #include "bauhaus/bauhaus.h"
+#include "common/clut.h"
 #include "common/colorspaces.h"
 #include "common/colorspaces_inline_conversions.h"
 #include "common/file_location.h"
@@ -46,6 +47,9 @@
 #define DT_IOP_COLOR_ICC_LEN 512
 #define LUT_SAMPLES 0x10000
 
+// size of the 3D lut the lcms2 transform is baked into
+#define CLUT_LEVEL 33
+
 DT_MODULE_INTROSPECTION(5, dt_iop_colorout_params_t)
 
 typedef struct dt_iop_colorout_data_t
@@ -55,6 +59,7 @@ typedef struct dt_iop_colorout_data_t
   float lut[3][LUT_SAMPLES];
   float cmatrix[9];
   cmsHTRANSFORM *xform;
+  float *clut;                  // xform baked into a 3D lut over normalized Lab
   float unbounded_coeffs[3][3]; // for extrapolation of shaper curves
 } dt_iop_colorout_data_t;
 
@@ -385,6 +390,110 @@ static void process_fastpath_apply_tonecurves(struct dt_iop_module_t *self, dt_d
   }
 }
 
+// the lut covers L in [0,100] and a, b in [-128,128]
+static inline void clut_normalize_Lab(const float *const Lab, float *const u)
+{
+  u[0] = Lab[0] * (1.0f / 100.0f);
+  u[1] = (Lab[1] + 128.0f) * (1.0f / 256.0f);
+  u[2] = (Lab[2] + 128.0f) * (1.0f / 256.0f);
+}
+
+static inline int clut_out_of_domain(const float *const u)
+{
+  return !(u[0] >= 0.0f && u[0] <= 1.0f && u[1] >= 0.0f && u[1] <= 1.0f && u[2] >= 0.0f && u[2] <= 1.0f);
+}
+
+static float *bake_clut(const dt_iop_colorout_data_t *const d)
+{
+  const int level = CLUT_LEVEL;
+  float *const clut = dt_alloc_align(64, sizeof(float) * 3 * level * level * level);
+  if(!clut) return NULL;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(clut, d, level) \
+  schedule(static)
+#endif
+  for(int ab = 0; ab < level * level; ab++)
+  {
+    float row[4 * CLUT_LEVEL] DT_ALIGNED_ARRAY;
+    const float a = 256.0f * (ab % level) / (level - 1) - 128.0f;
+    const float b = 256.0f * (ab / level) / (level - 1) - 128.0f;
+    for(int l = 0; l < level; l++)
+    {
+      row[4 * l + 0] = 100.0f * l / (level - 1);
+      row[4 * l + 1] = a;
+      row[4 * l + 2] = b;
+      row[4 * l + 3] = 0.0f;
+    }
+
+    cmsDoTransform(d->xform, row, row, level);
+
+    float *const node = clut + (size_t)3 * level * ab;
+    for(int l = 0; l < level; l++)
+      for(int c = 0; c < 3; c++) node[3 * l + c] = row[4 * l + c];
+  }
+
+  return clut;
+}
+
+// xform baked into the 3D lut, pixels outside of its domain still go through lcms2
+static void process_clut(const dt_iop_colorout_data_t *const d, const int ch, const void *const ivoid,
+                         void *const ovoid, const dt_iop_roi_t *const roi_out)
+{
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(ch, d, ivoid, ovoid, roi_out) \
+  schedule(static)
+#endif
+  for(int k = 0; k < roi_out->height; k++)
+  {
+    const float *in = ((float *)ivoid) + (size_t)ch * k * roi_out->width;
+    float *out = ((float *)ovoid) + (size_t)ch * k * roi_out->width;
+    const int width = roi_out->width;
+
+    int outside = 0;
+    for(int j = 0; j < width; j++)
+    {
+      float u[3];
+      clut_normalize_Lab(in + 4 * j, u);
+      outside += clut_out_of_domain(u);
+    }
+
+    float *fallback = NULL;
+    int *fallback_index = NULL;
+    if(outside)
+    {
+      fallback = dt_alloc_align(64, sizeof(float) * 4 * outside);
+      fallback_index = malloc(sizeof(int) * outside);
+      for(int j = 0, n = 0; j < width; j++)
+      {
+        float u[3];
+        clut_normalize_Lab(in + 4 * j, u);
+        if(!clut_out_of_domain(u)) continue;
+        for(int c = 0; c < 4; c++) fallback[4 * n + c] = in[4 * j + c];
+        fallback_index[n++] = j;
+      }
+    }
+
+    for(int j = 0; j < width; j++)
+    {
+      clut_normalize_Lab(in + 4 * j, out + 4 * j);
+      out[4 * j + 3] = in[4 * j + 3];
+    }
+    dt_clut_tetrahedral_row(out, out, width, d->clut, CLUT_LEVEL);
+
+    if(outside)
+    {
+      cmsDoTransform(d->xform, fallback, fallback, outside);
+      for(int n = 0; n < outside; n++)
+        for(int c = 0; c < 3; c++) out[4 * fallback_index[n] + c] = fallback[4 * n + c];
+      free(fallback_index);
+      dt_free_align(fallback);
+    }
+  }
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -425,6 +534,10 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 
     process_fastpath_apply_tonecurves(self, piece, ivoid, ovoid, roi_in, roi_out);
   }
+  else if(d->clut)
+  {
+    process_clut(d, ch, ivoid, ovoid, roi_out);
+  }
   else
   {
 // fprintf(stderr,"Using xform codepath\n");
@@ -506,6 +619,10 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
 
     process_fastpath_apply_tonecurves(self, piece, ivoid, ovoid, roi_in, roi_out);
   }
+  else if(d->clut)
+  {
+    process_clut(d, ch, ivoid, ovoid, roi_out);
+  }
   else
   {
     // fprintf(stderr,"Using xform codepath\n");
@@ -594,6 +711,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     cmsDeleteTransform(d->xform);
     d->xform = NULL;
   }
+  dt_free_align(d->clut);
+  d->clut = NULL;
   d->cmatrix[0] = NAN;
   d->lut[0][0] = -1.0f;
   d->lut[1][0] = -1.0f;
@@ -741,6 +860,10 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     }
   }
 
+  // plain lcms2 rendering (no softproof, no forced high quality export): bake the xform into a 3D lut
+  if(d->xform && d->mode == DT_PROFILE_NORMAL && !force_lcms2 && output_format == TYPE_RGBA_FLT)
+    d->clut = bake_clut(d);
+
   if(out_type == DT_COLORSPACE_DISPLAY || out_type == DT_COLORSPACE_DISPLAY2)
     pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
 
@@ -772,6 +895,7 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
   piece->data = calloc(1, sizeof(dt_iop_colorout_data_t));
   dt_iop_colorout_data_t *d = (dt_iop_colorout_data_t *)piece->data;
   d->xform = NULL;
+  d->clut = NULL;
   self->commit_params(self, self->default_params, pipe, piece);
 }
 
@@ -783,6 +907,8 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
     cmsDeleteTransform(d->xform);
     d->xform = NULL;
   }
+  dt_free_align(d->clut);
+  d->clut = NULL;
 
   free(piece->data);
   piece->data = NULL;
@@ -168,7 +168,9 @@ void masks_selection_changed(struct dt_iop_module_t *self, const int form_select
 /** this is the temp homebrew callback to operations.
   * x,y, and scale are just given for orientation in the framebuffer. i and o are
   * scaled to the same size width*height and contain a max of 3 floats. other color
-  * formats may be filled by this callback, if the pipeline can handle it. */
+  * formats may be filled by this callback, if the pipeline can handle it.
+  * long running implementations may poll dt_dev_pixelpipe_piece_cancelled(piece)
+  * and return early, the pipe will then discard the output. */
 /** the simplest variant of process(). you can only use OpenMP SIMD here, no intrinsics */
 /** must be provided by each IOP. */
 void process(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const i,
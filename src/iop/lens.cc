@@ -125,6 +125,41 @@ typedef struct dt_iop_lensfun_global_data_t
   int kernel_lens_vignette;
 } dt_iop_lensfun_global_data_t;
 
+// distortion grids are sampled every DT_IOP_LENSFUN_GRID_STEP pixels for the pixel remapping, and every
+// DT_IOP_LENSFUN_POINTS_GRID_STEP pixels over the whole image for point transforms.
+#define DT_IOP_LENSFUN_GRID_STEP 8
+#define DT_IOP_LENSFUN_POINTS_GRID_STEP 16
+#define DT_IOP_LENSFUN_GRID_SLOTS 4
+
+// coarse grid of lensfun subpixel distortion coordinates (x/y for r, g and b) with the modifier it was
+// sampled from. pixels are remapped by bilinear interpolation between the grid nodes.
+typedef struct dt_iop_lensfun_grid_t
+{
+  // cache key
+  float orig_w, orig_h;
+  int mods_filter;
+  int x, y, width, height;
+  int step;
+
+  lfModifier *modifier;
+  int modflags;
+  int cols, rows;
+  gboolean has_nan;
+  float *nodes; // cols * rows * 6 floats
+
+  int users;
+  gboolean stale;
+  uint64_t stamp;
+} dt_iop_lensfun_grid_t;
+
+// per piece cache of modifiers and distortion grids, flushed on commit_params()
+typedef struct dt_iop_lensfun_cache_t
+{
+  dt_pthread_mutex_t lock;
+  dt_iop_lensfun_grid_t *grid[DT_IOP_LENSFUN_GRID_SLOTS];
+  uint64_t stamp;
+} dt_iop_lensfun_cache_t;
+
 typedef struct dt_iop_lensfun_data_t
 {
   lfLens *lens;
@@ -139,6 +174,7 @@ typedef struct dt_iop_lensfun_data_t
   gboolean do_nan_checks;
   gboolean tca_override;
   lfLensCalibTCA custom_tca;
+  dt_iop_lensfun_cache_t *cache;
 } dt_iop_lensfun_data_t;
 
 
@@ -379,6 +415,190 @@ static lfModifier * get_modifier(int *mods_done, int w, int h, const dt_iop_lens
   return mod;
 }
 
+static void _grid_free(dt_iop_lensfun_grid_t *grid)
+{
+  if(!grid) return;
+  delete grid->modifier;
+  dt_free_align(grid->nodes);
+  free(grid);
+}
+
+static dt_iop_lensfun_grid_t *_grid_new(const dt_iop_lensfun_data_t *d, const float orig_w, const float orig_h,
+                                        const int mods_filter, const int x, const int y, const int width,
+                                        const int height, const int step)
+{
+  dt_iop_lensfun_grid_t *grid = (dt_iop_lensfun_grid_t *)calloc(1, sizeof(dt_iop_lensfun_grid_t));
+  grid->orig_w = orig_w;
+  grid->orig_h = orig_h;
+  grid->mods_filter = mods_filter;
+  grid->x = x;
+  grid->y = y;
+  grid->width = width;
+  grid->height = height;
+  grid->step = step;
+
+  dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
+  grid->modifier = get_modifier(&grid->modflags, orig_w, orig_h, d, mods_filter);
+  dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
+
+  if(!(grid->modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE)))
+    return grid;
+
+  // nodes at x + i * step, the last one lies at or beyond the last pixel of the area
+  grid->cols = width / step + 2;
+  grid->rows = height / step + 2;
+  grid->nodes = (float *)dt_alloc_align(64, (size_t)grid->cols * grid->rows * 6 * sizeof(float));
+  if(!grid->nodes) return grid;
+
+  const lfModifier *const modifier = grid->modifier;
+  const int cols = grid->cols;
+  const int rows = grid->rows;
+  float *const nodes = grid->nodes;
+  int has_nan = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(cols, rows, nodes, step, x, y) \
+  shared(modifier) reduction(| : has_nan) \
+  schedule(static)
+#endif
+  for(int j = 0; j < rows; j++)
+  {
+    float *node = nodes + (size_t)j * cols * 6;
+    for(int i = 0; i < cols; i++, node += 6)
+    {
+      modifier->ApplySubpixelGeometryDistortion(x + i * step, y + j * step, 1, 1, node);
+      for(int c = 0; c < 6; c++) has_nan |= !isfinite(node[c]);
+    }
+  }
+  grid->has_nan = has_nan;
+
+  return grid;
+}
+
+// get a grid covering the given area at the given image size, from the cache if possible. the returned
+// grid stays valid until _grid_release(), even if commit_params() flushes the cache in the meantime.
+static dt_iop_lensfun_grid_t *_grid_acquire(const dt_iop_lensfun_data_t *d, const float orig_w,
+                                            const float orig_h, const int mods_filter, const int x, const int y,
+                                            const int width, const int height, const int step)
+{
+  dt_iop_lensfun_cache_t *cache = d->cache;
+  dt_pthread_mutex_lock(&cache->lock);
+
+  for(int k = 0; k < DT_IOP_LENSFUN_GRID_SLOTS; k++)
+  {
+    dt_iop_lensfun_grid_t *grid = cache->grid[k];
+    if(grid && grid->orig_w == orig_w && grid->orig_h == orig_h && grid->mods_filter == mods_filter
+       && grid->x == x && grid->y == y && grid->width == width && grid->height == height && grid->step == step)
+    {
+      grid->users++;
+      grid->stamp = ++cache->stamp;
+      dt_pthread_mutex_unlock(&cache->lock);
+      return grid;
+    }
+  }
+
+  dt_iop_lensfun_grid_t *grid = _grid_new(d, orig_w, orig_h, mods_filter, x, y, width, height, step);
+  grid->users = 1;
+  grid->stamp = ++cache->stamp;
+
+  // replace the least recently used grid nobody is working with. if all are busy the new one stays uncached.
+  int slot = -1;
+  for(int k = 0; k < DT_IOP_LENSFUN_GRID_SLOTS; k++)
+  {
+    if(!cache->grid[k])
+    {
+      slot = k;
+      break;
+    }
+    if(cache->grid[k]->users == 0 && (slot < 0 || cache->grid[k]->stamp < cache->grid[slot]->stamp)) slot = k;
+  }
+
+  if(slot >= 0)
+  {
+    _grid_free(cache->grid[slot]);
+    cache->grid[slot] = grid;
+  }
+  else
+    grid->stale = TRUE;
+
+  dt_pthread_mutex_unlock(&cache->lock);
+  return grid;
+}
+
+static void _grid_release(const dt_iop_lensfun_data_t *d, dt_iop_lensfun_grid_t *grid)
+{
+  dt_iop_lensfun_cache_t *cache = d->cache;
+  dt_pthread_mutex_lock(&cache->lock);
+  grid->users--;
+  if(grid->stale && grid->users == 0) _grid_free(grid);
+  dt_pthread_mutex_unlock(&cache->lock);
+}
+
+static void _cache_flush(dt_iop_lensfun_cache_t *cache)
+{
+  dt_pthread_mutex_lock(&cache->lock);
+  for(int k = 0; k < DT_IOP_LENSFUN_GRID_SLOTS; k++)
+  {
+    dt_iop_lensfun_grid_t *grid = cache->grid[k];
+    if(!grid) continue;
+    if(grid->users == 0)
+      _grid_free(grid);
+    else
+      grid->stale = TRUE;
+    cache->grid[k] = NULL;
+  }
+  dt_pthread_mutex_unlock(&cache->lock);
+}
+
+// same as lfModifier::ApplySubpixelGeometryDistortion(x, y, width, 1, out), interpolated from the grid.
+// falls back to lensfun for pixels outside of the grid or next to nodes lensfun could not map.
+static void _grid_distort(const dt_iop_lensfun_grid_t *const grid, const float x, const float y,
+                          const int width, float *const out)
+{
+  const float inv_step = 1.0f / grid->step;
+  const float fy = (y - grid->y) * inv_step;
+  const float fx0 = (x - grid->x) * inv_step;
+  const float fx1 = (x + width - 1 - grid->x) * inv_step;
+
+  if(!grid->nodes || !(fy >= 0.0f && fy <= grid->rows - 1) || !(fx0 >= 0.0f && fx1 <= grid->cols - 1))
+  {
+    grid->modifier->ApplySubpixelGeometryDistortion(x, y, width, 1, out);
+    return;
+  }
+
+  const int j = MIN((int)fy, grid->rows - 2);
+  const float wy = fy - j;
+  const float *const n0 = grid->nodes + (size_t)j * grid->cols * 6;
+  const float *const n1 = n0 + (size_t)grid->cols * 6;
+
+  for(int k = 0; k < width; k++)
+  {
+    const float fx = fx0 + k * inv_step;
+    const int i = MIN((int)fx, grid->cols - 2);
+    const float wx = fx - i;
+    const float *const a = n0 + 6 * i;
+    const float *const b = n1 + 6 * i;
+    float *const o = out + 6 * k;
+    for(int c = 0; c < 6; c++)
+    {
+      const float top = a[c] + wx * (a[c + 6] - a[c]);
+      const float bottom = b[c] + wx * (b[c + 6] - b[c]);
+      o[c] = top + wy * (bottom - top);
+    }
+  }
+
+  if(grid->has_nan)
+  {
+    for(int k = 0; k < width; k++)
+    {
+      const float *const o = out + 6 * k;
+      if(!isfinite(o[0] + o[1] + o[2] + o[3] + o[4] + o[5]))
+        grid->modifier->ApplySubpixelGeometryDistortion(x + k, y, 1, 1, out + 6 * k);
+    }
+  }
+}
+
 void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid, void *const ovoid,
              const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -399,12 +619,10 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
 
   const float orig_w = roi_in->scale * piece->buf_in.width, orig_h = roi_in->scale * piece->buf_in.height;
 
-  dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
-
-  int modflags;
-  lfModifier *modifier = get_modifier(&modflags, orig_w, orig_h, d, LF_MODIFY_ALL);
-
-  dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
+  dt_iop_lensfun_grid_t *grid = _grid_acquire(d, orig_w, orig_h, LF_MODIFY_ALL, roi_out->x, roi_out->y,
+                                              roi_out->width, roi_out->height, DT_IOP_LENSFUN_GRID_STEP);
+  const int modflags = grid->modflags;
+  lfModifier *modifier = grid->modifier;
 
   const struct dt_interpolation *const interpolation = dt_interpolation_new(DT_INTERPOLATION_USERPREF);
 
@@ -419,15 +637,15 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(bufsize, ch, ch_width, d, interpolation, ivoid, \
+      dt_omp_firstprivate(bufsize, ch, ch_width, d, grid, interpolation, ivoid, \
                           mask_display, ovoid, roi_in, roi_out) \
-      shared(buf, modifier) \
+      shared(buf) \
       schedule(static)
 #endif
       for(int y = 0; y < roi_out->height; y++)
       {
         float *bufptr = ((float *)buf) + (size_t)bufsize * dt_get_thread_num();
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, bufptr);
+        _grid_distort(grid, roi_out->x, roi_out->y + y, roi_out->width, bufptr);
 
         // reverse transform the global coords from lf to our buffer
         float *out = ((float *)ovoid) + (size_t)y * roi_out->width * ch;
@@ -523,15 +741,14 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(buf2size, ch, ch_width, d, interpolation, mask_display, ovoid, roi_in, roi_out) \
-      shared(buf2, buf, modifier) \
+      dt_omp_firstprivate(buf2size, ch, ch_width, d, grid, interpolation, mask_display, ovoid, roi_in, roi_out) \
+      shared(buf2, buf) \
       schedule(static)
 #endif
       for(int y = 0; y < roi_out->height; y++)
       {
         float *buf2ptr = ((float *)buf2) + (size_t)buf2size * dt_get_thread_num();
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width,
-                                                  1, buf2ptr);
+        _grid_distort(grid, roi_out->x, roi_out->y + y, roi_out->width, buf2ptr);
         // reverse transform the global coords from lf to our buffer
         float *out = ((float *)ovoid) + (size_t)y * roi_out->width * ch;
         for(int x = 0; x < roi_out->width; x++, buf2ptr += 6, out += ch)
@@ -576,7 +793,7 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
     }
     dt_free_align(buf);
   }
-  delete modifier;
+  _grid_release(d, grid);
 
   if(self->dev->gui_attached && g && piece->pipe->type == DT_DEV_PIXELPIPE_PREVIEW)
   {
@@ -599,6 +816,7 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   cl_int err = -999;
 
   float *tmpbuf = NULL;
+  dt_iop_lensfun_grid_t *grid = NULL;
   lfModifier *modifier = NULL;
 
   const int devid = piece->pipe->devid;
@@ -663,9 +881,10 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   dev_tmpbuf = (cl_mem)dt_opencl_alloc_device_buffer(devid, tmpbuflen);
   if(dev_tmpbuf == NULL) goto error;
 
-  dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
-  modifier = get_modifier(&modflags, orig_w, orig_h, d, LF_MODIFY_ALL);
-  dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
+  grid = _grid_acquire(d, orig_w, orig_h, LF_MODIFY_ALL, roi_out->x, roi_out->y, roi_out->width,
+                       roi_out->height, DT_IOP_LENSFUN_GRID_STEP);
+  modflags = grid->modflags;
+  modifier = grid->modifier;
 
   if(d->inverse)
   {
@@ -674,14 +893,14 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
     {
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(tmpbufwidth, roi_out) \
-      shared(tmpbuf, d, modifier) \
+      dt_omp_firstprivate(grid, tmpbufwidth, roi_out) \
+      shared(tmpbuf) \
       schedule(static)
 #endif
       for(int y = 0; y < roi_out->height; y++)
       {
         float *pi = tmpbuf + (size_t)y * tmpbufwidth;
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, pi);
+        _grid_distort(grid, roi_out->x, roi_out->y + y, roi_out->width, pi);
       }
 
       /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
@@ -791,14 +1010,14 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
     {
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(tmpbufwidth, roi_out) \
-      shared(tmpbuf, d, modifier) \
+      dt_omp_firstprivate(grid, tmpbufwidth, roi_out) \
+      shared(tmpbuf) \
       schedule(static)
 #endif
       for(int y = 0; y < roi_out->height; y++)
       {
         float *pi = tmpbuf + (size_t)y * tmpbufwidth;
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, pi);
+        _grid_distort(grid, roi_out->x, roi_out->y + y, roi_out->width, pi);
       }
 
       /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
@@ -836,14 +1055,14 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   dt_opencl_release_mem_object(dev_tmpbuf);
   dt_opencl_release_mem_object(dev_tmp);
   if(tmpbuf != NULL) dt_free_align(tmpbuf);
-  if(modifier != NULL) delete modifier;
+  if(grid != NULL) _grid_release(d, grid);
   return TRUE;
 
 error:
   dt_opencl_release_mem_object(dev_tmp);
   dt_opencl_release_mem_object(dev_tmpbuf);
   if(tmpbuf != NULL) dt_free_align(tmpbuf);
-  if(modifier != NULL) delete modifier;
+  if(grid != NULL) _grid_release(d, grid);
   dt_print(DT_DEBUG_OPENCL, "[opencl_lens] couldn't enqueue kernel! %d\n", err);
   return FALSE;
 }
@@ -874,12 +1093,12 @@ int distort_transform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, floa
   if(!d->lens || !d->lens->Maker || d->crop <= 0.0f) return 0;
 
   const float orig_w = piece->buf_in.width, orig_h = piece->buf_in.height;
-  int modflags;
-  const lfModifier *modifier = get_modifier(&modflags, orig_w, orig_h, d, LF_MODIFY_ALL);
+  dt_iop_lensfun_grid_t *grid = _grid_acquire(d, orig_w, orig_h, LF_MODIFY_ALL, 0, 0, piece->buf_in.width,
+                                              piece->buf_in.height, DT_IOP_LENSFUN_POINTS_GRID_STEP);
 
-  if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
+  if(grid->modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
   {
-    float *buf = (float *)malloc(2 * 3 * sizeof(float));
+    float buf[2 * 3];
     for(size_t i = 0; i < points_count * 2; i += 2)
     {
       float p1 = points[i];
@@ -888,7 +1107,7 @@ int distort_transform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, floa
       // often after 2 or 3 loops.
       for(int k=0; k<10; k++)
       {
-        modifier->ApplySubpixelGeometryDistortion(p1, p2, 1, 1, buf);
+        _grid_distort(grid, p1, p2, 1, buf);
         const float dist1 = points[i]     - buf[0];
         const float dist2 = points[i + 1] - buf[3];
         if(fabs(dist1) < .5f && fabs(dist2) < .5f) break; // we have converged
@@ -899,10 +1118,9 @@ int distort_transform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, floa
       points[i]     = p1;
       points[i + 1] = p2;
     }
-    free(buf);
   }
 
-  delete modifier;
+  _grid_release(d, grid);
   return 1;
 }
 
@@ -914,22 +1132,21 @@ int distort_backtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
   if(!d->lens || !d->lens->Maker || d->crop <= 0.0f) return 0;
 
   const float orig_w = piece->buf_in.width, orig_h = piece->buf_in.height;
-  int modflags;
-  const lfModifier *modifier = get_modifier(&modflags, orig_w, orig_h, d, LF_MODIFY_ALL);
+  dt_iop_lensfun_grid_t *grid = _grid_acquire(d, orig_w, orig_h, LF_MODIFY_ALL, 0, 0, piece->buf_in.width,
+                                              piece->buf_in.height, DT_IOP_LENSFUN_POINTS_GRID_STEP);
 
-  if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
+  if(grid->modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
   {
-    float *buf = (float *)malloc(2 * 3 * sizeof(float));
+    float buf[2 * 3];
     for(size_t i = 0; i < points_count * 2; i += 2)
     {
-      modifier->ApplySubpixelGeometryDistortion(points[i], points[i + 1], 1, 1, buf);
+      _grid_distort(grid, points[i], points[i + 1], 1, buf);
       points[i] = buf[0];
       points[i + 1] = buf[3];
     }
-    free(buf);
   }
 
-  delete modifier;
+  _grid_release(d, grid);
   return 1;
 }
 
@@ -946,16 +1163,14 @@ void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
   }
 
   const float orig_w = roi_in->scale * piece->buf_in.width, orig_h = roi_in->scale * piece->buf_in.height;
-  dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
-  int modflags;
-  lfModifier *modifier = get_modifier(&modflags, orig_w, orig_h, d, /*LF_MODIFY_TCA |*/ LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE);
+  dt_iop_lensfun_grid_t *grid = _grid_acquire(d, orig_w, orig_h, /*LF_MODIFY_TCA |*/ LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE,
+                                              roi_out->x, roi_out->y, roi_out->width, roi_out->height,
+                                              DT_IOP_LENSFUN_GRID_STEP);
 
-  dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
-
-  if(!(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE)))
+  if(!(grid->modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE)))
   {
     memcpy(out, in, sizeof(float) * roi_out->width * roi_out->height);
-    delete modifier;
+    _grid_release(d, grid);
     return;
   }
 
@@ -967,14 +1182,14 @@ void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(bufsize, d, in, interpolation, out, roi_in, roi_out) \
-  shared(buf, modifier) \
+  dt_omp_firstprivate(bufsize, d, grid, in, interpolation, out, roi_in, roi_out) \
+  shared(buf) \
   schedule(static)
 #endif
   for(int y = 0; y < roi_out->height; y++)
   {
     float *bufptr = buf + bufsize * dt_get_thread_num();
-    modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, bufptr);
+    _grid_distort(grid, roi_out->x, roi_out->y + y, roi_out->width, bufptr);
 
     // reverse transform the global coords from lf to our buffer
     float *_out = out + (size_t)y * roi_out->width;
@@ -994,7 +1209,7 @@ void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
     }
   }
   dt_free_align(buf);
-  delete modifier;
+  _grid_release(d, grid);
 }
 
 void modify_roi_out(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, dt_iop_roi_t *roi_out,
@@ -1013,10 +1228,11 @@ void modify_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *
   if(!d->lens || !d->lens->Maker || d->crop <= 0.0f) return;
 
   const float orig_w = roi_in->scale * piece->buf_in.width, orig_h = roi_in->scale * piece->buf_in.height;
-  int modflags;
-  lfModifier *modifier = get_modifier(&modflags, orig_w, orig_h, d, LF_MODIFY_ALL);
+  // this is the grid process() will ask for with the same roi_out, so build it here already.
+  dt_iop_lensfun_grid_t *grid = _grid_acquire(d, orig_w, orig_h, LF_MODIFY_ALL, roi_out->x, roi_out->y,
+                                              roi_out->width, roi_out->height, DT_IOP_LENSFUN_GRID_STEP);
 
-  if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
+  if(grid->modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
   {
     const int xoff = roi_in->x;
     const int yoff = roi_in->y;
@@ -1034,34 +1250,34 @@ void modify_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *
 
 #ifdef _OPENMP
 #pragma omp parallel default(none) \
-    dt_omp_firstprivate(aheight, awidth, buf, height, nbpoints, width, xoff, \
+    dt_omp_firstprivate(aheight, awidth, buf, grid, height, nbpoints, width, xoff, \
                         xstep, yoff, ystep) \
-    shared(modifier) reduction(min : xm, ym) reduction(max : xM, yM)
+    reduction(min : xm, ym) reduction(max : xM, yM)
 #endif
     {
 #ifdef _OPENMP
 #pragma omp for schedule(static)
 #endif
       for(int i = 0; i < awidth; i++)
-        modifier->ApplySubpixelGeometryDistortion(xoff + i * xstep, yoff, 1, 1, buf + 6 * i);
+        _grid_distort(grid, xoff + i * xstep, yoff, 1, buf + 6 * i);
 
 #ifdef _OPENMP
 #pragma omp for schedule(static)
 #endif
       for(int i = 0; i < awidth; i++)
-        modifier->ApplySubpixelGeometryDistortion(xoff + i * xstep, yoff + (height - 1), 1, 1, buf + 6 * (awidth + i));
+        _grid_distort(grid, xoff + i * xstep, yoff + (height - 1), 1, buf + 6 * (awidth + i));
 
 #ifdef _OPENMP
 #pragma omp for schedule(static)
 #endif
       for(int j = 0; j < aheight; j++)
-        modifier->ApplySubpixelGeometryDistortion(xoff, yoff + j * ystep, 1, 1, buf + 6 * (2 * awidth + j));
+        _grid_distort(grid, xoff, yoff + j * ystep, 1, buf + 6 * (2 * awidth + j));
 
 #ifdef _OPENMP
 #pragma omp for schedule(static)
 #endif
       for(int j = 0; j < aheight; j++)
-        modifier->ApplySubpixelGeometryDistortion(xoff + (width - 1), yoff + j * ystep, 1, 1, buf + 6 * (2 * awidth + aheight + j));
+        _grid_distort(grid, xoff + (width - 1), yoff + j * ystep, 1, buf + 6 * (2 * awidth + aheight + j));
 
 #ifdef _OPENMP
 #pragma omp barrier
@@ -1101,7 +1317,7 @@ void modify_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *
     roi_in->width = CLAMP(roi_in->width, 1, (int)ceilf(orig_w) - roi_in->x);
     roi_in->height = CLAMP(roi_in->height, 1, (int)ceilf(orig_h) - roi_in->y);
   }
-  delete modifier;
+  _grid_release(d, grid);
 }
 
 void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_t *pipe,
@@ -1120,8 +1336,11 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   dt_iop_lensfun_data_t *d = (dt_iop_lensfun_data_t *)piece->data;
 
+  _cache_flush(d->cache);
+
+  // no database before the piece is enabled, a disabled piece doesn't need the lens
   dt_iop_lensfun_global_data_t *gd = (dt_iop_lensfun_global_data_t *)self->global_data;
-  lfDatabase *dt_iop_lensfun_db = (lfDatabase *)gd->db;
+  lfDatabase *dt_iop_lensfun_db = gd ? (lfDatabase *)gd->db : NULL;
   const lfCamera *camera = NULL;
   const lfCamera **cam = NULL;
 
@@ -1132,7 +1351,7 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   }
   d->lens = new lfLens;
 
-  if(p->camera[0])
+  if(p->camera[0] && dt_iop_lensfun_db)
   {
     dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
     cam = dt_iop_lensfun_db->FindCamerasExt(NULL, p->camera, 0);
@@ -1143,7 +1362,7 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     }
     dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
   }
-  if(p->lens[0])
+  if(p->lens[0] && dt_iop_lensfun_db)
   {
     dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
     const lfLens **lens
@@ -1211,7 +1430,10 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
-  piece->data = calloc(1, sizeof(dt_iop_lensfun_data_t));
+  dt_iop_lensfun_data_t *d = (dt_iop_lensfun_data_t *)calloc(1, sizeof(dt_iop_lensfun_data_t));
+  d->cache = (dt_iop_lensfun_cache_t *)calloc(1, sizeof(dt_iop_lensfun_cache_t));
+  dt_pthread_mutex_init(&d->cache->lock, NULL);
+  piece->data = d;
   self->commit_params(self, self->default_params, pipe, piece);
 }
 
@@ -1224,6 +1446,9 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
     delete d->lens;
     d->lens = NULL;
   }
+  _cache_flush(d->cache);
+  dt_pthread_mutex_destroy(&d->cache->lock);
+  free(d->cache);
   free(piece->data);
   piece->data = NULL;
 }
@@ -1335,6 +1560,8 @@ void reload_defaults(dt_iop_module_t *module)
       if(++cnt == 2) *c = '\0';
   if(img->exif_maker[0] || model[0])
   {
+    // the defaults come from the lensfun database, even for an instance that isn't enabled in any pipe yet
+    dt_iop_init_global_data(module);
     dt_iop_lensfun_global_data_t *gd = (dt_iop_lensfun_global_data_t *)module->global_data;
 
     // just to be sure
@@ -2549,7 +2776,7 @@ void gui_update(struct dt_iop_module_t *self)
   dt_bauhaus_slider_set(g->scale, p->scale);
   const lfCamera **cam = NULL;
   g->camera = NULL;
-  if(p->camera[0])
+  if(p->camera[0] && dt_iop_lensfun_db)
   {
     dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
     cam = dt_iop_lensfun_db->FindCamerasExt(NULL, p->camera, 0);
@@ -259,6 +259,37 @@ typedef struct
   int warp_kernel;
 } dt_iop_liquify_global_data_t;
 
+#define DT_IOP_LIQUIFY_CACHED_WARPS 2 // interpolated paths kept per piece
+#define DT_IOP_LIQUIFY_CACHED_MAPS 4  // unused distortion maps kept per piece
+
+// the interpolated warps of the paths once distorted into piece coordinates
+typedef struct
+{
+  uint64_t hash;   // of the distorted paths
+  GList *warps;
+  uint64_t stamp;
+} dt_iop_liquify_warps_t;
+
+// a distortion map, shared by process, distort_mask and distort_(back)transform
+typedef struct
+{
+  uint64_t hash;   // of the distorted paths
+  cairo_rectangle_int_t extent;
+  gboolean inverted;
+  float complex *map;
+  int users;
+  uint64_t stamp;
+} dt_iop_liquify_map_t;
+
+typedef struct
+{
+  dt_iop_liquify_params_t params; // first, so that piece->data can be used as the params
+  dt_pthread_mutex_t lock;        // protects the caches below
+  GList *warps;                   // dt_iop_liquify_warps_t
+  GList *maps;                    // dt_iop_liquify_map_t
+  uint64_t stamp;
+} dt_iop_liquify_data_t;
+
 typedef struct
 {
   dt_pthread_mutex_t lock;
@@ -1167,12 +1198,12 @@ static void _get_map_extent (const dt_iop_roi_t *roi_out,
 }
 
 static float complex *create_global_distortion_map (const cairo_rectangle_int_t *map_extent,
-                                                    GList *interpolated,
-                                                    gboolean inverted)
+                                                    GList *interpolated)
 {
   // allocate distortion map big enough to contain all paths
   const int mapsize = map_extent->width * map_extent->height;
   float complex * map = dt_alloc_align(64, mapsize * sizeof (float complex));
+  if (map == NULL) return NULL;
   memset (map, 0, mapsize * sizeof (float complex));
 
   // build map
@@ -1186,87 +1217,253 @@ static float complex *create_global_distortion_map (const cairo_rectangle_int_t
     free ((void *) stamp);
   }
 
-  if (inverted)
+  return map;
+}
+
+// the inverted map, for the transformation of points from piece to module input coordinates
+
+static float complex *invert_global_distortion_map (const cairo_rectangle_int_t *map_extent,
+                                                    const float complex *map)
+{
+  const int mapsize = map_extent->width * map_extent->height;
+  float complex * const imap = dt_alloc_align (64, mapsize * sizeof (float complex));
+  if (imap == NULL) return NULL;
+  memset (imap, 0, mapsize * sizeof (float complex));
+
+  // copy map into imap (inverted map).
+  // imap [ n + dx(map[n]) , n + dy(map[n]) ] = -map[n]
+
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule (static) default (shared)
+  #endif
+
+  for (int y = 0; y <  map_extent->height; y++)
   {
-    float complex * const imap = dt_alloc_align (64, mapsize * sizeof (float complex));
-    memset (imap, 0, mapsize * sizeof (float complex));
+    const float complex *row = map + y * map_extent->width;
+    for (int x = 0; x < map_extent->width; x++)
+    {
+      const float complex d = *(row + x);
+      // compute new position (nx,ny) given the displacement d
+      const int nx = x + (int)creal(d);
+      const int ny = y + (int)cimag(d);
+
+      // if the point falls into the extent, set it
+      if (nx>0 && nx<map_extent->width && ny>0 && ny<map_extent->height)
+        imap[nx + ny * map_extent->width] = -d;
+    }
+  }
 
-    // copy map into imap (inverted map).
-    // imap [ n + dx(map[n]) , n + dy(map[n]) ] = -map[n]
+  // now just do a pass to avoid gap with a displacement of zero, note that we do not need high
+  // precision here as the inverted distortion mask is only used to compute a final displacement
+  // of points.
 
-    #ifdef _OPENMP
-    #pragma omp parallel for schedule (static) default (shared)
-    #endif
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule (dynamic) default (shared)
+  #endif
 
-    for (int y = 0; y <  map_extent->height; y++)
+  for (int y = 0; y <  map_extent->height; y++)
+  {
+    float complex *row = imap + y * map_extent->width;
+    float complex last[2] = { 0, 0 };
+    for (int x = 0; x < map_extent->width / 2 + 1; x++)
     {
-      const float complex *row = map + y * map_extent->width;
-      for (int x = 0; x < map_extent->width; x++)
+      float complex *cl = row + x;
+      float complex *cr = row + map_extent->width - x;
+      if (x!=0)
       {
-        const float complex d = *(row + x);
-        // compute new position (nx,ny) given the displacement d
-        const int nx = x + (int)creal(d);
-        const int ny = y + (int)cimag(d);
-
-        // if the point falls into the extent, set it
-        if (nx>0 && nx<map_extent->width && ny>0 && ny<map_extent->height)
-          imap[nx + ny * map_extent->width] = -d;
+        if (*cl == 0) *cl = last[0];
+        if (*cr == 0) *cr = last[1];
       }
+      last[0] = *cl; last[1] = *cr;
     }
+  }
 
-    dt_free_align ((void *) map);
+  return imap;
+}
 
-    // now just do a pass to avoid gap with a displacement of zero, note that we do not need high
-    // precision here as the inverted distortion mask is only used to compute a final displacement
-    // of points.
+static uint64_t _paths_hash (const dt_iop_liquify_params_t *p)
+{
+  uint64_t hash = 5381;
+  const char *str = (const char *) p;
+  for (size_t i = 0; i < sizeof (dt_iop_liquify_params_t); i++)
+    hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
 
-    #ifdef _OPENMP
-    #pragma omp parallel for schedule (dynamic) default (shared)
-    #endif
+// the interpolated warps of the distorted paths p, owned by the cache. called with the lock held.
 
-    for (int y = 0; y <  map_extent->height; y++)
+static GList *_warps_get (dt_iop_liquify_data_t *d, const dt_iop_liquify_params_t *p, const uint64_t hash)
+{
+  dt_iop_liquify_warps_t *found = NULL;
+  for (GList *l = d->warps; l; l = g_list_next (l))
+  {
+    dt_iop_liquify_warps_t *w = (dt_iop_liquify_warps_t *) l->data;
+    if (w->hash == hash)
     {
-      float complex *row = imap + y * map_extent->width;
-      float complex last[2] = { 0, 0 };
-      for (int x = 0; x < map_extent->width / 2 + 1; x++)
-      {
-        float complex *cl = row + x;
-        float complex *cr = row + map_extent->width - x;
-        if (x!=0)
-        {
-          if (*cl == 0) *cl = last[0];
-          if (*cr == 0) *cr = last[1];
-        }
-        last[0] = *cl; last[1] = *cr;
-      }
+      found = w;
+      break;
     }
+  }
 
-    map = imap;
+  if (!found)
+  {
+    // drop the oldest
+    if (g_list_length (d->warps) >= DT_IOP_LIQUIFY_CACHED_WARPS)
+    {
+      GList *oldest = d->warps;
+      for (GList *l = d->warps; l; l = g_list_next (l))
+        if (((dt_iop_liquify_warps_t *) l->data)->stamp < ((dt_iop_liquify_warps_t *) oldest->data)->stamp)
+          oldest = l;
+      g_list_free_full (((dt_iop_liquify_warps_t *) oldest->data)->warps, free);
+      free (oldest->data);
+      d->warps = g_list_delete_link (d->warps, oldest);
+    }
+
+    found = malloc (sizeof (dt_iop_liquify_warps_t));
+    found->hash = hash;
+    found->warps = interpolate_paths ((dt_iop_liquify_params_t *) p);
+    d->warps = g_list_prepend (d->warps, found);
   }
 
-  return map;
+  found->stamp = ++d->stamp;
+  return found->warps;
+}
+
+static void _map_free (dt_iop_liquify_map_t *m)
+{
+  if (m->map) dt_free_align ((void *) m->map);
+  free (m);
+}
+
+// drop unused maps beyond keep, oldest first. called with the lock held.
+
+static void _maps_trim (dt_iop_liquify_data_t *d, const int keep)
+{
+  for (;;)
+  {
+    int unused = 0;
+    GList *oldest = NULL;
+    for (GList *l = d->maps; l; l = g_list_next (l))
+    {
+      dt_iop_liquify_map_t *m = (dt_iop_liquify_map_t *) l->data;
+      if (m->users) continue;
+      unused++;
+      if (!oldest || m->stamp < ((dt_iop_liquify_map_t *) oldest->data)->stamp) oldest = l;
+    }
+    if (unused <= keep) return;
+    _map_free ((dt_iop_liquify_map_t *) oldest->data);
+    d->maps = g_list_delete_link (d->maps, oldest);
+  }
+}
+
+// find a cached map. called with the lock held.
+
+static dt_iop_liquify_map_t *_maps_find (dt_iop_liquify_data_t *d, const uint64_t hash,
+                                         const cairo_rectangle_int_t *extent, const gboolean inverted)
+{
+  for (GList *l = d->maps; l; l = g_list_next (l))
+  {
+    dt_iop_liquify_map_t *m = (dt_iop_liquify_map_t *) l->data;
+    if (m->hash == hash && m->inverted == inverted && m->extent.x == extent->x && m->extent.y == extent->y
+        && m->extent.width == extent->width && m->extent.height == extent->height)
+      return m;
+  }
+  return NULL;
 }
 
-static float complex *build_global_distortion_map (struct dt_iop_module_t *module,
-                                                   const dt_dev_pixelpipe_iop_t *piece,
-                                                   const dt_iop_roi_t *roi_in,
-                                                   const dt_iop_roi_t *roi_out,
-                                                   cairo_rectangle_int_t *map_extent)
+// add a map to the cache. called with the lock held.
+
+static dt_iop_liquify_map_t *_maps_add (dt_iop_liquify_data_t *d, const uint64_t hash,
+                                        const cairo_rectangle_int_t *extent, const gboolean inverted,
+                                        float complex *map)
 {
+  dt_iop_liquify_map_t *m = malloc (sizeof (dt_iop_liquify_map_t));
+  m->hash = hash;
+  m->extent = *extent;
+  m->inverted = inverted;
+  m->map = map;
+  m->users = 0;
+  m->stamp = ++d->stamp;
+  d->maps = g_list_prepend (d->maps, m);
+  return m;
+}
+
+/*
+  Gets the distortion map of the paths distorted into piece coordinates
+  at @a scale, covering the warps that touch @a roi.
+
+  Maps are cached per piece and keyed by a hash of the distorted paths and
+  by their extent, so that process, distort_mask and the transformation of
+  points don't rebuild them as long as the paths and the region don't
+  change. The inverted map is built from the cached forward one.
+
+  Returns NULL if no warp touches @a roi. Give it back with _map_release().
+*/
+
+static dt_iop_liquify_map_t *_map_acquire (struct dt_iop_module_t *module,
+                                           const dt_dev_pixelpipe_iop_t *piece,
+                                           const float scale,
+                                           const gboolean from_distort_transform,
+                                           const dt_iop_roi_t *roi,
+                                           const gboolean inverted)
+{
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *) piece->data;
+
   // copy params
   dt_iop_liquify_params_t copy_params;
-  memcpy(&copy_params, (dt_iop_liquify_params_t *)piece->data, sizeof(dt_iop_liquify_params_t));
+  memcpy(&copy_params, &d->params, sizeof(dt_iop_liquify_params_t));
 
-  distort_paths_raw_to_piece (module, piece->pipe, roi_in->scale, &copy_params, FALSE);
+  distort_paths_raw_to_piece (module, piece->pipe, scale, &copy_params, from_distort_transform);
+  const uint64_t hash = _paths_hash (&copy_params);
 
-  GList *interpolated = interpolate_paths (&copy_params);
+  dt_pthread_mutex_lock (&d->lock);
 
-  _get_map_extent (roi_out, interpolated, map_extent);
+  cairo_rectangle_int_t extent;
+  _get_map_extent (roi, _warps_get (d, &copy_params, hash), &extent);
 
-  float complex *map = create_global_distortion_map(map_extent, interpolated, FALSE);
+  dt_iop_liquify_map_t *m = NULL;
+  if (extent.width != 0 && extent.height != 0)
+  {
+    m = _maps_find (d, hash, &extent, inverted);
+    if (!m)
+    {
+      const double start = dt_get_wtime ();
+      dt_iop_liquify_map_t *forward = _maps_find (d, hash, &extent, FALSE);
+      if (!forward)
+      {
+        float complex *map = create_global_distortion_map (&extent, _warps_get (d, &copy_params, hash));
+        if (map) forward = _maps_add (d, hash, &extent, FALSE, map);
+      }
+      m = forward;
+      if (forward && inverted)
+      {
+        float complex *imap = invert_global_distortion_map (&extent, forward->map);
+        m = imap ? _maps_add (d, hash, &extent, TRUE, imap) : NULL;
+      }
+      dt_print (DT_DEBUG_PERF, "[liquify] built %s%dx%d distortion map in %.3f secs\n",
+                inverted ? "inverted " : "", extent.width, extent.height, dt_get_wtime () - start);
+    }
+  }
 
-  g_list_free_full (interpolated, free);
-  return map;
+  if (m)
+  {
+    m->users++;
+    m->stamp = ++d->stamp;
+  }
+  _maps_trim (d, DT_IOP_LIQUIFY_CACHED_MAPS);
+
+  dt_pthread_mutex_unlock (&d->lock);
+  return m;
+}
+
+static void _map_release (const dt_dev_pixelpipe_iop_t *piece, dt_iop_liquify_map_t *m)
+{
+  if (!m) return;
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *) piece->data;
+  dt_pthread_mutex_lock (&d->lock);
+  m->users--;
+  _maps_trim (d, DT_IOP_LIQUIFY_CACHED_MAPS);
+  dt_pthread_mutex_unlock (&d->lock);
 }
 
 // 1st pass: how large would the output be, given this input roi?
@@ -1292,11 +1489,14 @@ void modify_roi_in (struct dt_iop_module_t *module,
 
   *roi_in = *roi_out;
 
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *) piece->data;
+
   // copy params
   dt_iop_liquify_params_t copy_params;
-  memcpy(&copy_params, (dt_iop_liquify_params_t*)piece->data, sizeof(dt_iop_liquify_params_t));
+  memcpy(&copy_params, &d->params, sizeof(dt_iop_liquify_params_t));
 
   distort_paths_raw_to_piece (module, piece->pipe, roi_in->scale, &copy_params, FALSE);
+  const uint64_t hash = _paths_hash (&copy_params);
 
   cairo_rectangle_int_t pipe_rect =
     {
@@ -1316,9 +1516,10 @@ void modify_roi_in (struct dt_iop_module_t *module,
   cairo_region_t *roi_in_region = cairo_region_create_rectangle (&roi_in_rect);
 
   // get extent of all paths
-  GList *interpolated = interpolate_paths (&copy_params);
   cairo_rectangle_int_t extent;
-  _get_map_extent (roi_out, interpolated, &extent);
+  dt_pthread_mutex_lock (&d->lock);
+  _get_map_extent (roi_out, _warps_get (d, &copy_params, hash), &extent);
+  dt_pthread_mutex_unlock (&d->lock);
 
   // (eventually) extend roi_in
   cairo_region_union_rectangle (roi_in_region, &extent);
@@ -1334,7 +1535,6 @@ void modify_roi_in (struct dt_iop_module_t *module,
 
   // cleanup
   cairo_region_destroy (roi_in_region);
-  g_list_free_full (interpolated, free);
 }
 
 static int _distort_xtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, float *points, size_t points_count, gboolean inverted)
@@ -1359,26 +1559,15 @@ static int _distort_xtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pi
 
   if (extent.width != 0 && extent.height != 0)
   {
-    // copy params
-    dt_iop_liquify_params_t copy_params;
-    memcpy(&copy_params, (dt_iop_liquify_params_t *)piece->data, sizeof(dt_iop_liquify_params_t));
-
-    distort_paths_raw_to_piece (self, piece->pipe, scale, &copy_params, TRUE);
-
-    // create the distortion map for this extent
-
-    GList *interpolated = interpolate_paths (&copy_params);
-
-    // we need to adjust the extent to be the union enclosing all the points (currently in extent) and
-    // the warps that are in (possibly partly) in this same region.
+    // get the distortion map for the warps that are (possibly partly) in the region of the points
 
-    dt_iop_roi_t roi_in = { .x = extent.x, .y = extent.y, .width = extent.width, .height = extent.height };
-    _get_map_extent (&roi_in, interpolated, &extent);
+    const dt_iop_roi_t roi_in = { .x = extent.x, .y = extent.y, .width = extent.width, .height = extent.height };
+    dt_iop_liquify_map_t *m = _map_acquire (self, piece, scale, TRUE, &roi_in, inverted);
 
-    float complex *map = create_global_distortion_map (&extent, interpolated, inverted);
-    g_list_free_full (interpolated, free);
+    if (m == NULL) return 0;
 
-    if (map == NULL) return 0;
+    const float complex *map = m->map;
+    extent = m->extent;
 
     const int map_size =  extent.width * extent.height;
     const int x_last = extent.x + extent.width;
@@ -1401,7 +1590,7 @@ static int _distort_xtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pi
       }
     }
 
-    dt_free_align ((void *) map);
+    _map_release (piece, m);
   }
 
   return 1;
@@ -1435,24 +1624,20 @@ void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
     memcpy (destrow, srcrow, sizeof (float) * roi_out->width);
   }
 
-  // 2. build the distortion map
+  // 2. get the distortion map
 
-  cairo_rectangle_int_t map_extent;
-  float complex *map = build_global_distortion_map (self, piece, roi_in, roi_out, &map_extent);
-  if (map == NULL)
+  dt_iop_liquify_map_t *m = _map_acquire (self, piece, roi_in->scale, FALSE, roi_out, FALSE);
+  if (m == NULL)
     return;
 
   // 3. apply the map
 
-  if (map_extent.width != 0 && map_extent.height != 0)
-  {
-    int ch = piece->colors;
-    piece->colors = 1;
-    apply_global_distortion_map (self, piece, in, out, roi_in, roi_out, map, &map_extent);
-    piece->colors = ch;
-  }
+  int ch = piece->colors;
+  piece->colors = 1;
+  apply_global_distortion_map (self, piece, in, out, roi_in, roi_out, m->map, &m->extent);
+  piece->colors = ch;
 
-  dt_free_align ((void *) map);
+  _map_release (piece, m);
 
 }
 
@@ -1481,19 +1666,17 @@ void process(struct dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, cons
     memcpy (destrow, srcrow, sizeof (float) * ch * width);
   }
 
-  // 2. build the distortion map
+  // 2. get the distortion map
 
-  cairo_rectangle_int_t map_extent;
-  float complex *map = build_global_distortion_map (module, piece, roi_in, roi_out, &map_extent);
-  if (map == NULL)
+  dt_iop_liquify_map_t *m = _map_acquire (module, piece, roi_in->scale, FALSE, roi_out, FALSE);
+  if (m == NULL)
     return;
 
   // 3. apply the map
 
-  if (map_extent.width != 0 && map_extent.height != 0)
-    apply_global_distortion_map (module, piece, in, out, roi_in, roi_out, map, &map_extent);
+  apply_global_distortion_map (module, piece, in, out, roi_in, roi_out, m->map, &m->extent);
 
-  dt_free_align ((void *) map);
+  _map_release (piece, m);
 }
 
 #ifdef HAVE_OPENCL
@@ -1655,19 +1838,17 @@ int process_cl (struct dt_iop_module_t *module,
     if (err != CL_SUCCESS) goto error;
   }
 
-  // 2. build the distortion map
+  // 2. get the distortion map
 
-  cairo_rectangle_int_t map_extent;
-  const float complex *map = build_global_distortion_map (module, piece, roi_in, roi_out, &map_extent);
-  if (map == NULL)
+  dt_iop_liquify_map_t *m = _map_acquire (module, piece, roi_in->scale, FALSE, roi_out, FALSE);
+  if (m == NULL)
     return TRUE;
 
   // 3. apply the map
 
-  if (map_extent.width != 0 && map_extent.height != 0)
-    err = apply_global_distortion_map_cl (module, piece, dev_in, dev_out, roi_in, roi_out, map, &map_extent);
+  err = apply_global_distortion_map_cl (module, piece, dev_in, dev_out, roi_in, roi_out, m->map, &m->extent);
 
-  dt_free_align ((void *) map);
+  _map_release (piece, m);
   if (err != CL_SUCCESS) goto error;
 
   return TRUE;
@@ -1717,12 +1898,20 @@ void cleanup (dt_iop_module_t *module)
 
 void init_pipe (struct dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
-  piece->data = malloc (module->params_size);
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *) calloc (1, sizeof (dt_iop_liquify_data_t));
+  dt_pthread_mutex_init (&d->lock, NULL);
+  piece->data = d;
   module->commit_params (module, module->default_params, pipe, piece);
 }
 
 void cleanup_pipe (struct dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *) piece->data;
+  for (GList *l = d->warps; l; l = g_list_next (l))
+    g_list_free_full (((dt_iop_liquify_warps_t *) l->data)->warps, free);
+  g_list_free_full (d->warps, free);
+  g_list_free_full (d->maps, (GDestroyNotify) _map_free);
+  dt_pthread_mutex_destroy (&d->lock);
   free (piece->data);
   piece->data = NULL;
 }
@@ -1734,7 +1923,17 @@ void commit_params (struct dt_iop_module_t *module,
                     dt_dev_pixelpipe_t *pipe,
                     dt_dev_pixelpipe_iop_t *piece)
 {
-  memcpy (piece->data, params, module->params_size);
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *) piece->data;
+
+  // maps of the previous paths won't be asked for anymore
+  if (memcmp (&d->params, params, module->params_size))
+  {
+    dt_pthread_mutex_lock (&d->lock);
+    _maps_trim (d, 0);
+    dt_pthread_mutex_unlock (&d->lock);
+  }
+
+  memcpy (&d->params, params, module->params_size);
 }
 
 // calculate the dot product of 2 vectors.
@@ -20,6 +20,7 @@
 #endif
 
 #include "bauhaus/bauhaus.h"
+#include "common/clut.h"
 #include "common/imageio_png.h"
 #include "common/colorspaces.h"
 #include "common/colorspaces_inline_conversions.h"
@@ -33,6 +34,7 @@
 #include <png.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <dirent.h>
 #if defined (_WIN32)
@@ -41,6 +43,9 @@
 
 DT_MODULE_INTROSPECTION(1, dt_iop_lut3d_params_t)
 
+// parsed luts kept around by the global cache when no pipe uses them anymore
+#define DT_IOP_LUT3D_CACHED 4
+
 typedef enum dt_iop_lut3d_colorspace_t
 {
   DT_IOP_SRGB = 0,
@@ -71,11 +76,24 @@ typedef struct dt_iop_lut3d_gui_data_t
   GtkWidget *interpolation;
 } dt_iop_lut3d_gui_data_t;
 
+// a parsed lut file, shared by all pipes using it
+typedef struct dt_iop_lut3d_lut_t
+{
+  char *filepath;       // full path of the lut file
+  time_t mtime;         // to notice when the file changes
+  off_t size;
+  gboolean half;        // nodes are stored as half floats in clut_half
+  float *clut;          // cube lut pointer
+  uint16_t *clut_half;
+  uint8_t level;        // cube_size
+  int users;
+  uint64_t stamp;       // last acquire, for eviction
+} dt_iop_lut3d_lut_t;
+
 typedef struct dt_iop_lut3d_data_t
 {
   dt_iop_lut3d_params_t params;
-  float *clut;  // cube lut pointer
-  uint8_t level; // cube_size
+  dt_iop_lut3d_lut_t *lut;
 } dt_iop_lut3d_data_t;
 
 typedef struct dt_iop_lut3d_global_data_t
@@ -84,6 +102,9 @@ typedef struct dt_iop_lut3d_global_data_t
   int kernel_lut3d_trilinear;
   int kernel_lut3d_pyramid;
   int kernel_lut3d_none;
+  dt_pthread_mutex_t lock; // protects the lut cache
+  GList *luts;             // parsed luts, dt_iop_lut3d_lut_t
+  uint64_t stamp;
 } dt_iop_lut3d_global_data_t;
 
 const char *name()
@@ -106,246 +127,6 @@ int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_p
   return iop_cs_rgb;
 }
 
-// From `HaldCLUT_correct.c' by Eskil Steenberg (http://www.quelsolaar.com) (BSD licensed)
-void correct_pixel_trilinear(const float *const in, float *const out,
-                             const size_t pixel_nb, const float *const restrict clut, const uint8_t level)
-{
-  const int level2 = level * level;
-#ifdef _OPENMP
-#pragma omp parallel for SIMD() default(none) \
-  dt_omp_firstprivate(clut, in, level, level2, out, pixel_nb) \
-  schedule(static)
-#endif
-  for(size_t k = 0; k < (size_t)(pixel_nb * 4); k+=4)
-  {
-    float *input = ((float *)in) + k;
-    float *output = ((float *)out) + k;
-
-    int rgbi[3], i, j;
-    float tmp[6];
-    float rgbd[3];
-
-    for(int c = 0; c < 3; ++c) input[c] = fminf(fmaxf(input[c], 0.0f), 1.0f);
-
-    rgbd[0] = input[0] * (float)(level - 1);
-    rgbd[1] = input[1] * (float)(level - 1);
-    rgbd[2] = input[2] * (float)(level - 1);
-
-    rgbi[0] = CLAMP((int)rgbd[0], 0, level - 2);
-    rgbi[1] = CLAMP((int)rgbd[1], 0, level - 2);
-    rgbi[2] = CLAMP((int)rgbd[2], 0, level - 2);
-
-    rgbd[0] = rgbd[0] - rgbi[0]; // delta red
-    rgbd[1] = rgbd[1] - rgbi[1]; // delta green
-    rgbd[2] = rgbd[2] - rgbi[2]; // delta blue
-
-    // indexes of P000 to P111 in clut
-
-    const int color = rgbi[0] + rgbi[1] * level + rgbi[2] * level * level;
-    i = color * 3;  // P000
-    j = (color + 1) * 3;  // P100
-
-    tmp[0] = clut[i] * (1 - rgbd[0]) + clut[j] * rgbd[0];
-    tmp[1] = clut[i+1] * (1 - rgbd[0]) + clut[j+1] * rgbd[0];
-    tmp[2] = clut[i+2] * (1 - rgbd[0]) + clut[j+2] * rgbd[0];
-
-    i = (color + level) * 3;  // P010
-    j = (color + level + 1) * 3;  //P110
-
-    tmp[3] = clut[i] * (1 - rgbd[0]) + clut[j] * rgbd[0];
-    tmp[4] = clut[i+1] * (1 - rgbd[0]) + clut[j+1] * rgbd[0];
-    tmp[5] = clut[i+2] * (1 - rgbd[0]) + clut[j+2] * rgbd[0];
-
-    output[0] = tmp[0] * (1 - rgbd[1]) + tmp[3] * rgbd[1];
-    output[1] = tmp[1] * (1 - rgbd[1]) + tmp[4] * rgbd[1];
-    output[2] = tmp[2] * (1 - rgbd[1]) + tmp[5] * rgbd[1];
-
-    i = (color + level2) * 3;  // P001
-    j = (color + level2 + 1) * 3;  // P101
-
-    tmp[0] = clut[i] * (1 - rgbd[0]) + clut[j] * rgbd[0];
-    tmp[1] = clut[i+1] * (1 - rgbd[0]) + clut[j+1] * rgbd[0];
-    tmp[2] = clut[i+2] * (1 - rgbd[0]) + clut[j+2] * rgbd[0];
-
-    i = (color + level + level2) * 3;  // P011
-    j = (color + level + level2 + 1) * 3;  // P111
-
-    tmp[3] = clut[i] * (1 - rgbd[0]) + clut[j] * rgbd[0];
-    tmp[4] = clut[i+1] * (1 - rgbd[0]) + clut[j+1] * rgbd[0];
-    tmp[5] = clut[i+2] * (1 - rgbd[0]) + clut[j+2] * rgbd[0];
-
-    tmp[0] = tmp[0] * (1 - rgbd[1]) + tmp[3] * rgbd[1];
-    tmp[1] = tmp[1] * (1 - rgbd[1]) + tmp[4] * rgbd[1];
-    tmp[2] = tmp[2] * (1 - rgbd[1]) + tmp[5] * rgbd[1];
-
-    output[0] = output[0] * (1 - rgbd[2]) + tmp[0] * rgbd[2];
-    output[1] = output[1] * (1 - rgbd[2]) + tmp[1] * rgbd[2];
-    output[2] = output[2] * (1 - rgbd[2]) + tmp[2] * rgbd[2];
- }
-}
-
-// from OpenColorIO
-// https://github.com/imageworks/OpenColorIO/blob/master/src/OpenColorIO/ops/Lut3D/Lut3DOp.cpp
-void correct_pixel_tetrahedral(const float *const in, float *const out,
-                               const size_t pixel_nb, const float *const restrict clut, const uint8_t level)
-{
-  const int level2 = level * level;
-#ifdef _OPENMP
-#pragma omp parallel for SIMD() default(none) \
-  dt_omp_firstprivate(clut, in, level, level2, out, pixel_nb) \
-  schedule(static)
-#endif
-  for(size_t k = 0; k < (size_t)(pixel_nb * 4); k+=4)
-  {
-    float *const input = ((float *const)in) + k;
-    float *const output = ((float *const)out) + k;
-    int rgbi[3];
-
-    float rgbd[3];
-    for(int c = 0; c < 3; ++c) input[c] = fminf(fmaxf(input[c], 0.0f), 1.0f);
-
-    rgbd[0] = input[0] * (float)(level - 1);
-    rgbd[1] = input[1] * (float)(level - 1);
-    rgbd[2] = input[2] * (float)(level - 1);
-
-    rgbi[0] = CLAMP((int)rgbd[0], 0, level - 2);
-    rgbi[1] = CLAMP((int)rgbd[1], 0, level - 2);
-    rgbi[2] = CLAMP((int)rgbd[2], 0, level - 2);
-
-    rgbd[0] = rgbd[0] - rgbi[0]; // delta red
-    rgbd[1] = rgbd[1] - rgbi[1]; // delta green
-    rgbd[2] = rgbd[2] - rgbi[2]; // delta blue
-
-    // indexes of P000 to P111 in clut
-    const int color = rgbi[0] + rgbi[1] * level + rgbi[2] * level * level;
-    const int i000 = color * 3;                     // P000
-    const int i100 = i000 + 3;                      // P100
-    const int i010 = (color + level) * 3;           // P010
-    const int i110 = i010 + 3;                      // P110
-    const int i001 = (color + level2) * 3;          // P001
-    const int i101 = i001 + 3;                      // P101
-    const int i011 = (color + level + level2) * 3;  // P011
-    const int i111 = i011 + 3;                      // P111
-
-    if (rgbd[0] > rgbd[1])
-    {
-      if (rgbd[1] > rgbd[2])
-      {
-        output[0] = (1-rgbd[0])*clut[i000] + (rgbd[0]-rgbd[1])*clut[i100] + (rgbd[1]-rgbd[2])*clut[i110] + rgbd[2]*clut[i111];
-        output[1] = (1-rgbd[0])*clut[i000+1] + (rgbd[0]-rgbd[1])*clut[i100+1] + (rgbd[1]-rgbd[2])*clut[i110+1] + rgbd[2]*clut[i111+1];
-        output[2] = (1-rgbd[0])*clut[i000+2] + (rgbd[0]-rgbd[1])*clut[i100+2] + (rgbd[1]-rgbd[2])*clut[i110+2] + rgbd[2]*clut[i111+2];
-      }
-      else if (rgbd[0] > rgbd[2])
-      {
-        output[0] = (1-rgbd[0])*clut[i000] + (rgbd[0]-rgbd[2])*clut[i100] + (rgbd[2]-rgbd[1])*clut[i101] + rgbd[1]*clut[i111];
-        output[1] = (1-rgbd[0])*clut[i000+1] + (rgbd[0]-rgbd[2])*clut[i100+1] + (rgbd[2]-rgbd[1])*clut[i101+1] + rgbd[1]*clut[i111+1];
-        output[2] = (1-rgbd[0])*clut[i000+2] + (rgbd[0]-rgbd[2])*clut[i100+2] + (rgbd[2]-rgbd[1])*clut[i101+2] + rgbd[1]*clut[i111+2];
-      }
-      else
-      {
-        output[0] = (1-rgbd[2])*clut[i000] + (rgbd[2]-rgbd[0])*clut[i001] + (rgbd[0]-rgbd[1])*clut[i101] + rgbd[1]*clut[i111];
-        output[1] = (1-rgbd[2])*clut[i000+1] + (rgbd[2]-rgbd[0])*clut[i001+1] + (rgbd[0]-rgbd[1])*clut[i101+1] + rgbd[1]*clut[i111+1];
-        output[2] = (1-rgbd[2])*clut[i000+2] + (rgbd[2]-rgbd[0])*clut[i001+2] + (rgbd[0]-rgbd[1])*clut[i101+2] + rgbd[1]*clut[i111+2];
-      }
-    }
-    else
-    {
-      if (rgbd[2] > rgbd[1])
-      {
-        output[0] = (1-rgbd[2])*clut[i000] + (rgbd[2]-rgbd[1])*clut[i001] + (rgbd[1]-rgbd[0])*clut[i011] + rgbd[0]*clut[i111];
-        output[1] = (1-rgbd[2])*clut[i000+1] + (rgbd[2]-rgbd[1])*clut[i001+1] + (rgbd[1]-rgbd[0])*clut[i011+1] + rgbd[0]*clut[i111+1];
-        output[2] = (1-rgbd[2])*clut[i000+2] + (rgbd[2]-rgbd[1])*clut[i001+2] + (rgbd[1]-rgbd[0])*clut[i011+2] + rgbd[0]*clut[i111+2];
-      }
-      else if (rgbd[2] > rgbd[0])
-      {
-        output[0] = (1-rgbd[1])*clut[i000] + (rgbd[1]-rgbd[2])*clut[i010] + (rgbd[2]-rgbd[0])*clut[i011] + rgbd[0]*clut[i111];
-        output[1] = (1-rgbd[1])*clut[i000+1] + (rgbd[1]-rgbd[2])*clut[i010+1] + (rgbd[2]-rgbd[0])*clut[i011+1] + rgbd[0]*clut[i111+1];
-        output[2] = (1-rgbd[1])*clut[i000+2] + (rgbd[1]-rgbd[2])*clut[i010+2] + (rgbd[2]-rgbd[0])*clut[i011+2] + rgbd[0]*clut[i111+2];
-      }
-      else
-      {
-        output[0] = (1-rgbd[1])*clut[i000] + (rgbd[1]-rgbd[0])*clut[i010] + (rgbd[0]-rgbd[2])*clut[i110] + rgbd[2]*clut[i111];
-        output[1] = (1-rgbd[1])*clut[i000+1] + (rgbd[1]-rgbd[0])*clut[i010+1] + (rgbd[0]-rgbd[2])*clut[i110+1] + rgbd[2]*clut[i111+1];
-        output[2] = (1-rgbd[1])*clut[i000+2] + (rgbd[1]-rgbd[0])*clut[i010+2] + (rgbd[0]-rgbd[2])*clut[i110+2] + rgbd[2]*clut[i111+2];
-      }
-    }
-  }
-}
-
-// from Study on the 3D Interpolation Models Used in Color Conversion
-// http://ijetch.org/papers/318-T860.pdf
-void correct_pixel_pyramid(const float *const in, float *const out,
-                           const size_t pixel_nb, const float *const restrict clut, const uint8_t level)
-{
-  const int level2 = level * level;
-#ifdef _OPENMP
-#pragma omp parallel for SIMD() default(none) \
-  dt_omp_firstprivate(clut, in, level, level2, out, pixel_nb) \
-  schedule(static)
-#endif
-  for(size_t k = 0; k < (size_t)(pixel_nb * 4); k+=4)
-  {
-    float *const input = ((float *const)in) + k;
-    float *const output = ((float *const)out) + k;
-
-    int rgbi[3];
-    float rgbd[3];
-
-    for(int c = 0; c < 3; ++c) input[c] = fminf(fmaxf(input[c], 0.0f), 1.0f);
-
-    rgbd[0] = input[0] * (float)(level - 1);
-    rgbd[1] = input[1] * (float)(level - 1);
-    rgbd[2] = input[2] * (float)(level - 1);
-
-    rgbi[0] = CLAMP((int)rgbd[0], 0, level - 2);
-    rgbi[1] = CLAMP((int)rgbd[1], 0, level - 2);
-    rgbi[2] = CLAMP((int)rgbd[2], 0, level - 2);
-
-    rgbd[0] = rgbd[0] - rgbi[0]; // delta red
-    rgbd[1] = rgbd[1] - rgbi[1]; // delta green
-    rgbd[2] = rgbd[2] - rgbi[2]; // delta blue
-
-    // indexes of P000 to P111 in clut
-    const int color = rgbi[0] + rgbi[1] * level + rgbi[2] * level * level;
-    const int i000 = color * 3;                     // P000
-    const int i100 = i000 + 3;                      // P100
-    const int i010 = (color + level) * 3;           // P010
-    const int i110 = i010 + 3;                      // P110
-    const int i001 = (color + level2) * 3;          // P001
-    const int i101 = i001 + 3;                      // P101
-    const int i011 = (color + level + level2) * 3;  // P011
-    const int i111 = i011 + 3;                      // P111
-
-    if (rgbd[1] > rgbd[0] && rgbd[2] > rgbd[0])
-    {
-      output[0] = clut[i000] + (clut[i111]-clut[i011])*rgbd[0] + (clut[i010]-clut[i000])*rgbd[1] + (clut[i001]-clut[i000])*rgbd[2]
-        + (clut[i011]-clut[i001]-clut[i010]+clut[i000])*rgbd[1]*rgbd[2];
-      output[1] = clut[i000+1] + (clut[i111+1]-clut[i011+1])*rgbd[0] + (clut[i010+1]-clut[i000+1])*rgbd[1] + (clut[i001+1]-clut[i000+1])*rgbd[2]
-        + (clut[i011+1]-clut[i001+1]-clut[i010+1]+clut[i000+1])*rgbd[1]*rgbd[2];
-      output[2] = clut[i000+2] + (clut[i111+2]-clut[i011+2])*rgbd[0] + (clut[i010+2]-clut[i000+2])*rgbd[1] + (clut[i001+2]-clut[i000+2])*rgbd[2]
-        + (clut[i011+2]-clut[i001+2]-clut[i010+2]+clut[i000+2])*rgbd[1]*rgbd[2];
-    }
-    else if (rgbd[0] > rgbd[1] && rgbd[2] > rgbd[1])
-    {
-      output[0] = clut[i000] + (clut[i100]-clut[i000])*rgbd[0] + (clut[i111]-clut[i101])*rgbd[1] + (clut[i001]-clut[i000])*rgbd[2]
-        + (clut[i101]-clut[i001]-clut[i100]+clut[i000])*rgbd[0]*rgbd[2];
-      output[1] = clut[i000+1] + (clut[i100+1]-clut[i000+1])*rgbd[0] + (clut[i111+1]-clut[i101+1])*rgbd[1] + (clut[i001+1]-clut[i000+1])*rgbd[2]
-        + (clut[i101+1]-clut[i001+1]-clut[i100+1]+clut[i000+1])*rgbd[0]*rgbd[2];
-      output[2] = clut[i000+2] + (clut[i100+2]-clut[i000+2])*rgbd[0] + (clut[i111]-clut[i101+2])*rgbd[1] + (clut[i001+2]-clut[i000+2])*rgbd[2]
-        + (clut[i101+2]-clut[i001+2]-clut[i100+2]+clut[i000+2])*rgbd[0]*rgbd[2];
-    }
-    else
-    {
-      output[0] = clut[i000] + (clut[i100]-clut[i000])*rgbd[0] + (clut[i010]-clut[i000])*rgbd[1] + (clut[i111]-clut[i110])*rgbd[2]
-        + (clut[i110]-clut[i100]-clut[i010]+clut[i000])*rgbd[0]*rgbd[1];
-      output[1] = clut[i000+1] + (clut[i100+1]-clut[i000+1])*rgbd[0] + (clut[i010+1]-clut[i000+1])*rgbd[1] + (clut[i111+1]-clut[i110+1])*rgbd[2]
-        + (clut[i110+1]-clut[i100+1]-clut[i010+1]+clut[i000+1])*rgbd[0]*rgbd[1];
-      output[2] = clut[i000+2] + (clut[i100+2]-clut[i000+2])*rgbd[0] + (clut[i010+2]-clut[i000+2])*rgbd[1] + (clut[i111+2]-clut[i110+2])*rgbd[2]
-        + (clut[i110+2]-clut[i100+2]-clut[i010+2]+clut[i000+2])*rgbd[0]*rgbd[1];
-    }
-  }
-}
-
 uint8_t calculate_clut_haldclut(char *filepath, float **clut)
 {
   dt_imageio_png_t png;
@@ -660,6 +441,125 @@ uint8_t calculate_clut_cube(char *filepath, float **clut)
   return level;
 }
 
+static void _lut_free(dt_iop_lut3d_lut_t *lut)
+{
+  g_free(lut->filepath);
+  if(lut->clut) dt_free_align(lut->clut);
+  if(lut->clut_half) dt_free_align(lut->clut_half);
+  free(lut);
+}
+
+static dt_iop_lut3d_lut_t *_lut_load(const char *const fullpath, const char *const filepath,
+                                     const struct stat *const st, const gboolean half)
+{
+  float *clut = NULL;
+  uint8_t level = 0;
+  if(g_str_has_suffix(filepath, ".png") || g_str_has_suffix(filepath, ".PNG"))
+    level = calculate_clut_haldclut((char *)fullpath, &clut);
+  else if(g_str_has_suffix(filepath, ".cube") || g_str_has_suffix(filepath, ".CUBE"))
+    level = calculate_clut_cube((char *)fullpath, &clut);
+  if(!level || !clut) return NULL;
+
+  dt_iop_lut3d_lut_t *lut = calloc(1, sizeof(dt_iop_lut3d_lut_t));
+  lut->filepath = g_strdup(fullpath);
+  lut->mtime = st->st_mtime;
+  lut->size = st->st_size;
+  lut->level = level;
+  lut->clut = clut;
+  if(half)
+  {
+    const size_t nodes = (size_t)level * level * level * 3;
+    lut->clut_half = dt_alloc_align(64, nodes * sizeof(uint16_t));
+    if(lut->clut_half)
+    {
+      dt_clut_float_to_half(clut, lut->clut_half, nodes);
+      dt_free_align(lut->clut);
+      lut->clut = NULL;
+      lut->half = TRUE;
+    }
+  }
+  return lut;
+}
+
+// drop unused luts beyond DT_IOP_LUT3D_CACHED, oldest first. called with the lock held.
+static void _lut_trim(dt_iop_lut3d_global_data_t *gd)
+{
+  for(;;)
+  {
+    int unused = 0;
+    GList *oldest = NULL;
+    for(GList *l = gd->luts; l; l = g_list_next(l))
+    {
+      dt_iop_lut3d_lut_t *lut = (dt_iop_lut3d_lut_t *)l->data;
+      if(lut->users) continue;
+      unused++;
+      if(!oldest || lut->stamp < ((dt_iop_lut3d_lut_t *)oldest->data)->stamp) oldest = l;
+    }
+    if(unused <= DT_IOP_LUT3D_CACHED) return;
+    _lut_free((dt_iop_lut3d_lut_t *)oldest->data);
+    gd->luts = g_list_delete_link(gd->luts, oldest);
+  }
+}
+
+// get the parsed lut for the file, from the cache if the file didn't change since it was parsed
+static dt_iop_lut3d_lut_t *_lut_acquire(dt_iop_lut3d_global_data_t *gd, const char *const lutfolder,
+                                        const char *const filepath, const gboolean half)
+{
+  char *fullpath = g_build_filename(lutfolder, filepath, NULL);
+  struct stat st;
+  if(stat(fullpath, &st) == -1)
+  {
+    fprintf(stderr, "[lut3d] can't access lut file %s\n", fullpath);
+    dt_control_log(_("can't access lut file %s"), fullpath);
+    g_free(fullpath);
+    return NULL;
+  }
+
+  dt_pthread_mutex_lock(&gd->lock);
+  dt_iop_lut3d_lut_t *found = NULL;
+  for(GList *l = gd->luts; l; l = g_list_next(l))
+  {
+    dt_iop_lut3d_lut_t *lut = (dt_iop_lut3d_lut_t *)l->data;
+    if(lut->half == half && lut->mtime == st.st_mtime && lut->size == st.st_size
+       && !strcmp(lut->filepath, fullpath))
+    {
+      found = lut;
+      break;
+    }
+  }
+
+  if(!found)
+  {
+    // parsed under the lock, so pipes asking for the same file at the same time only parse it once
+    const double start = dt_get_wtime();
+    found = _lut_load(fullpath, filepath, &st, half);
+    if(found)
+    {
+      gd->luts = g_list_prepend(gd->luts, found);
+      dt_print(DT_DEBUG_PERF, "[lut3d] parsed %s, level %d%s, in %.3f secs\n", fullpath, found->level,
+               half ? " (half floats)" : "", dt_get_wtime() - start);
+    }
+  }
+
+  if(found)
+  {
+    found->users++;
+    found->stamp = ++gd->stamp;
+  }
+  dt_pthread_mutex_unlock(&gd->lock);
+  g_free(fullpath);
+  return found;
+}
+
+static void _lut_release(dt_iop_lut3d_global_data_t *gd, dt_iop_lut3d_lut_t *lut)
+{
+  if(!lut) return;
+  dt_pthread_mutex_lock(&gd->lock);
+  lut->users--;
+  _lut_trim(gd);
+  dt_pthread_mutex_unlock(&gd->lock);
+}
+
 #ifdef HAVE_OPENCL
 int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
                const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
@@ -667,8 +567,9 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   dt_iop_lut3d_data_t *d = (dt_iop_lut3d_data_t *)piece->data;
   dt_iop_lut3d_global_data_t *gd = (dt_iop_lut3d_global_data_t *)self->global_data;
   cl_int err = CL_SUCCESS;
-  const float *const clut = (float *)d->clut;
-  const int level = d->level;
+  const dt_iop_lut3d_lut_t *const lut = d->lut;
+  const int level = lut ? lut->level : 0;
+  float *clut = lut ? lut->clut : NULL;
   const int kernel = (d->params.interpolation == DT_IOP_TETRAHEDRAL) ? gd->kernel_lut3d_tetrahedral
     : (d->params.interpolation == DT_IOP_TRILINEAR) ? gd->kernel_lut3d_trilinear
     : gd->kernel_lut3d_pyramid;
@@ -688,9 +589,17 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   const int height = roi_in->height;
   const size_t sizes[] = { ROUNDUPWD(width), ROUNDUPHT(height), 1 };
 
-  if (clut && level)
+  if (lut && level)
   {
-    clut_cl = dt_opencl_copy_host_to_device_constant(devid, level * level * level * 3 * sizeof(float), (void *)clut);
+    const size_t nodes = (size_t)level * level * level * 3;
+    if(lut->half)
+    {
+      // the kernels read floats
+      clut = dt_alloc_align(64, nodes * sizeof(float));
+      if(clut) dt_clut_half_to_float(lut->clut_half, clut, nodes);
+    }
+    clut_cl = clut ? dt_opencl_copy_host_to_device_constant(devid, nodes * sizeof(float), (void *)clut) : NULL;
+    if(lut->half) dt_free_align(clut);
     if(clut_cl == NULL)
     {
       fprintf(stderr, "[lut3d process_cl] error allocating memory\n");
@@ -747,9 +656,11 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   const int width = roi_in->width;
   const int height = roi_in->height;
   const int ch = piece->colors;
-  const float *const clut = (float *)d->clut;
-  const uint8_t level = d->level;
-  const int interpolation = d->params.interpolation;
+  const dt_iop_lut3d_lut_t *const lut = d->lut;
+  const dt_clut_interpolation_t interpolation
+    = (d->params.interpolation == DT_IOP_TRILINEAR) ? DT_CLUT_TRILINEAR
+    : (d->params.interpolation == DT_IOP_PYRAMID) ? DT_CLUT_PYRAMID
+    : DT_CLUT_TETRAHEDRAL;
   const int colorspace
     = (d->params.colorspace == DT_IOP_SRGB) ? DT_COLORSPACE_SRGB
     : (d->params.colorspace == DT_IOP_REC709) ? DT_COLORSPACE_REC709
@@ -760,30 +671,18 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   const dt_iop_order_iccprofile_info_t *const work_profile
     = dt_ioppr_get_pipe_work_profile_info(piece->pipe);
   const gboolean transform = (work_profile != NULL && lut_profile != NULL) ? TRUE : FALSE;
-  if (clut)
+  if (lut)
   {
     if (transform)
     {
       dt_ioppr_transform_image_colorspace_rgb(ibuf, obuf, width, height,
         work_profile, lut_profile, "work profile to LUT profile");
-      if (interpolation == DT_IOP_TETRAHEDRAL)
-        correct_pixel_tetrahedral(obuf, obuf, width * height, clut, level);
-      else if (interpolation == DT_IOP_TRILINEAR)
-        correct_pixel_trilinear(obuf, obuf, width * height, clut, level);
-      else
-        correct_pixel_pyramid(obuf, obuf, width * height, clut, level);
+      dt_clut_apply(obuf, obuf, (size_t)width * height, lut->clut, lut->clut_half, lut->level, interpolation);
       dt_ioppr_transform_image_colorspace_rgb(obuf, obuf, width, height,
         lut_profile, work_profile, "LUT profile to work profile");
     }
     else
-    {
-      if (interpolation == DT_IOP_TETRAHEDRAL)
-        correct_pixel_tetrahedral(ibuf, obuf, width * height, clut, level);
-      else if (interpolation == DT_IOP_TRILINEAR)
-        correct_pixel_trilinear(ibuf, obuf, width * height, clut, level);
-      else
-        correct_pixel_pyramid(ibuf, obuf, width * height, clut, level);
-    }
+      dt_clut_apply(ibuf, obuf, (size_t)width * height, lut->clut, lut->clut_half, lut->level, interpolation);
   }
   else  // no clut
   {
@@ -832,6 +731,9 @@ void init_global(dt_iop_module_so_t *module)
   gd->kernel_lut3d_trilinear = dt_opencl_create_kernel(program, "lut3d_trilinear");
   gd->kernel_lut3d_pyramid = dt_opencl_create_kernel(program, "lut3d_pyramid");
   gd->kernel_lut3d_none = dt_opencl_create_kernel(program, "lut3d_none");
+  dt_pthread_mutex_init(&gd->lock, NULL);
+  gd->luts = NULL;
+  gd->stamp = 0;
 }
 
 void cleanup_global(dt_iop_module_so_t *module)
@@ -841,6 +743,8 @@ void cleanup_global(dt_iop_module_so_t *module)
   dt_opencl_free_kernel(gd->kernel_lut3d_trilinear);
   dt_opencl_free_kernel(gd->kernel_lut3d_pyramid);
   dt_opencl_free_kernel(gd->kernel_lut3d_none);
+  g_list_free_full(gd->luts, (GDestroyNotify)_lut_free);
+  dt_pthread_mutex_destroy(&gd->lock);
   free(module->data);
   module->data = NULL;
 }
@@ -850,51 +754,30 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 {
   dt_iop_lut3d_params_t *p = (dt_iop_lut3d_params_t *)p1;
   dt_iop_lut3d_data_t *d = (dt_iop_lut3d_data_t *)piece->data;
-  if (strcmp(p->filepath, d->params.filepath) != 0)
-  {
-    if (d->clut)
-    {
-      dt_free_align(d->clut);
-      d->clut = NULL;
-      d->level = 0;
-    }
-  }
-  memcpy(&d->params, p, sizeof(dt_iop_lut3d_params_t));
-  const gchar *lutfolder = dt_conf_get_string("plugins/darkroom/lut3d/def_path");
+  dt_iop_lut3d_global_data_t *gd = (dt_iop_lut3d_global_data_t *)self->global_data;
 
-  if (p->filepath[0] && lutfolder[0] && !d->clut)
-  {
-    char *fullpath = g_build_filename(lutfolder, p->filepath, NULL);
-    if (g_str_has_suffix (p->filepath, ".png") || g_str_has_suffix (p->filepath, ".PNG"))
-    {
-      d->level = calculate_clut_haldclut(fullpath, &d->clut);
-    }
-    else if (g_str_has_suffix (p->filepath, ".cube") || g_str_has_suffix (p->filepath, ".CUBE"))
-    {
-      d->level = calculate_clut_cube(fullpath, &d->clut);
-    }
-    g_free(fullpath);
-  }
+  // cheap when the file didn't change: the parsed lut comes from the global cache
+  dt_iop_lut3d_lut_t *old = d->lut;
+  d->lut = NULL;
+  memcpy(&d->params, p, sizeof(dt_iop_lut3d_params_t));
+  gchar *lutfolder = dt_conf_get_string("plugins/darkroom/lut3d/def_path");
+  if (p->filepath[0] && lutfolder[0])
+    d->lut = _lut_acquire(gd, lutfolder, p->filepath, dt_conf_get_bool("plugins/darkroom/lut3d/half_precision"));
+  g_free(lutfolder);
+  _lut_release(gd, old);
 }
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
   // create part of the pixelpipe
-  piece->data = malloc(sizeof(dt_iop_lut3d_data_t));
-  dt_iop_lut3d_data_t *d = (dt_iop_lut3d_data_t *)piece->data;
-  d->clut = NULL;
-  d->level = 0;
+  piece->data = calloc(1, sizeof(dt_iop_lut3d_data_t));
   self->commit_params(self, self->default_params, pipe, piece);
 }
 
 void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
   dt_iop_lut3d_data_t *d = (dt_iop_lut3d_data_t *)piece->data;
-  if (d->clut)
-  {
-    dt_free_align(d->clut);
-    d->clut = NULL;
-  }
+  _lut_release((dt_iop_lut3d_global_data_t *)self->global_data, d->lut);
   free(piece->data);
   piece->data = NULL;
 }
@@ -0,0 +1,583 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// reproducible pixelpipe benchmark. writes synthetic bayer and x-trans raws as float dngs, gives them fixed
+// histories and runs them through the export, thumbnail and preview pipes the way darktable-cli, the
+// lighttable and the darkroom do. per module timings come from the pipe trace (-d trace), the whole report
+// goes to stdout (or --output) as json, progress to stderr.
+//
+// every scenario is run --runs times and the fastest run is reported. mpix_per_s of a scenario is the raw
+// size divided by the pipe time, the one of a module its output size divided by its time. peak_rss_kb is the
+// high water mark while the scenario ran, where the os lets us reset it (linux), the one of the process
+// otherwise. encode of the tiff and png scenarios is their wall time minus the one of the same history
+// exported to memory.
+//
+// config and cache go to a fresh temporary directory, so that neither darktablerc nor the thumbnail cache
+// of the user influence the numbers. the trace of the last run is left there.
+//
+// usage: darktable-bench [--runs <n>] [--scale <factor>] [--output <file.json>] [--core <darktable options>]
+
+#include "common/darktable.h"
+#include "common/film.h"
+#include "common/image.h"
+#include "common/imageio.h"
+#include "common/imageio_dng.h"
+#include "common/imageio_module.h"
+#include "common/mipmap_cache.h"
+#include "common/opencl.h"
+#include "common/trace.h"
+#include "control/conf.h"
+#include "develop/develop.h"
+#include "develop/imageop.h"
+#include "develop/pixelpipe.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#define BENCH_MAX_OPS 8
+#define BENCH_MAX_MODULES 64
+
+typedef enum bench_pipe_t
+{
+  BENCH_EXPORT,
+  BENCH_THUMBNAIL,
+  BENCH_PREVIEW
+} bench_pipe_t;
+
+typedef struct bench_scenario_t
+{
+  const char *name;
+  bench_pipe_t pipe;
+  const char *format; // NULL exports to memory
+  const char *ops[BENCH_MAX_OPS]; // enabled with default parameters on top of what a new image gets
+} bench_scenario_t;
+
+#define BENCH_REFERENCE { "exposure", "denoiseprofile", "bilat", "filmicrgb", "sharpen", NULL }
+
+static const bench_scenario_t scenarios[] = {
+  { "defaults", BENCH_EXPORT, NULL, { NULL } },
+  { "reference", BENCH_EXPORT, NULL, BENCH_REFERENCE },
+  { "thumbnail", BENCH_THUMBNAIL, NULL, BENCH_REFERENCE },
+  { "preview", BENCH_PREVIEW, NULL, BENCH_REFERENCE },
+  { "tiff", BENCH_EXPORT, "tiff", BENCH_REFERENCE },
+  { "png", BENCH_EXPORT, "png", BENCH_REFERENCE },
+  { "denoiseprofile", BENCH_EXPORT, NULL, { "denoiseprofile", NULL } },
+  { "nlmeans", BENCH_EXPORT, NULL, { "nlmeans", NULL } },
+  { "bilat", BENCH_EXPORT, NULL, { "bilat", NULL } },
+  { "atrous", BENCH_EXPORT, NULL, { "atrous", NULL } },
+  { "filmicrgb", BENCH_EXPORT, NULL, { "filmicrgb", NULL } },
+};
+
+typedef struct bench_input_t
+{
+  const char *name;
+  int width, height;
+  uint32_t filters;
+} bench_input_t;
+
+static const bench_input_t inputs[] = {
+  { "bayer", 6000, 4000, 0x94949494 }, // rggb
+  { "xtrans", 6000, 4000, 9u },
+};
+
+static const uint8_t xtrans[6][6] = { { 1, 1, 0, 1, 1, 2 }, { 1, 1, 2, 1, 1, 0 }, { 2, 0, 1, 0, 2, 1 },
+                                      { 1, 1, 2, 1, 1, 0 }, { 1, 1, 0, 1, 1, 2 }, { 0, 2, 1, 2, 0, 1 } };
+static const uint8_t no_xtrans[6][6] = { { 0 } };
+
+typedef struct bench_module_t
+{
+  char name[32];
+  double time;
+  int width, height;
+  gboolean gpu;
+} bench_module_t;
+
+typedef struct bench_run_t
+{
+  double wall, pipe;
+  const char *pipe_type;
+  int width, height;
+  bench_module_t module[BENCH_MAX_MODULES];
+  int num_modules;
+} bench_run_t;
+
+// in-memory export format, lets the pixels end up nowhere
+typedef struct bench_format_t
+{
+  dt_imageio_module_data_t head;
+  int bpp;
+} bench_format_t;
+
+static int _bpp(dt_imageio_module_data_t *data)
+{
+  return ((bench_format_t *)data)->bpp;
+}
+
+static int _levels(dt_imageio_module_data_t *data)
+{
+  return IMAGEIO_RGB | (((bench_format_t *)data)->bpp == 8 ? IMAGEIO_INT8 : IMAGEIO_FLOAT);
+}
+
+static const char *_mime(dt_imageio_module_data_t *data)
+{
+  return "memory";
+}
+
+static int _write_image(dt_imageio_module_data_t *data, const char *filename, const void *in,
+                        dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                        void *exif, int exif_len, int imgid, int num, int total, dt_dev_pixelpipe_t *pipe)
+{
+  return 0;
+}
+
+static uint32_t _xorshift(uint32_t *state)
+{
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+// colour patches on a horizontal exposure ramp with some fine texture, and noise growing with the signal
+// like shot noise, so that the denoisers have something to do. the same for every run and every machine.
+static void _synthetic_raw(float *const raw, const bench_input_t *const input, const int width, const int height)
+{
+  for(int y = 0; y < height; y++)
+  {
+    uint32_t state = 0x9e3779b9u ^ (uint32_t)(y + 1) * 2654435761u;
+    for(int x = 0; x < width; x++)
+    {
+      const int patch = (6 * y / height) * 4 + 4 * x / width;
+      const float hue[3] = { 0.3f + 0.7f * ((patch * 7) % 24) / 23.0f, 0.3f + 0.7f * ((patch * 11) % 24) / 23.0f,
+                             0.3f + 0.7f * ((patch * 5) % 24) / 23.0f };
+      const float ramp = 0.02f + 0.6f * (float)x / width;
+      const float texture = 1.0f + 0.1f * sinf(0.3f * x) * sinf(0.2f * y);
+      const int c = input->filters == 9u ? xtrans[y % 6][x % 6] : ((y & 1) ? ((x & 1) ? 2 : 1) : ((x & 1) ? 1 : 0));
+      const float signal = ramp * texture * hue[c];
+      const float noise = ((_xorshift(&state) >> 8) + (_xorshift(&state) >> 8)) * (1.0f / (1 << 24)) - 1.0f;
+      raw[(size_t)width * y + x] = CLAMPS(signal + noise * (0.002f + 0.03f * sqrtf(signal)), 0.0f, 1.0f);
+    }
+  }
+}
+
+static void _reset_peak_rss()
+{
+#ifdef __linux__
+  // 5 resets the high water mark of the resident set size
+  FILE *f = g_fopen("/proc/self/clear_refs", "w");
+  if(!f) return;
+  fputs("5", f);
+  fclose(f);
+#endif
+}
+
+static int64_t _peak_rss()
+{
+#ifdef __linux__
+  FILE *f = g_fopen("/proc/self/status", "r");
+  if(f)
+  {
+    char line[256];
+    long kb = -1;
+    while(fgets(line, sizeof(line), f))
+      if(sscanf(line, "VmHWM: %ld kB", &kb) == 1) break;
+    fclose(f);
+    if(kb >= 0) return kb;
+  }
+#endif
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+  return ru.ru_maxrss / 1024;
+#else
+  return ru.ru_maxrss;
+#endif
+}
+
+static void _collect(const dt_trace_event_t *event, void *user_data)
+{
+  bench_run_t *run = (bench_run_t *)user_data;
+  const double time = event->end - event->start;
+
+  if(!strcmp(event->cat, "pipe"))
+  {
+    run->pipe += time;
+    run->pipe_type = event->pipe;
+    run->width = event->width;
+    run->height = event->height;
+    return;
+  }
+  if(strcmp(event->cat, "module")) return;
+
+  // instances and repeated runs of the same module add up
+  int k = 0;
+  while(k < run->num_modules && strcmp(run->module[k].name, event->name)) k++;
+  if(k == BENCH_MAX_MODULES) return;
+  bench_module_t *m = run->module + k;
+  if(k == run->num_modules)
+  {
+    memset(m, 0, sizeof(bench_module_t));
+    g_strlcpy(m->name, event->name, sizeof(m->name));
+    run->num_modules++;
+  }
+  m->time += time;
+  m->width = event->width;
+  m->height = event->height;
+  m->gpu |= event->device >= 0;
+}
+
+// fresh history: what a new image gets, plus the ops of the scenario with their default parameters
+static int _set_history(const int imgid, const bench_scenario_t *const scenario, int *base_end)
+{
+  dt_develop_t dev;
+  dt_dev_init(&dev, 0);
+  dt_dev_load_image(&dev, imgid);
+  if(*base_end < 0) *base_end = dev.history_end;
+  dt_dev_pop_history_items_ext(&dev, *base_end);
+
+  int missing = 0;
+  for(int k = 0; k < BENCH_MAX_OPS && scenario->ops[k]; k++)
+  {
+    dt_iop_module_t *module = NULL;
+    for(GList *modules = dev.iop; modules; modules = g_list_next(modules))
+    {
+      dt_iop_module_t *mod = (dt_iop_module_t *)modules->data;
+      if(!strcmp(mod->op, scenario->ops[k]) && mod->multi_priority == 0)
+      {
+        module = mod;
+        break;
+      }
+    }
+    if(!module)
+    {
+      fprintf(stderr, "[bench] module `%s' not found\n", scenario->ops[k]);
+      missing++;
+      continue;
+    }
+    dt_dev_add_history_item_ext(&dev, module, TRUE, TRUE);
+  }
+
+  dt_dev_write_history(&dev);
+  dt_dev_cleanup(&dev);
+  return missing;
+}
+
+// what the darkroom does for its navigation preview, minus the gui
+static int _run_preview(const int imgid)
+{
+  dt_develop_t dev;
+  dt_dev_init(&dev, 0);
+  dt_dev_load_image(&dev, imgid);
+
+  int res = 1;
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_F, DT_MIPMAP_BLOCKING, 'r');
+  dt_dev_pixelpipe_t pipe;
+  if(buf.buf && buf.width && buf.height && dt_dev_pixelpipe_init_preview(&pipe))
+  {
+    dt_dev_pixelpipe_set_input(&pipe, &dev, (float *)buf.buf, buf.width, buf.height, buf.iscale);
+    dt_dev_pixelpipe_create_nodes(&pipe, &dev);
+    dt_dev_pixelpipe_synch_all(&pipe, &dev);
+    dt_dev_pixelpipe_get_dimensions(&pipe, &dev, pipe.iwidth, pipe.iheight, &pipe.processed_width,
+                                    &pipe.processed_height);
+    res = dt_dev_pixelpipe_process(&pipe, &dev, 0, 0, pipe.processed_width, pipe.processed_height, 1.0f);
+    dt_dev_pixelpipe_cleanup(&pipe);
+  }
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  dt_dev_cleanup(&dev);
+  return res;
+}
+
+static int _run_export(const int imgid, const bench_scenario_t *const scenario, const char *workdir)
+{
+  if(scenario->format)
+  {
+    dt_imageio_module_format_t *format = dt_imageio_get_format_by_name(scenario->format);
+    if(!format) return 1;
+    gchar *key = g_strdup_printf("plugins/imageio/format/%s/bpp", scenario->format);
+    dt_conf_set_int(key, 16);
+    g_free(key);
+
+    dt_imageio_module_data_t *fdata = format->get_params(format);
+    if(!fdata) return 1;
+    fdata->max_width = fdata->max_height = 0;
+    fdata->style[0] = '\0';
+    gchar *filename = g_strdup_printf("%s/bench.%s", workdir, format->extension(fdata));
+    const int res = dt_imageio_export(imgid, filename, format, fdata, TRUE, FALSE, FALSE, DT_COLORSPACE_NONE,
+                                      NULL, DT_INTENT_LAST, NULL, NULL, 1, 1, NULL);
+    g_unlink(filename);
+    g_free(filename);
+    format->free_params(format, fdata);
+    return res;
+  }
+
+  const gboolean thumbnail = scenario->pipe == BENCH_THUMBNAIL;
+  dt_imageio_module_format_t format = { 0 };
+  format.bpp = _bpp;
+  format.levels = _levels;
+  format.mime = _mime;
+  format.write_image = _write_image;
+  bench_format_t dat = { { 0 } };
+  dat.bpp = thumbnail ? 8 : 32;
+  if(thumbnail)
+  {
+    dat.head.max_width = darktable.mipmap_cache->max_width[DT_MIPMAP_3];
+    dat.head.max_height = darktable.mipmap_cache->max_height[DT_MIPMAP_3];
+  }
+  return dt_imageio_export_with_flags(imgid, "unused", &format, (dt_imageio_module_data_t *)&dat, TRUE, FALSE,
+                                      !thumbnail, FALSE, thumbnail, NULL, FALSE, DT_COLORSPACE_NONE, NULL,
+                                      DT_INTENT_LAST, NULL, NULL, 1, 1, NULL);
+}
+
+static void _add_int(JsonBuilder *builder, const char *name, const gint64 value)
+{
+  json_builder_set_member_name(builder, name);
+  json_builder_add_int_value(builder, value);
+}
+
+static void _add_double(JsonBuilder *builder, const char *name, const double value)
+{
+  json_builder_set_member_name(builder, name);
+  json_builder_add_double_value(builder, value);
+}
+
+static void _add_string(JsonBuilder *builder, const char *name, const char *value)
+{
+  json_builder_set_member_name(builder, name);
+  json_builder_add_string_value(builder, value);
+}
+
+int main(int argc, char *argv[])
+{
+  int runs = 3;
+  double scale = 1.0;
+  const char *output = NULL;
+  int k = 1;
+  for(; k < argc; k++)
+  {
+    if(!strcmp(argv[k], "--runs") && argc > k + 1)
+      runs = MAX(1, atoi(argv[++k]));
+    else if(!strcmp(argv[k], "--scale") && argc > k + 1)
+      scale = CLAMP(g_ascii_strtod(argv[++k], NULL), 0.05, 4.0);
+    else if(!strcmp(argv[k], "--output") && argc > k + 1)
+      output = argv[++k];
+    else if(!strcmp(argv[k], "--core"))
+    {
+      k++;
+      break;
+    }
+    else
+    {
+      fprintf(stderr, "usage: %s [--runs <n>] [--scale <factor>] [--output <file.json>] [--core <darktable "
+                      "options>]\n",
+              argv[0]);
+      exit(1);
+    }
+  }
+
+  GError *error = NULL;
+  gchar *workdir = g_dir_make_tmp("darktable-bench-XXXXXX", &error);
+  if(!workdir)
+  {
+    fprintf(stderr, "[bench] can't create a temporary directory: %s\n", error->message);
+    g_error_free(error);
+    exit(1);
+  }
+  gchar *configdir = g_build_filename(workdir, "config", NULL);
+  gchar *cachedir = g_build_filename(workdir, "cache", NULL);
+
+  int dt_argc = 0;
+  char **dt_argv = malloc((12 + argc - k + 1) * sizeof(char *));
+  dt_argv[dt_argc++] = "darktable-bench";
+  dt_argv[dt_argc++] = "--library";
+  dt_argv[dt_argc++] = ":memory:";
+  dt_argv[dt_argc++] = "--configdir";
+  dt_argv[dt_argc++] = configdir;
+  dt_argv[dt_argc++] = "--cachedir";
+  dt_argv[dt_argc++] = cachedir;
+  dt_argv[dt_argc++] = "--conf";
+  dt_argv[dt_argc++] = "write_sidecar_files=FALSE";
+  dt_argv[dt_argc++] = "-d";
+  dt_argv[dt_argc++] = "trace";
+  for(; k < argc; k++) dt_argv[dt_argc++] = argv[k];
+  dt_argv[dt_argc] = NULL;
+
+  // init dt without gui, but with data.db for the presets new images get:
+  if(dt_init(dt_argc, dt_argv, FALSE, TRUE, NULL)) exit(1);
+
+  JsonBuilder *builder = json_builder_new();
+  json_builder_begin_object(builder);
+  _add_string(builder, "version", darktable_package_version);
+  _add_int(builder, "threads", dt_get_num_threads());
+  json_builder_set_member_name(builder, "opencl");
+  json_builder_add_boolean_value(builder, dt_opencl_is_enabled());
+  _add_int(builder, "runs", runs);
+  json_builder_set_member_name(builder, "results");
+  json_builder_begin_array(builder);
+
+  int failed = 0;
+  dt_film_t film;
+  const int filmid = dt_film_new(&film, workdir);
+  for(int i = 0; i < (int)(sizeof(inputs) / sizeof(*inputs)); i++)
+  {
+    const bench_input_t *input = inputs + i;
+    // multiples of the x-trans pattern
+    const int width = MAX(6, (int)(input->width * scale / 6) * 6);
+    const int height = MAX(6, (int)(input->height * scale / 6) * 6);
+    const double mpix = 1e-6 * width * height;
+
+    float *raw = dt_alloc_align(64, sizeof(float) * width * height);
+    if(!raw)
+    {
+      fprintf(stderr, "[bench] out of memory\n");
+      failed++;
+      break;
+    }
+    _synthetic_raw(raw, input, width, height);
+    gchar *filename = g_strdup_printf("%s/%s.dng", workdir, input->name);
+    dt_imageio_write_dng(filename, raw, width, height, NULL, 0, input->filters,
+                         input->filters == 9u ? xtrans : no_xtrans, 1.0f);
+    dt_free_align(raw);
+
+    const int imgid = dt_image_import(filmid, filename, TRUE);
+    if(!imgid)
+    {
+      fprintf(stderr, "[bench] can't import `%s'\n", filename);
+      failed++;
+      g_unlink(filename);
+      g_free(filename);
+      continue;
+    }
+
+    int base_end = -1;
+    double memory_wall = 0.0;
+    for(int s = 0; s < (int)(sizeof(scenarios) / sizeof(*scenarios)); s++)
+    {
+      const bench_scenario_t *scenario = scenarios + s;
+      if(_set_history(imgid, scenario, &base_end))
+      {
+        failed++;
+        continue;
+      }
+
+      bench_run_t best = { 0 };
+      int errors = 0;
+      _reset_peak_rss();
+      for(int r = 0; r < runs; r++)
+      {
+        bench_run_t run = { 0 };
+        dt_trace_reset();
+        const double start = dt_get_wtime();
+        errors += scenario->pipe == BENCH_PREVIEW ? _run_preview(imgid)
+                                                  : _run_export(imgid, scenario, workdir);
+        run.wall = dt_get_wtime() - start;
+        dt_trace_foreach(_collect, &run);
+        if(r == 0 || run.wall < best.wall) best = run;
+      }
+      const int64_t peak_rss = _peak_rss();
+
+      if(errors)
+      {
+        fprintf(stderr, "[bench] %s %s: %d of %d runs failed\n", input->name, scenario->name, errors, runs);
+        failed++;
+        continue;
+      }
+      if(!scenario->format && scenario->pipe == BENCH_EXPORT && !strcmp(scenario->name, "reference"))
+        memory_wall = best.wall;
+
+      fprintf(stderr, "[bench] %-7s %-15s %8.3f s wall %8.3f s pipe %7.1f Mpix/s %9" PRId64 " kB peak rss\n",
+              input->name, scenario->name, best.wall, best.pipe, best.pipe > 0.0 ? mpix / best.pipe : 0.0,
+              peak_rss);
+
+      json_builder_begin_object(builder);
+      _add_string(builder, "input", input->name);
+      _add_int(builder, "input_width", width);
+      _add_int(builder, "input_height", height);
+      _add_string(builder, "scenario", scenario->name);
+      _add_string(builder, "pipe", best.pipe_type ? best.pipe_type : "unknown");
+      _add_int(builder, "width", best.width);
+      _add_int(builder, "height", best.height);
+      _add_double(builder, "wall", best.wall);
+      _add_double(builder, "pipe_time", best.pipe);
+      _add_double(builder, "mpix_per_s", best.pipe > 0.0 ? mpix / best.pipe : 0.0);
+      if(scenario->format && memory_wall > 0.0) _add_double(builder, "encode", MAX(0.0, best.wall - memory_wall));
+      _add_int(builder, "peak_rss_kb", peak_rss);
+      json_builder_set_member_name(builder, "modules");
+      json_builder_begin_array(builder);
+      for(int m = 0; m < best.num_modules; m++)
+      {
+        const bench_module_t *module = best.module + m;
+        json_builder_begin_object(builder);
+        _add_string(builder, "name", module->name);
+        _add_double(builder, "time", module->time);
+        _add_double(builder, "mpix_per_s",
+                    module->time > 0.0 ? 1e-6 * module->width * module->height / module->time : 0.0);
+        _add_string(builder, "device", module->gpu ? "GPU" : "CPU");
+        json_builder_end_object(builder);
+      }
+      json_builder_end_array(builder);
+      json_builder_end_object(builder);
+    }
+
+    g_unlink(filename);
+    g_free(filename);
+  }
+
+  json_builder_end_array(builder);
+  json_builder_end_object(builder);
+
+  JsonGenerator *generator = json_generator_new();
+  json_generator_set_pretty(generator, TRUE);
+  JsonNode *root = json_builder_get_root(builder);
+  json_generator_set_root(generator, root);
+  if(output)
+  {
+    if(!json_generator_to_file(generator, output, &error))
+    {
+      fprintf(stderr, "[bench] can't write `%s': %s\n", output, error->message);
+      g_error_free(error);
+      failed++;
+    }
+  }
+  else
+  {
+    gchar *json = json_generator_to_data(generator, NULL);
+    printf("%s\n", json);
+    g_free(json);
+  }
+  json_node_free(root);
+  g_object_unref(generator);
+  g_object_unref(builder);
+
+  dt_cleanup();
+
+  fprintf(stderr, "[bench] config, cache and trace left in `%s'\n", workdir);
+  free(dt_argv);
+  g_free(configdir);
+  g_free(cachedir);
+  g_free(workdir);
+  return failed ? 1 : 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
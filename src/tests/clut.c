@@ -0,0 +1,107 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// benchmark for the 3D lut lookups in common/clut.c: every interpolation with float and half float nodes.
+// usage: darktable-test-clut [level] [megapixels]
+
+#include "common/clut.h"
+#include "common/darktable.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char *argv[])
+{
+  const int level = argc > 1 ? atoi(argv[1]) : 65;
+  const size_t npixels = (argc > 2 ? atof(argv[2]) : 24.0) * 1e6;
+  if(level < 2 || level > 255 || !npixels)
+  {
+    fprintf(stderr, "usage: %s [level] [megapixels]\n", argv[0]);
+    return 1;
+  }
+
+  // a smooth, non linear lut with a known analytic value
+  const size_t nodes = (size_t)3 * level * level * level;
+  float *clut = dt_alloc_align(64, nodes * sizeof(float));
+  uint16_t *clut_half = dt_alloc_align(64, nodes * sizeof(uint16_t));
+  for(int b = 0; b < level; b++)
+    for(int g = 0; g < level; g++)
+      for(int r = 0; r < level; r++)
+      {
+        float *node = clut + 3 * (r + g * level + (size_t)b * level * level);
+        node[0] = sqrtf((float)r / (level - 1));
+        node[1] = (float)g / (level - 1);
+        node[2] = powf((float)b / (level - 1), 2.2f);
+      }
+  dt_clut_float_to_half(clut, clut_half, nodes);
+
+  float *in = dt_alloc_align(64, 4 * npixels * sizeof(float));
+  float *out = dt_alloc_align(64, 4 * npixels * sizeof(float));
+  float *out_half = dt_alloc_align(64, 4 * npixels * sizeof(float));
+  if(!clut || !clut_half || !in || !out || !out_half)
+  {
+    fprintf(stderr, "[clut] out of memory\n");
+    return 1;
+  }
+  srand(42);
+  for(size_t k = 0; k < 4 * npixels; k++) in[k] = (float)rand() / RAND_MAX;
+
+  const char *names[] = { "tetrahedral", "trilinear", "pyramid" };
+  printf("level %d, %.1f megapixels\n", level, npixels * 1e-6);
+  for(int interpolation = DT_CLUT_TETRAHEDRAL; interpolation <= DT_CLUT_PYRAMID; interpolation++)
+  {
+    // warm up, then take the best of a few runs
+    double best = 1e9, best_half = 1e9;
+    for(int run = 0; run < 4; run++)
+    {
+      double start = dt_get_wtime();
+      dt_clut_apply(in, out, npixels, clut, NULL, level, interpolation);
+      if(run) best = fmin(best, dt_get_wtime() - start);
+      start = dt_get_wtime();
+      dt_clut_apply(in, out_half, npixels, NULL, clut_half, level, interpolation);
+      if(run) best_half = fmin(best_half, dt_get_wtime() - start);
+    }
+
+    float err = 0.0f, err_half = 0.0f;
+    for(size_t k = 0; k < npixels; k++)
+    {
+      const float *const i = in + 4 * k;
+      const float ref[3] = { sqrtf(i[0]), i[1], powf(i[2], 2.2f) };
+      for(int c = 0; c < 3; c++)
+      {
+        err = fmaxf(err, fabsf(out[4 * k + c] - ref[c]));
+        err_half = fmaxf(err_half, fabsf(out_half[4 * k + c] - out[4 * k + c]));
+      }
+    }
+
+    printf("%-12s float %8.1f Mpix/s  half %8.1f Mpix/s  max error %.2e  half vs float %.2e\n", names[interpolation],
+           npixels * 1e-6 / best, npixels * 1e-6 / best_half, err, err_half);
+  }
+
+  dt_free_align(clut);
+  dt_free_align(clut_half);
+  dt_free_align(in);
+  dt_free_align(out);
+  dt_free_align(out_half);
+  return 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
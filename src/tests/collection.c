@@ -0,0 +1,139 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// runs EXPLAIN QUERY PLAN on the queries dt_collection_update() generates for the usual collect rules and
+// sort orders and fails when one of them has to scan a table that grows with the library.
+// usage: darktable-test-collection [-v]
+
+#include "common/collection.h"
+#include "common/darktable.h"
+#include "common/database.h"
+#include "control/conf.h"
+
+#include <stdio.h>
+#include <string.h>
+
+typedef struct test_rule_t
+{
+  dt_collection_properties_t property;
+  const char *text;
+  gboolean needs_fts; // substring matches on images columns scan without the full text search index
+} test_rule_t;
+
+static const test_rule_t rules[] = {
+  { DT_COLLECTION_PROP_FILMROLL, "/tmp/darktable-test", FALSE },
+  { DT_COLLECTION_PROP_FOLDERS, "/tmp", FALSE },
+  { DT_COLLECTION_PROP_COLORLABEL, "green", FALSE },
+  { DT_COLLECTION_PROP_TAG, "darktable|test%", FALSE },
+  { DT_COLLECTION_PROP_TITLE, "sunset", FALSE },
+  { DT_COLLECTION_PROP_FILENAME, "IMG_", TRUE },
+  { DT_COLLECTION_PROP_LENS, "70-200", TRUE },
+};
+
+static const dt_collection_sort_t sorts[] = {
+  DT_COLLECTION_SORT_FILENAME, DT_COLLECTION_SORT_DATETIME, DT_COLLECTION_SORT_RATING,
+  DT_COLLECTION_SORT_ID,       DT_COLLECTION_SORT_COLOR,    DT_COLLECTION_SORT_GROUP,
+  DT_COLLECTION_SORT_PATH,     DT_COLLECTION_SORT_CUSTOM_ORDER, DT_COLLECTION_SORT_TITLE,
+  DT_COLLECTION_SORT_DESCRIPTION, DT_COLLECTION_SORT_ASPECT_RATIO,
+};
+
+// film rolls and tags hold one row per folder and per tag, scanning them is fine
+static gboolean _is_full_scan(const char *detail)
+{
+  if(strncmp(detail, "SCAN", 4)) return FALSE;
+  return !(strstr(detail, "film_rolls") || strstr(detail, "tags") || strstr(detail, "CONSTANT ROW")
+           || strstr(detail, "VIRTUAL TABLE"));
+}
+
+static int _check_plan(const char *query, const gboolean verbose)
+{
+  sqlite3 *db = dt_database_get(darktable.db);
+  gchar *explain = g_strdup_printf("EXPLAIN QUERY PLAN %s", query);
+  sqlite3_stmt *stmt;
+  if(sqlite3_prepare_v2(db, explain, -1, &stmt, NULL) != SQLITE_OK)
+  {
+    printf("  [FAIL] can't prepare '%s': %s\n", query, sqlite3_errmsg(db));
+    g_free(explain);
+    return 1;
+  }
+  sqlite3_bind_int(stmt, 1, 0);
+  sqlite3_bind_int(stmt, 2, -1);
+
+  int scans = 0;
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const char *detail = (const char *)sqlite3_column_text(stmt, 3);
+    if(!detail) continue;
+    const gboolean scan = _is_full_scan(detail);
+    if(scan) scans++;
+    if(scan || verbose) printf("    %s%s\n", scan ? "full scan: " : "", detail);
+  }
+  sqlite3_finalize(stmt);
+  g_free(explain);
+
+  if(scans) printf("  [FAIL] %s\n", query);
+  return scans ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+  const gboolean verbose = argc > 1 && !strcmp(argv[1], "-v");
+  char *dt_argv[] = {"darktable-test-collection", "--library", ":memory:", "--conf", "write_sidecar_files=FALSE", NULL};
+  int dt_argc = sizeof(dt_argv) / sizeof(*dt_argv) - 1;
+
+  // init dt without gui and without data.db:
+  if(dt_init(dt_argc, dt_argv, FALSE, FALSE, NULL)) exit(1);
+
+  const gboolean fts = dt_database_has_fts(darktable.db);
+  printf("full text search index: %s\n", fts ? "yes" : "no");
+
+  const dt_collection_t *collection = dt_collection_new(darktable.collection);
+  int n_tests = 0, n_failed = 0;
+
+  dt_conf_set_int("plugins/lighttable/collect/num_rules", 1);
+  dt_conf_set_int("plugins/lighttable/collect/mode0", 0);
+  for(int r = 0; r < (int)(sizeof(rules) / sizeof(*rules)); r++)
+  {
+    if(rules[r].needs_fts && !fts) continue;
+
+    dt_conf_set_int("plugins/lighttable/collect/item0", rules[r].property);
+    dt_conf_set_string("plugins/lighttable/collect/string0", rules[r].text);
+
+    for(int s = 0; s < (int)(sizeof(sorts) / sizeof(*sorts)); s++)
+      for(int descending = 0; descending < 2; descending++)
+      {
+        dt_collection_set_sort(collection, sorts[s], descending);
+        dt_collection_update_query(collection);
+        const int failed = _check_plan(dt_collection_get_query(collection), verbose);
+        if(!failed && verbose) printf("  [OK] %s\n", dt_collection_get_query(collection));
+        n_tests++;
+        n_failed += failed;
+      }
+  }
+
+  printf("%d / %d queries with full scans\n", n_failed, n_tests);
+
+  dt_collection_free(collection);
+  dt_cleanup();
+
+  return n_failed ? 1 : 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,166 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// checks the multigrid solver of common/heal.c against the previous successive over-relaxation solver and
+// times both.
+// usage: darktable-test-heal [size]
+
+#include "common/darktable.h"
+#include "common/heal.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the solver dt_heal() used before: red/black Gauss-Seidel with over-relaxation on the whole masked area
+static void sor_heal(const float *const src, float *const dest, const float *const mask, const int width,
+                     const int height, const int ch, const int max_iter,
+                     const float epsilon)
+{
+  const int ch1 = (ch == 4) ? ch - 1 : ch;
+  float *pixels = calloc((size_t)width * (height + 1) * ch, sizeof(float));
+  float *Adiag = malloc(sizeof(float) * width * height);
+  int *Aidx = malloc(sizeof(int) * 5 * width * height);
+  for(size_t k = 0; k < (size_t)width * height * ch; k++) pixels[k] = dest[k] - src[k];
+
+  const int zero = ch * width * height;
+  int nmask = 0;
+  for(int parity = 0; parity < 2; parity++)
+  {
+    for(int i = 0; i < height; i++)
+      for(int j = (i & 1) ^ parity; j < width; j += 2)
+      {
+        if(!mask[j + i * width]) continue;
+#define A_NEIGHBOR(o, di, dj)                                                                                     \
+  if((dj < 0 && j == 0) || (dj > 0 && j == width - 1) || (di < 0 && i == 0) || (di > 0 && i == height - 1))       \
+    Aidx[o + nmask * 5] = zero;                                                                                   \
+  else                                                                                                            \
+    Aidx[o + nmask * 5] = ((i + di) * width + (j + dj)) * ch;
+        Adiag[nmask] = 4 - (i == 0) - (j == 0) - (i == height - 1) - (j == width - 1);
+        A_NEIGHBOR(0, 0, 0);
+        A_NEIGHBOR(1, 0, 1);
+        A_NEIGHBOR(2, 1, 0);
+        A_NEIGHBOR(3, 0, -1);
+        A_NEIGHBOR(4, -1, 0);
+#undef A_NEIGHBOR
+        nmask++;
+      }
+  }
+
+  const float w = ((2.0f - 1.0f / (0.1575f * sqrtf(nmask) + 0.8f)) * .25f);
+  const float err_exit = epsilon * epsilon * w * w;
+  for(int iter = 0; iter < max_iter; iter++)
+  {
+    float err = 0.0f;
+    for(int i = 0; i < nmask; i++)
+    {
+      const int *const A = Aidx + 5 * i;
+      for(int k = 0; k < ch1; k++)
+      {
+        const float diff = w
+                           * (Adiag[i] * pixels[A[0] + k]
+                              - (pixels[A[1] + k] + pixels[A[2] + k] + pixels[A[3] + k] + pixels[A[4] + k]));
+        pixels[A[0] + k] -= diff;
+        err += diff * diff;
+      }
+    }
+    if(err < err_exit) break;
+  }
+
+  for(size_t k = 0; k < (size_t)width * height * ch; k++) dest[k] = pixels[k] + src[k];
+  free(pixels);
+  free(Adiag);
+  free(Aidx);
+}
+
+static float max_difference(const float *const a, const float *const b, const size_t n)
+{
+  float err = 0.0f;
+  for(size_t k = 0; k < n; k++) err = fmaxf(err, fabsf(a[k] - b[k]));
+  return err;
+}
+
+int main(int argc, char *argv[])
+{
+  const int size = argc > 1 ? atoi(argv[1]) : 256;
+  if(size < 8)
+  {
+    fprintf(stderr, "usage: %s [size]\n", argv[0]);
+    return 1;
+  }
+
+  const int width = size, height = size * 3 / 4, ch = 4;
+  const size_t n = (size_t)width * height * ch;
+  float *src = dt_alloc_align(64, sizeof(float) * n);
+  float *dest = dt_alloc_align(64, sizeof(float) * n);
+  float *mask = dt_alloc_align(64, sizeof(float) * width * height);
+  float *healed = dt_alloc_align(64, sizeof(float) * n);
+  float *sor = malloc(sizeof(float) * n);
+  float *converged = malloc(sizeof(float) * n);
+
+  // two different textures, a round spot and a rectangle touching the canvas border to heal
+  srand(42);
+  for(int i = 0; i < height; i++)
+    for(int j = 0; j < width; j++)
+    {
+      const size_t k = (size_t)i * width + j;
+      for(int c = 0; c < 3; c++)
+      {
+        src[4 * k + c] = 0.3f + 0.2f * sinf(0.02f * j * (c + 1)) + 0.01f * ((float)rand() / RAND_MAX);
+        dest[4 * k + c] = 0.6f + 0.3f * cosf(0.03f * i + c) + 0.01f * ((float)rand() / RAND_MAX);
+      }
+      src[4 * k + 3] = dest[4 * k + 3] = 0.0f;
+      const float dx = j - 0.4f * width, dy = i - 0.5f * height;
+      mask[k] = (dx * dx + dy * dy < 0.09f * height * height) || (j > 0.8f * width && i > 0.2f * height);
+    }
+
+  memcpy(healed, dest, sizeof(float) * n);
+  double start = dt_get_wtime();
+  dt_heal(src, healed, mask, width, height, ch, 0);
+  const double secs_multigrid = dt_get_wtime() - start;
+
+  memcpy(sor, dest, sizeof(float) * n);
+  start = dt_get_wtime();
+  sor_heal(src, sor, mask, width, height, ch, 1000, 0.1 / 255);
+  const double secs_sor = dt_get_wtime() - start;
+
+  // the previous solver run way past its iteration limit and tolerance as the reference solution
+  memcpy(converged, dest, sizeof(float) * n);
+  sor_heal(src, converged, mask, width, height, ch, 100000, 1e-7f);
+
+  const float err_multigrid = max_difference(healed, converged, n);
+  const float err_sor = max_difference(sor, converged, n);
+  const int ok = err_multigrid < 1e-3f;
+  printf("  %d x %d\n", width, height);
+  printf("  multigrid: %.3f secs, max difference to converged solution %.2e\n", secs_multigrid, err_multigrid);
+  printf("  sor:       %.3f secs, max difference to converged solution %.2e\n", secs_sor, err_sor);
+  printf("  [%s]\n", ok ? "OK" : "FAIL");
+
+  dt_free_align(src);
+  dt_free_align(dest);
+  dt_free_align(mask);
+  dt_free_align(healed);
+  free(sor);
+  free(converged);
+  return ok ? 0 : 1;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,142 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// pastes a history onto more than DT_HISTORY_PASTE_BATCH images and fails if sqlite reports any error on the
+// way, e.g. a nested BEGIN or a COMMIT without a transaction, if a transaction is left open or if a
+// destination didn't get the history.
+// usage: darktable-test-history-paste
+
+#include "common/darktable.h"
+#include "common/database.h"
+#include "common/debug.h"
+#include "common/history.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_IMAGES (2 * DT_HISTORY_PASTE_BATCH + 7)
+#define NUM_ITEMS 3
+
+static int sql_errors = 0;
+static gboolean counting = FALSE;
+
+static void _sql_log(void *data, int code, const char *msg)
+{
+  const int primary = code & 0xff;
+  if(!counting || primary == SQLITE_OK || primary == SQLITE_NOTICE || primary == SQLITE_WARNING) return;
+  sql_errors++;
+  printf("  [FAIL] sqlite error %d: %s\n", code, msg);
+}
+
+static void _exec(const char *query)
+{
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), query, NULL, NULL, NULL);
+}
+
+static int _history_count(const int imgid)
+{
+  sqlite3_stmt *stmt;
+  int count = -1;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT COUNT(*) FROM main.history WHERE imgid = ?1", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  if(sqlite3_step(stmt) == SQLITE_ROW) count = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+  return count;
+}
+
+int main(int argc, char *argv[])
+{
+  // has to be set before sqlite gets initialized in dt_init()
+  sqlite3_config(SQLITE_CONFIG_LOG, _sql_log, NULL);
+
+  char *dt_argv[] = {"darktable-test-history-paste", "--library", ":memory:", "--conf", "write_sidecar_files=FALSE", NULL};
+  int dt_argc = sizeof(dt_argv) / sizeof(*dt_argv) - 1;
+
+  // init dt without gui and without data.db:
+  if(dt_init(dt_argc, dt_argv, FALSE, FALSE, NULL)) exit(1);
+
+  // images don't need files for an overwrite paste, the history is copied row by row
+  _exec("INSERT INTO main.film_rolls (id, folder) VALUES (1, '/nonexistent')");
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT INTO main.images (id, group_id, film_id, filename, flags, history_end, "
+                              "iop_order_version, version, max_version, width, height) "
+                              "VALUES (?1, ?1, 1, ?2, 0, 0, 0, 0, 0, 100, 100)",
+                              -1, &stmt, NULL);
+  for(int id = 1; id <= NUM_IMAGES + 1; id++)
+  {
+    gchar *filename = g_strdup_printf("img_%04d.raw", id);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
+    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, filename, -1, SQLITE_TRANSIENT);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    g_free(filename);
+  }
+  sqlite3_finalize(stmt);
+
+  // source image 1 with a short history
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT INTO main.history (imgid, num, module, operation, op_params, enabled, "
+                              "blendop_params, blendop_version, multi_priority, multi_name, iop_order) "
+                              "VALUES (1, ?1, 1, ?2, x'00000000', 1, NULL, 1, 0, '', ?3)",
+                              -1, &stmt, NULL);
+  const char *ops[NUM_ITEMS] = { "exposure", "colorbalance", "sharpen" };
+  for(int k = 0; k < NUM_ITEMS; k++)
+  {
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, k);
+    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, ops[k], -1, SQLITE_STATIC);
+    DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 3, k + 1.0);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+  }
+  sqlite3_finalize(stmt);
+  _exec("UPDATE main.images SET history_end = 3 WHERE id = 1");
+
+  GList *list = NULL;
+  for(int id = 2; id <= NUM_IMAGES + 1; id++) list = g_list_prepend(list, GINT_TO_POINTER(id));
+  list = g_list_reverse(list);
+
+  int n_failed = 0;
+
+  counting = TRUE;
+  dt_history_copy_and_paste_on_list(1, list, FALSE, NULL);
+  counting = FALSE;
+  n_failed += sql_errors;
+  printf("  [%s] %d sql errors while pasting onto %d images\n", sql_errors ? "FAIL" : "OK", sql_errors,
+         NUM_IMAGES);
+
+  const gboolean open = !sqlite3_get_autocommit(dt_database_get(darktable.db));
+  n_failed += open;
+  printf("  [%s] no transaction left open\n", open ? "FAIL" : "OK");
+
+  int missing = 0;
+  for(GList *l = list; l; l = g_list_next(l))
+    if(_history_count(GPOINTER_TO_INT(l->data)) != NUM_ITEMS) missing++;
+  n_failed += missing;
+  printf("  [%s] %d of %d images without the pasted history\n", missing ? "FAIL" : "OK", missing, NUM_IMAGES);
+
+  g_list_free(list);
+  dt_cleanup();
+
+  return n_failed ? 1 : 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
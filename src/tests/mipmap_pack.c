@@ -0,0 +1,152 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// writes thumbnails to a pack file and checks they come back after reopening, after a
+// torn write at the end of the file and after compaction.
+// usage: darktable-test-mipmap-pack
+
+#include "common/mipmap_pack.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N_IMAGES 100
+
+static int n_failed = 0;
+
+#define CHECK(cond)                                                                                          \
+  if(!(cond))                                                                                                \
+  {                                                                                                          \
+    fprintf(stderr, "[FAIL] %s:%d: %s\n", __FILE__, __LINE__, #cond);                                        \
+    n_failed++;                                                                                              \
+  }
+
+// deterministic payload per image and version
+static size_t _fill(uint8_t *buf, const uint32_t imgid, const int version)
+{
+  const size_t size = 1000 + 37 * imgid + version;
+  for(size_t k = 0; k < size; k++) buf[k] = (uint8_t)(k * 7 + imgid * 13 + version);
+  return size;
+}
+
+static gboolean _matches(dt_mipmap_pack_t *pack, const uint32_t imgid, const int version)
+{
+  uint8_t expected[8192];
+  const size_t size = _fill(expected, imgid, version);
+  dt_mipmap_pack_blob_t blob;
+  if(!dt_mipmap_pack_read(pack, imgid, &blob)) return FALSE;
+  const gboolean ok = blob.size == size && blob.color_space == imgid % 3 && !memcmp(blob.data, expected, size);
+  dt_mipmap_pack_blob_release(&blob);
+  return ok;
+}
+
+static void _write(dt_mipmap_pack_t *pack, const uint32_t imgid, const int version)
+{
+  uint8_t buf[8192];
+  const size_t size = _fill(buf, imgid, version);
+  CHECK(!dt_mipmap_pack_write(pack, imgid, buf, size, imgid % 3));
+}
+
+static int64_t _length(const char *filename)
+{
+  GStatBuf st;
+  return g_stat(filename, &st) ? -1 : st.st_size;
+}
+
+int main(int argc, char *argv[])
+{
+  gchar *dir = g_dir_make_tmp("darktable-test-mipmap-pack-XXXXXX", NULL);
+  if(!dir) exit(1);
+  gchar *filename = g_build_filename(dir, "0.pack", NULL);
+  gchar *index = g_strdup_printf("%s.idx", filename);
+
+  // fill a new pack
+  dt_mipmap_pack_t *pack = dt_mipmap_pack_open(filename);
+  CHECK(pack);
+  if(!pack) exit(1);
+  for(uint32_t imgid = 1; imgid <= N_IMAGES; imgid++) _write(pack, imgid, 0);
+  for(uint32_t imgid = 1; imgid <= N_IMAGES; imgid++) CHECK(_matches(pack, imgid, 0));
+  dt_mipmap_pack_close(pack);
+  CHECK(g_file_test(index, G_FILE_TEST_EXISTS));
+
+  // reopen from the index, then replace and remove some
+  pack = dt_mipmap_pack_open(filename);
+  CHECK(pack);
+  if(!pack) exit(1);
+  for(uint32_t imgid = 1; imgid <= N_IMAGES; imgid++) CHECK(_matches(pack, imgid, 0));
+  _write(pack, 10, 1);
+  dt_mipmap_pack_remove(pack, 20);
+  CHECK(_matches(pack, 10, 1));
+  CHECK(!dt_mipmap_pack_contains(pack, 20, NULL));
+  dt_mipmap_pack_close(pack);
+
+  // a crash while appending: the index is behind and there's half a record at the end
+  const int64_t length = _length(filename);
+  g_unlink(index);
+  FILE *f = g_fopen(filename, "ab");
+  CHECK(f);
+  if(f)
+  {
+    const char torn[20] = "half a record";
+    fwrite(torn, sizeof(torn), 1, f);
+    fclose(f);
+  }
+  pack = dt_mipmap_pack_open(filename);
+  CHECK(pack);
+  if(!pack) exit(1);
+  CHECK(_length(filename) == length);
+  CHECK(_matches(pack, 10, 1));
+  CHECK(!dt_mipmap_pack_contains(pack, 20, NULL));
+  CHECK(_matches(pack, 30, 0));
+  _write(pack, 20, 2);
+  dt_mipmap_pack_close(pack);
+
+  // rewrite with the live records only
+  pack = dt_mipmap_pack_open(filename);
+  CHECK(pack);
+  if(!pack) exit(1);
+  CHECK(_matches(pack, 20, 2));
+  for(uint32_t imgid = 1; imgid <= N_IMAGES; imgid++) _write(pack, imgid, 3);
+  const int64_t before = _length(filename);
+  CHECK(!dt_mipmap_pack_compact(pack));
+  CHECK(_length(filename) < before / 2 + 4096);
+  for(uint32_t imgid = 1; imgid <= N_IMAGES; imgid++) CHECK(_matches(pack, imgid, 3));
+  dt_mipmap_pack_close(pack);
+
+  pack = dt_mipmap_pack_open(filename);
+  CHECK(pack);
+  if(!pack) exit(1);
+  for(uint32_t imgid = 1; imgid <= N_IMAGES; imgid++) CHECK(_matches(pack, imgid, 3));
+  dt_mipmap_pack_close(pack);
+
+  g_unlink(index);
+  g_unlink(filename);
+  g_rmdir(dir);
+  g_free(index);
+  g_free(filename);
+  g_free(dir);
+
+  printf("%s\n", n_failed ? "failed" : "ok");
+  return n_failed ? 1 : 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
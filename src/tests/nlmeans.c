@@ -0,0 +1,178 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// checks the tiled non-local means of common/nlmeans_core.c against a direct implementation and benchmarks it
+// with the settings of the nlmeans and denoiseprofile modules.
+// usage: darktable-test-nlmeans [width] [height]
+
+#include "common/darktable.h"
+#include "common/nlmeans_core.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef union floatint_t
+{
+  float f;
+  uint32_t i;
+} floatint_t;
+
+// the same approximation of 2^-x as the engine, so that only the summation order differs
+static float reference_weight(const float x)
+{
+  const float i1 = (float)0x3f800000u;
+  const float i2 = (float)0x3f000000u;
+  const float k0 = i1 + x * (i2 - i1);
+  floatint_t k;
+  k.i = k0 >= (float)0x800000u ? k0 : 0;
+  return k.f;
+}
+
+// one pixel at a time, every patch summed from scratch
+static void reference(const float *const in, float *const out, const int width, const int height,
+                      const dt_nlmeans_param_t *const p, const int *const offsets, const int num_offsets)
+{
+  const int P = p->patch_radius;
+  for(int y = 0; y < height; y++)
+    for(int x = 0; x < width; x++)
+    {
+      double sum[4] = { 0.0 };
+      for(int o = 0; o < num_offsets; o++)
+      {
+        const int ki = offsets[2 * o], kj = offsets[2 * o + 1];
+        if(x + ki < 0 || x + ki >= width || y + kj < 0 || y + kj >= height) continue;
+        float dissimilarity = 0.0f;
+        for(int dy = -P; dy <= P; dy++)
+          for(int dx = -P; dx <= P; dx++)
+          {
+            const int ax = x + dx, ay = y + dy;
+            if(ax < 0 || ax >= width || ay < 0 || ay >= height) continue;
+            if(ax + ki < 0 || ax + ki >= width || ay + kj < 0 || ay + kj >= height) continue;
+            const float *a = in + 4 * ((size_t)width * ay + ax);
+            const float *b = in + 4 * ((size_t)width * (ay + kj) + ax + ki);
+            for(int c = 0; c < 3; c++) dissimilarity += p->norm[c] * (a[c] - b[c]) * (a[c] - b[c]);
+          }
+        const float *a = in + 4 * ((size_t)width * y + x);
+        const float *b = in + 4 * ((size_t)width * (y + kj) + x + ki);
+        if(p->center_weight != 0.0f)
+        {
+          float center = 0.0f;
+          for(int c = 0; c < 3; c++) center += p->norm[c] * (a[c] - b[c]) * (a[c] - b[c]);
+          center *= (2 * P + 1) * (2 * P + 1);
+          dissimilarity = (dissimilarity + center * p->center_weight) / (1.0f + p->center_weight);
+        }
+        const float w = reference_weight(fmaxf(0.0f, dissimilarity * p->sharpness - p->bias));
+        for(int c = 0; c < 3; c++) sum[c] += w * b[c];
+        sum[3] += w;
+      }
+      for(int c = 0; c < 3; c++) out[4 * ((size_t)width * y + x) + c] = sum[c] / sum[3];
+      out[4 * ((size_t)width * y + x) + 3] = 1.0f;
+    }
+}
+
+static void noisy_image(float *const buf, const int width, const int height)
+{
+  for(int y = 0; y < height; y++)
+    for(int x = 0; x < width; x++)
+    {
+      float *px = buf + 4 * ((size_t)width * y + x);
+      const float v = 0.5f + 0.4f * sinf(x * 0.05f) * cosf(y * 0.03f);
+      for(int c = 0; c < 3; c++) px[c] = v + 0.05f * ((float)rand() / RAND_MAX - 0.5f);
+      px[3] = 0.0f;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+  const int bench_width = argc > 1 ? atoi(argv[1]) : 4000;
+  const int bench_height = argc > 2 ? atoi(argv[2]) : 3000;
+
+  // like the nlmeans module (Lab) and the denoiseprofile module (scattered offsets, center weight)
+  const dt_nlmeans_param_t params[2]
+      = { { .patch_radius = 2, .search_radius = 7, .scattering = 0.0f, .scale = 1.0f, .sharpness = 30.0f,
+            .bias = 0.0f, .center_weight = 0.0f, .norm = { 1.0f, 0.25f, 0.25f } },
+          { .patch_radius = 1, .search_radius = 7, .scattering = 0.5f, .scale = 1.0f, .sharpness = 40.0f,
+            .bias = 2.0f, .center_weight = 0.1f, .norm = { 1.0f, 1.0f, 1.0f } } };
+  const char *names[2] = { "nlmeans", "denoiseprofile" };
+
+  int failed = 0;
+  srand(42);
+  for(int k = 0; k < 2; k++)
+  {
+    const dt_nlmeans_param_t *const p = params + k;
+    const int K = p->search_radius;
+
+    // correctness on a small image, with sizes that are not multiples of the tiles
+    const int width = 150, height = 99;
+    float *in = dt_alloc_align(64, sizeof(float) * 4 * width * height);
+    float *out = dt_alloc_align(64, sizeof(float) * 4 * width * height);
+    float *ref = dt_alloc_align(64, sizeof(float) * 4 * width * height);
+    noisy_image(in, width, height);
+
+    int *offsets = malloc(sizeof(int) * 2 * (2 * K + 1) * (2 * K + 1));
+    int num_offsets = 0;
+    for(int j = -K; j <= K; j++)
+      for(int i = -K; i <= K; i++)
+      {
+        // only the plain grid is checked, dt_nlmeans_denoise() scatters them itself
+        offsets[2 * num_offsets] = i;
+        offsets[2 * num_offsets + 1] = j;
+        num_offsets++;
+      }
+    dt_nlmeans_param_t grid = *p;
+    grid.scattering = 0.0f;
+    reference(in, ref, width, height, &grid, offsets, num_offsets);
+    dt_nlmeans_denoise(in, out, width, height, &grid);
+
+    float err = 0.0f;
+    for(size_t i = 0; i < (size_t)4 * width * height; i++) err = fmaxf(err, fabsf(out[i] - ref[i]));
+    const int ok = err < 1e-3f;
+    failed += !ok;
+    printf("  [%s] %s: max difference to direct implementation %.2e\n", ok ? "OK" : "FAIL", names[k], err);
+
+    free(offsets);
+    dt_free_align(in);
+    dt_free_align(out);
+    dt_free_align(ref);
+
+    // speed
+    in = dt_alloc_align(64, sizeof(float) * 4 * bench_width * bench_height);
+    out = dt_alloc_align(64, sizeof(float) * 4 * bench_width * bench_height);
+    if(!in || !out)
+    {
+      fprintf(stderr, "[nlmeans] out of memory\n");
+      return 1;
+    }
+    noisy_image(in, bench_width, bench_height);
+    const double start = dt_get_wtime();
+    dt_nlmeans_denoise(in, out, bench_width, bench_height, p);
+    const double secs = dt_get_wtime() - start;
+    printf("  %s: %d x %d, P=%d K=%d in %.3f secs, %.1f Mpix/s\n", names[k], bench_width, bench_height,
+           p->patch_radius, K, secs, 1e-6 * bench_width * bench_height / secs);
+    dt_free_align(in);
+    dt_free_align(out);
+  }
+
+  printf("%d / 2 tests failed\n", failed);
+  return failed ? 1 : 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
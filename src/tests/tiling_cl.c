@@ -0,0 +1,273 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// checks the asynchronous opencl tiling of develop/tiling.c against the blocking one. a synthetic image is
+// exported with exposure and local contrast, downscaled at the end so that finalscale takes the roi path,
+// with the device memory headroom set so that nearly nothing fits and every module has to tile. both
+// transfer paths (direct and pinned) are run with opencl_async_tiling on and off, the outputs have to be
+// identical. cpu opencl devices are allowed, so this runs on pocl.
+// usage: darktable-test-tiling-cl [--core <darktable options>]
+// exits with 0 and says so if there is no opencl device.
+
+#include "common/darktable.h"
+#include "common/film.h"
+#include "common/image.h"
+#include "common/imageio.h"
+#include "common/imageio_module.h"
+#include "common/opencl.h"
+#include "common/trace.h"
+#include "control/conf.h"
+#include "develop/develop.h"
+#include "develop/imageop.h"
+
+#include <glib/gstdio.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WIDTH 2000
+#define HEIGHT 1500
+#define AVAILABLE_MB 48
+
+typedef struct capture_format_t
+{
+  dt_imageio_module_data_t head;
+  float *buf;
+} capture_format_t;
+
+static int _bpp(dt_imageio_module_data_t *data)
+{
+  return 32;
+}
+
+static int _levels(dt_imageio_module_data_t *data)
+{
+  return IMAGEIO_RGB | IMAGEIO_FLOAT;
+}
+
+static const char *_mime(dt_imageio_module_data_t *data)
+{
+  return "memory";
+}
+
+static int _write_image(dt_imageio_module_data_t *data, const char *filename, const void *in,
+                        dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                        void *exif, int exif_len, int imgid, int num, int total, dt_dev_pixelpipe_t *pipe)
+{
+  capture_format_t *d = (capture_format_t *)data;
+  d->buf = dt_alloc_align(64, sizeof(float) * 4 * data->width * data->height);
+  if(!d->buf) return 1;
+  memcpy(d->buf, in, sizeof(float) * 4 * data->width * data->height);
+  return 0;
+}
+
+static void _count_device_tiles(const dt_trace_event_t *event, void *user_data)
+{
+  if(!strcmp(event->cat, "tile") && event->device >= 0) (*(int *)user_data)++;
+}
+
+static int _write_pfm(const char *filename)
+{
+  FILE *f = g_fopen(filename, "wb");
+  if(!f) return 1;
+  fprintf(f, "PF\n%d %d\n-1.0\n", WIDTH, HEIGHT);
+  float *row = malloc(sizeof(float) * 3 * WIDTH);
+  for(int y = 0; y < HEIGHT; y++)
+  {
+    for(int x = 0; x < WIDTH; x++)
+    {
+      const float ramp = 0.05f + 0.9f * x / WIDTH;
+      row[3 * x + 0] = ramp * (0.6f + 0.4f * sinf(0.05f * y));
+      row[3 * x + 1] = ramp * (0.6f + 0.4f * sinf(0.07f * x));
+      row[3 * x + 2] = ramp * (0.6f + 0.4f * sinf(0.03f * (x + y)));
+    }
+    fwrite(row, sizeof(float), 3 * WIDTH, f);
+  }
+  free(row);
+  fclose(f);
+  return 0;
+}
+
+static int _set_history(const int imgid)
+{
+  const char *ops[] = { "exposure", "bilat" };
+  dt_develop_t dev;
+  dt_dev_init(&dev, 0);
+  dt_dev_load_image(&dev, imgid);
+  int missing = 0;
+  for(int k = 0; k < (int)(sizeof(ops) / sizeof(*ops)); k++)
+  {
+    dt_iop_module_t *module = NULL;
+    for(GList *modules = dev.iop; modules && !module; modules = g_list_next(modules))
+      if(!strcmp(((dt_iop_module_t *)modules->data)->op, ops[k])) module = (dt_iop_module_t *)modules->data;
+    if(module)
+      dt_dev_add_history_item_ext(&dev, module, TRUE, TRUE);
+    else
+      missing++;
+  }
+  dt_dev_write_history(&dev);
+  dt_dev_cleanup(&dev);
+  return missing;
+}
+
+static float *_export(const int imgid, int *width, int *height, int *device_tiles)
+{
+  dt_imageio_module_format_t format = { 0 };
+  format.bpp = _bpp;
+  format.levels = _levels;
+  format.mime = _mime;
+  format.write_image = _write_image;
+  capture_format_t dat = { { 0 } };
+  dat.head.max_width = WIDTH / 2;
+  dat.head.max_height = HEIGHT / 2;
+
+  dt_trace_reset();
+  // high quality, so that the downscaling happens in finalscale at the end of the pipe
+  const int res = dt_imageio_export_with_flags(imgid, "unused", &format, (dt_imageio_module_data_t *)&dat, TRUE,
+                                               FALSE, TRUE, FALSE, FALSE, NULL, FALSE, DT_COLORSPACE_NONE, NULL,
+                                               DT_INTENT_LAST, NULL, NULL, 1, 1, NULL);
+  *device_tiles = 0;
+  dt_trace_foreach(_count_device_tiles, device_tiles);
+  *width = dat.head.width;
+  *height = dat.head.height;
+  if(res)
+  {
+    dt_free_align(dat.buf);
+    return NULL;
+  }
+  return dat.buf;
+}
+
+int main(int argc, char *argv[])
+{
+  gchar *workdir = g_dir_make_tmp("darktable-test-tiling-cl-XXXXXX", NULL);
+  if(!workdir) exit(1);
+  gchar *configdir = g_build_filename(workdir, "config", NULL);
+  gchar *cachedir = g_build_filename(workdir, "cache", NULL);
+
+  int dt_argc = 0;
+  char **dt_argv = malloc((15 + argc) * sizeof(char *));
+  dt_argv[dt_argc++] = "darktable-test-tiling-cl";
+  dt_argv[dt_argc++] = "--library";
+  dt_argv[dt_argc++] = ":memory:";
+  dt_argv[dt_argc++] = "--configdir";
+  dt_argv[dt_argc++] = configdir;
+  dt_argv[dt_argc++] = "--cachedir";
+  dt_argv[dt_argc++] = cachedir;
+  dt_argv[dt_argc++] = "--conf";
+  dt_argv[dt_argc++] = "write_sidecar_files=FALSE";
+  dt_argv[dt_argc++] = "--conf";
+  dt_argv[dt_argc++] = "opencl_use_cpu_devices=TRUE";
+  dt_argv[dt_argc++] = "-d";
+  dt_argv[dt_argc++] = "trace";
+  for(int k = 1; k < argc; k++)
+    if(strcmp(argv[k], "--core")) dt_argv[dt_argc++] = argv[k];
+  dt_argv[dt_argc] = NULL;
+
+  // init dt without gui, but with data.db for the presets new images get:
+  if(dt_init(dt_argc, dt_argv, FALSE, TRUE, NULL)) exit(1);
+
+  int failed = 0;
+#ifdef HAVE_OPENCL
+  if(!darktable.opencl->inited || darktable.opencl->num_devs == 0)
+#endif
+  {
+    printf("  [SKIP] no opencl device\n");
+    goto end;
+  }
+#ifdef HAVE_OPENCL
+  // the startup benchmark switches a cpu device off as being too slow, we want it anyway
+  dt_conf_set_bool("opencl", TRUE);
+  dt_opencl_update_settings();
+
+  // leave only a few MB to the pipe on every device
+  for(int devid = 0; devid < darktable.opencl->num_devs; devid++)
+  {
+    const int total_mb = darktable.opencl->dev[devid].max_global_mem / (1024 * 1024);
+    dt_conf_set_int("opencl_memory_headroom", MIN(dt_conf_get_int("opencl_memory_headroom"),
+                                                  MAX(0, total_mb - AVAILABLE_MB)));
+  }
+
+  gchar *filename = g_build_filename(workdir, "tiling.pfm", NULL);
+  dt_film_t film;
+  const int filmid = dt_film_new(&film, workdir);
+  const int imgid = _write_pfm(filename) ? 0 : dt_image_import(filmid, filename, TRUE);
+  if(!imgid || _set_history(imgid))
+  {
+    printf("  [FAIL] can't set up the test image\n");
+    failed++;
+    g_unlink(filename);
+    g_free(filename);
+    goto end;
+  }
+
+  for(int pinned = 0; pinned < 2; pinned++)
+  {
+    dt_conf_set_bool("opencl_use_pinned_memory", pinned);
+    const char *path = pinned ? "pinned" : "direct";
+
+    float *out[2] = { NULL, NULL };
+    int width[2], height[2], tiles[2];
+    for(int async = 0; async < 2; async++)
+    {
+      dt_conf_set_bool("opencl_async_tiling", async);
+      out[async] = _export(imgid, width + async, height + async, tiles + async);
+    }
+
+    if(!out[0] || !out[1] || width[0] != width[1] || height[0] != height[1])
+    {
+      printf("  [FAIL] %s: export failed\n", path);
+      failed++;
+    }
+    else if(!tiles[0] || !tiles[1])
+    {
+      // nothing to compare, the device was never used for tiling
+      printf("  [FAIL] %s: %d blocking and %d async tiles ran on the device\n", path, tiles[0], tiles[1]);
+      failed++;
+    }
+    else
+    {
+      float err = 0.0f;
+      for(size_t k = 0; k < (size_t)4 * width[0] * height[0]; k++)
+        if(k % 4 != 3) err = fmaxf(err, fabsf(out[0][k] - out[1][k]));
+      const int ok = err == 0.0f;
+      failed += !ok;
+      printf("  [%s] %s: %d tiles, max difference async to blocking %.2e\n", ok ? "OK" : "FAIL", path,
+             tiles[1], err);
+    }
+    dt_free_align(out[0]);
+    dt_free_align(out[1]);
+  }
+
+  g_unlink(filename);
+  g_free(filename);
+#endif
+
+end:
+  dt_cleanup();
+  free(dt_argv);
+  g_free(configdir);
+  g_free(cachedir);
+  g_free(workdir);
+  return failed ? 1 : 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
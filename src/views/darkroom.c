@@ -281,8 +281,10 @@ void expose(
     float ht = dev->pipe->output_backbuf_height;
     stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, wd);
     surface = dt_cairo_image_surface_create_for_data(dev->pipe->output_backbuf, CAIRO_FORMAT_RGB24, wd, ht, stride);
-    wd /= darktable.gui->ppd;
-    ht /= darktable.gui->ppd;
+    // coarse pass of progressive rendering, scale it up to the size of the final rendering
+    const int downscale = dev->pipe->output_downscale;
+    wd *= downscale / darktable.gui->ppd;
+    ht *= downscale / darktable.gui->ppd;
     if(dev->full_preview)
       dt_gui_gtk_set_source_rgb(cr, DT_GUI_COLOR_DARKROOM_PREVIEW_BG);
     else
@@ -296,9 +298,21 @@ void expose(
       cairo_translate(cr, -(.5 - 0.5/scale) * wd, -(.5 - 0.5/scale) * ht);
     }
     cairo_rectangle(cr, 0, 0, wd, ht);
-    cairo_set_source_surface(cr, surface, 0, 0);
-    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_FAST);
-    cairo_fill(cr);
+    if(downscale > 1)
+    {
+      cairo_save(cr);
+      cairo_scale(cr, downscale, downscale);
+      cairo_set_source_surface(cr, surface, 0, 0);
+      cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+      cairo_fill(cr);
+      cairo_restore(cr);
+    }
+    else
+    {
+      cairo_set_source_surface(cr, surface, 0, 0);
+      cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_FAST);
+      cairo_fill(cr);
+    }
     cairo_surface_destroy(surface);
     dt_pthread_mutex_unlock(mutex);
     image_surface_imgid = dev->image_storage.id;
@@ -221,6 +221,14 @@ typedef struct dt_library_t
     sqlite3_stmt *is_grouped;
   } statements;
 
+  /* scroll-ahead prefetching in filemanager */
+  struct
+  {
+    int32_t offset;  // offset at the last prefetch
+    double time;     // and when it happened
+    float velocity;  // smoothed scrolling speed in rows per second, < 0 is upwards
+  } prefetch;
+
   GtkWidget *profile_floating_window;
 
 } dt_library_t;
@@ -1032,6 +1040,69 @@ void cleanup(dt_view_t *self)
  * \return The absolute, zero-based index of the specified grid location
  */
 
+/* prefetch the thumbnails of the rows about to scroll into view. the faster the user scrolls the further
+ * ahead we look, in the direction of scrolling. the thumbnail queue gets told which images are still wanted,
+ * so requests for rows that scrolled past before their turn don't hold up the queue. */
+static void _filemanager_prefetch(dt_library_t *lib, const int32_t offset, const int max_rows, const int iir,
+                                  const dt_mipmap_size_t mip)
+{
+  const double now = dt_get_wtime();
+  const double elapsed = now - lib->prefetch.time;
+  const float rows = (float)(offset - lib->prefetch.offset) / iir;
+
+  if(elapsed > 0.5 || elapsed <= 0.0)
+    // starting to scroll again, all we know is the direction
+    lib->prefetch.velocity = rows < 0.0f ? -1.0f : 1.0f;
+  else if(rows != 0.0f)
+    lib->prefetch.velocity = 0.5f * lib->prefetch.velocity + 0.5f * rows / elapsed;
+  lib->prefetch.offset = offset;
+  lib->prefetch.time = now;
+
+  // half a screen when idle, up to four screens when flinging through the collection.
+  // 0.5s is about what it takes to generate a row of thumbnails from embedded jpegs.
+  const int prefetchrows = MIN(4 * max_rows, (int)(.5 * max_rows + 1 + .5f * fabsf(lib->prefetch.velocity)));
+  const gboolean upwards = lib->prefetch.velocity < 0.0f;
+
+  int32_t start = offset + max_rows * iir;
+  int32_t count = prefetchrows * iir;
+  if(upwards)
+  {
+    start = MAX(0, offset - prefetchrows * iir);
+    count = offset - start;
+  }
+  if(count <= 0)
+  {
+    dt_thumbnail_jobs_set_window(NULL, 0);
+    return;
+  }
+
+  uint32_t *imgids = malloc(count * sizeof(uint32_t));
+  int imgids_num = 0;
+
+  /* clear and reset main query */
+  DT_DEBUG_SQLITE3_CLEAR_BINDINGS(lib->statements.main_query);
+  DT_DEBUG_SQLITE3_RESET(lib->statements.main_query);
+
+  /* setup offset and row for prefetch */
+  DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 1, start);
+  DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 2, count);
+
+  while(sqlite3_step(lib->statements.main_query) == SQLITE_ROW && imgids_num < count)
+    imgids[imgids_num++] = sqlite3_column_int(lib->statements.main_query, 0);
+
+  // drops the queued requests of rows that left the window
+  dt_thumbnail_jobs_set_window(imgids, imgids_num);
+
+  // prefetch jobs in inverse order: supersede previous jobs: most important, closest to the screen, last
+  for(int k = 0; k < imgids_num; k++)
+  {
+    const int i = upwards ? k : imgids_num - 1 - k;
+    dt_mipmap_cache_get(darktable.mipmap_cache, NULL, imgids[i], mip, DT_MIPMAP_PREFETCH_WINDOW, 'r');
+  }
+
+  free(imgids);
+}
+
 static int expose_filemanager(dt_view_t *self, cairo_t *cr, int32_t width, int32_t height, int32_t pointerx,
                                int32_t pointery)
 {
@@ -1563,32 +1634,10 @@ after_drawing:
   /* check if offset was changed and we need to prefetch thumbs */
   if(offset_changed)
   {
-    int32_t imgids_num = 0;
-    const int prefetchrows = .5 * max_rows + 1;
-    int32_t *imgids = malloc(prefetchrows * iir * sizeof(int32_t));
-
-    /* clear and reset main query */
-    DT_DEBUG_SQLITE3_CLEAR_BINDINGS(lib->statements.main_query);
-    DT_DEBUG_SQLITE3_RESET(lib->statements.main_query);
-
-    /* setup offset and row for prefetch */
-    DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 1, offset + max_rows * iir);
-    DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 2, prefetchrows * iir);
-
-    // prefetch jobs in inverse order: supersede previous jobs: most important last
-    while(sqlite3_step(lib->statements.main_query) == SQLITE_ROW && imgids_num < prefetchrows * iir)
-      imgids[imgids_num++] = sqlite3_column_int(lib->statements.main_query, 0);
-
     float imgwd = iir == 1 ? 0.97 : 0.8;
     dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, imgwd * wd,
                                                              imgwd * (iir == 1 ? height : ht));
-    while(imgids_num > 0)
-    {
-      imgids_num--;
-      dt_mipmap_cache_get(darktable.mipmap_cache, NULL, imgids[imgids_num], mip, DT_MIPMAP_PREFETCH, 'r');
-    }
-
-    free(imgids);
+    _filemanager_prefetch(lib, offset, max_rows, iir, mip);
   }
 
   free(query_ids);
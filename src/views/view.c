@@ -32,6 +32,7 @@
 #include "control/conf.h"
 #include "control/control.h"
 #include "develop/develop.h"
+#include "develop/format.h"
 #include "dtgtk/button.h"
 #include "dtgtk/expander.h"
 #include "gui/accelerators.h"
@@ -1976,36 +1977,84 @@ void dt_view_filmstrip_set_active_image(dt_view_manager_t *vm, int iid)
   dt_view_filmstrip_scroll_to_image(vm, iid, TRUE);
 }
 
+// bytes the full buffer of imgid is going to take, 0 if the image was never loaded
+static size_t _filmstrip_preload_size(const int imgid)
+{
+  size_t size = 0;
+  const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+  if(img)
+  {
+    if(img->width > 0 && img->height > 0)
+      size = (size_t)img->width * img->height * dt_iop_buffer_dsc_to_bpp(&img->buf_dsc);
+    dt_image_cache_read_release(darktable.image_cache, img);
+  }
+  return size;
+}
+
 void dt_view_filmstrip_prefetch()
 {
   const gchar *qin = dt_collection_get_query(darktable.collection);
   if(!qin) return;
 
-  int offset = 0;
-  if(qin)
-  {
-    int imgid = -1;
-    sqlite3_stmt *stmt;
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT imgid FROM main.selected_images", -1, &stmt,
-                                NULL);
-    if(sqlite3_step(stmt) == SQLITE_ROW) imgid = sqlite3_column_int(stmt, 0);
-    sqlite3_finalize(stmt);
-
-    offset = dt_collection_image_offset(imgid);
-  }
+  const int neighbours = CLAMP(dt_conf_get_int("plugins/darkroom/preload/images"), 0, DT_VIEW_PRELOAD_MAX);
+  if(neighbours == 0) return;
+  const size_t budget = (size_t)MAX(dt_conf_get_int("plugins/darkroom/preload/memory"), 0) * 1024 * 1024;
+  const gboolean preview = dt_conf_get_bool("plugins/darkroom/preload/preview");
 
+  int imgid = -1;
   sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT imgid FROM main.selected_images", -1, &stmt,
+                              NULL);
+  if(sqlite3_step(stmt) == SQLITE_ROW) imgid = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+
+  const int offset = dt_collection_image_offset(imgid);
+  const int first = MAX(0, offset - neighbours);
+
+  // the images around the selected one, in collection order
+  int ids[2 * DT_VIEW_PRELOAD_MAX + 1];
+  int count = 0;
+  int current = offset - first;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), qin, -1, &stmt, NULL);
-  // only get one more image:
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, offset + 1);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, offset + 2);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, first);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, offset - first + neighbours + 1);
+  while(sqlite3_step(stmt) == SQLITE_ROW && count < 2 * DT_VIEW_PRELOAD_MAX + 1)
   {
-    const uint32_t prefetchid = sqlite3_column_int(stmt, 0);
-    // dt_control_log("prefetching image %u", prefetchid);
-    dt_mipmap_cache_get(darktable.mipmap_cache, NULL, prefetchid, DT_MIPMAP_FULL, DT_MIPMAP_PREFETCH, 'r');
+    ids[count] = sqlite3_column_int(stmt, 0);
+    if(ids[count] == imgid) current = count;
+    count++;
   }
   sqlite3_finalize(stmt);
+
+  // don't push the image being edited out of the full cache, one buffer goes to it and one to the thumbnails.
+  // images which were never loaded are assumed to be as large as the selected one.
+  int slots = MAX(1, (int)dt_mipmap_cache_get_quota(darktable.mipmap_cache, DT_MIPMAP_FULL) - 2);
+  const size_t fallback = _filmstrip_preload_size(imgid);
+  size_t used = 0;
+
+  // closest first, and the next image before the previous one as that's the usual direction of culling
+  for(int d = 1; d <= neighbours && slots > 0; d++)
+  {
+    for(int dir = 1; dir >= -1 && slots > 0; dir -= 2)
+    {
+      const int k = current + dir * d;
+      if(k < 0 || k >= count) continue;
+      const int prefetchid = ids[k];
+
+      if(!dt_mipmap_cache_contains(darktable.mipmap_cache, prefetchid, DT_MIPMAP_FULL))
+      {
+        const size_t size = _filmstrip_preload_size(prefetchid);
+        used += size ? size : fallback;
+        if(used > budget) return;
+        dt_mipmap_cache_get(darktable.mipmap_cache, NULL, prefetchid, DT_MIPMAP_FULL, DT_MIPMAP_PREFETCH, 'r');
+      }
+      slots--;
+
+      // the input of the preview pipe, it is downscaled from the full buffer
+      if(preview)
+        dt_mipmap_cache_get(darktable.mipmap_cache, NULL, prefetchid, DT_MIPMAP_F, DT_MIPMAP_PREFETCH, 'r');
+    }
+  }
 }
 
 void dt_view_manager_view_toolbox_add(dt_view_manager_t *vm, GtkWidget *tool, dt_view_type_flags_t views)
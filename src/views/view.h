@@ -478,7 +478,12 @@ gboolean dt_view_lighttable_culling_is_image_visible(dt_view_manager_t *vm, gint
 
 /** set active image */
 void dt_view_filmstrip_set_active_image(dt_view_manager_t *vm, int iid);
-/** prefetch the next few images in film strip, from selected on.
+/** upper bound for the number of images preloaded on each side of the selected one */
+#define DT_VIEW_PRELOAD_MAX 4
+
+/** preload the images around the selected one in film strip into the full (and optionally the preview) mipmap
+    cache, so switching to them doesn't have to wait for the raw to be decoded. the number of images and the
+    memory they may take are configurable.
     TODO: move to control ?
 */
 void dt_view_filmstrip_prefetch();